@@ -14,8 +14,20 @@ addr RSP_DMA_BUSY        = 0x0404'0018;
 addr RSP_SEMAPHORE       = 0x0404'001C;
 addr RSP_PC              = 0x0408'0000;
 
+// RDP command registers
+addr DPC_START           = 0x0410'0000;
+addr DPC_END             = 0x0410'0004;
+addr DPC_CURRENT         = 0x0410'0008;
+addr DPC_STATUS          = 0x0410'000C;
+addr DPC_CLOCK           = 0x0410'0010;
+addr DPC_BUFBUSY         = 0x0410'0014;
+addr DPC_PIPEBUSY        = 0x0410'0018;
+addr DPC_TMEM            = 0x0410'001C;
+
 // MIPS Interface
 addr MI_MODE             = 0x0430'0000;
+addr MI_VERSION          = 0x0430'0004;
+addr MI_INTR             = 0x0430'0008;
 addr MI_MASK             = 0x0430'000C;
 
 // Video Interface
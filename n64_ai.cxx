@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#include "n64_ai.hxx"
+#include "n64_cpu.hxx"
+#include "../include/error_factory.hxx"
+
+namespace TKPEmu::N64::Devices {
+    WAVAudioSink::WAVAudioSink(const std::string& path) {
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_) {
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open audio output file: " + path);
+        }
+        write_header();
+    }
+
+    WAVAudioSink::~WAVAudioSink() {
+        std::fseek(file_, 0, SEEK_SET);
+        write_header();
+        std::fclose(file_);
+    }
+
+    void WAVAudioSink::Write(const int16_t* samples, size_t frames) {
+        std::fwrite(samples, 4, frames, file_);
+        data_size_ += frames * 4;
+    }
+
+    void WAVAudioSink::write_header() {
+        // Every field is little endian, like the host
+        struct {
+            char riff[4] = { 'R', 'I', 'F', 'F' };
+            uint32_t riff_size;
+            char wave[4] = { 'W', 'A', 'V', 'E' };
+            char fmt[4] = { 'f', 'm', 't', ' ' };
+            uint32_t fmt_size = 16;
+            uint16_t format = 1;
+            uint16_t channels = 2;
+            uint32_t sample_rate = AudioInterface::OUTPUT_RATE;
+            uint32_t byte_rate = AudioInterface::OUTPUT_RATE * 4;
+            uint16_t block_align = 4;
+            uint16_t bits_per_sample = 16;
+            char data[4] = { 'd', 'a', 't', 'a' };
+            uint32_t data_size;
+        } header;
+        static_assert(sizeof(header) == 44);
+        header.riff_size = 36 + data_size_;
+        header.data_size = data_size_;
+        std::fwrite(&header, sizeof(header), 1, file_);
+    }
+
+    PipeAudioSink::PipeAudioSink(const std::string& command) {
+        pipe_ = popen(command.c_str(), "w");
+        if (!pipe_) {
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not start audio output command: " + command);
+        }
+    }
+
+    PipeAudioSink::~PipeAudioSink() {
+        pclose(pipe_);
+    }
+
+    void PipeAudioSink::Write(const int16_t* samples, size_t frames) {
+        std::fwrite(samples, 4, frames, pipe_);
+    }
+
+    std::unique_ptr<AudioSink> MakeAudioSink(const std::string& spec) {
+        if (spec.empty())
+            return nullptr;
+        if (spec == "null")
+            return std::make_unique<NullAudioSink>();
+        if (spec[0] == '|')
+            return std::make_unique<PipeAudioSink>(spec.substr(1));
+        return std::make_unique<WAVAudioSink>(spec);
+    }
+
+    AudioInterface::~AudioInterface() {
+        stop_audio_thread();
+    }
+
+    void AudioInterface::Reset() {
+        dram_addr_ = length_ = control_ = status_ = dacrate_ = bitrate_ = 0;
+        fifo_count_ = 0;
+        dma_start_ = 0;
+        dropped_ = 0;
+        if (bus_)
+            bus_->scheduler_.Cancel(SchedulerEvent::AI);
+    }
+
+    void AudioInterface::SetSink(std::unique_ptr<AudioSink> sink) {
+        stop_audio_thread();
+        sink_ = std::move(sink);
+        if (sink_) {
+            position_ = 0;
+            last_frame_ = {};
+            audio_quit_ = false;
+            audio_thread_ = std::thread(&AudioInterface::audio_loop, this);
+        }
+    }
+
+    void AudioInterface::stop_audio_thread() {
+        if (!audio_thread_.joinable())
+            return;
+        // The thread drains the queue before it quits
+        audio_quit_.store(true, std::memory_order_release);
+        audio_wake_.fetch_add(1, std::memory_order_release);
+        audio_wake_.notify_one();
+        audio_thread_.join();
+    }
+
+    uint32_t AudioInterface::WriteRegister(int reg, uint32_t data) {
+        switch (reg & 7) {
+            case 0: {
+                data &= 0xFF'FFF8;
+                dram_addr_ = __builtin_bswap32(data);
+                return data;
+            }
+            case 1: {
+                push_dma(data & 0x3'FFF8);
+                update_length();
+                return __builtin_bswap32(length_);
+            }
+            case 2: {
+                control_ = __builtin_bswap32(data & 1);
+                update_status();
+                return data & 1;
+            }
+            case 3: {
+                // Any write acknowledges the interrupt, the register itself is read only
+                bus_->clear_interrupt(MIInterrupt::AI);
+                return __builtin_bswap32(status_);
+            }
+            case 4: {
+                dacrate_ = __builtin_bswap32(data & 0x3FFF);
+                return data & 0x3FFF;
+            }
+            case 5: {
+                bitrate_ = __builtin_bswap32(data & 0xF);
+                return data & 0xF;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t AudioInterface::sample_rate() const {
+        return VI_CLOCK / (__builtin_bswap32(dacrate_) + 1);
+    }
+
+    void AudioInterface::update_status() {
+        uint32_t status = 0;
+        if (fifo_count_ == 2)
+            status |= AI_STATUS_FULL;
+        if (fifo_count_ != 0)
+            status |= AI_STATUS_BUSY;
+        if (control_)
+            status |= AI_STATUS_ENABLED;
+        status_ = __builtin_bswap32(status);
+    }
+
+    void AudioInterface::update_length() {
+        uint32_t remaining = 0;
+        if (fifo_count_ != 0) {
+            const DMA& dma = fifo_[0];
+            uint64_t elapsed = bus_->scheduler_.Now() - dma_start_;
+            if (elapsed < dma.duration)
+                remaining = (dma.length * (dma.duration - elapsed) / dma.duration) & ~7u;
+        }
+        length_ = __builtin_bswap32(remaining);
+    }
+
+    void AudioInterface::push_dma(uint32_t length) {
+        if (length == 0 || fifo_count_ == 2)
+            return;
+        DMA& dma = fifo_[fifo_count_++];
+        dma.address = __builtin_bswap32(dram_addr_);
+        dma.length = length;
+        // Every frame is a 16-bit left and right sample pair
+        uint64_t frames = length / 4;
+        dma.duration = std::max<uint64_t>(frames * CPU_CLOCK * (__builtin_bswap32(dacrate_) + 1) / VI_CLOCK, 1);
+        if (fifo_count_ == 1)
+            start_dma();
+        update_status();
+    }
+
+    void AudioInterface::start_dma() {
+        const DMA& dma = fifo_[0];
+        dma_start_ = bus_->scheduler_.Now();
+        bus_->scheduler_.Schedule(SchedulerEvent::AI, dma.duration);
+        if (!sink_ || !control_)
+            return;
+        uint32_t address = std::min<uint32_t>(dma.address, bus_->rdram_.size());
+        uint32_t length = std::min<uint32_t>(dma.length, bus_->rdram_.size() - address);
+        bus_->rcp_.rdp_.SyncRange(address, length);
+        Chunk chunk;
+        chunk.rate = sample_rate();
+        chunk.samples.resize(length / 2);
+        std::memcpy(chunk.samples.data(), &bus_->rdram_[address], length);
+        if (!queue_.TryPush(std::move(chunk))) {
+            ++dropped_;
+            return;
+        }
+        audio_wake_.fetch_add(1, std::memory_order_release);
+        audio_wake_.notify_one();
+    }
+
+    void AudioInterface::FinishDMA() {
+        if (fifo_count_ == 2) {
+            fifo_[0] = fifo_[1];
+            fifo_count_ = 1;
+            start_dma();
+        } else {
+            fifo_count_ = 0;
+        }
+        update_status();
+        bus_->raise_interrupt(MIInterrupt::AI);
+    }
+
+    void AudioInterface::audio_loop() {
+        Chunk chunk;
+        while (true) {
+            uint64_t wake = audio_wake_.load(std::memory_order_acquire);
+            if (queue_.TryPop(chunk)) {
+                resample(chunk);
+                if (!output_.empty())
+                    sink_->Write(output_.data(), output_.size() / 2);
+                continue;
+            }
+            if (audio_quit_.load(std::memory_order_acquire))
+                return;
+            audio_wake_.wait(wake, std::memory_order_acquire);
+        }
+    }
+
+    void AudioInterface::resample(const Chunk& chunk) {
+        size_t count = chunk.samples.size() & ~size_t(1);
+        size_t frames = count / 2;
+        output_.clear();
+        if (frames == 0)
+            return;
+        // The last frame of the previous chunk goes first so outputs can interpolate across chunks
+        input_.resize(2 + count);
+        input_[0] = last_frame_[0];
+        input_[1] = last_frame_[1];
+        const int16_t* samples = chunk.samples.data();
+        float* input = input_.data() + 2;
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+            // Big endian to host, then sign extended to 32 bits by shifting down from the top half
+            data = _mm_or_si128(_mm_slli_epi16(data, 8), _mm_srli_epi16(data, 8));
+            __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(data, data), 16);
+            __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(data, data), 16);
+            _mm_storeu_ps(input + i, _mm_cvtepi32_ps(low));
+            _mm_storeu_ps(input + i + 4, _mm_cvtepi32_ps(high));
+        }
+        for (; i < count; i++) {
+            input[i] = static_cast<int16_t>(__builtin_bswap16(samples[i]));
+        }
+        // Frame f of the chunk is at index f + 1 of input_, outputs need the frame after theirs too
+        uint64_t step = (static_cast<uint64_t>(chunk.rate) << 32) / OUTPUT_RATE;
+        uint64_t end = static_cast<uint64_t>(frames) << 32;
+        uint64_t position = position_;
+        constexpr float FRACTION = 1.0f / 4294967296.0f;
+        size_t outputs = position < end ? (end - position + step - 1) / step : 0;
+        output_.resize(outputs * 2);
+        int16_t* output = output_.data();
+        size_t k = 0;
+        // Two output frames per register: [left0, right0, left1, right1]
+        for (; k + 2 <= outputs; k += 2) {
+            uint64_t next = position + step;
+            __m128 a = _mm_loadu_ps(input_.data() + 2 * (position >> 32));
+            __m128 b = _mm_loadu_ps(input_.data() + 2 * (next >> 32));
+            __m128 from = _mm_movelh_ps(a, b);
+            __m128 to = _mm_movehl_ps(b, a);
+            float t0 = static_cast<uint32_t>(position) * FRACTION;
+            float t1 = static_cast<uint32_t>(next) * FRACTION;
+            __m128 t = _mm_set_ps(t1, t1, t0, t0);
+            __m128 result = _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(to, from), t));
+            __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(result), _mm_setzero_si128());
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(output + 2 * k), packed);
+            position = next + step;
+        }
+        if (k < outputs) {
+            const float* frame = input_.data() + 2 * (position >> 32);
+            float t = static_cast<uint32_t>(position) * FRACTION;
+            for (int channel = 0; channel < 2; channel++) {
+                float value = frame[channel] + (frame[channel + 2] - frame[channel]) * t;
+                output[2 * k + channel] = std::clamp(std::nearbyint(value), -32768.0f, 32767.0f);
+            }
+            position += step;
+        }
+        position_ = position - end;
+        last_frame_ = { input_[2 * frames], input_[2 * frames + 1] };
+    }
+}
\ No newline at end of file
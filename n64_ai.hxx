@@ -0,0 +1,148 @@
+#pragma once
+#ifndef TKP_N64_AI_H
+#define TKP_N64_AI_H
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "n64_spsc.hxx"
+
+namespace TKPEmu::N64::Devices {
+    class CPUBus;
+    // AI_STATUS bits as read, FULL is mirrored in bit 0
+    constexpr uint32_t AI_STATUS_FULL    = (1u << 31) | 1;
+    constexpr uint32_t AI_STATUS_BUSY    = 1 << 30;
+    constexpr uint32_t AI_STATUS_ENABLED = 1 << 25;
+    /**
+        Where resampled audio goes, always 16-bit stereo at AudioInterface::OUTPUT_RATE
+
+        Only ever called from the audio thread.
+    */
+    class AudioSink {
+    public:
+        virtual ~AudioSink() = default;
+        // samples holds frames interleaved left/right pairs in host byte order
+        virtual void Write(const int16_t* samples, size_t frames) = 0;
+    };
+    class NullAudioSink final : public AudioSink {
+    public:
+        void Write(const int16_t*, size_t) override {}
+    };
+    // A RIFF WAV file, the header sizes are patched in when the sink is destroyed
+    class WAVAudioSink final : public AudioSink {
+    public:
+        WAVAudioSink(const std::string& path);
+        ~WAVAudioSink() override;
+        void Write(const int16_t* samples, size_t frames) override;
+    private:
+        void write_header();
+
+        std::FILE* file_ = nullptr;
+        uint32_t data_size_ = 0;
+    };
+    // Raw samples fed to the standard input of a command, for example an encoder or a player
+    class PipeAudioSink final : public AudioSink {
+    public:
+        PipeAudioSink(const std::string& command);
+        ~PipeAudioSink() override;
+        void Write(const int16_t* samples, size_t frames) override;
+    private:
+        std::FILE* pipe_ = nullptr;
+    };
+    /**
+        Creates the sink described by spec: "" for none, "null" to discard everything,
+        "|command" to pipe raw samples to command and anything else is the path of a WAV file
+    */
+    std::unique_ptr<AudioSink> MakeAudioSink(const std::string& spec);
+
+    /**
+        Audio Interface
+
+        AI_LEN writes queue a DMA into a two entry FIFO: the first one starts playing right
+        away and sets BUSY, the second waits for it and sets FULL. Each DMA lasts as long as
+        its samples take to play at the rate set in AI_DACRATE, its end is a scheduler event
+        that raises the AI interrupt and starts the queued DMA, if any.
+
+        When a sink is attached the samples of each DMA are copied out of RDRAM as it starts
+        and pushed to an audio thread through a lock-free queue. The audio thread resamples
+        them to OUTPUT_RATE and hands them to the sink, so a slow sink never stalls emulation:
+        if the queue is full the chunk is dropped and counted instead.
+    */
+    class AudioInterface {
+    public:
+        constexpr static uint32_t OUTPUT_RATE = 48'000;
+        // The AI is clocked from the video DAC clock, the NTSC one is assumed
+        constexpr static uint64_t VI_CLOCK = 48'681'812;
+        constexpr static uint64_t CPU_CLOCK = 93'750'000;
+        AudioInterface() = default;
+        ~AudioInterface();
+        AudioInterface(const AudioInterface&) = delete;
+        AudioInterface& operator=(const AudioInterface&) = delete;
+        void Reset();
+        void SetBus(CPUBus* bus) { bus_ = bus; }
+        // Replaces the sink, nullptr disables streaming. Chunks in flight go to the old sink first
+        void SetSink(std::unique_ptr<AudioSink> sink);
+        // Applies a write to AI register reg (0 is AI_DRAM_ADDR), returns the value it reads back as
+        uint32_t WriteRegister(int reg, uint32_t data);
+        // Called when the DMA at the front of the FIFO has finished playing
+        void FinishDMA();
+        // Chunks the audio thread couldn't keep up with
+        uint64_t DroppedChunks() const { return dropped_; }
+    private:
+        struct DMA {
+            uint32_t address = 0;
+            uint32_t length = 0;
+            // In CPU cycles
+            uint64_t duration = 0;
+        };
+        // Samples of one DMA, still in guest byte order
+        struct Chunk {
+            std::vector<int16_t> samples;
+            uint32_t rate = 0;
+        };
+        void push_dma(uint32_t length);
+        void start_dma();
+        // Refreshes length_ to what's left of the playing DMA, AI_LEN reads count down
+        void update_length();
+        void update_status();
+        uint32_t sample_rate() const;
+        void audio_loop();
+        void stop_audio_thread();
+        // Resamples a chunk to OUTPUT_RATE into output_, keeping the position across chunks
+        void resample(const Chunk& chunk);
+
+        CPUBus* bus_ = nullptr;
+        // Memory mapped registers, kept in guest byte order like the rest of the bus
+        uint32_t dram_addr_ = 0;
+        uint32_t length_ = 0;
+        uint32_t control_ = 0;
+        uint32_t status_ = 0;
+        uint32_t dacrate_ = 0;
+        uint32_t bitrate_ = 0;
+        std::array<DMA, 2> fifo_ {};
+        int fifo_count_ = 0;
+        // When the DMA at the front of the FIFO started
+        uint64_t dma_start_ = 0;
+        uint64_t dropped_ = 0;
+
+        std::unique_ptr<AudioSink> sink_;
+        SPSCQueue<Chunk, 64> queue_;
+        std::thread audio_thread_;
+        // Bumped to wake the audio thread up after a push or to make it quit
+        std::atomic<uint64_t> audio_wake_ = 0;
+        std::atomic<bool> audio_quit_ = false;
+        // Resampler state, only touched by the audio thread. The position is 32.32 fixed
+        // point, in input frames past the last frame of the previous chunk.
+        uint64_t position_ = 0;
+        std::array<float, 2> last_frame_ {};
+        std::vector<float> input_;
+        std::vector<int16_t> output_;
+        friend class CPUBus;
+        friend class CPU;
+    };
+}
+#endif
\ No newline at end of file
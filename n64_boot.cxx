@@ -0,0 +1,27 @@
+#include <array>
+#include "n64_boot.hxx"
+#include "n64_hash.hxx"
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        constexpr std::array<CICInfo, 6> CICTable = {{
+            { CICType::CIC6101, 0x6170'A4A1, 0x3F, 0 },
+            { CICType::CIC7102, 0x009E'9EA3, 0x3F, 0 },
+            { CICType::CIC6102, 0x90BB'6CB5, 0x3F, 0 },
+            { CICType::CIC6103, 0x0B05'0EE0, 0x78, 0x100000 },
+            { CICType::CIC6105, 0x98BC'2C86, 0x91, 0 },
+            { CICType::CIC6106, 0xACC8'580A, 0x85, 0x200000 },
+        }};
+    }
+
+    const CICInfo& DetectCIC(std::span<const uint8_t> rom) {
+        if (rom.size() >= 0x1000) {
+            uint32_t crc = Hash::CRC32(rom.data() + 0x40, 0x1000 - 0x40);
+            for (const auto& cic : CICTable) {
+                if (cic.ipl3_crc == crc)
+                    return cic;
+            }
+        }
+        return CICTable[2];
+    }
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef TKP_N64_BOOT_H
+#define TKP_N64_BOOT_H
+#include <cstdint>
+#include <span>
+
+namespace TKPEmu::N64::Devices {
+    enum class CICType {
+        CIC6101,
+        CIC7102,
+        CIC6102,
+        CIC6103,
+        CIC6105,
+        CIC6106,
+    };
+    /**
+        What the IPL needs to know about the lockout chip a cartridge was made for
+
+        The CIC is recognized from the IPL3 boot code in the ROM header page, each CIC
+        only boots the IPL3 it was paired with.
+
+        @see https://n64brew.dev/wiki/CIC-NUS
+    */
+    struct CICInfo {
+        CICType type;
+        // CRC32 of ROM 0x40-0xFFF
+        uint32_t ipl3_crc;
+        // Seed the PIF passes to IPL3 in s6
+        uint8_t seed;
+        // IPL3 loads the game this much below the entry point in the header
+        uint32_t entry_offset;
+    };
+    // Unrecognized boot code (homebrew, patched ROMs) is treated as 6102, the most common one
+    const CICInfo& DetectCIC(std::span<const uint8_t> rom);
+}
+#endif
\ No newline at end of file
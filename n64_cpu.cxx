@@ -4,6 +4,8 @@
 #include <iostream>
 #include <bitset>
 #include <limits>
+#include <algorithm>
+#include <immintrin.h>
 #include "../include/error_factory.hxx"
 #include "n64_addresses.hxx"
 #define SKIPDEBUGSTUFF 1
@@ -21,17 +23,100 @@ namespace TKPEmu::N64::Devices {
         cpubus_(cpubus),
         rcp_(rcp)
     {
+        cpubus_.cpu_ = this;
     }
 
     void CPU::Reset() {
         pc_ = 0xBFC0'0000;
+        direct_ = interpreter_ == InterpreterMode::Direct;
         ldi_ = false;
+        delay_slot_ = false;
+        extra_cycles_ = 0;
+        load_dest_ = NO_LOAD;
+        exception_raised_ = false;
+        random_start_ = 0;
+        idle_branch_ = 0;
+        busy_loops_.fill(0);
+        idle_skipped_cycles_ = 0;
+        memory_loop_ = {};
+        plain_loops_.fill(0);
+        memory_loop_bytes_ = 0;
         clear_registers();
+        cp0_regs_[CP0_STATUS].UD = STATUS_BEV | STATUS_ERL;
         cpubus_.Reset();
+        decoded_pages_.clear();
+        decoded_pages_.resize(cpubus_.rdram_.size() >> 12);
         if (cpubus_.IsEverythingLoaded()) {
-            // memcpy(cpubus_.redirect_paddress(0x1000), cpubus_.redirect_paddress(0x10001000), 0x100000);
-            fill_pipeline();
+            if (cpubus_.hle_boot_) {
+                hle_boot();
+            }
+            if (direct_) {
+                next_pc_ = pc_ + 4;
+            } else {
+                fill_pipeline();
+            }
+        }
+        update_interrupt_pending();
+    }
+
+    void CPU::hle_boot() {
+        auto rom = cpubus_.cart_rom_;
+        auto read_rom = [&rom](size_t offset) {
+            return __builtin_bswap32(*reinterpret_cast<uint32_t*>(&rom[offset]));
+        };
+        auto write_rdram = [this](uint32_t paddr, uint32_t data) {
+            *reinterpret_cast<uint32_t*>(&cpubus_.rdram_[paddr]) = __builtin_bswap32(data);
+        };
+        const auto& cic = DetectCIC(rom);
+        // IPL3 runs from DMEM, games sometimes read the header back from there
+        std::memcpy(cpubus_.rsp_dmem_.data(), rom.data(), cpubus_.rsp_dmem_.size());
+        uint32_t entry = read_rom(0x08) - cic.entry_offset;
+        uint32_t dest = entry & 0x1FFF'FFFF;
+        if (dest < cpubus_.rdram_.size()) {
+            size_t size = std::min<size_t>(0x100000, cpubus_.rdram_.size() - dest);
+            std::memcpy(&cpubus_.rdram_[dest], &rom[0x1000], size);
         }
+        // Domain 1 timings come from the first word of the header
+        uint32_t pi_config = read_rom(0x00);
+        cpubus_.pi_bsd_dom1_lat_ = __builtin_bswap32(pi_config & 0xFF);
+        cpubus_.pi_bsd_dom1_pwd_ = __builtin_bswap32((pi_config >> 8) & 0xFF);
+        cpubus_.pi_bsd_dom1_pgs_ = __builtin_bswap32((pi_config >> 16) & 0x0F);
+        cpubus_.pi_bsd_dom1_rls_ = __builtin_bswap32((pi_config >> 20) & 0x03);
+        // 0 PAL, 1 NTSC, 2 MPAL, from the country code
+        uint32_t tv_type = 1;
+        switch (rom[0x3E]) {
+            case 'D': case 'F': case 'I': case 'P': case 'S': case 'U': case 'X': case 'Y':
+                tv_type = 0;
+                break;
+            case 'B':
+                tv_type = 2;
+                break;
+        }
+        gpr_regs_[11].UD = 0xFFFF'FFFF'A400'0040; // t3
+        gpr_regs_[19].UD = 0;                     // s3, rom type (cartridge)
+        gpr_regs_[20].UD = tv_type;               // s4
+        gpr_regs_[21].UD = 0;                     // s5, reset type (cold)
+        gpr_regs_[22].UD = cic.seed;              // s6
+        gpr_regs_[23].UD = 0;                     // s7, version
+        gpr_regs_[29].UD = 0xFFFF'FFFF'A400'1FF0; // sp
+        gpr_regs_[31].UD = 0xFFFF'FFFF'A400'1550; // ra
+        // Globals libultra expects IPL3 to have filled in
+        write_rdram(0x300, tv_type);
+        write_rdram(0x304, 0);
+        write_rdram(0x308, 0xB000'0000);
+        write_rdram(0x30C, 0);
+        write_rdram(0x310, cic.seed);
+        write_rdram(0x314, 0);
+        write_rdram(0x318, cpubus_.rdram_.size());
+        if (cic.type == CICType::CIC6105) {
+            // 6105 games look for the memory size here instead
+            write_rdram(0x3F0, cpubus_.rdram_.size());
+        }
+        cp0_regs_[CP0_RANDOM].UD = 0x1F;
+        cp0_regs_[CP0_STATUS].UD = 0x3400'0000;
+        cp0_regs_[CP0_PRID].UD = 0x0B00;
+        cp0_regs_[CP0_CONFIG].UD = 0x7006'E463;
+        pc_ = entry;
     }
 
     TKP_INSTR_FUNC CPU::ERROR() {
@@ -86,11 +171,11 @@ namespace TKPEmu::N64::Devices {
 	}
     
     TKP_INSTR_FUNC CPU::s_SYSCALL() {
-		throw ErrorFactory::generate_exception(__func__, __LINE__, "s_SYSCALL opcode reached");
+		raise_exception(ExceptionCode::Syscall);
 	}
     
     TKP_INSTR_FUNC CPU::s_BREAK() {
-		throw ErrorFactory::generate_exception(__func__, __LINE__, "s_BREAK opcode reached");
+		raise_exception(ExceptionCode::Breakpoint);
 	}
 
     TKP_INSTR_FUNC CPU::s_SYNC() {
@@ -182,18 +267,19 @@ namespace TKPEmu::N64::Devices {
     TKP_INSTR_FUNC CPU::s_SUB() {
 		int32_t result = 0;
 		bool overflow = __builtin_sub_overflow(rfex_latch_.fetched_rs.W._0, rfex_latch_.fetched_rt.W._0, &result);
-		exdc_latch_.dest = &gpr_regs_[rfex_latch_.instruction.RType.rd].UB._0;
-        exdc_latch_.data = static_cast<int64_t>(result);
-        exdc_latch_.access_type = AccessType::UDOUBLEWORD;
-		bypass_register();
         #if SKIPEXCEPTIONS == 0
-        if (overflow) {
+        if (overflow) [[unlikely]] {
             // An integer overflow exception occurs if carries out of bits 30 and 31 differ (2’s
             // complement overflow). The contents of destination register rt is not modified
             // when an integer overflow exception occurs.
-            throw IntegerOverflowException();
+            raise_exception(ExceptionCode::IntegerOverflow);
+            return;
         }
         #endif
+		exdc_latch_.dest = &gpr_regs_[rfex_latch_.instruction.RType.rd].UB._0;
+        exdc_latch_.data = static_cast<int64_t>(result);
+        exdc_latch_.access_type = AccessType::UDOUBLEWORD;
+		bypass_register();
 	}
     
     TKP_INSTR_FUNC CPU::s_SUBU() {
@@ -241,23 +327,28 @@ namespace TKPEmu::N64::Devices {
 	}
     
     TKP_INSTR_FUNC CPU::s_TGEU() {
-		throw ErrorFactory::generate_exception(__func__, __LINE__, "s_TGEU opcode reached");
+        if (rfex_latch_.fetched_rs.UD >= rfex_latch_.fetched_rt.UD)
+            raise_exception(ExceptionCode::Trap);
 	}
     
     TKP_INSTR_FUNC CPU::s_TLT() {
-		throw ErrorFactory::generate_exception(__func__, __LINE__, "s_TLT opcode reached");
+        if (rfex_latch_.fetched_rs.D < rfex_latch_.fetched_rt.D)
+            raise_exception(ExceptionCode::Trap);
 	}
     
     TKP_INSTR_FUNC CPU::s_TLTU() {
-		throw ErrorFactory::generate_exception(__func__, __LINE__, "s_TLTU opcode reached");
+        if (rfex_latch_.fetched_rs.UD < rfex_latch_.fetched_rt.UD)
+            raise_exception(ExceptionCode::Trap);
 	}
     
     TKP_INSTR_FUNC CPU::s_TEQ() {
-		throw ErrorFactory::generate_exception(__func__, __LINE__, "s_TEQ opcode reached");
+        if (rfex_latch_.fetched_rs.UD == rfex_latch_.fetched_rt.UD)
+            raise_exception(ExceptionCode::Trap);
 	}
     
     TKP_INSTR_FUNC CPU::s_TNE() {
-		throw ErrorFactory::generate_exception(__func__, __LINE__, "s_TNE opcode reached");
+        if (rfex_latch_.fetched_rs.UD != rfex_latch_.fetched_rt.UD)
+            raise_exception(ExceptionCode::Trap);
 	}
     
     /**
@@ -293,13 +384,9 @@ namespace TKPEmu::N64::Devices {
 	}
     
     TKP_INSTR_FUNC CPU::BLEZ() {
-		int16_t offset = rfex_latch_.instruction.IType.immediate << 2;
-        int32_t seoffset = offset;
+	        int32_t seoffset = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate) * 4;
         if (rfex_latch_.fetched_rs.D <= 0) {
-            exdc_latch_.data = pc_ - 4 + seoffset;
-            exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-            exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		    bypass_register();
+            take_branch(pc_ - 4 + seoffset);
         }
 	}
     
@@ -324,6 +411,8 @@ namespace TKPEmu::N64::Devices {
 	}
     
     TKP_INSTR_FUNC CPU::COP1() {
+        if (cop1_unusable())
+            return;
         (FloatTable[rfex_latch_.instruction.RType.func])(this);
 	}
     
@@ -414,6 +503,8 @@ namespace TKPEmu::N64::Devices {
 	}
     
     TKP_INSTR_FUNC CPU::LWC1() {
+        if (cop1_unusable())
+            return;
 		throw ErrorFactory::generate_exception(__func__, __LINE__, "LWC1 opcode reached");
 	}
     
@@ -426,6 +517,8 @@ namespace TKPEmu::N64::Devices {
 	}
     
     TKP_INSTR_FUNC CPU::LDC1() {
+        if (cop1_unusable())
+            return;
 		throw ErrorFactory::generate_exception(__func__, __LINE__, "LDC1 opcode reached");
 	}
     
@@ -438,6 +531,8 @@ namespace TKPEmu::N64::Devices {
 	}
     
     TKP_INSTR_FUNC CPU::SWC1() {
+        if (cop1_unusable())
+            return;
 		throw ErrorFactory::generate_exception(__func__, __LINE__, "SWC1 opcode reached");
 	}
     
@@ -450,6 +545,8 @@ namespace TKPEmu::N64::Devices {
 	}
     
     TKP_INSTR_FUNC CPU::SDC1() {
+        if (cop1_unusable())
+            return;
 		throw ErrorFactory::generate_exception(__func__, __LINE__, "SDC1 opcode reached");
 	}
     
@@ -527,18 +624,19 @@ namespace TKPEmu::N64::Devices {
         int32_t seimm = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate);
         int32_t result = 0;
         bool overflow = __builtin_add_overflow(rfex_latch_.fetched_rs.W._0, seimm, &result);
-        exdc_latch_.dest = &gpr_regs_[rfex_latch_.instruction.IType.rt].UB._0;
-        exdc_latch_.data = result;
-        exdc_latch_.access_type = AccessType::UDOUBLEWORD;
-		bypass_register();
         #if SKIPEXCEPTIONS == 0
-        if (overflow) {
+        if (overflow) [[unlikely]] {
             // An integer overflow exception occurs if carries out of bits 30 and 31 differ (2’s
             // complement overflow). The contents of destination register rt is not modified
             // when an integer overflow exception occurs.
-            throw IntegerOverflowException();
+            raise_exception(ExceptionCode::IntegerOverflow);
+            return;
         }
         #endif
+        exdc_latch_.dest = &gpr_regs_[rfex_latch_.instruction.IType.rt].UB._0;
+        exdc_latch_.data = result;
+        exdc_latch_.access_type = AccessType::UDOUBLEWORD;
+		bypass_register();
     }
     /**
      * DADDI
@@ -550,18 +648,19 @@ namespace TKPEmu::N64::Devices {
         int64_t seimm = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate);
         int64_t result = 0;
         bool overflow = __builtin_add_overflow(rfex_latch_.fetched_rs.D, seimm, &result);
-        exdc_latch_.dest = &gpr_regs_[rfex_latch_.instruction.IType.rt].UB._0;
-        exdc_latch_.data = result;
-        exdc_latch_.access_type = AccessType::UDOUBLEWORD;
-		bypass_register();
         #if SKIPEXCEPTIONS == 0
-        if (overflow) {
+        if (overflow) [[unlikely]] {
             // An integer overflow exception occurs if carries out of bits 30 and 31 differ (2’s
             // complement overflow). The contents of destination register rt is not modified
             // when an integer overflow exception occurs.
-            throw IntegerOverflowException();
+            raise_exception(ExceptionCode::IntegerOverflow);
+            return;
         }
         #endif
+        exdc_latch_.dest = &gpr_regs_[rfex_latch_.instruction.IType.rt].UB._0;
+        exdc_latch_.data = result;
+        exdc_latch_.access_type = AccessType::UDOUBLEWORD;
+		bypass_register();
     }
     /**
      * J, JAL
@@ -576,10 +675,7 @@ namespace TKPEmu::N64::Devices {
     TKP_INSTR_FUNC CPU::J() {
         auto jump_addr = rfex_latch_.instruction.JType.target;
         // combine first 3 bits of pc and jump_addr shifted left by 2
-        exdc_latch_.data = (pc_ & 0xF000'0000) | (jump_addr << 2);
-        exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-        exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		bypass_register();
+        take_branch((pc_ & 0xF000'0000) | (jump_addr << 2));
     }
     /**
      * LUI
@@ -643,17 +739,19 @@ namespace TKPEmu::N64::Devices {
         exdc_latch_.write_type = WriteType::MMU;
         exdc_latch_.access_type = AccessType::UDOUBLEWORD;
         #if SKIPEXCEPTIONS == 0
-        if ((exdc_latch_.vaddr & 0b111) != 0) { 
+        if ((write_vaddr & 0b111) != 0) {
             // From manual:
             // If either of the loworder two bits of the address are not zero, an address error exception occurs.
-            throw InstructionAddressErrorException();
+            cp0_regs_[CP0_BADVADDR].UD = static_cast<int64_t>(static_cast<int32_t>(write_vaddr));
+            raise_exception(ExceptionCode::AddressErrorStore);
+            return;
         }
         if (!mode64_ && opmode_ != OperatingMode::Kernel) {
             // From manual:
             // This operation is defined for the VR4300 operating in 64-bit mode and in 32-bit
             // Kernel mode. Execution of this instruction in 32-bit User or Supervisor mode
             // causes a reserved instruction exception.
-            throw ReservedInstructionException();
+            raise_exception(ExceptionCode::ReservedInstruction);
         }
         #endif
     }
@@ -677,10 +775,12 @@ namespace TKPEmu::N64::Devices {
         exdc_latch_.write_type = WriteType::MMU;
         exdc_latch_.access_type = AccessType::UWORD;
         #if SKIPEXCEPTIONS == 0
-        if ((exdc_latch_.dest & 0b11) != 0) {
+        if ((write_vaddr & 0b11) != 0) {
             // From manual:
             // If either of the loworder two bits of the address are not zero, an address error exception occurs.
-            throw InstructionAddressErrorException();
+            cp0_regs_[CP0_BADVADDR].UD = static_cast<int64_t>(static_cast<int32_t>(write_vaddr));
+            raise_exception(ExceptionCode::AddressErrorStore);
+            return;
         }
         #endif
     }
@@ -704,10 +804,12 @@ namespace TKPEmu::N64::Devices {
         exdc_latch_.write_type = WriteType::MMU;
         exdc_latch_.access_type = AccessType::UHALFWORD;
         #if SKIPEXCEPTIONS == 0
-        if ((exdc_latch_.dest & 0b11) != 0) {
+        if ((write_vaddr & 0b1) != 0) {
             // From manual:
-            // If either of the loworder two bits of the address are not zero, an address error exception occurs.
-            throw InstructionAddressErrorException();
+            // If the least-significant bit of the address is not zero, an address error exception occurs.
+            cp0_regs_[CP0_BADVADDR].UD = static_cast<int64_t>(static_cast<int32_t>(write_vaddr));
+            raise_exception(ExceptionCode::AddressErrorStore);
+            return;
         }
         #endif
     }
@@ -749,17 +851,19 @@ namespace TKPEmu::N64::Devices {
         exdc_latch_.access_type = AccessType::UDOUBLEWORD;
         detect_ldi();
         #if SKIPEXCEPTIONS == 0
-        if ((exdc_latch_.vaddr & 0b111) != 0) { 
+        if ((exdc_latch_.vaddr & 0b111) != 0) {
             // From manual:
             // If either of the loworder two bits of the address are not zero, an address error exception occurs.
-            throw InstructionAddressErrorException();
+            cp0_regs_[CP0_BADVADDR].UD = static_cast<int64_t>(static_cast<int32_t>(exdc_latch_.vaddr));
+            raise_exception(ExceptionCode::AddressErrorLoad);
+            return;
         }
         if (!mode64_ && opmode_ != OperatingMode::Kernel) {
             // From manual:
             // This operation is defined for the VR4300 operating in 64-bit mode and in 32-bit
             // Kernel mode. Execution of this instruction in 32-bit User or Supervisor mode
             // causes a reserved instruction exception.
-            throw ReservedInstructionException();
+            raise_exception(ExceptionCode::ReservedInstruction);
         }
         #endif
     }
@@ -787,7 +891,9 @@ namespace TKPEmu::N64::Devices {
         if ((exdc_latch_.vaddr & 0b1) != 0) {
             // From manual:
             // If the least-significant bit of the address is not zero, an address error exception occurs.
-            throw InstructionAddressErrorException();
+            cp0_regs_[CP0_BADVADDR].UD = static_cast<int64_t>(static_cast<int32_t>(exdc_latch_.vaddr));
+            raise_exception(ExceptionCode::AddressErrorLoad);
+            return;
         }
         #endif
     }
@@ -815,7 +921,9 @@ namespace TKPEmu::N64::Devices {
         if ((exdc_latch_.vaddr & 0b11) != 0) {
             // From manual:
             // If either of the loworder two bits of the address are not zero, an address error exception occurs.
-            throw InstructionAddressErrorException();
+            cp0_regs_[CP0_BADVADDR].UD = static_cast<int64_t>(static_cast<int32_t>(exdc_latch_.vaddr));
+            raise_exception(ExceptionCode::AddressErrorLoad);
+            return;
         }
         #endif
     }
@@ -836,14 +944,10 @@ namespace TKPEmu::N64::Devices {
      * doesn't throw
      */
     TKP_INSTR_FUNC CPU::BEQ() {
-        int16_t offset = rfex_latch_.instruction.IType.immediate << 2;
-        int32_t seoffset = offset;
+        int32_t seoffset = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate) * 4;
         // std::cout << "compare " << std::hex << rfex_latch_.fetched_rs.UD << " == " << rfex_latch_.fetched_rt.UD << std::endl;
         if (rfex_latch_.fetched_rs.UD == rfex_latch_.fetched_rt.UD) {
-            exdc_latch_.data = pc_ - 4 + seoffset;
-            exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-            exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		    bypass_register();
+            take_branch(pc_ - 4 + seoffset);
         }
     }
     /**
@@ -852,16 +956,11 @@ namespace TKPEmu::N64::Devices {
      * doesn't throw
      */
     TKP_INSTR_FUNC CPU::BEQL() {
-        int16_t offset = rfex_latch_.instruction.IType.immediate << 2;
-        int32_t seoffset = offset;
+        int32_t seoffset = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate) * 4;
         if (rfex_latch_.fetched_rs.UD == rfex_latch_.fetched_rt.UD) {
-            exdc_latch_.data = pc_ - 4 + seoffset;
-            exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-            exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		    bypass_register();
+            take_branch(pc_ - 4 + seoffset);
         } else {
-            // Discard delay slot instruction
-            icrf_latch_.instruction.Full = 0;
+            nullify_delay_slot();
         }
     }
     /**
@@ -870,17 +969,13 @@ namespace TKPEmu::N64::Devices {
      * doesn't throw
      */
     TKP_INSTR_FUNC CPU::BNE() {
-        int16_t offset = rfex_latch_.instruction.IType.immediate << 2;
-        int32_t seoffset = offset;
+        int32_t seoffset = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate) * 4;
         if (pc_ == 0xFFFFFFFF800001B4 || pc_ == 0xFFFFFFFF800001C0) [[unlikely]] { // CRC check skip
             std::cout << std::hex << rfex_latch_.fetched_rs.UD <<" vs " << rfex_latch_.fetched_rt.UD << std::endl;
             return;
         }
         if (rfex_latch_.fetched_rs.UD != rfex_latch_.fetched_rt.UD) {
-            exdc_latch_.data = pc_ - 4 + seoffset;
-            exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-            exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		    bypass_register();
+            take_branch(pc_ - 4 + seoffset);
         }
     }
     /**
@@ -889,16 +984,11 @@ namespace TKPEmu::N64::Devices {
      * doesn't throw
      */
     TKP_INSTR_FUNC CPU::BNEL() {
-        int16_t offset = rfex_latch_.instruction.IType.immediate << 2;
-        int32_t seoffset = offset;
+        int32_t seoffset = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate) * 4;
         if (rfex_latch_.fetched_rs.UD != rfex_latch_.fetched_rt.UD) {
-            exdc_latch_.data = pc_ - 4 + seoffset;
-            exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-            exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		    bypass_register();
+            take_branch(pc_ - 4 + seoffset);
         } else {
-            // Discard delay slot instruction
-            icrf_latch_.instruction.Full = 0;
+            nullify_delay_slot();
         }
     }
     /**
@@ -907,16 +997,11 @@ namespace TKPEmu::N64::Devices {
      * doesn't throw
      */
     TKP_INSTR_FUNC CPU::BLEZL() {
-        int16_t offset = rfex_latch_.instruction.IType.immediate << 2;
-        int32_t seoffset = offset;
+        int32_t seoffset = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate) * 4;
         if (rfex_latch_.fetched_rs.D <= 0) {
-            exdc_latch_.data = pc_ - 4 + seoffset;
-            exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-            exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		    bypass_register();
+            take_branch(pc_ - 4 + seoffset);
         } else {
-            // Discard delay slot instruction
-            icrf_latch_.instruction.Full = 0;
+            nullify_delay_slot();
         }
     }
     /**
@@ -925,23 +1010,19 @@ namespace TKPEmu::N64::Devices {
      * doesn't throw
      */
     TKP_INSTR_FUNC CPU::BGTZ() {
-        int16_t offset = rfex_latch_.instruction.IType.immediate << 2;
-        int32_t seoffset = offset;
+        int32_t seoffset = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate) * 4;
         if (rfex_latch_.fetched_rs.D > 0) {
-            exdc_latch_.data = pc_ - 4 + seoffset;
-            exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-            exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		    bypass_register();
+            take_branch(pc_ - 4 + seoffset);
         }
     }
     /**
      * TGE
      * 
-     * throws TrapException
+     * raises Trap exception
      */
     TKP_INSTR_FUNC CPU::s_TGE() {
-        if (rfex_latch_.fetched_rs.UD >= rfex_latch_.fetched_rt.UD)
-            throw ErrorFactory::generate_exception(__func__, __LINE__, "TrapException was thrown");
+        if (rfex_latch_.fetched_rs.D >= rfex_latch_.fetched_rt.D)
+            raise_exception(ExceptionCode::Trap);
     }
     /**
      * s_ADD, s_ADDU
@@ -951,18 +1032,19 @@ namespace TKPEmu::N64::Devices {
     TKP_INSTR_FUNC CPU::s_ADD() {
         int32_t result = 0;
         bool overflow = __builtin_add_overflow(rfex_latch_.fetched_rt.W._0, rfex_latch_.fetched_rs.W._0, &result);
-        exdc_latch_.dest = &gpr_regs_[rfex_latch_.instruction.RType.rd].UB._0;
-        exdc_latch_.data = static_cast<int64_t>(result);
-        exdc_latch_.access_type = AccessType::UDOUBLEWORD;
-		bypass_register();
         #if SKIPEXCEPTIONS == 0
-        if (overflow) {
+        if (overflow) [[unlikely]] {
             // An integer overflow exception occurs if carries out of bits 30 and 31 differ (2’s
             // complement overflow). The contents of destination register rd is not modified
             // when an integer overflow exception occurs.
-            throw IntegerOverflowException();
+            raise_exception(ExceptionCode::IntegerOverflow);
+            return;
         }
         #endif
+        exdc_latch_.dest = &gpr_regs_[rfex_latch_.instruction.RType.rd].UB._0;
+        exdc_latch_.data = static_cast<int64_t>(result);
+        exdc_latch_.access_type = AccessType::UDOUBLEWORD;
+		bypass_register();
     }
     TKP_INSTR_FUNC CPU::s_ADDU() {
         int32_t result = 0;
@@ -994,10 +1076,6 @@ namespace TKPEmu::N64::Devices {
     }
     TKP_INSTR_FUNC CPU::s_JR() {
         auto jump_addr = rfex_latch_.fetched_rs.UD;
-        exdc_latch_.data = jump_addr;
-        exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-        exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		bypass_register();
         #if SKIPEXCEPTIONS == 0
         if ((jump_addr & 0b11) != 0) {
             // From manual:
@@ -1006,9 +1084,12 @@ namespace TKPEmu::N64::Devices {
             // are zero. If these low-order two bits are not zero, an address exception will occur
             // when the jump target instruction is fetched.
             // TODO: when the jump target instruction is *fetched*. Does it matter that the exc is thrown here?
-            throw InstructionAddressErrorException();
+            cp0_regs_[CP0_BADVADDR].UD = static_cast<int64_t>(static_cast<int32_t>(jump_addr));
+            raise_exception(ExceptionCode::AddressErrorLoad);
+            return;
         }
         #endif
+        take_branch(jump_addr);
     }
     /**
      * s_DSLL32
@@ -1107,13 +1188,9 @@ namespace TKPEmu::N64::Devices {
     }
     
     TKP_INSTR_FUNC CPU::r_BGEZ() {
-        int16_t offset = rfex_latch_.instruction.IType.immediate << 2;
-        int32_t seoffset = offset;
+        int32_t seoffset = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate) * 4;
         if (rfex_latch_.fetched_rs.W._0 >= 0) {
-            exdc_latch_.data = pc_ - 4 + seoffset;
-            exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-            exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		    bypass_register();
+            take_branch(pc_ - 4 + seoffset);
         }
     }
     
@@ -1126,27 +1203,39 @@ namespace TKPEmu::N64::Devices {
     }
     
     TKP_INSTR_FUNC CPU::r_TGEI() {
-        throw ErrorFactory::generate_exception(__func__, __LINE__, "r_TGEI opcode reached");
+        int64_t seimm = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate);
+        if (rfex_latch_.fetched_rs.D >= seimm)
+            raise_exception(ExceptionCode::Trap);
     }
     
     TKP_INSTR_FUNC CPU::r_TGEIU() {
-        throw ErrorFactory::generate_exception(__func__, __LINE__, "r_TGEIU opcode reached");
+        int64_t seimm = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate);
+        if (rfex_latch_.fetched_rs.UD >= static_cast<uint64_t>(seimm))
+            raise_exception(ExceptionCode::Trap);
     }
     
     TKP_INSTR_FUNC CPU::r_TLTI() {
-        throw ErrorFactory::generate_exception(__func__, __LINE__, "r_TLTI opcode reached");
+        int64_t seimm = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate);
+        if (rfex_latch_.fetched_rs.D < seimm)
+            raise_exception(ExceptionCode::Trap);
     }
     
     TKP_INSTR_FUNC CPU::r_TLTIU() {
-        throw ErrorFactory::generate_exception(__func__, __LINE__, "r_TLTIU opcode reached");
+        int64_t seimm = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate);
+        if (rfex_latch_.fetched_rs.UD < static_cast<uint64_t>(seimm))
+            raise_exception(ExceptionCode::Trap);
     }
     
     TKP_INSTR_FUNC CPU::r_TEQI() {
-        throw ErrorFactory::generate_exception(__func__, __LINE__, "r_TEQI opcode reached");
+        int64_t seimm = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate);
+        if (rfex_latch_.fetched_rs.D == seimm)
+            raise_exception(ExceptionCode::Trap);
     }
     
     TKP_INSTR_FUNC CPU::r_TNEI() {
-        throw ErrorFactory::generate_exception(__func__, __LINE__, "r_TNEI opcode reached");
+        int64_t seimm = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate);
+        if (rfex_latch_.fetched_rs.D != seimm)
+            raise_exception(ExceptionCode::Trap);
     }
     
     TKP_INSTR_FUNC CPU::r_BLTZAL() {
@@ -1154,14 +1243,10 @@ namespace TKPEmu::N64::Devices {
     }
     
     TKP_INSTR_FUNC CPU::r_BGEZAL() {
-        int16_t offset = rfex_latch_.instruction.IType.immediate << 2;
-        int32_t seoffset = offset;
+        int32_t seoffset = static_cast<int16_t>(rfex_latch_.instruction.IType.immediate) * 4;
         gpr_regs_[31].UD = pc_;
         if (rfex_latch_.fetched_rs.D >= 0) {
-            exdc_latch_.data = pc_ - 4 + seoffset;
-            exdc_latch_.dest = reinterpret_cast<uint8_t*>(&pc_);
-            exdc_latch_.access_type = AccessType::UDOUBLEWORD_DIRECT;
-		    bypass_register();
+            take_branch(pc_ - 4 + seoffset);
         }
     }
     
@@ -1334,6 +1419,8 @@ namespace TKPEmu::N64::Devices {
     }
 
     CPU::PipelineStageRet CPU::EX(PipelineStageArgs) {
+        in_delay_slot_ = delay_slot_;
+        delay_slot_ = false;
         exdc_latch_.write_type = WriteType::NONE;
         exdc_latch_.access_type = AccessType::NONE;
         execute_instruction();
@@ -1394,20 +1481,128 @@ namespace TKPEmu::N64::Devices {
         *dest = (*dest & ~mask) | (data & mask);
     }
     void CPU::invalidate_hwio(uint32_t addr, uint64_t& data) {
+        if (addr - 0x0400'1000u < 0x1000u) [[unlikely]] {
+            rcp_.rsp_.InvalidateIMEM();
+            return;
+        }
+        if (addr - 0x0800'0000u < 0x2'0000u) [[unlikely]] {
+            // SRAM or FlashRAM commands
+            cpubus_.cart_save_.WriteWord(addr - 0x0800'0000u, data);
+            return;
+        }
+        // Registers where writing zero also has side effects
+        switch (addr) {
+            case RSP_DMA_SPADDR: {
+                data &= 0x1FF8;
+                return;
+            }
+            case RSP_DMA_RAMADDR: {
+                data &= 0xFF'FFF8;
+                return;
+            }
+            case RSP_DMA_RDLEN: {
+                data = rcp_.rsp_.WriteDMALength(data, false);
+                return;
+            }
+            case RSP_DMA_WRLEN: {
+                data = rcp_.rsp_.WriteDMALength(data, true);
+                return;
+            }
+            case RSP_STATUS: {
+                data = rcp_.rsp_.WriteStatus(data);
+                return;
+            }
+            case RSP_PC: {
+                rcp_.rsp_.WritePC(data);
+                data &= 0xFFC;
+                return;
+            }
+            case RSP_SEMAPHORE: {
+                data = 0;
+                return;
+            }
+            case RSP_DMA_FULL: {
+                data = __builtin_bswap32(rcp_.rsp_.dma_full_);
+                return;
+            }
+            case RSP_DMA_BUSY: {
+                data = __builtin_bswap32(rcp_.rsp_.dma_busy_);
+                return;
+            }
+            case DPC_START: case DPC_END: case DPC_CURRENT: case DPC_STATUS:
+            case DPC_CLOCK: case DPC_BUFBUSY: case DPC_PIPEBUSY: case DPC_TMEM: {
+                data = rcp_.rdp_.WriteRegister((addr >> 2) & 7, data);
+                return;
+            }
+            case AI_DRAM_ADDR: case AI_LEN: case AI_CONTROL:
+            case AI_STATUS: case AI_DACRATE: case AI_BITRATE: {
+                data = rcp_.ai_.WriteRegister((addr >> 2) & 7, data);
+                return;
+            }
+            case SI_DRAM_ADDR: case SI_PIF_AD_RD64B: case SI_PIF_AD_WR4B:
+            case SI_PIF_AD_WR64B: case SI_PIF_AD_RD4B: case SI_STATUS: {
+                data = rcp_.si_.WriteRegister((addr >> 2) & 7, data);
+                return;
+            }
+            case VI_V_INTR: case VI_V_CURRENT: case VI_V_SYNC: case VI_H_SYNC: {
+                data = rcp_.vi_.WriteRegister((addr >> 2) & 0xF, data);
+                return;
+            }
+            case MI_MODE: {
+                data = cpubus_.write_mi_mode(data);
+                return;
+            }
+            case MI_VERSION: {
+                data = __builtin_bswap32(cpubus_.mi_version_);
+                return;
+            }
+            case MI_INTR: {
+                // Read only, acknowledged through the device that raised the interrupt
+                data = __builtin_bswap32(cpubus_.mi_intr_);
+                return;
+            }
+            case MI_MASK: {
+                data = cpubus_.write_mi_mask(data);
+                return;
+            }
+        }
         if (data != 0)
         switch (addr) {
             case PI_STATUS: {
+                if (data & 0b10) {
+                    cpubus_.clear_interrupt(MIInterrupt::PI);
+                }
                 cpubus_.pi_status_ = 0;
                 data = 0;
                 break;
             }
             case PI_RD_LEN: {
-                std::cout << "FUCK!" << std::endl;
-                // std::memcpy(&cpubus_.rdram_[__builtin_bswap32(cpubus_.pi_cart_addr_)], cpubus_.redirect_paddress(__builtin_bswap32(cpubus_.pi_dram_addr_)), data + 1);
+                // Of the cartridge only the save chip on domain 2 can be written
+                uint32_t cart_addr = __builtin_bswap32(cpubus_.pi_cart_addr_);
+                uint32_t dram_addr = __builtin_bswap32(cpubus_.pi_dram_addr_) & 0xFF'FFFF;
+                if (cart_addr - 0x0800'0000u < 0x0800'0000u && dram_addr < cpubus_.rdram_.size()) {
+                    size_t length = std::min<size_t>(data + 1, cpubus_.rdram_.size() - dram_addr);
+                    rcp_.rdp_.SyncRange(dram_addr, length);
+                    cpubus_.cart_save_.Write(cart_addr - 0x0800'0000u, &cpubus_.rdram_[dram_addr], length);
+                }
+                // The transfer is done right away
+                cpubus_.raise_interrupt(MIInterrupt::PI);
                 break;
             }
             case PI_WR_LEN: {
-                std::memcpy(&cpubus_.rdram_[__builtin_bswap32(cpubus_.pi_dram_addr_)], cpubus_.redirect_paddress(__builtin_bswap32(cpubus_.pi_cart_addr_)), data + 1);
+                uint32_t cart_addr = __builtin_bswap32(cpubus_.pi_cart_addr_);
+                uint32_t dram_addr = __builtin_bswap32(cpubus_.pi_dram_addr_) & 0xFF'FFFF;
+                if (dram_addr < cpubus_.rdram_.size()) {
+                    size_t length = std::min<size_t>(data + 1, cpubus_.rdram_.size() - dram_addr);
+                    rcp_.rdp_.SyncRange(dram_addr, length);
+                    cpubus_.mark_rdram_dirty(dram_addr, length);
+                    if (cart_addr - 0x0800'0000u < 0x0800'0000u) {
+                        cpubus_.cart_save_.Read(cart_addr - 0x0800'0000u, &cpubus_.rdram_[dram_addr], length);
+                    } else {
+                        std::memcpy(&cpubus_.rdram_[dram_addr], cpubus_.redirect_paddress(cart_addr), length);
+                    }
+                }
+                cpubus_.raise_interrupt(MIInterrupt::PI);
                 break;
             }
             case VI_CTRL: {
@@ -1431,32 +1626,49 @@ namespace TKPEmu::N64::Devices {
                 break;
             }
             case PIF_COMMAND: {
-                if (data & 0x20) {
-                    data |= 0x80;
-                }
-                if (data & 0x40) {
-                    cpubus_.pif_ram_.fill(0);
-                    data = 0;
-                }
+                // The command is the last byte of the word
+                data = (data & ~0xFFull) | cpubus_.pif_.Command(data, cpubus_.pif_ram_);
                 break;
             }
         }
     }
     void CPU::store_memory(bool cached, uint32_t paddr, uint64_t& data, int size) {
         invalidate_hwio(paddr, data);
+        if (rcp_.rdp_.HasPendingWrites()) [[unlikely]] {
+            rcp_.rdp_.SyncRange(paddr, size);
+        }
+        if (paddr < cpubus_.rdram_.size()) {
+            cpubus_.mark_rdram_dirty(paddr, size);
+        }
         // if (!cached) {
-        uint8_t* loc = cpubus_.redirect_paddress(paddr);
         uint64_t temp = __builtin_bswap64(data);
         temp >>= 8 * (AccessType::UDOUBLEWORD - size);
-        std::memcpy(loc, &temp, size);
+        if (cpubus_.fastmem_base_) {
+            cpubus_.fastmem_store(paddr, temp, size);
+        } else {
+            uint8_t* loc = cpubus_.redirect_paddress(paddr);
+            std::memcpy(loc, &temp, size);
+        }
         // } else {
         //     // currently not implemented
         // }
     }
     void CPU::load_memory(bool cached, uint32_t paddr, uint64_t& data, int size) {
-        uint8_t* loc = cpubus_.redirect_paddress(paddr);
         uint64_t temp = 0;
-        std::memcpy(&temp, loc, size);
+        if (rcp_.rdp_.HasPendingWrites()) [[unlikely]] {
+            // The render thread may still be drawing here
+            rcp_.rdp_.SyncRange(paddr, size);
+        }
+        if (paddr == RSP_SEMAPHORE) [[unlikely]] {
+            // Reading sets the semaphore, the bus only hands out a pointer to it for writes
+            uint32_t semaphore = __builtin_bswap32(rcp_.rsp_.ReadSemaphore());
+            std::memcpy(&temp, &semaphore, std::min(size, 4));
+        } else if (cpubus_.fastmem_base_) {
+            temp = cpubus_.fastmem_load(paddr, size);
+        } else {
+            uint8_t* loc = cpubus_.redirect_paddress(paddr);
+            std::memcpy(&temp, loc, size);
+        }
         temp = __builtin_bswap64(temp);
         temp >>= 8 * (AccessType::UDOUBLEWORD - size);
         // Sign extend loaded word
@@ -1484,6 +1696,11 @@ namespace TKPEmu::N64::Devices {
         for (auto& reg : fpr_regs_) {
             reg = 0.0;
         }
+        for (auto& reg : cp0_regs_) {
+            reg.UD = 0;
+        }
+        hi_ = 0;
+        lo_ = 0;
     }
 
     // TODO: probably safe to remove
@@ -1518,7 +1735,535 @@ namespace TKPEmu::N64::Devices {
         }
         ++cp0_regs_[CP0_COUNT].UD;
         if (cp0_regs_[CP0_COUNT].UW._0 == cp0_regs_[CP0_COMPARE].UW._0) [[unlikely]] {
-            std::cout << "AH! interrupt" << std::endl;
+            set_interrupt_line(INTERRUPT_LINE_TIMER, true);
+        }
+        if (cpubus_.scheduler_.Tick()) [[unlikely]] {
+            handle_events();
+        }
+        if (exception_pending_) [[unlikely]] {
+            handle_exception();
+        }
+    }
+
+    namespace {
+        using RegFunc = uint64_t (*)(uint64_t rs, uint64_t rt);
+        using ImmFunc = uint64_t (*)(uint64_t rs, uint16_t imm);
+        using ShiftFunc = uint64_t (*)(uint64_t rt, uint32_t sa);
+        using CondFunc = bool (*)(uint64_t rs, uint64_t rt);
+
+        uint64_t sign_extend32(uint32_t value) {
+            return static_cast<int64_t>(static_cast<int32_t>(value));
+        }
+        uint64_t sign_extend16(uint16_t value) {
+            return static_cast<int64_t>(static_cast<int16_t>(value));
+        }
+
+        // What the SPECIAL handlers of the same name compute
+        uint64_t op_addu(uint64_t rs, uint64_t rt) { return sign_extend32(rs + rt); }
+        uint64_t op_subu(uint64_t rs, uint64_t rt) { return sign_extend32(rs - rt); }
+        uint64_t op_and(uint64_t rs, uint64_t rt) { return rs & rt; }
+        uint64_t op_or(uint64_t rs, uint64_t rt) { return rs | rt; }
+        uint64_t op_xor(uint64_t rs, uint64_t rt) { return rs ^ rt; }
+        uint64_t op_nor(uint64_t rs, uint64_t rt) { return ~(rs | rt); }
+        uint64_t op_slt(uint64_t rs, uint64_t rt) { return static_cast<int64_t>(rs) < static_cast<int64_t>(rt); }
+        uint64_t op_sltu(uint64_t rs, uint64_t rt) { return rs < rt; }
+
+        uint64_t op_sll(uint64_t rt, uint32_t sa) { return sign_extend32(static_cast<uint32_t>(rt) << sa); }
+        uint64_t op_srl(uint64_t rt, uint32_t sa) { return sign_extend32(static_cast<uint32_t>(rt) >> sa); }
+        uint64_t op_sra(uint64_t rt, uint32_t sa) { return sign_extend32(static_cast<int64_t>(rt) >> sa); }
+        uint64_t op_dsll(uint64_t rt, uint32_t sa) { return rt << sa; }
+        uint64_t op_dsll32(uint64_t rt, uint32_t sa) { return rt << (sa + 32); }
+        uint64_t op_dsra32(uint64_t rt, uint32_t sa) { return static_cast<int64_t>(rt) >> (sa + 32); }
+
+        uint64_t op_addiu(uint64_t rs, uint16_t imm) { return sign_extend32(rs + sign_extend16(imm)); }
+        uint64_t op_daddiu(uint64_t rs, uint16_t imm) { return rs + sign_extend16(imm); }
+        uint64_t op_andi(uint64_t rs, uint16_t imm) { return rs & imm; }
+        uint64_t op_ori(uint64_t rs, uint16_t imm) { return rs | imm; }
+        uint64_t op_xori(uint64_t rs, uint16_t imm) { return rs ^ imm; }
+        uint64_t op_slti(uint64_t rs, uint16_t imm) { return static_cast<int64_t>(rs) < static_cast<int16_t>(imm); }
+        uint64_t op_sltiu(uint64_t rs, uint16_t imm) { return rs < sign_extend16(imm); }
+        uint64_t op_lui(uint64_t, uint16_t imm) { return sign_extend32(static_cast<uint32_t>(imm) << 16); }
+
+        bool cond_eq(uint64_t rs, uint64_t rt) { return rs == rt; }
+        bool cond_ne(uint64_t rs, uint64_t rt) { return rs != rt; }
+        bool cond_lez(uint64_t rs, uint64_t) { return static_cast<int64_t>(rs) <= 0; }
+        bool cond_gtz(uint64_t rs, uint64_t) { return static_cast<int64_t>(rs) > 0; }
+        bool cond_gez(uint64_t rs, uint64_t) { return static_cast<int32_t>(rs) >= 0; }
+        bool cond_always(uint64_t, uint64_t) { return true; }
+    }
+
+    /**
+        Handlers direct mode picks between when an instruction is decoded
+
+        The common ALU instructions and branches get a handler of their own that reads
+        the registers and writes the result itself, with no trip through the latches.
+        What's known at decode time is baked into a template instance: a write to r0
+        is a nop, a zero rs or rt is a constant (so ADDU rd, r0, rt is a move and
+        ORI rt, r0, imm loads an immediate), and branch likely only exists in the
+        handlers that need the nullify. Anything else goes through generic, which is
+        what EX runs.
+
+        Some pairs of instructions that go together are fused, one handler running
+        both so there's one dispatch for the two:
+        - LUI and an ORI or ADDIU of the register it loaded, a 32-bit constant
+        - LUI and a load or store based on the register it loaded, an absolute access
+        - SLT, SLTU, SLTI or SLTIU and a BEQ or BNE testing its result against r0
+        Only the pair has to be in the same page for the decoded copy to notice either
+        changing. The register in between is still written, unless the second one
+        writes it too, as nothing says it's dead past the pair. When the first one runs
+        in a delay slot the second isn't what comes next, so it's left for its own
+        dispatch.
+    */
+    struct DecodedHandlers {
+        using Handler = void (*)(CPU*, Instruction);
+
+        template<Handler Run>
+        static void single(CPU* cpu, const DecodedInstruction& decoded) {
+            Run(cpu, decoded.instr);
+        }
+
+        static void nop(CPU*, Instruction) {}
+
+        template<RegFunc Op, bool RsZero, bool RtZero>
+        static void reg(CPU* cpu, Instruction instr) {
+            uint64_t rs = RsZero ? 0 : cpu->gpr_regs_[instr.RType.rs].UD;
+            uint64_t rt = RtZero ? 0 : cpu->gpr_regs_[instr.RType.rt].UD;
+            cpu->gpr_regs_[instr.RType.rd].UD = Op(rs, rt);
+        }
+
+        template<ImmFunc Op, bool RsZero>
+        static void imm(CPU* cpu, Instruction instr) {
+            uint64_t rs = RsZero ? 0 : cpu->gpr_regs_[instr.IType.rs].UD;
+            cpu->gpr_regs_[instr.IType.rt].UD = Op(rs, instr.IType.immediate);
+        }
+
+        template<ShiftFunc Op>
+        static void shift(CPU* cpu, Instruction instr) {
+            cpu->gpr_regs_[instr.RType.rd].UD = Op(cpu->gpr_regs_[instr.RType.rt].UD, instr.RType.sa);
+        }
+
+        template<CondFunc Cond, bool RtZero, bool Likely>
+        static void branch(CPU* cpu, Instruction instr) {
+            uint64_t rs = cpu->gpr_regs_[instr.IType.rs].UD;
+            uint64_t rt = RtZero ? 0 : cpu->gpr_regs_[instr.IType.rt].UD;
+            if (Cond(rs, rt)) {
+                cpu->take_branch(cpu->pc_ - 4 + sign_extend16(instr.IType.immediate) * 4);
+            } else if constexpr (Likely) {
+                cpu->nullify_delay_slot();
+            }
+        }
+
+        // BNEL with rs == rt, never taken
+        static void nullify(CPU* cpu, Instruction) {
+            cpu->nullify_delay_slot();
+        }
+
+        // The handler EX runs, with the load or store finished right away
+        static void generic(CPU* cpu, Instruction instr) {
+            cpu->rfex_latch_.instruction = instr;
+            cpu->rfex_latch_.fetched_rt_i = instr.RType.rt;
+            cpu->rfex_latch_.fetched_rs.UD = cpu->gpr_regs_[instr.RType.rs].UD;
+            cpu->rfex_latch_.fetched_rt.UD = cpu->gpr_regs_[instr.RType.rt].UD;
+            cpu->exdc_latch_.write_type = WriteType::NONE;
+            cpu->exdc_latch_.access_type = AccessType::NONE;
+            cpu->execute_instruction();
+            // Set by detect_ldi, which can't know what runs next here
+            cpu->ldi_ = false;
+            if (cpu->exception_raised_) [[unlikely]]
+                return;
+            switch (cpu->exdc_latch_.write_type) {
+                case WriteType::LATEREGISTER: {
+                    auto paddr_s = cpu->translate_vaddr(cpu->exdc_latch_.vaddr);
+                    uint64_t data = 0;
+                    cpu->load_memory(paddr_s.cached, paddr_s.paddr, data, cpu->exdc_latch_.access_type);
+                    cpu->store_register(cpu->exdc_latch_.dest, data, AccessType::UDOUBLEWORD);
+                    cpu->load_dest_ = instr.IType.rt;
+                    break;
+                }
+                case WriteType::MMU: {
+                    cpu->store_memory(cpu->exdc_latch_.cached, cpu->exdc_latch_.paddr, cpu->exdc_latch_.data, cpu->exdc_latch_.access_type);
+                    break;
+                }
+                default: {
+                    break;
+                }
+            }
+        }
+
+        // Moves on to the second instruction of a fused pair, false if it isn't next
+        static bool fuse_next(CPU* cpu) {
+            if (cpu->in_delay_slot_) [[unlikely]]
+                return false;
+            // As step would for it, the first one is no branch so nothing else changes
+            cpu->pc_ += 4;
+            cpu->next_pc_ += 4;
+            ++cpu->extra_cycles_;
+            return true;
+        }
+
+        // LUI rt and ORI or ADDIU rt, rt
+        template<ImmFunc Op>
+        static void constant(CPU* cpu, const DecodedInstruction& decoded) {
+            uint64_t upper = op_lui(0, decoded.instr.IType.immediate);
+            if (fuse_next(cpu)) [[likely]]
+                upper = Op(upper, decoded.fused.IType.immediate);
+            cpu->gpr_regs_[decoded.instr.IType.rt].UD = upper;
+        }
+
+        // LUI and an ORI or ADDIU of its register into another one
+        template<ImmFunc Op>
+        static void upper_imm(CPU* cpu, const DecodedInstruction& decoded) {
+            uint64_t upper = op_lui(0, decoded.instr.IType.immediate);
+            cpu->gpr_regs_[decoded.instr.IType.rt].UD = upper;
+            if (fuse_next(cpu)) [[likely]]
+                cpu->gpr_regs_[decoded.fused.IType.rt].UD = Op(upper, decoded.fused.IType.immediate);
+        }
+
+        // LUI and a load or store based on its register
+        static void upper_access(CPU* cpu, const DecodedInstruction& decoded) {
+            cpu->gpr_regs_[decoded.instr.IType.rt].UD = op_lui(0, decoded.instr.IType.immediate);
+            if (fuse_next(cpu)) [[likely]]
+                generic(cpu, decoded.fused);
+        }
+
+        // A set on less than and a branch on its result, First being the handler of the former
+        template<Handler First, bool Equal, bool Likely>
+        static void compare_branch(CPU* cpu, const DecodedInstruction& decoded) {
+            First(cpu, decoded.instr);
+            if (fuse_next(cpu)) [[likely]]
+                branch<Equal ? cond_eq : cond_ne, true, Likely>(cpu, decoded.fused);
+        }
+
+        template<RegFunc Op>
+        static DecodedFunc select_reg(Instruction instr) {
+            if (instr.RType.rd == 0)
+                return single<nop>;
+            bool rs_zero = instr.RType.rs == 0;
+            bool rt_zero = instr.RType.rt == 0;
+            if (rs_zero && rt_zero)
+                return single<reg<Op, true, true>>;
+            if (rs_zero)
+                return single<reg<Op, true, false>>;
+            if (rt_zero)
+                return single<reg<Op, false, true>>;
+            return single<reg<Op, false, false>>;
+        }
+
+        template<ImmFunc Op>
+        static DecodedFunc select_imm(Instruction instr) {
+            if (instr.IType.rt == 0)
+                return single<nop>;
+            if (instr.IType.rs == 0)
+                return single<imm<Op, true>>;
+            return single<imm<Op, false>>;
+        }
+
+        template<ShiftFunc Op>
+        static DecodedFunc select_shift(Instruction instr) {
+            // Includes SLL r0, r0, 0, the canonical NOP
+            if (instr.RType.rd == 0)
+                return single<nop>;
+            return single<shift<Op>>;
+        }
+
+        // For BEQ and BNE, which compare two registers
+        template<bool Equal, bool Likely>
+        static DecodedFunc select_compare(Instruction instr) {
+            if (instr.IType.rs == instr.IType.rt) {
+                if constexpr (Equal)
+                    return single<branch<cond_always, true, Likely>>;
+                return Likely ? single<nullify> : single<nop>;
+            }
+            constexpr CondFunc cond = Equal ? cond_eq : cond_ne;
+            if (instr.IType.rt == 0)
+                return single<branch<cond, true, Likely>>;
+            return single<branch<cond, false, Likely>>;
+        }
+
+        static DecodedFunc select(Instruction instr, uint32_t paddr) {
+            switch (instr.IType.op) {
+                case 0x00: {
+                    switch (instr.RType.func) {
+                        case 0x00: return select_shift<op_sll>(instr);
+                        case 0x02: return select_shift<op_srl>(instr);
+                        case 0x03: return select_shift<op_sra>(instr);
+                        case 0x21: return select_reg<op_addu>(instr);
+                        case 0x23: return select_reg<op_subu>(instr);
+                        case 0x24: return select_reg<op_and>(instr);
+                        case 0x25: return select_reg<op_or>(instr);
+                        case 0x26: return select_reg<op_xor>(instr);
+                        case 0x27: return select_reg<op_nor>(instr);
+                        case 0x2A: return select_reg<op_slt>(instr);
+                        case 0x2B: return select_reg<op_sltu>(instr);
+                        case 0x38: return select_shift<op_dsll>(instr);
+                        case 0x3C: return select_shift<op_dsll32>(instr);
+                        case 0x3F: return select_shift<op_dsra32>(instr);
+                    }
+                    break;
+                }
+                case 0x01: {
+                    // BGEZ, the other REGIMM branches aren't implemented yet
+                    if (instr.IType.rt == 0x01)
+                        return single<branch<cond_gez, true, false>>;
+                    break;
+                }
+                case 0x04: return select_compare<true, false>(instr);
+                case 0x05: {
+                    // The IPL3 checksum skip in BNE has to see these
+                    if (paddr == 0x1AC || paddr == 0x1B8)
+                        break;
+                    return select_compare<false, false>(instr);
+                }
+                case 0x06: return single<branch<cond_lez, true, false>>;
+                case 0x07: return single<branch<cond_gtz, true, false>>;
+                case 0x09: return select_imm<op_addiu>(instr);
+                case 0x0A: return select_imm<op_slti>(instr);
+                case 0x0B: return select_imm<op_sltiu>(instr);
+                case 0x0C: return select_imm<op_andi>(instr);
+                case 0x0D: return select_imm<op_ori>(instr);
+                case 0x0E: return select_imm<op_xori>(instr);
+                case 0x0F: return select_imm<op_lui>(instr);
+                case 0x14: return select_compare<true, true>(instr);
+                case 0x15: return select_compare<false, true>(instr);
+                case 0x16: return single<branch<cond_lez, true, true>>;
+                case 0x19: return select_imm<op_daddiu>(instr);
+            }
+            return single<generic>;
+        }
+
+        // Whether instr is the first of a pair that may fuse, worth looking at the next one for
+        static bool may_fuse(Instruction instr) {
+            switch (instr.IType.op) {
+                case 0x00:
+                    return (instr.RType.func == 0x2A || instr.RType.func == 0x2B) && instr.RType.rd != 0;
+                case 0x0A:
+                case 0x0B:
+                case 0x0F:
+                    return instr.IType.rt != 0;
+            }
+            return false;
+        }
+
+        // The branch of a compare and branch, BEQ or BNE of dest against r0
+        template<Handler First>
+        static DecodedFunc select_compare_branch(Instruction next, uint32_t dest) {
+            if (next.IType.rs != dest || next.IType.rt != 0)
+                return nullptr;
+            switch (next.IType.op) {
+                case 0x04: return compare_branch<First, true, false>;
+                case 0x05: return compare_branch<First, false, false>;
+                case 0x14: return compare_branch<First, true, true>;
+                case 0x15: return compare_branch<First, false, true>;
+            }
+            return nullptr;
+        }
+
+        // Handler running both instr and next, if they're a pair that fuses
+        static DecodedFunc select_fused(Instruction instr, Instruction next) {
+            switch (instr.IType.op) {
+                case 0x00: {
+                    uint32_t rd = instr.RType.rd;
+                    if (instr.RType.func == 0x2A)
+                        return select_compare_branch<reg<op_slt, false, false>>(next, rd);
+                    return select_compare_branch<reg<op_sltu, false, false>>(next, rd);
+                }
+                case 0x0A: return select_compare_branch<imm<op_slti, false>>(next, instr.IType.rt);
+                case 0x0B: return select_compare_branch<imm<op_sltiu, false>>(next, instr.IType.rt);
+            }
+            // LUI
+            uint32_t rt = instr.IType.rt;
+            if (next.IType.rs != rt)
+                return nullptr;
+            switch (next.IType.op) {
+                case 0x09: return next.IType.rt == rt ? constant<op_addiu> : upper_imm<op_addiu>;
+                case 0x0D: return next.IType.rt == rt ? constant<op_ori> : upper_imm<op_ori>;
+                // Loads and stores that don't merge with what's in the register
+                case 0x20: case 0x21: case 0x23: case 0x24: case 0x25: case 0x27:
+                case 0x28: case 0x29: case 0x2B: case 0x31: case 0x35: case 0x37:
+                case 0x39: case 0x3D: case 0x3F:
+                    return upper_access;
+            }
+            return nullptr;
+        }
+    };
+
+    void CPU::decode(DecodedInstruction& decoded, uint32_t paddr) {
+        // The second of a pair has to be in the same page, so a write to it is noticed
+        if (DecodedHandlers::may_fuse(decoded.instr) && (paddr & 0xFFF) != 0xFFC) {
+            decoded.fused.Full = cpubus_.fetch_instruction_uncached(paddr + 4);
+            if (DecodedFunc handler = DecodedHandlers::select_fused(decoded.instr, decoded.fused)) {
+                decoded.handler = handler;
+                return;
+            }
+        }
+        decoded.handler = DecodedHandlers::select(decoded.instr, paddr);
+    }
+
+    const DecodedInstruction& CPU::fetch_decoded_slow(uint32_t paddr) {
+        DecodedInstruction* decoded = &decoded_uncached_;
+        uint32_t page = paddr >> 12;
+        if (page < decoded_pages_.size()) {
+            uint32_t version = cpubus_.rdram_versions_[page];
+            auto& decoded_page = decoded_pages_[page];
+            if (!decoded_page) {
+                decoded_page = std::make_unique<DecodedPage>();
+                // Nothing in it is decoded yet
+                decoded_page->fill({ nullptr, {}, {}, version - 1 });
+            }
+            decoded = &(*decoded_page)[(paddr >> 2) & 1023];
+            decoded->version = version;
+        }
+        decoded->instr.Full = cpubus_.fetch_instruction_uncached(paddr);
+        decode(*decoded, paddr);
+        return *decoded;
+    }
+
+    void CPU::step() {
+        uint64_t pc = pc_;
+        const DecodedInstruction& decoded = fetch_decoded(translate_vaddr(pc).paddr);
+        Instruction instr = decoded.instr;
+        uint32_t cycles = 1;
+        if (instr.IType.op == 0) {
+            cycles = SpecialCycles[instr.RType.func];
+        }
+        if (load_dest_ == instr.RType.rs || load_dest_ == instr.RType.rt) [[unlikely]] {
+            // Load interlock, same test as detect_ldi
+            ++cycles;
+        }
+        gpr_regs_[0].UD = 0;
+        // The handlers expect pc_ where the pipeline would be fetching, see next_pc_
+        pc_ = next_pc_ + 4;
+        in_delay_slot_ = delay_slot_;
+        delay_slot_ = false;
+        load_dest_ = NO_LOAD;
+        decoded.handler(this, decoded);
+        uint64_t after = pc_;
+        pc_ = next_pc_;
+        next_pc_ = after;
+        cycles += extra_cycles_;
+        extra_cycles_ = 0;
+        uint32_t count = cp0_regs_[CP0_COUNT].UW._0;
+        cp0_regs_[CP0_COUNT].UD += cycles;
+        if (cp0_regs_[CP0_COMPARE].UW._0 - count - 1 < cycles) [[unlikely]] {
+            set_interrupt_line(INTERRUPT_LINE_TIMER, true);
+        }
+        if (cpubus_.scheduler_.Tick(cycles)) [[unlikely]] {
+            handle_events();
+        }
+        if (exception_pending_) [[unlikely]] {
+            handle_exception();
+        }
+    }
+
+    void CPU::set_interrupt_line(int line, bool asserted) {
+        uint32_t bit = 1 << (8 + line);
+        uint32_t cause = cp0_regs_[CP0_CAUSE].UW._0;
+        cp0_regs_[CP0_CAUSE].UW._0 = asserted ? (cause | bit) : (cause & ~bit);
+        update_interrupt_pending();
+    }
+
+    void CPU::update_interrupt_pending() {
+        uint32_t status = cp0_regs_[CP0_STATUS].UW._0;
+        uint32_t cause = cp0_regs_[CP0_CAUSE].UW._0;
+        bool interrupt = (status & (STATUS_IE | STATUS_EXL | STATUS_ERL)) == STATUS_IE && (status & cause & 0xFF00);
+        exception_pending_ = interrupt || exception_raised_;
+    }
+
+    void CPU::raise_exception(ExceptionCode code, uint32_t coprocessor) {
+        exception_raised_ = true;
+        exception_pending_ = true;
+        exception_code_ = code;
+        exception_coprocessor_ = coprocessor;
+        // An exception in the delay slot of a taken branch returns to the branch
+        exception_delay_slot_ = in_delay_slot_;
+        exception_pc_ = in_delay_slot_ ? branch_pc_ : pc_ - 8;
+    }
+
+    bool CPU::cop1_unusable() {
+        if (cp0_regs_[CP0_STATUS].UW._0 & STATUS_CU1) [[likely]]
+            return false;
+        raise_exception(ExceptionCode::CoprocessorUnusable, 1);
+        return true;
+    }
+
+    void CPU::handle_exception() {
+        if (exception_raised_) {
+            exception_raised_ = false;
+            // The instruction before completes, the one that raised it doesn't
+            if (!direct_)
+                WB();
+            enter_exception(exception_code_, exception_pc_, exception_delay_slot_, exception_coprocessor_);
+            return;
+        }
+        // Waits for an instruction the handler can return to
+        if (ldi_ || delay_slot_)
+            return;
+        if (direct_) {
+            enter_exception(ExceptionCode::Interrupt, pc_, false, 0);
+            return;
+        }
+        // What's past EX completes, the instruction in RF is returned to
+        WB();
+        DC();
+        WB();
+        enter_exception(ExceptionCode::Interrupt, pc_ - 8, false, 0);
+    }
+
+    void CPU::enter_exception(ExceptionCode code, uint32_t epc, bool delay_slot, uint32_t coprocessor) {
+        uint32_t status = cp0_regs_[CP0_STATUS].UW._0;
+        uint32_t cause = cp0_regs_[CP0_CAUSE].UW._0 & ~(CAUSE_EXCCODE | CAUSE_CE);
+        cause |= (static_cast<uint32_t>(code) << 2) | (coprocessor << 28);
+        // An exception inside the handler leaves EPC and BD as they were
+        if (!(status & STATUS_EXL)) {
+            cp0_regs_[CP0_EPC].UD = static_cast<int64_t>(static_cast<int32_t>(epc));
+            cause = delay_slot ? (cause | CAUSE_BD) : (cause & ~CAUSE_BD);
+        }
+        cp0_regs_[CP0_CAUSE].UW._0 = cause;
+        cp0_regs_[CP0_STATUS].UW._0 = status | STATUS_EXL;
+        ldi_ = false;
+        update_interrupt_pending();
+        pc_ = ((status & STATUS_BEV) ? 0xFFFF'FFFF'BFC0'0200 : 0xFFFF'FFFF'8000'0000) + 0x180;
+        if (direct_) {
+            next_pc_ = pc_ + 4;
+        } else {
+            fill_pipeline();
+        }
+    }
+
+    void CPU::handle_events() {
+        SchedulerEvent event;
+        while ((event = cpubus_.scheduler_.PopDue()) != SchedulerEvent::Count) {
+            switch (event) {
+                case SchedulerEvent::RSP: {
+                    rcp_.rsp_.Run(RSP::BATCH_CYCLES);
+                    if (!rcp_.rsp_.IsHalted()) {
+                        cpubus_.scheduler_.Schedule(SchedulerEvent::RSP, RSP::BATCH_CPU_CYCLES);
+                    }
+                    break;
+                }
+                case SchedulerEvent::SPDMA: {
+                    rcp_.rsp_.FinishDMA();
+                    break;
+                }
+                case SchedulerEvent::AI: {
+                    rcp_.ai_.FinishDMA();
+                    break;
+                }
+                case SchedulerEvent::SI: {
+                    rcp_.si_.FinishDMA();
+                    break;
+                }
+                case SchedulerEvent::VI: {
+                    rcp_.vi_.Interrupt();
+                    break;
+                }
+                case SchedulerEvent::VIField: {
+                    rcp_.vi_.FinishField();
+                    break;
+                }
+                default:
+                    break;
+            }
         }
     }
 
@@ -1531,6 +2276,452 @@ namespace TKPEmu::N64::Devices {
         exdc_latch_.write_type = WriteType::NONE;
     }
 
+    void CPU::take_branch(uint64_t target) {
+        // The delay slot has been fetched already
+        uint32_t branch = pc_ - 8;
+        pc_ = target;
+        delay_slot_ = true;
+        branch_pc_ = branch;
+        if (branch - static_cast<uint32_t>(target) < IDLE_LOOP_MAX * 4) [[unlikely]] {
+            if (idle_skip_)
+                check_idle_loop(branch, target);
+            if (memory_hle_ && direct_)
+                check_memory_loop(branch, target);
+        }
+    }
+
+    bool CPU::scan_idle_loop(uint32_t start, uint32_t end, uint32_t& written) {
+        written = 0;
+        for (uint32_t vaddr = start; vaddr <= end; vaddr += 4) {
+            Instruction instr;
+            instr.Full = cpubus_.fetch_instruction_uncached(translate_vaddr(vaddr).paddr);
+            uint32_t op = instr.IType.op;
+            switch (op) {
+                case 0x00: {
+                    // Shifts, MFHI, MFLO and arithmetic, not jumps, traps or anything writing HI/LO
+                    constexpr uint64_t PURE_SPECIAL = [] {
+                        uint64_t mask = 0;
+                        for (int funct : { 0x00, 0x02, 0x03, 0x04, 0x06, 0x07, 0x10, 0x12, 0x14, 0x16, 0x17,
+                                0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+                                0x38, 0x3A, 0x3B, 0x3C, 0x3E, 0x3F }) {
+                            mask |= 1ull << funct;
+                        }
+                        return mask;
+                    }();
+                    if (!((PURE_SPECIAL >> instr.RType.func) & 1))
+                        return false;
+                    written |= 1u << instr.RType.rd;
+                    break;
+                }
+                case 0x01: {
+                    // BLTZ, BGEZ and their likely forms, the others link or trap
+                    if (instr.RType.rt > 0x03)
+                        return false;
+                    break;
+                }
+                case 0x02:
+                case 0x04: case 0x05: case 0x06: case 0x07:
+                case 0x14: case 0x15: case 0x16: case 0x17: {
+                    break;
+                }
+                case 0x08: case 0x09: case 0x0A: case 0x0B:
+                case 0x0C: case 0x0D: case 0x0E: case 0x0F:
+                case 0x18: case 0x19:
+                case 0x1A: case 0x1B:
+                case 0x20: case 0x21: case 0x22: case 0x23:
+                case 0x24: case 0x25: case 0x26: case 0x27:
+                case 0x37: {
+                    // Immediate arithmetic and loads
+                    written |= 1u << instr.IType.rt;
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        written &= ~1u;
+        return true;
+    }
+
+    void CPU::check_idle_loop(uint32_t branch, uint32_t target) {
+        uint32_t& busy = busy_loops_[(branch >> 2) & (busy_loops_.size() - 1)];
+        if (busy == branch)
+            return;
+        bool changed = std::exchange(cpubus_.timed_read_, false);
+        if (branch != idle_branch_) {
+            uint32_t written;
+            if (!scan_idle_loop(target, branch + 4, written)) {
+                busy = branch;
+                return;
+            }
+            idle_branch_ = branch;
+            idle_written_ = written;
+            changed = true;
+        }
+        for (uint32_t mask = idle_written_; mask; mask &= mask - 1) {
+            int reg = __builtin_ctz(mask);
+            if (gpr_regs_[reg].UD != idle_regs_[reg]) {
+                idle_regs_[reg] = gpr_regs_[reg].UD;
+                changed = true;
+            }
+        }
+        if (changed)
+            return;
+        // Made sure of again in case the code was overwritten since it was first seen
+        uint32_t written;
+        if (!scan_idle_loop(target, branch + 4, written) || written != idle_written_) {
+            idle_branch_ = 0;
+            return;
+        }
+        skip_idle_cycles();
+    }
+
+    void CPU::skip_idle_cycles() {
+        Scheduler& scheduler = cpubus_.scheduler_;
+        uint64_t now = scheduler.Now();
+        uint64_t next = scheduler.NextDeadline();
+        if (next == Scheduler::NEVER || next <= now + 1)
+            return;
+        // Stops a cycle short so the event is handled the usual way, and short of COUNT
+        // reaching COMPARE
+        uint64_t skip = next - now - 1;
+        uint32_t to_compare = cp0_regs_[CP0_COMPARE].UW._0 - cp0_regs_[CP0_COUNT].UW._0;
+        uint64_t compare_limit = to_compare ? to_compare - 1 : std::numeric_limits<uint32_t>::max();
+        skip = std::min(skip, compare_limit);
+        scheduler.Tick(skip);
+        cp0_regs_[CP0_COUNT].UD += skip;
+        idle_skipped_cycles_ += skip;
+    }
+
+    namespace {
+        // Repeats the pattern of one pass over length bytes
+        void fill_passes(uint8_t* dst, const uint8_t* pattern, uint32_t stride, size_t length) {
+            if (std::all_of(pattern, pattern + stride, [](uint8_t byte) { return byte == 0; })) {
+                std::memset(dst, 0, length);
+                return;
+            }
+            size_t filled = 0;
+            if (16 % stride == 0) {
+                alignas(16) uint8_t wide[16];
+                for (uint32_t i = 0; i < 16; i += stride)
+                    std::memcpy(&wide[i], pattern, stride);
+                const __m128i vector = _mm_load_si128(reinterpret_cast<const __m128i*>(wide));
+                for (; filled + 16 <= length; filled += 16)
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + filled), vector);
+                std::memcpy(dst + filled, wide, length - filled);
+                return;
+            }
+            // Copies what's been filled onto what's after it, twice as much each time
+            std::memcpy(dst, pattern, std::min<size_t>(stride, length));
+            for (filled = stride; filled < length; filled *= 2)
+                std::memcpy(dst + filled, dst, std::min(filled, length - filled));
+        }
+    }
+
+    void CPU::check_memory_loop(uint32_t branch, uint32_t target) {
+        uint32_t& plain = plain_loops_[(branch >> 2) & (plain_loops_.size() - 1)];
+        // A pending interrupt is taken after the delay slot, not after the loop
+        if (plain == branch || exception_pending_)
+            return;
+        uint32_t code_begin = translate_vaddr(target).paddr;
+        uint32_t code_end = code_begin + (branch + 8 - target);
+        if (target - KSEG0_START >= 0x4000'0000u || code_end > cpubus_.rdram_.size()) {
+            // Not in RDRAM, there'd be nothing telling when the code changes
+            plain = branch;
+            return;
+        }
+        // Versions only go up, so the sum changes when either page's does
+        uint32_t version = cpubus_.rdram_versions_[code_begin >> 12] + cpubus_.rdram_versions_[(code_end - 1) >> 12];
+        MemoryLoop& loop = memory_loop_;
+        if (loop.branch != branch || loop.code_version != version) {
+            if (!scan_memory_loop(branch, target, loop)) {
+                loop.branch = 0;
+                plain = branch;
+                return;
+            }
+            loop.code_begin = code_begin;
+            loop.code_end = code_end;
+            loop.code_version = version;
+        }
+        run_memory_loop(loop);
+    }
+
+    bool CPU::scan_memory_loop(uint32_t branch, uint32_t target, MemoryLoop& loop) {
+        loop = {};
+        loop.branch = branch;
+        uint32_t count = (branch - target) / 4 + 2;
+        std::array<Instruction, IDLE_LOOP_MAX + 1> code;
+        for (uint32_t i = 0; i < count; i++) {
+            // A pass starts with the delay slot and ends with the branch
+            uint32_t vaddr = i == 0 ? branch + 4 : target + (i - 1) * 4;
+            code[i].Full = cpubus_.fetch_instruction_uncached(translate_vaddr(vaddr).paddr);
+        }
+        // How far each register has moved so far in the pass
+        std::array<int32_t, 32> moved {};
+        // Offsets of the accesses from their base as it is when the pass starts
+        std::array<int32_t, IDLE_LOOP_MAX> offsets {};
+        std::array<uint8_t, IDLE_LOOP_MAX> bases {};
+        uint32_t loaded = 0;
+        // Stores of a register before the pass loads it, which store what the previous pass
+        // loaded or, if it's never loaded, a value that stays the same throughout
+        std::array<bool, IDLE_LOOP_MAX> early {};
+        uint32_t stored_early = 0;
+        uint32_t stores = 0;
+        for (uint32_t i = 0; i + 1 < count; i++) {
+            Instruction instr = code[i];
+            uint32_t op = instr.IType.op;
+            uint32_t rs = instr.IType.rs;
+            uint32_t rt = instr.IType.rt;
+            int32_t imm = static_cast<int16_t>(instr.IType.immediate);
+            switch (op) {
+                case 0x00: {
+                    if (instr.Full != 0)
+                        return false;
+                    break;
+                }
+                case 0x09:
+                case 0x19: {
+                    // ADDIU and DADDIU of a register to itself, once a pass
+                    uint32_t bit = 1u << rt;
+                    if (rt == 0 || rs != rt || imm == 0 || ((loop.stepped | loaded) & bit))
+                        return false;
+                    loop.stepped |= bit;
+                    if (op == 0x19)
+                        loop.wide |= bit;
+                    loop.steps[rt] = imm;
+                    moved[rt] = imm;
+                    break;
+                }
+                case 0x20: case 0x21: case 0x23: case 0x24: case 0x25: case 0x27: case 0x37:
+                case 0x28: case 0x29: case 0x2B: case 0x3F: {
+                    bool load = op < 0x28 || op == 0x37;
+                    uint32_t size = op == 0x37 || op == 0x3F ? 8 : ((op & 3) == 3 ? 4 : (op & 3) + 1);
+                    if (((loaded >> rs) & 1) || loop.access_count == loop.accesses.size())
+                        return false;
+                    if (load) {
+                        if (rt == 0 || ((loop.stepped | loaded) >> rt) & 1)
+                            return false;
+                        loaded |= 1u << rt;
+                    } else {
+                        early[loop.access_count] = !((loaded >> rt) & 1);
+                        stored_early |= early[loop.access_count] << rt;
+                        stores++;
+                    }
+                    bool sign_extend = load && op != 0x24 && op != 0x25 && op != 0x27;
+                    uint32_t index = loop.access_count++;
+                    loop.accesses[index] = { static_cast<uint8_t>(rt), static_cast<uint8_t>(size), load, sign_extend, 0 };
+                    offsets[index] = imm + moved[rs];
+                    bases[index] = rs;
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        // BNE or BNEL of a register that moves each pass and one that doesn't
+        Instruction instr = code[count - 1];
+        if (instr.IType.op != 0x05 && instr.IType.op != 0x15)
+            return false;
+        uint32_t written = loop.stepped | loaded;
+        bool rs_moves = (loop.stepped >> instr.IType.rs) & 1;
+        loop.counter = rs_moves ? instr.IType.rs : instr.IType.rt;
+        loop.end = rs_moves ? instr.IType.rt : instr.IType.rs;
+        if (!((loop.stepped >> loop.counter) & 1) || ((written >> loop.end) & 1))
+            return false;
+        uint32_t stored_invariant = stored_early & ~loaded;
+        if ((stored_invariant & written & ~1u) || (loaded && (stored_invariant || stores != loop.access_count - stores)))
+            return false;
+        // Stores go through one base and loads through another, both moving by what a pass covers
+        int32_t dst_begin = std::numeric_limits<int32_t>::max();
+        uint32_t dst_bytes = 0;
+        loop.dst_base = MemoryLoop::NO_SOURCE;
+        for (uint32_t i = 0; i < loop.access_count; i++) {
+            const auto& access = loop.accesses[i];
+            uint8_t& base = access.load ? loop.src_base : loop.dst_base;
+            if (base != MemoryLoop::NO_SOURCE && base != bases[i])
+                return false;
+            base = bases[i];
+            if (!access.load) {
+                dst_begin = std::min(dst_begin, offsets[i]);
+                dst_bytes += access.size;
+            }
+        }
+        loop.stride = dst_bytes;
+        if (stores == 0 || loop.stride > 64 || loop.steps[loop.dst_base] != static_cast<int32_t>(loop.stride))
+            return false;
+        if (loaded && loop.steps[loop.src_base] != static_cast<int32_t>(loop.stride))
+            return false;
+        // Where each copy store's bytes were loaded from, a pass back for early ones
+        std::array<int32_t, IDLE_LOOP_MAX> sources {};
+        int32_t src_begin = std::numeric_limits<int32_t>::max();
+        for (uint32_t i = 0; loaded && i < loop.access_count; i++) {
+            const auto& access = loop.accesses[i];
+            if (access.load)
+                continue;
+            auto source = std::find_if(loop.accesses.begin(), loop.accesses.begin() + loop.access_count, [&access](const auto& other) {
+                return other.load && other.reg == access.reg;
+            });
+            if (source == loop.accesses.begin() + loop.access_count || source->size != access.size)
+                return false;
+            sources[i] = offsets[source - loop.accesses.begin()] - (early[i] ? loop.stride : 0);
+            src_begin = std::min(src_begin, sources[i]);
+        }
+        loop.dst_offset = dst_begin;
+        loop.src_offset = src_begin;
+        // The stores have to cover the stride exactly, each copy store putting its bytes where
+        // they were relative to the pass. Loads can reach into the pass after
+        uint64_t covered = 0;
+        for (uint32_t i = 0; i < loop.access_count; i++) {
+            auto& access = loop.accesses[i];
+            access.at = offsets[i] - (access.load ? src_begin : dst_begin);
+            uint32_t limit = access.load ? 2 * loop.stride : loop.stride;
+            if (loop.stride % access.size || access.at % access.size || access.at + access.size > limit)
+                return false;
+            if (access.load)
+                continue;
+            uint64_t bytes = (~0ull >> (64 - access.size)) << access.at;
+            if (covered & bytes)
+                return false;
+            covered |= bytes;
+            if (loaded && sources[i] - src_begin != static_cast<int32_t>(access.at))
+                return false;
+        }
+        if (covered != (~0ull >> (64 - loop.stride)))
+            return false;
+        // Every instruction of the pass, plus the interlocks between them
+        loop.cycles = count;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t op = code[i].IType.op;
+            if ((op < 0x20 || op >= 0x28) && op != 0x37)
+                continue;
+            Instruction next = code[(i + 1) % count];
+            if (next.RType.rs == code[i].IType.rt || next.RType.rt == code[i].IType.rt)
+                loop.cycles++;
+        }
+        return true;
+    }
+
+    void CPU::run_memory_loop(const MemoryLoop& loop) {
+        uint64_t counter = gpr_regs_[loop.counter].UD;
+        uint64_t end = gpr_regs_[loop.end].UD;
+        int64_t step = loop.steps[loop.counter];
+        int64_t distance;
+        if ((loop.wide >> loop.counter) & 1) {
+            distance = end - counter;
+        } else {
+            // ADDIU keeps the counter sign extended, it never reaches an end that isn't
+            if (end != static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(end))))
+                return;
+            distance = static_cast<int32_t>(static_cast<uint32_t>(end) - static_cast<uint32_t>(counter));
+        }
+        // Passes before the one whose branch isn't taken, which runs as usual
+        if (distance % step != 0 || distance / step < 2)
+            return;
+        uint64_t passes = distance / step - 1;
+        // Stops short of the next event and of COUNT reaching COMPARE, leaving room for the
+        // branch, its interlock and a fused instruction
+        constexpr uint64_t MARGIN = 4;
+        Scheduler& scheduler = cpubus_.scheduler_;
+        uint64_t budget = std::numeric_limits<uint32_t>::max();
+        if (scheduler.NextDeadline() != Scheduler::NEVER)
+            budget = scheduler.NextDeadline() > scheduler.Now() ? scheduler.NextDeadline() - scheduler.Now() : 0;
+        uint32_t to_compare = cp0_regs_[CP0_COMPARE].UW._0 - cp0_regs_[CP0_COUNT].UW._0;
+        if (to_compare)
+            budget = std::min<uint64_t>(budget, to_compare);
+        if (budget <= MARGIN)
+            return;
+        passes = std::min(passes, (budget - MARGIN) / loop.cycles);
+        if (passes == 0)
+            return;
+        uint64_t length = passes * loop.stride;
+        // Direct mapped addresses in RDRAM only, the rest go through the bus as usual
+        auto in_rdram = [this](uint32_t vaddr, uint64_t size, uint32_t& paddr) {
+            if (vaddr - KSEG0_START >= 0x4000'0000u)
+                return false;
+            paddr = translate_vaddr(vaddr).paddr;
+            return paddr + size <= cpubus_.rdram_.size();
+        };
+        uint32_t dst = 0;
+        if (!in_rdram(static_cast<uint32_t>(gpr_regs_[loop.dst_base].UD) + loop.dst_offset, length, dst))
+            return;
+        if (dst < loop.code_end && loop.code_begin < dst + length)
+            return;
+        uint32_t src = 0;
+        bool copy = loop.src_base != MemoryLoop::NO_SOURCE;
+        // The last pass's loads can reach a pass past what's copied
+        uint64_t src_length = length + loop.stride;
+        if (copy) {
+            if (!in_rdram(static_cast<uint32_t>(gpr_regs_[loop.src_base].UD) + loop.src_offset, src_length, src))
+                return;
+            // Going a pass at a time would copy what it already wrote
+            if (src < dst + length && dst < src + src_length)
+                return;
+        }
+        for (uint32_t i = 0; i < loop.access_count; i++) {
+            const auto& access = loop.accesses[i];
+            if (((access.load ? src : dst) + access.at) % access.size)
+                return;
+        }
+        if (rcp_.rdp_.HasPendingWrites()) [[unlikely]] {
+            rcp_.rdp_.SyncRange(dst, length);
+            if (copy)
+                rcp_.rdp_.SyncRange(src, src_length);
+        }
+        uint8_t* rdram = cpubus_.rdram_.data();
+        if (copy) {
+            std::memcpy(rdram + dst, rdram + src, length);
+            // Loaded registers end up with what the last pass loaded
+            uint32_t last = src + (passes - 1) * loop.stride;
+            for (uint32_t i = 0; i < loop.access_count; i++) {
+                const auto& access = loop.accesses[i];
+                if (!access.load)
+                    continue;
+                uint64_t value = 0;
+                for (uint32_t byte = 0; byte < access.size; byte++)
+                    value = (value << 8) | rdram[last + access.at + byte];
+                if (access.sign_extend) {
+                    uint32_t shift = 64 - 8 * access.size;
+                    value = static_cast<int64_t>(value << shift) >> shift;
+                }
+                gpr_regs_[access.reg].UD = value;
+            }
+        } else {
+            // Stored in guest byte order, like store_memory does
+            std::array<uint8_t, 64> pattern {};
+            for (uint32_t i = 0; i < loop.access_count; i++) {
+                const auto& access = loop.accesses[i];
+                uint64_t value = gpr_regs_[access.reg].UD;
+                for (uint32_t byte = 0; byte < access.size; byte++)
+                    pattern[access.at + byte] = value >> (8 * (access.size - 1 - byte));
+            }
+            fill_passes(rdram + dst, pattern.data(), loop.stride, length);
+        }
+        cpubus_.mark_rdram_dirty(dst, length);
+        for (uint32_t mask = loop.stepped; mask; mask &= mask - 1) {
+            int reg = __builtin_ctz(mask);
+            uint64_t moved = passes * static_cast<int64_t>(loop.steps[reg]);
+            if ((loop.wide >> reg) & 1) {
+                gpr_regs_[reg].UD += moved;
+            } else {
+                gpr_regs_[reg].UD = static_cast<int64_t>(static_cast<int32_t>(gpr_regs_[reg].UW._0 + static_cast<uint32_t>(moved)));
+            }
+        }
+        extra_cycles_ += passes * loop.cycles;
+        memory_loop_bytes_ += length;
+    }
+
+    void CPU::nullify_delay_slot() {
+        if (direct_) {
+            // Goes on from past the delay slot, which takes a cycle all the same
+            next_pc_ = pc_;
+            pc_ += 4;
+            ++extra_cycles_;
+            return;
+        }
+        icrf_latch_.instruction.Full = 0;
+        delay_slot_ = true;
+    }
+
     void CPU::detect_ldi() {
         ldi_ = (rfex_latch_.fetched_rt_i == icrf_latch_.instruction.RType.rt || rfex_latch_.fetched_rt_i == icrf_latch_.instruction.RType.rs);
         // Insert NOP so next EX doesn't re-execute the load in case ldi = true
@@ -1541,7 +2732,46 @@ namespace TKPEmu::N64::Devices {
         uint32_t func = instr.RType.rs;
         if (func & 0b10000) {
             // Coprocessor function
-            std::cout << "WHOOPS: " << instr.Full << std::endl;
+            switch (instr.RType.func) {
+                /**
+                 * ERET
+                 * 
+                 * Returns from an exception to ErrorEPC if Status.ERL is set or EPC otherwise,
+                 * clearing that bit and LLbit
+                 */
+                case 0b011000: {
+                    uint32_t status = cp0_regs_[CP0_STATUS].UW._0;
+                    if (status & STATUS_ERL) {
+                        pc_ = cp0_regs_[CP0_ERROREPC].UD;
+                        status &= ~STATUS_ERL;
+                    } else {
+                        pc_ = cp0_regs_[CP0_EPC].UD;
+                        status &= ~STATUS_EXL;
+                    }
+                    cp0_regs_[CP0_STATUS].UW._0 = status;
+                    llbit_ = false;
+                    // There's no delay slot, the instruction fetched after ERET doesn't run
+                    nullify_delay_slot();
+                    update_interrupt_pending();
+                    break;
+                }
+                /**
+                 * TLBR, TLBWI, TLBWR, TLBP
+                 * 
+                 * There's no TLB yet, libultra clears it at boot (osUnmapTLBAll) and
+                 * mapped addresses aren't supported anyway
+                 */
+                case 0b000001:
+                case 0b000010:
+                case 0b000110:
+                case 0b001000: {
+                    break;
+                }
+                default: {
+                    raise_exception(ExceptionCode::ReservedInstruction);
+                    break;
+                }
+            }
         } else {
             switch (func & 0b1111) {
                 /**
@@ -1550,12 +2780,17 @@ namespace TKPEmu::N64::Devices {
                  * throws Coprocessor unusable exception
                  */
                 case 0b0100: {
-                    int64_t sedata = gpr_regs_[instr.RType.rd].W._0;
-                    exdc_latch_.dest = &cp0_regs_[instr.RType.rt].UB._0;
-                    exdc_latch_.data = sedata;
-                    exdc_latch_.access_type = AccessType::UDOUBLEWORD;
-                    bypass_register();
-                    std::cout << "Write " << std::hex << sedata << " to cp0[" << std::hex << instr.RType.rt << "]" << std::endl; 
+                    int64_t sedata = rfex_latch_.fetched_rt.W._0;
+                    write_cp0(instr.RType.rd, sedata);
+                    break;
+                }
+                /**
+                 * DMTC0
+                 * 
+                 * throws Coprocessor unusable exception
+                 */
+                case 0b0101: {
+                    write_cp0(instr.RType.rd, rfex_latch_.fetched_rt.UD);
                     break;
                 }
                 /**
@@ -1564,13 +2799,25 @@ namespace TKPEmu::N64::Devices {
                  * throws Coprocessor unusable exception
                  */
                 case 0b0000: {
-                    int64_t sedata = cp0_regs_[instr.RType.rd].W._0;
+                    int64_t sedata = static_cast<int32_t>(read_cp0(instr.RType.rd));
                     exdc_latch_.dest = &gpr_regs_[instr.RType.rt].UB._0;
                     exdc_latch_.data = sedata;
                     exdc_latch_.access_type = AccessType::UDOUBLEWORD;
                     bypass_register();
                     break;
                 }
+                /**
+                 * DMFC0
+                 * 
+                 * throws Coprocessor unusable exception
+                 */
+                case 0b0001: {
+                    exdc_latch_.dest = &gpr_regs_[instr.RType.rt].UB._0;
+                    exdc_latch_.data = read_cp0(instr.RType.rd);
+                    exdc_latch_.access_type = AccessType::UDOUBLEWORD;
+                    bypass_register();
+                    break;
+                }
                 default: {
                     std::stringstream ss;
                     ss << "Unimplemented CP0 microcode:" << std::bitset<5>(func) << " - full:" << std::bitset<32>(instr.Full);
@@ -1579,4 +2826,60 @@ namespace TKPEmu::N64::Devices {
             }
         }
     }
+
+    uint64_t CPU::read_cp0(int reg) {
+        if (reg == CP0_RANDOM) {
+            // Counts down from 31 to Wired once per cycle, then starts over
+            uint32_t wired = std::min<uint32_t>(cp0_regs_[CP0_WIRED].UW._0, 31);
+            uint32_t elapsed = cp0_regs_[CP0_COUNT].UW._0 - random_start_;
+            return 31 - elapsed % (32 - wired);
+        }
+        return cp0_regs_[reg].UD;
+    }
+
+    void CPU::write_cp0(int reg, uint64_t data) {
+        switch (reg) {
+            case CP0_RANDOM:
+            case CP0_BADVADDR:
+            case CP0_PRID: {
+                // Read only
+                break;
+            }
+            case CP0_WIRED: {
+                // Also sends Random back to 31
+                cp0_regs_[reg].UD = data & 0x3F;
+                random_start_ = cp0_regs_[CP0_COUNT].UW._0;
+                break;
+            }
+            case CP0_CONFIG: {
+                // Only K0, CU, BE and EP can be written
+                constexpr uint32_t writable = 0x0F00'800F;
+                uint32_t config = cp0_regs_[reg].UW._0;
+                cp0_regs_[reg].UD = (config & ~writable) | (data & writable);
+                break;
+            }
+            case CP0_COMPARE: {
+                // Acknowledges the timer interrupt
+                cp0_regs_[reg].UD = data;
+                set_interrupt_line(INTERRUPT_LINE_TIMER, false);
+                break;
+            }
+            case CP0_STATUS: {
+                cp0_regs_[reg].UD = data;
+                update_interrupt_pending();
+                break;
+            }
+            case CP0_CAUSE: {
+                // Only the two software interrupts can be written
+                uint32_t cause = cp0_regs_[reg].UW._0;
+                cp0_regs_[reg].UW._0 = (cause & ~0x300u) | (data & 0x300);
+                update_interrupt_pending();
+                break;
+            }
+            default: {
+                cp0_regs_[reg].UD = data;
+                break;
+            }
+        }
+    }
 }
\ No newline at end of file
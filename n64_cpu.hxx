@@ -3,13 +3,21 @@
 #define TKP_N64_CPU_H
 #include <cstdint>
 #include <limits>
+#include <algorithm>
 #include <array>
 #include <queue>
 #include <vector>
 #include <memory>
+#include <span>
 #include "n64_types.hxx"
+#include "n64_memory.hxx"
+#include "n64_fastmem.hxx"
+#include "n64_ipl.hxx"
+#include "n64_boot.hxx"
 #include "n64_cpu_exceptions.hxx"
 #include "n64_rcp.hxx"
+#include "n64_scheduler.hxx"
+#include "n64_pif.hxx"
 
 // TODO: Move these to cmake
 #define SKIP64BITCHECK 1
@@ -23,8 +31,32 @@ constexpr uint32_t KSEG0_END   = 0x9FFF'FFFF;
 constexpr uint32_t KSEG1_START = 0xA000'0000;
 constexpr uint32_t KSEG1_END   = 0xBFFF'FFFF;
 
+constexpr auto CP0_RANDOM = 1;
+constexpr auto CP0_WIRED = 6;
+constexpr auto CP0_BADVADDR = 8;
 constexpr auto CP0_COUNT = 9;
 constexpr auto CP0_COMPARE = 11;
+constexpr auto CP0_STATUS = 12;
+constexpr auto CP0_CAUSE = 13;
+constexpr auto CP0_EPC = 14;
+constexpr auto CP0_PRID = 15;
+constexpr auto CP0_CONFIG = 16;
+constexpr auto CP0_LLADDR = 17;
+constexpr auto CP0_ERROREPC = 30;
+
+// Status bits
+constexpr uint32_t STATUS_IE  = 1 << 0;
+constexpr uint32_t STATUS_EXL = 1 << 1;
+constexpr uint32_t STATUS_ERL = 1 << 2;
+constexpr uint32_t STATUS_BEV = 1 << 22;
+constexpr uint32_t STATUS_CU1 = 1 << 29;
+// Cause bits
+constexpr uint32_t CAUSE_EXCCODE = 0x1F << 2;
+constexpr uint32_t CAUSE_CE = 0b11 << 28;
+constexpr uint32_t CAUSE_BD = 1u << 31;
+// Interrupt lines, each a Cause.IP bit and a Status.IM bit starting from bit 8
+constexpr int INTERRUPT_LINE_MI = 2;
+constexpr int INTERRUPT_LINE_TIMER = 7;
 
 namespace TKPEmu {
     namespace N64 {
@@ -45,12 +77,45 @@ namespace TKPEmu::N64::Devices {
         std::numeric_limits<uint32_t>::max(),
         std::numeric_limits<uint64_t>::max()
     };
+    // MI_INTR bits, one per RCP device
+    enum class MIInterrupt : uint32_t {
+        SP = 1 << 0,
+        SI = 1 << 1,
+        AI = 1 << 2,
+        VI = 1 << 3,
+        PI = 1 << 4,
+        DP = 1 << 5,
+    };
+    // Cause.ExcCode values
+    enum class ExceptionCode : uint32_t {
+        Interrupt = 0,
+        TLBModification = 1,
+        TLBMissLoad = 2,
+        TLBMissStore = 3,
+        AddressErrorLoad = 4,
+        AddressErrorStore = 5,
+        InstructionBusError = 6,
+        DataBusError = 7,
+        Syscall = 8,
+        Breakpoint = 9,
+        ReservedInstruction = 10,
+        CoprocessorUnusable = 11,
+        IntegerOverflow = 12,
+        Trap = 13,
+        FloatingPoint = 15,
+        Watch = 23,
+    };
     // Only kernel mode is used for (most?) n64 licensed games
     enum class OperatingMode {
         User,
         Supervisor,
         Kernel
     };
+    // How the CPU runs instructions, see CPU::step and CPU::update_pipeline
+    enum class InterpreterMode {
+        Direct,
+        Pipeline,
+    };
     struct ICRF_latch {
         Instruction     instruction;
     };
@@ -93,32 +158,127 @@ namespace TKPEmu::N64::Devices {
         bool LoadCartridge(std::string path);
         bool LoadIPL(std::string path);
         bool IsEverythingLoaded() {
-            return rom_loaded_ && ipl_loaded_;
+            return rom_loaded_ && (ipl_loaded_ || hle_boot_);
         }
         void Reset();
+        /**
+            Switches between page table and virtual memory fastmem accesses.
+            Enabling it rebuilds guest memory, so it must happen before anything is loaded.
+        */
+        void SetFastmem(bool enabled);
+        // Selects 8 MB (expansion pak) or 4 MB of RDRAM, must happen before anything is loaded
+        void SetExpansionPak(bool enabled);
+        // Boot straight into the game on reset instead of running the IPL, see CPU::hle_boot
+        void SetHLEBoot(bool enabled) { hle_boot_ = enabled; }
+        /**
+            Picks the save chip of the cartridge and loads the saves (and memory paks) from
+            files named path followed by an extension for each. An empty path keeps saves
+            in memory only. Anything pending for the previous files is written first.
+        */
+        void SetSaves(SaveType type, const std::string& path);
+        // Takes effect the next time the game polls the controllers
+        void SetControllerState(int port, const ControllerState& state) { pif_.GetInput().SetLive(port, state); }
+        Input& GetInput() { return pif_.GetInput(); }
+        // Plays a movie from the next poll on, with exactly the controllers it was recorded with connected
+        void PlayMovie(const std::string& path);
+        // Records the input of every connected controller from the next poll on
+        void RecordMovie(const std::string& path);
+        constexpr static size_t RDRAM_SIZE = 0x400000;
+        constexpr static size_t RDRAM_XPK_SIZE = 0x800000;
     private:
         uint32_t  fetch_instruction_uncached(uint32_t paddr);
         uint32_t  fetch_instruction_cached  (uint32_t paddr);
         uint8_t*  redirect_paddress         (uint32_t paddr);
         uint8_t*  redirect_paddress_slow    (uint32_t paddr);
+        [[noreturn]] void bad_address       (uint32_t paddr);
         void      map_direct_addresses();
+        void      bind_memory();
+        void      copy_ipl();
+        void      raise_interrupt(MIInterrupt interrupt);
+        void      clear_interrupt(MIInterrupt interrupt);
+        // Passes whether any unmasked MI interrupt is pending on to the CPU
+        void      update_interrupt_line();
+        // Apply writes to MI_MODE and MI_MASK, return the value the register reads back as
+        uint32_t  write_mi_mode(uint32_t data);
+        uint32_t  write_mi_mask(uint32_t data);
+        // Bumps the version of every RDRAM page in [addr, addr + length). Every write to RDRAM
+        // from the emulation thread has to go through here, caches of data derived from RDRAM
+        // (the RDP texture cache) compare versions to notice it changed.
+        __always_inline void mark_rdram_dirty(uint32_t addr, uint32_t length) {
+            uint32_t last = std::min<uint32_t>((addr + length - 1) >> 12, rdram_versions_.size() - 1);
+            for (uint32_t page = addr >> 12; page <= last; page++) {
+                // Only written by this thread, read by the RDP render threads
+                __atomic_store_n(&rdram_versions_[page], rdram_versions_[page] + 1, __ATOMIC_RELAXED);
+            }
+        }
+        __always_inline uint64_t fastmem_load(uint32_t paddr, int size) {
+            uint8_t* ptr = fastmem_base_ + paddr;
+            uint64_t data;
+            switch (size) {
+                case 1: data = fastmem_read<uint8_t>(ptr); break;
+                case 2: data = fastmem_read<uint16_t>(ptr); break;
+                case 4: data = fastmem_read<uint32_t>(ptr); break;
+                default: data = fastmem_read<uint64_t>(ptr); break;
+            }
+            if (bad_access_) [[unlikely]] {
+                bad_access_ = false;
+                bad_address(bad_paddr_);
+            }
+            return data;
+        }
+        __always_inline void fastmem_store(uint32_t paddr, uint64_t data, int size) {
+            uint8_t* ptr = fastmem_base_ + paddr;
+            switch (size) {
+                case 1: fastmem_write<uint8_t>(ptr, data); break;
+                case 2: fastmem_write<uint16_t>(ptr, data); break;
+                case 4: fastmem_write<uint32_t>(ptr, data); break;
+                default: fastmem_write<uint64_t>(ptr, data); break;
+            }
+            if (bad_access_) [[unlikely]] {
+                bad_access_ = false;
+                bad_address(bad_paddr_);
+            }
+        }
 
-        std::array<uint8_t, 0xFC00000> cart_rom_;
+        GuestMemory memory_;
+        std::unique_ptr<Fastmem> fastmem_;
+        // Base of the fastmem window, nullptr when accesses go through the page table
+        uint8_t* fastmem_base_ = nullptr;
+        // Set by the fastmem fault handler when the slow path couldn't resolve an address
+        bool bad_access_ = false;
+        uint32_t bad_paddr_ = 0;
+        std::span<uint8_t> cart_rom_;
         bool rom_loaded_ = false;
         bool ipl_loaded_ = false;
-        static std::vector<uint8_t> ipl_;
-        std::array<uint8_t, 0x400000> rdram_ {};
-        std::array<uint8_t, 0x400000> rdram_xpk_ {};
-        std::array<uint8_t, 64> pif_ram_ {};
-        std::array<uint8_t, 0x1000> rsp_imem_ {};
-        std::array<uint8_t, 0x1000> rsp_dmem_ {};
-        std::array<uint8_t, 0x100000> rdp_cmem_ {};
-        std::array<uint8_t*, 0x1000> page_table_ {};
+        bool hle_boot_ = false;
+        // Shared with every other instance that boots from the same image
+        std::shared_ptr<const IPLImage> ipl_;
+        std::span<uint8_t> ipl_rom_;
+        // Installed RDRAM, one contiguous region of either RDRAM_SIZE or RDRAM_XPK_SIZE
+        std::span<uint8_t> rdram_;
+        size_t rdram_size_ = RDRAM_SIZE;
+        // Write count of each 4 KB page of RDRAM, see mark_rdram_dirty
+        std::array<uint32_t, (RDRAM_XPK_SIZE >> 12)> rdram_versions_ {};
+        // Register file shared by every installed RDRAM module
+        std::array<uint8_t, 0x400> rdram_regs_ {};
+        // Reads of open bus addresses return 0 and writes are dropped
+        uint64_t open_bus_ = 0;
+        // Set by reads of registers that change without a scheduler event, see CPU::check_idle_loop
+        bool timed_read_ = false;
+        std::span<uint8_t> pif_ram_;
+        std::span<uint8_t> rsp_imem_;
+        std::span<uint8_t> rsp_dmem_;
+        std::span<uint8_t> rdp_cmem_;
+        std::span<uint8_t*> page_table_;
         uint8_t the_void_ = 0; // redirect unimplemented and useless addresses here
 
         // MIPS Interface
         uint32_t mi_mode_         = 0;
+        uint32_t mi_version_      = 0;
+        uint32_t mi_intr_         = 0;
         uint32_t mi_mask_         = 0;
+        // Whose interrupt line MI drives, set by the CPU
+        CPU* cpu_ = nullptr;
 
         // Peripheral Interface
         uint32_t pi_dram_addr_    = 0;
@@ -135,28 +295,42 @@ namespace TKPEmu::N64::Devices {
         uint32_t pi_bsd_dom2_pgs_ = 0;
         uint32_t pi_bsd_dom2_rls_ = 0;
 
-        // Audio Interface
-        uint32_t ai_dram_addr_    = 0;
-        uint32_t ai_length_       = 0;
-        uint32_t ai_control_      = 0;
-        uint32_t ai_status_       = 0;
-        uint32_t ai_dacrate_       = 0;
-        uint32_t ai_bitrate_       = 0;
-
         // RDRAM Interface
         uint32_t ri_mode_         = 0;
         uint32_t ri_config_       = 0;
         uint32_t ri_current_load_ = 0;
         uint32_t ri_select_       = 0;
 
-        // Serial Interface
-        uint32_t si_status_       = 0;
-
+        Scheduler scheduler_;
+        // Declared before the save chips so it outlives them and writes what they left pending
+        SaveWriter save_writer_;
+        PIF pif_;
+        CartSave cart_save_;
         Devices::RCP& rcp_;
         friend class CPU;
+        friend class RSP;
+        friend class RDP;
+        friend class AudioHLE;
+        friend class AudioInterface;
+        friend class SerialInterface;
+        friend class VideoInterface;
         friend class N64;
+        friend class Fastmem;
         friend class TKPEmu::Applications::N64_RomDisassembly;
+        friend class TKPEmu::N64::QA;
+    };
+    // Handler picked for an instruction when it's decoded, see DecodedHandlers
+    struct DecodedInstruction;
+    using DecodedFunc = void (*)(CPU*, const DecodedInstruction&);
+    struct DecodedInstruction {
+        DecodedFunc handler;
+        Instruction instr;
+        // The instruction after it, when the handler runs both
+        Instruction fused;
+        // rdram_versions_ of its page when it was decoded, it's decoded again once that changes
+        uint32_t version;
     };
+    struct DecodedHandlers;
     template<auto MemberFunc>
     static void lut_wrapper(CPU* cpu) {
         // Props: calc84maniac
@@ -193,10 +367,103 @@ namespace TKPEmu::N64::Devices {
         bool llbit_;
         uint64_t fcr0_, fcr31_;
         bool ldi_ = false;
+        // Set when the instruction in RF can't be returned to by itself, a delay slot
+        // or one that's been nullified, so an interrupt has to wait an instruction
+        bool delay_slot_ = false;
+        // delay_slot_ as it was for the instruction in EX
+        bool in_delay_slot_ = false;
+        // Address of the last branch taken, where an exception in its delay slot returns to
+        uint32_t branch_pc_ = 0;
+        // Asked for by N64::SetInterpreter, direct_ is what's running and only changes on Reset
+        InterpreterMode interpreter_ = InterpreterMode::Direct;
+        bool direct_ = true;
+        /**
+            In direct mode pc_ is the next instruction to run and next_pc_ the one after,
+            the branch target while pc_ is a delay slot. While an instruction runs pc_
+            is moved on to the one after next_pc_, which is where the pipeline's fetch
+            would be, so branches set it to their target and that's all. Either way the
+            instruction after is next_pc_ and the one after that pc_.
+        */
+        uint64_t next_pc_ = 0;
+        // Register the last instruction loaded into in direct mode, one that reads it next stalls
+        constexpr static uint32_t NO_LOAD = 0xFF;
+        uint32_t load_dest_ = NO_LOAD;
+        // Instructions direct mode has decoded, a page per 4 KB of RDRAM made when it's first run from
+        using DecodedPage = std::array<DecodedInstruction, 1024>;
+        std::vector<std::unique_ptr<DecodedPage>> decoded_pages_;
+        // Anything run from outside RDRAM (the IPL, DMEM) is decoded every time
+        DecodedInstruction decoded_uncached_ {};
+        // Cycles the last instruction took past its own, for a nullified delay slot or
+        // the second one of a fused pair
+        uint32_t extra_cycles_ = 0;
+        /**
+            The only thing the pipeline checks for exceptions. Set when the instruction in
+            EX raised one, or when an interrupt can be taken: Status.IE set, EXL and ERL
+            clear and an unmasked Cause.IP bit, see update_interrupt_pending.
+        */
+        bool exception_pending_ = false;
+        // What the instruction in EX raised, see raise_exception
+        bool exception_raised_ = false;
+        ExceptionCode exception_code_ = ExceptionCode::Interrupt;
+        uint32_t exception_coprocessor_ = 0;
+        uint32_t exception_pc_ = 0;
+        bool exception_delay_slot_ = false;
+        // COUNT when Wired was last written, Random counts down from there
+        uint32_t random_start_ = 0;
         bool should_resize_ = false;
         unsigned text_format_ = 0;
         unsigned text_width_ = 0;
         unsigned text_height_ = 0;
+        // Idle loop skipping, see check_idle_loop
+        constexpr static uint32_t IDLE_LOOP_MAX = 16;
+        bool idle_skip_ = true;
+        // The loop being watched and the registers it writes, with their values after the last pass
+        uint32_t idle_branch_ = 0;
+        uint32_t idle_written_ = 0;
+        std::array<uint64_t, 32> idle_regs_ {};
+        // Branches of loops that can't be idle, indexed by address
+        std::array<uint32_t, 64> busy_loops_ {};
+        uint64_t idle_skipped_cycles_ = 0;
+        // What a loop that only copies or fills memory does each pass, see check_memory_loop
+        struct MemoryLoop {
+            // A load or store, at an offset from the start of the bytes a pass covers
+            struct Access {
+                uint8_t reg;
+                uint8_t size;
+                bool load;
+                bool sign_extend;
+                uint32_t at;
+            };
+            constexpr static uint8_t NO_SOURCE = 0xFF;
+            // The branch of the loop, 0 when there's none
+            uint32_t branch = 0;
+            // Where the code is, and the versions of its first and last page added up when it was scanned
+            uint32_t code_begin = 0;
+            uint32_t code_end = 0;
+            uint32_t code_version = 0;
+            uint32_t cycles = 0;
+            // The BNE or BNEL compares counter, which moves each pass, with end, which doesn't
+            uint8_t counter = 0;
+            uint8_t end = 0;
+            // Bytes are written from dst_offset past the dst_base register, and copied from
+            // src_offset past src_base unless it's NO_SOURCE. Both move by stride each pass.
+            uint8_t dst_base = 0;
+            uint8_t src_base = NO_SOURCE;
+            int32_t dst_offset = 0;
+            int32_t src_offset = 0;
+            uint32_t stride = 0;
+            // Registers ADDIU or DADDIU (the wide ones) add steps to each pass
+            uint32_t stepped = 0;
+            uint32_t wide = 0;
+            std::array<int32_t, 32> steps {};
+            std::array<Access, IDLE_LOOP_MAX> accesses {};
+            uint32_t access_count = 0;
+        };
+        bool memory_hle_ = true;
+        MemoryLoop memory_loop_ {};
+        // Branches of loops that aren't memory loops, indexed by address
+        std::array<uint32_t, 64> plain_loops_ {};
+        uint64_t memory_loop_bytes_ = 0;
         // Kernel mode addressing functions
         /**
             VR4300 manual, page 122: 
@@ -348,19 +615,131 @@ namespace TKPEmu::N64::Devices {
             &lut_wrapper<&CPU::r_BLTZAL>, &lut_wrapper<&CPU::r_BGEZAL>, &lut_wrapper<&CPU::r_BLTZALL>, &lut_wrapper<&CPU::r_BGEZALL>, &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>,
             &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>, &lut_wrapper<&CPU::ERROR>,
         };
+        /**
+            Cycles SPECIAL instructions take in direct mode, by function. MULT and DIV keep
+            HI/LO busy for this long and the pipeline stalls on the next access, charging it
+            right away is close enough. Everything else takes one.
+        */
+        constexpr static std::array<uint8_t, 64> SpecialCycles = [] {
+            std::array<uint8_t, 64> cycles {};
+            cycles.fill(1);
+            cycles[0x18] = cycles[0x19] = 5;  // MULT, MULTU
+            cycles[0x1A] = cycles[0x1B] = 37; // DIV, DIVU
+            cycles[0x1C] = cycles[0x1D] = 8;  // DMULT, DMULTU
+            cycles[0x1E] = cycles[0x1F] = 69; // DDIV, DDIVU
+            return cycles;
+        }();
         __always_inline void bypass_register();
         __always_inline void detect_ldi();
+        // Discards the delay slot of a branch likely that isn't taken
+        __always_inline void nullify_delay_slot();
+        // Jumps to target after the delay slot
+        __always_inline void take_branch(uint64_t target);
+        /**
+            Called when a branch jumps at most IDLE_LOOP_MAX instructions back.
+
+            A loop made only of loads, register arithmetic and branches can't change
+            anything but the registers it writes. If a whole pass leaves those as they
+            were, every following pass reads the same memory and does the same, until a
+            scheduler event changes something (DMA, interrupts, the RSP). Time then skips
+            to just before the next event. Registers that move on their own between events
+            (VI_V_CURRENT, AI_LEN) are excluded by CPUBus::timed_read_, and so is COUNT by
+            not accepting MFC0.
+        */
+        void check_idle_loop(uint32_t branch, uint32_t target);
+        // Decodes [start, end], returns false if an instruction has side effects or reads COUNT
+        bool scan_idle_loop(uint32_t start, uint32_t end, uint32_t& written);
+        void skip_idle_cycles();
+        /**
+            Called in direct mode when a branch jumps at most IDLE_LOOP_MAX instructions back.
+
+            Guest memcpy and memset (bcopy, bzero and the like) come down to loops of loads
+            and stores with a pointer moving by the bytes they cover. When the loop is only
+            that, the delay slot included, and a BNE(L) on a moving counter ends it, the passes
+            still to come are worked out from the registers and done over rdram_ directly.
+            The last pass is left to run as usual, as is anything that doesn't fit: ranges
+            outside RDRAM or over the loop's own code, a copy onto its source, or a pass
+            not covering its stride exactly. Passes are only done in bulk up to the next
+            scheduler event or COMPARE, so those happen when they would have anyway.
+        */
+        void check_memory_loop(uint32_t branch, uint32_t target);
+        // Decodes the delay slot and [target, branch], returns false if it's no memory loop
+        bool scan_memory_loop(uint32_t branch, uint32_t target, MemoryLoop& loop);
+        void run_memory_loop(const MemoryLoop& loop);
         /**
          * Called during EX stage, handles the logic execution of each instruction
          */
         void execute_instruction();
         void execute_cp0_instruction(const Instruction& instr);
+        // MFC0 and DMFC0, Random is worked out when it's read
+        uint64_t read_cp0(int reg);
+        // MTC0 and DMTC0, keeps read only bits and applies side effects
+        void write_cp0(int reg, uint64_t data);
+        // Sets or clears Cause.IP bit 8 + line
+        void set_interrupt_line(int line, bool asserted);
+        /**
+            Works out exception_pending_ again. Only called when Status, Cause or MI change,
+            so the pipeline checks a single flag per instruction.
+        */
+        void update_interrupt_pending();
+        /**
+            Called by the instruction in EX, which must not have written anything yet.
+            The handler is entered once the instruction before it has completed.
+        */
+        void raise_exception(ExceptionCode code, uint32_t coprocessor = 0);
+        // Raises Coprocessor Unusable unless Status.CU1 is set, for every COP1 instruction
+        bool cop1_unusable();
+        // Enters the handler of the raised exception or of a pending interrupt
+        void handle_exception();
+        /**
+            Sets Cause, EPC (unless already in an exception) and EXL, then restarts the
+            pipeline at the general exception vector, in ROM while Status.BEV is set.
+            There's no TLB, so the refill vectors are never used.
+        */
+        void enter_exception(ExceptionCode code, uint32_t epc, bool delay_slot, uint32_t coprocessor);
         void update_pipeline();
+        /**
+            Direct mode, runs the instruction at pc_ to completion. Instructions are decoded
+            once into a handler picked for them (see DecodedHandlers), the ones without a
+            handler of their own go through EX's with loads and stores finished right after.
+            Registers are never late, so there are no latches to move along. Timing comes
+            from SpecialCycles, plus a cycle for a load interlock and one for a nullified
+            delay slot like the pipeline stalls for.
+        */
+        void step();
+        __always_inline const DecodedInstruction& fetch_decoded(uint32_t paddr) {
+            uint32_t page = paddr >> 12;
+            if (page < decoded_pages_.size()) [[likely]] {
+                DecodedPage* decoded_page = decoded_pages_[page].get();
+                if (decoded_page) [[likely]] {
+                    const DecodedInstruction& decoded = (*decoded_page)[(paddr >> 2) & 1023];
+                    if (decoded.version == cpubus_.rdram_versions_[page]) [[likely]]
+                        return decoded;
+                }
+            }
+            return fetch_decoded_slow(paddr);
+        }
+        const DecodedInstruction& fetch_decoded_slow(uint32_t paddr);
+        // Picks the handler for decoded.instr, paddr is where it's at
+        void decode(DecodedInstruction& decoded, uint32_t paddr);
+        // Runs every scheduler event that has come due
+        void handle_events();
         // Fills the pipeline with the first 5 instructions
         void fill_pipeline();
 
         void clear_registers();
+        /**
+            Does what the PIF boot ROM and IPL3 would have done by the time the game's
+            entry point runs: the first 1 MB of the game is copied to RDRAM, the boot code
+            to DMEM, the globals IPL3 leaves for libultra are filled in and the registers
+            are seeded as the CIC expects. The IPL itself is never needed.
+
+            @see https://n64brew.dev/wiki/Initial_Program_Load
+        */
+        void hle_boot();
 
+        friend class CPUBus;
+        friend struct DecodedHandlers;
         friend class TKPEmu::N64::N64_TKPWrapper;
         friend class TKPEmu::N64::N64;
         friend class TKPEmu::Applications::N64_RomDisassembly;
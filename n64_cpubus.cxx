@@ -1,63 +1,226 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "n64_cpu.hxx"
 #include "n64_addresses.hxx"
 #include "../include/error_factory.hxx"
 
 namespace TKPEmu::N64::Devices {
-    std::vector<uint8_t> CPUBus::ipl_ {};
-
     CPUBus::CPUBus(Devices::RCP& rcp) : rcp_(rcp) {
+        rcp_.rsp_.SetBus(this);
+        rcp_.rdp_.SetBus(this);
+        rcp_.ai_.SetBus(this);
+        rcp_.si_.SetBus(this);
+        rcp_.vi_.SetBus(this);
+        bind_memory();
+        SetSaves(SaveType::None, "");
+    }
+
+    void CPUBus::bind_memory() {
+        cart_rom_ = memory_.Get(GuestRegion::CartRom);
+        rdram_ = memory_.Get(GuestRegion::Rdram).subspan(0, rdram_size_);
+        ipl_rom_ = memory_.Get(GuestRegion::Pif).subspan(0, 0x7C0);
+        pif_ram_ = memory_.Get(GuestRegion::Pif).subspan(0x7C0, 64);
+        rsp_dmem_ = memory_.Get(GuestRegion::SpMem).subspan(0, 0x1000);
+        rsp_imem_ = memory_.Get(GuestRegion::SpMem).subspan(0x1000, 0x1000);
+        rdp_cmem_ = memory_.Get(GuestRegion::RdpCmem);
+        rcp_.rsp_.SetMemory(rsp_dmem_.data(), rsp_imem_.data());
+        page_table_ = { reinterpret_cast<uint8_t**>(memory_.Get(GuestRegion::PageTable).data()), 0x1000 };
         map_direct_addresses();
     }
 
-    bool CPUBus::LoadCartridge(std::string path) {
-        std::ifstream ifs(path, std::ios::in | std::ios::binary);
-        if (ifs.is_open()) {
-            ifs.unsetf(std::ios::skipws);
-            ifs.seekg(0, std::ios::end);
-            std::streampos size = ifs.tellg();
-            ifs.seekg(0, std::ios::beg);
-            ifs.read(reinterpret_cast<char*>(cart_rom_.data()), size);
-            rom_loaded_ = true;
-            Reset();
+    void CPUBus::SetExpansionPak(bool enabled) {
+        size_t size = enabled ? RDRAM_XPK_SIZE : RDRAM_SIZE;
+        if (size == rdram_size_)
+            return;
+        rdram_size_ = size;
+        bind_memory();
+        if (fastmem_) {
+            // The window maps exactly the installed RDRAM, so rebuild it
+            fastmem_.reset();
+            fastmem_ = std::make_unique<Fastmem>(memory_, *this);
+            fastmem_base_ = fastmem_->Base();
+        }
+    }
+
+    void CPUBus::SetFastmem(bool enabled) {
+        if (enabled == (fastmem_ != nullptr))
+            return;
+        if (enabled) {
+            if (memory_.Fd() == -1) {
+                // The fastmem window maps the same pages, so they need a file backing
+                memory_ = GuestMemory(true);
+                bind_memory();
+                rom_loaded_ = false;
+                if (ipl_) {
+                    copy_ipl();
+                }
+            }
+            fastmem_ = std::make_unique<Fastmem>(memory_, *this);
+            fastmem_base_ = fastmem_->Base();
         } else {
+            fastmem_base_ = nullptr;
+            fastmem_.reset();
+        }
+    }
+
+    bool CPUBus::LoadCartridge(std::string path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
             return false;
         }
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            close(fd);
+            return false;
+        }
+        size_t size = std::min(static_cast<size_t>(st.st_size), cart_rom_.size());
+        // Drop the previous rom so a shorter one doesn't keep its tail. The rom is copied
+        // instead of mapped: a mapping of the file would fault with SIGBUS on every read
+        // once the file is truncated or replaced. The bus is reset by whoever starts emulation.
+        memory_.Discard(GuestRegion::CartRom);
+        size_t read = 0;
+        while (read < size) {
+            ssize_t ret = pread(fd, cart_rom_.data() + read, size - read, read);
+            if (ret <= 0) {
+                close(fd);
+                return false;
+            }
+            read += ret;
+        }
+        close(fd);
+        rom_loaded_ = true;
         return true;
     }
 
     bool CPUBus::LoadIPL(std::string path) {
-        std::ifstream ifs(path, std::ios::in | std::ios::binary);
-        if (ifs.is_open()) {
-            if (CPUBus::ipl_.empty()) {
-                ifs.unsetf(std::ios::skipws);
-                ifs.seekg(0, std::ios::end);
-                std::streampos size = ifs.tellg();
-                ifs.seekg(0, std::ios::beg);
-                CPUBus::ipl_.resize(size);
-                ifs.read(reinterpret_cast<char*>(CPUBus::ipl_.data()), size);
-            }
-        } else {
+        auto ipl = IPLRegistry::Load(path);
+        if (!ipl) {
             return false;
         }
-        ipl_loaded_ = !ipl_.empty();
+        ipl_ = std::move(ipl);
+        copy_ipl();
         return true;
     }
 
+    void CPUBus::copy_ipl() {
+        // Each instance keeps its own copy next to PIF RAM
+        auto data = ipl_->Data();
+        size_t size = std::min(data.size(), ipl_rom_.size());
+        std::memcpy(ipl_rom_.data(), data.data(), size);
+        // A shorter image mustn't leave the tail of the previous one behind
+        std::memset(ipl_rom_.data() + size, 0, ipl_rom_.size() - size);
+        ipl_loaded_ = true;
+    }
+
     void CPUBus::Reset() {
-        rdram_.fill(0);
-        rdram_xpk_.fill(0);
-        pif_ram_.fill(0);
+        // The render thread may still be writing to RDRAM, it has to be done before it's released
+        rcp_.rdp_.Sync();
+        // Released instead of cleared, the pages read as zero until they're written again
+        memory_.Discard(GuestRegion::Rdram);
+        rdram_regs_.fill(0);
+        // RDRAM_DEVICE_TYPE, every module is a 2 MB (4.5 Mbit x 9 banks) part
+        *reinterpret_cast<uint32_t*>(&rdram_regs_[0]) = __builtin_bswap32(0xB419'0010);
+        std::memset(pif_ram_.data(), 0, pif_ram_.size());
         ri_mode_ = 0x0E000000;
         ri_config_ = 0x40000000;
         ri_select_ = 0x14000000;
+        mi_mode_ = 0;
+        // RSP, RDP, RAC and IO versions of a retail console
+        mi_version_ = __builtin_bswap32(0x0202'0102);
+        mi_intr_ = 0;
+        mi_mask_ = 0;
+        update_interrupt_line();
+        cart_save_.Reset();
+        scheduler_.Reset();
+    }
+
+    void CPUBus::SetSaves(SaveType type, const std::string& path) {
+        save_writer_.CloseAll();
+        pif_.Open(type, &save_writer_, path);
+        cart_save_.Open(type, &save_writer_, path);
+    }
+
+    void CPUBus::PlayMovie(const std::string& path) {
+        uint8_t ports = pif_.GetInput().PlayMovie(path);
+        for (int port = 0; port < PIF::CONTROLLER_COUNT; port++) {
+            pif_.SetControllerConnected(port, ports & (1 << port));
+        }
+    }
+
+    void CPUBus::RecordMovie(const std::string& path) {
+        uint8_t ports = 0;
+        for (int port = 0; port < PIF::CONTROLLER_COUNT; port++) {
+            if (pif_.IsControllerConnected(port))
+                ports |= 1 << port;
+        }
+        pif_.GetInput().Record(path, ports);
+    }
+
+    void CPUBus::raise_interrupt(MIInterrupt interrupt) {
+        mi_intr_ |= __builtin_bswap32(static_cast<uint32_t>(interrupt));
+        update_interrupt_line();
+    }
+
+    void CPUBus::clear_interrupt(MIInterrupt interrupt) {
+        mi_intr_ &= ~__builtin_bswap32(static_cast<uint32_t>(interrupt));
+        update_interrupt_line();
+    }
+
+    void CPUBus::update_interrupt_line() {
+        if (cpu_) {
+            // Both are in guest byte order, which doesn't matter for the test
+            cpu_->set_interrupt_line(INTERRUPT_LINE_MI, (mi_intr_ & mi_mask_) != 0);
+        }
+    }
+
+    uint32_t CPUBus::write_mi_mode(uint32_t data) {
+        uint32_t mode = __builtin_bswap32(mi_mode_);
+        // Bits 0-6 are the repeat count of init mode, the rest come in clear/set pairs
+        mode = (mode & ~0x7Fu) | (data & 0x7F);
+        if (data & (1 << 7))
+            mode &= ~(1u << 7);
+        if (data & (1 << 8))
+            mode |= 1 << 7;
+        if (data & (1 << 9))
+            mode &= ~(1u << 8);
+        if (data & (1 << 10))
+            mode |= 1 << 8;
+        if (data & (1 << 11))
+            clear_interrupt(MIInterrupt::DP);
+        if (data & (1 << 12))
+            mode &= ~(1u << 9);
+        if (data & (1 << 13))
+            mode |= 1 << 9;
+        mi_mode_ = __builtin_bswap32(mode);
+        return mode;
+    }
+
+    uint32_t CPUBus::write_mi_mask(uint32_t data) {
+        uint32_t mask = __builtin_bswap32(mi_mask_);
+        // A clear bit and a set bit for each interrupt, set wins when both are written
+        for (int i = 0; i < 6; i++) {
+            if (data & (1 << (i * 2)))
+                mask &= ~(1u << i);
+            if (data & (1 << (i * 2 + 1)))
+                mask |= 1 << i;
+        }
+        mi_mask_ = __builtin_bswap32(mask);
+        update_interrupt_line();
+        return mask;
     }
     
     uint32_t CPUBus::fetch_instruction_uncached(uint32_t paddr) {
         // Loads in big endian
         // should only work for .z64 files
+        if (fastmem_base_) {
+            return __builtin_bswap32(fastmem_load(paddr, 4));
+        }
         uint8_t* ptr = redirect_paddress(paddr);
         uint32_t ret = __builtin_bswap32(*reinterpret_cast<uint32_t*>(ptr));
         return ret;
@@ -73,7 +236,10 @@ namespace TKPEmu::N64::Devices {
             if (ptr_slow)
                 return ptr_slow;
         }
-        volatile int k = 0;
+        bad_address(paddr);
+    }
+
+    void CPUBus::bad_address(uint32_t paddr) {
         std::stringstream ss;
         ss << "Tried to access bad address: 0x" << std::hex << paddr << std::endl;
         throw ErrorFactory::generate_exception(__func__, __LINE__, ss.str());
@@ -83,39 +249,67 @@ namespace TKPEmu::N64::Devices {
         #define redir_case(A,B) case A: return reinterpret_cast<uint8_t*>(&B)
         switch (paddr) {
             // RSP internal registers
-            redir_case(RSP_STATUS, rcp_.rsp_status_);
-            redir_case(RSP_DMA_BUSY, rcp_.rsp_dma_busy_);
-            redir_case(RSP_PC, rcp_.rsp_pc_);
+            redir_case(RSP_DMA_SPADDR, rcp_.rsp_.dma_spaddr_);
+            redir_case(RSP_DMA_RAMADDR, rcp_.rsp_.dma_ramaddr_);
+            redir_case(RSP_DMA_RDLEN, rcp_.rsp_.dma_rdlen_);
+            redir_case(RSP_DMA_WRLEN, rcp_.rsp_.dma_wrlen_);
+            redir_case(RSP_STATUS, rcp_.rsp_.status_);
+            redir_case(RSP_DMA_FULL, rcp_.rsp_.dma_full_);
+            redir_case(RSP_DMA_BUSY, rcp_.rsp_.dma_busy_);
+            redir_case(RSP_PC, rcp_.rsp_.pc_reg_);
+            redir_case(RSP_SEMAPHORE, rcp_.rsp_.semaphore_);
+
+            // RDP command registers
+            redir_case(DPC_START, rcp_.rdp_.start_);
+            redir_case(DPC_END, rcp_.rdp_.end_);
+            redir_case(DPC_CURRENT, rcp_.rdp_.current_);
+            redir_case(DPC_STATUS, rcp_.rdp_.status_);
+            redir_case(DPC_CLOCK, rcp_.rdp_.clock_);
+            redir_case(DPC_BUFBUSY, rcp_.rdp_.buf_busy_);
+            redir_case(DPC_PIPEBUSY, rcp_.rdp_.pipe_busy_);
+            redir_case(DPC_TMEM, rcp_.rdp_.tmem_busy_);
 
             // MIPS Interface
             redir_case(MI_MODE, mi_mode_);
+            redir_case(MI_VERSION, mi_version_);
+            redir_case(MI_INTR, mi_intr_);
             redir_case(MI_MASK, mi_mask_);
 
             // Video Interface
-            redir_case(VI_CTRL, rcp_.vi_ctrl_);
-            redir_case(VI_ORIGIN, rcp_.vi_origin_);
-            redir_case(VI_WIDTH, rcp_.vi_width_);
-            redir_case(VI_V_INTR, rcp_.vi_v_intr_);
-            redir_case(VI_V_CURRENT, rcp_.vi_v_current_);
-            redir_case(VI_BURST, rcp_.vi_burst_);
-            redir_case(VI_V_SYNC, rcp_.vi_v_sync_);
-            redir_case(VI_H_SYNC, rcp_.vi_h_sync_);
-            redir_case(VI_H_SYNC_LEAP, rcp_.vi_h_sync_leap_);
-            redir_case(VI_H_VIDEO, rcp_.vi_h_video_);
-            redir_case(VI_V_VIDEO, rcp_.vi_v_video_);
-            redir_case(VI_V_BURST, rcp_.vi_v_burst_);
-            redir_case(VI_X_SCALE, rcp_.vi_x_scale_);
-            redir_case(VI_Y_SCALE, rcp_.vi_y_scale_);
-            redir_case(VI_TEST_ADDR, rcp_.vi_test_addr_);
-            redir_case(VI_STAGED_DATA, rcp_.vi_staged_data_);
+            redir_case(VI_CTRL, rcp_.vi_.ctrl_);
+            redir_case(VI_ORIGIN, rcp_.vi_.origin_);
+            redir_case(VI_WIDTH, rcp_.vi_.width_);
+            redir_case(VI_V_INTR, rcp_.vi_.v_intr_);
+            case VI_V_CURRENT: {
+                // Moves along with the cycle count, only worked out when it's accessed
+                rcp_.vi_.update_current();
+                timed_read_ = true;
+                return reinterpret_cast<uint8_t*>(&rcp_.vi_.v_current_);
+            }
+            redir_case(VI_BURST, rcp_.vi_.burst_);
+            redir_case(VI_V_SYNC, rcp_.vi_.v_sync_);
+            redir_case(VI_H_SYNC, rcp_.vi_.h_sync_);
+            redir_case(VI_H_SYNC_LEAP, rcp_.vi_.h_sync_leap_);
+            redir_case(VI_H_VIDEO, rcp_.vi_.h_video_);
+            redir_case(VI_V_VIDEO, rcp_.vi_.v_video_);
+            redir_case(VI_V_BURST, rcp_.vi_.v_burst_);
+            redir_case(VI_X_SCALE, rcp_.vi_.x_scale_);
+            redir_case(VI_Y_SCALE, rcp_.vi_.y_scale_);
+            redir_case(VI_TEST_ADDR, rcp_.vi_.test_addr_);
+            redir_case(VI_STAGED_DATA, rcp_.vi_.staged_data_);
 
             // Audio Interface
-            redir_case(AI_DRAM_ADDR, ai_dram_addr_);
-            redir_case(AI_LEN, ai_length_);
-            redir_case(AI_CONTROL, ai_control_);
-            redir_case(AI_STATUS, ai_status_);
-            redir_case(AI_DACRATE, ai_dacrate_);
-            redir_case(AI_BITRATE, ai_bitrate_);
+            redir_case(AI_DRAM_ADDR, rcp_.ai_.dram_addr_);
+            case AI_LEN: {
+                // Counts down while the DMA plays, only worked out when it's accessed
+                rcp_.ai_.update_length();
+                timed_read_ = true;
+                return reinterpret_cast<uint8_t*>(&rcp_.ai_.length_);
+            }
+            redir_case(AI_CONTROL, rcp_.ai_.control_);
+            redir_case(AI_STATUS, rcp_.ai_.status_);
+            redir_case(AI_DACRATE, rcp_.ai_.dacrate_);
+            redir_case(AI_BITRATE, rcp_.ai_.bitrate_);
 
             // Peripheral Interface
             redir_case(PI_DRAM_ADDR, pi_dram_addr_);
@@ -139,11 +333,34 @@ namespace TKPEmu::N64::Devices {
             redir_case(RI_SELECT, ri_select_);
 
             // Serial Interface
-            redir_case(SI_STATUS, si_status_);
+            redir_case(SI_DRAM_ADDR, rcp_.si_.dram_addr_);
+            redir_case(SI_PIF_AD_RD64B, rcp_.si_.pif_addr_);
+            redir_case(SI_PIF_AD_WR4B, rcp_.si_.pif_addr_);
+            redir_case(SI_PIF_AD_WR64B, rcp_.si_.pif_addr_);
+            redir_case(SI_PIF_AD_RD4B, rcp_.si_.pif_addr_);
+            redir_case(SI_STATUS, rcp_.si_.status_);
         }
         #undef redir_case
-        if (paddr - 0x1FC00000u < 1984u) {
-            return &ipl_[paddr - 0x1FC00000u];
+        if (paddr < 0x03F0'0000u) {
+            // RDRAM that isn't installed
+            open_bus_ = 0;
+            return reinterpret_cast<uint8_t*>(&open_bus_);
+        } else if (paddr < 0x0400'0000u) {
+            // RDRAM registers. Each 2 MB module answers at its own 1 KB slot, the upper
+            // half is the broadcast range. All installed modules share one register file,
+            // absent modules read as open bus which is how the IPL sizes memory.
+            uint32_t module = (paddr - 0x03F0'0000u) >> 10;
+            if (paddr >= 0x03F8'0000u || module < rdram_.size() / 0x200000) {
+                return &rdram_regs_[paddr & 0x3FF];
+            }
+            open_bus_ = 0;
+            return reinterpret_cast<uint8_t*>(&open_bus_);
+        } else if (paddr - 0x0800'0000u < 0x2'0000u && cart_save_.Present()) {
+            // SRAM or FlashRAM, accessed a word at a time
+            cart_save_.register_ = __builtin_bswap32(cart_save_.ReadWord(paddr - 0x0800'0000u));
+            return reinterpret_cast<uint8_t*>(&cart_save_.register_);
+        } else if (paddr - 0x1FC00000u < 1984u) {
+            return &ipl_rom_[paddr - 0x1FC00000u];
         } else if (paddr - 0x1FC0'07C0u < 64u) {
             return &pif_ram_[paddr - 0x1FC0'07C0u];
         } else if (paddr - 0x04000000u < 4096u) {
@@ -159,14 +376,13 @@ namespace TKPEmu::N64::Devices {
     void CPUBus::map_direct_addresses() {
         // https://wheremyfoodat.github.io/software-fastmem/
         const uint32_t PAGE_SIZE = 0x100000;
-        // Map rdram
-        for (int i = 0; i < 0xE; i++) {
+        // Map rdram, pages past the installed size go through the slow path as open bus
+        for (int i = 0; i < 8; i++) {
+            page_table_[i] = nullptr;
+        }
+        for (size_t i = 0; i < rdram_.size() / PAGE_SIZE; i++) {
             page_table_[i] = &rdram_[PAGE_SIZE * i];
         }
-        // Map rdram from expansion pak
-        // for (int i = 4; i < 8; i++) {
-        //     page_table_[i] = &rdram_xpk_[PAGE_SIZE * i];
-        // }
         // Map cartridge rom
         for (int i = 0x100; i <= 0x1FB; i++) {
             page_table_[i] = &cart_rom_[PAGE_SIZE * (i - 0x100)];
@@ -0,0 +1,129 @@
+#include <sys/mman.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include "n64_fastmem.hxx"
+#include "n64_cpu.hxx"
+#include "../include/error_factory.hxx"
+
+// Defined by the linker, hold the address of every fastmem access instruction
+extern "C" __attribute__((weak)) const uintptr_t __start_n64_fastmem_sites[];
+extern "C" __attribute__((weak)) const uintptr_t __stop_n64_fastmem_sites[];
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        struct FastmemMapping {
+            uint32_t paddr;
+            GuestRegion region;
+        };
+        constexpr FastmemMapping FastmemMappings[] = {
+            { 0x0000'0000, GuestRegion::Rdram },
+            { 0x0400'0000, GuestRegion::SpMem },
+            { 0x1000'0000, GuestRegion::CartRom },
+            { 0x1FC0'0000, GuestRegion::Pif },
+        };
+        // Windows are looked up from the signal handler, so they are kept in a
+        // fixed array of atomics instead of a container that might reallocate
+        constexpr size_t MAX_FASTMEM_WINDOWS = 64;
+        std::array<std::atomic<Fastmem*>, MAX_FASTMEM_WINDOWS> fastmem_windows {};
+        struct sigaction previous_action {};
+        std::once_flag handler_installed;
+
+        bool is_access_site(uintptr_t rip) {
+            if (!__start_n64_fastmem_sites)
+                return false;
+            return std::find(__start_n64_fastmem_sites, __stop_n64_fastmem_sites, rip) != __stop_n64_fastmem_sites;
+        }
+
+        void segv_handler(int sig, siginfo_t* info, void* context) {
+            if (Fastmem::HandleFault(info->si_addr, context))
+                return;
+            // Not ours, hand it to whoever was installed before us
+            if (previous_action.sa_flags & SA_SIGINFO) {
+                previous_action.sa_sigaction(sig, info, context);
+            } else if (previous_action.sa_handler != SIG_IGN && previous_action.sa_handler != SIG_DFL) {
+                previous_action.sa_handler(sig);
+            } else {
+                signal(sig, SIG_DFL);
+            }
+        }
+    }
+
+    Fastmem::Fastmem(const GuestMemory& memory, CPUBus& bus) : bus_(bus) {
+        if (memory.Fd() == -1) {
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Fastmem needs shareable guest memory");
+        }
+        void* window = mmap(nullptr, WINDOW_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (window == MAP_FAILED) {
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not reserve fastmem window");
+        }
+        base_ = static_cast<uint8_t*>(window);
+        for (const auto& mapping : FastmemMappings) {
+            // Only whole pages are mapped, the rest of a partial one (all of the 0x800 byte
+            // PIF region) has to fault so it gets the same treatment as without fastmem
+            auto size = memory.Get(mapping.region).size() & ~(GuestMemory::PAGE_SIZE - 1);
+            if (mapping.region == GuestRegion::Rdram) {
+                // RDRAM past the installed size has to fault so it reads as open bus
+                size = bus.rdram_.size();
+            }
+            if (size == 0)
+                continue;
+            if (mmap(base_ + mapping.paddr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memory.Fd(), memory.FileOffset(mapping.region)) == MAP_FAILED) {
+                munmap(base_, WINDOW_SIZE);
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not map fastmem window");
+            }
+        }
+        std::call_once(handler_installed, install_handler);
+        for (auto& slot : fastmem_windows) {
+            Fastmem* expected = nullptr;
+            if (slot.compare_exchange_strong(expected, this))
+                return;
+        }
+        munmap(base_, WINDOW_SIZE);
+        throw ErrorFactory::generate_exception(__func__, __LINE__, "Too many fastmem windows");
+    }
+
+    Fastmem::~Fastmem() {
+        for (auto& slot : fastmem_windows) {
+            Fastmem* expected = this;
+            slot.compare_exchange_strong(expected, nullptr);
+        }
+        munmap(base_, WINDOW_SIZE);
+    }
+
+    void Fastmem::install_handler() {
+        struct sigaction action {};
+        action.sa_sigaction = segv_handler;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous_action);
+    }
+
+    bool Fastmem::HandleFault(void* fault_addr, void* context) {
+        auto* uc = static_cast<ucontext_t*>(context);
+        auto& rip = uc->uc_mcontext.gregs[REG_RIP];
+        auto& rdx = uc->uc_mcontext.gregs[REG_RDX];
+        auto* addr = static_cast<uint8_t*>(fault_addr);
+        for (auto& slot : fastmem_windows) {
+            Fastmem* fastmem = slot.load(std::memory_order_acquire);
+            if (!fastmem || addr < fastmem->base_ || addr >= fastmem->base_ + WINDOW_SIZE)
+                continue;
+            if (!is_access_site(rip))
+                return false;
+            uint32_t paddr = addr - fastmem->base_;
+            uint8_t* ptr = fastmem->bus_.redirect_paddress_slow(paddr);
+            if (!ptr) {
+                // Can't throw from here, let the caller throw once the access completes
+                fastmem->bus_.bad_paddr_ = paddr;
+                fastmem->bus_.bad_access_ = true;
+                ptr = fastmem->bad_access_sink_;
+            }
+            ++fastmem->fault_count_;
+            rdx = reinterpret_cast<greg_t>(ptr);
+            return true;
+        }
+        return false;
+    }
+}
\ No newline at end of file
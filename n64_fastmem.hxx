@@ -0,0 +1,77 @@
+#pragma once
+#ifndef TKP_N64_FASTMEM_H
+#define TKP_N64_FASTMEM_H
+#include <cstddef>
+#include <cstdint>
+#include "n64_memory.hxx"
+
+namespace TKPEmu::N64::Devices {
+    class CPUBus;
+    /**
+        Virtual memory fastmem
+
+        Reserves 4 GB of host address space so that every 32-bit physical address is
+        a plain offset from Base(). Installed RDRAM, SP memory, cartridge ROM and the PIF page are
+        mapped at their physical addresses from the same memfd as the guest memory arena,
+        everything else (MMIO and unused space) is left inaccessible.
+
+        Accesses through fastmem_read/fastmem_write that land on an inaccessible page
+        raise SIGSEGV. The handler recognizes the faulting instruction as one of the
+        registered access sites, resolves the address through the slow path and points
+        the address register at the result, so the access is retried against the MMIO
+        register. An interpreter has no generated code to patch, so every MMIO access
+        in this mode pays for a signal.
+
+        @see https://wheremyfoodat.github.io/software-fastmem/
+    */
+    class Fastmem {
+    public:
+        Fastmem(const GuestMemory& memory, CPUBus& bus);
+        ~Fastmem();
+        Fastmem(const Fastmem&) = delete;
+        Fastmem& operator=(const Fastmem&) = delete;
+        uint8_t* Base() const { return base_; }
+        // Number of accesses that faulted and went through the slow path
+        uint64_t FaultCount() const { return fault_count_; }
+        // Called from the SIGSEGV handler, returns false if the fault isn't ours
+        static bool HandleFault(void* fault_addr, void* context);
+        constexpr static size_t WINDOW_SIZE = 0x1'0000'0000;
+    private:
+        static void install_handler();
+
+        uint8_t* base_ = nullptr;
+        CPUBus& bus_;
+        uint64_t fault_count_ = 0;
+        // Some accesses need a destination even if the address is bad
+        alignas(8) uint8_t bad_access_sink_[8] {};
+    };
+
+    // Fastmem accessors. The address must be in rdx so the fault handler
+    // knows which register to redirect.
+    #define FASTMEM_SITE(insn) \
+        "1: " insn "\n" \
+        ".pushsection n64_fastmem_sites, \"aw\"\n" \
+        ".balign 8\n" \
+        ".quad 1b\n" \
+        ".popsection\n"
+    template <typename T>
+    __always_inline T fastmem_read(uint8_t* ptr) {
+        T value;
+        if constexpr (sizeof(T) == 1) {
+            asm volatile(FASTMEM_SITE("movb (%[ptr]), %[value]") : [value] "=q"(value), [ptr] "+d"(ptr) : : "memory");
+        } else {
+            asm volatile(FASTMEM_SITE("mov (%[ptr]), %[value]") : [value] "=r"(value), [ptr] "+d"(ptr) : : "memory");
+        }
+        return value;
+    }
+    template <typename T>
+    __always_inline void fastmem_write(uint8_t* ptr, T value) {
+        if constexpr (sizeof(T) == 1) {
+            asm volatile(FASTMEM_SITE("movb %[value], (%[ptr])") : [ptr] "+d"(ptr) : [value] "q"(value) : "memory");
+        } else {
+            asm volatile(FASTMEM_SITE("mov %[value], (%[ptr])") : [ptr] "+d"(ptr) : [value] "r"(value) : "memory");
+        }
+    }
+    #undef FASTMEM_SITE
+}
+#endif
\ No newline at end of file
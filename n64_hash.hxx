@@ -0,0 +1,61 @@
+#pragma once
+#ifndef TKP_N64_HASH_H
+#define TKP_N64_HASH_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace TKPEmu::N64 {
+    /**
+        Fast non-cryptographic 64-bit hash for identifying blocks of guest data
+        (boot ROMs, microcode). Multiply-fold mixing in the style of wyhash, one 8 byte
+        word per step. CRC32 is only here for matching against known checksums.
+    */
+    namespace Hash {
+        constexpr uint64_t P0 = 0xA076'1D64'78BD'642Full;
+        constexpr uint64_t P1 = 0xE703'7ED1'A0B4'28DBull;
+
+        inline uint64_t mix(uint64_t a, uint64_t b) {
+            __uint128_t r = static_cast<__uint128_t>(a) * b;
+            return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+        }
+
+        inline uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0) {
+            auto* bytes = static_cast<const uint8_t*>(data);
+            uint64_t h = seed ^ mix(seed ^ P0, size ^ P1);
+            size_t i = 0;
+            for (; i + 8 <= size; i += 8) {
+                uint64_t word;
+                std::memcpy(&word, bytes + i, 8);
+                h = mix(h ^ word ^ P0, P1);
+            }
+            uint64_t tail = 0;
+            std::memcpy(&tail, bytes + i, size - i);
+            return mix(h ^ tail ^ P1, P0 ^ size);
+        }
+
+        constexpr std::array<uint32_t, 256> CRC32Table = [] {
+            std::array<uint32_t, 256> table {};
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int j = 0; j < 8; j++) {
+                    c = (c & 1) ? (0xEDB8'8320 ^ (c >> 1)) : (c >> 1);
+                }
+                table[i] = c;
+            }
+            return table;
+        }();
+
+        // Standard (zlib) CRC32, what ROM tools use to identify boot code
+        inline uint32_t CRC32(const void* data, size_t size) {
+            auto* bytes = static_cast<const uint8_t*>(data);
+            uint32_t crc = 0xFFFF'FFFF;
+            for (size_t i = 0; i < size; i++) {
+                crc = CRC32Table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+    }
+}
+#endif
\ No newline at end of file
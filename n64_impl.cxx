@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include "n64_impl.hxx"
 
@@ -20,8 +21,72 @@ namespace TKPEmu::N64 {
         return false;
     }
     
+    void N64::SetFastmem(bool enabled) {
+        cpu_.cpubus_.SetFastmem(enabled);
+    }
+
+    void N64::SetExpansionPak(bool enabled) {
+        cpu_.cpubus_.SetExpansionPak(enabled);
+    }
+
+    void N64::SetHLEBoot(bool enabled) {
+        cpu_.cpubus_.SetHLEBoot(enabled);
+    }
+
+    void N64::SetRDPThreads(int count) {
+        rcp_.rdp_.SetWorkerCount(std::max(count, 1));
+    }
+
+    void N64::SetRDPAsync(bool enabled) {
+        rcp_.rdp_.SetAsync(enabled);
+    }
+
+    void N64::SetHLEAudio(bool enabled) {
+        rcp_.rsp_.SetHLEAudio(enabled);
+    }
+
+    void N64::SetIdleLoopSkip(bool enabled) {
+        cpu_.idle_skip_ = enabled;
+    }
+
+    void N64::SetMemoryLoopHLE(bool enabled) {
+        cpu_.memory_hle_ = enabled;
+    }
+
+    void N64::SetAudioOutput(const std::string& spec) {
+        rcp_.ai_.SetSink(Devices::MakeAudioSink(spec));
+    }
+
+    void N64::SetSaves(Devices::SaveType type, const std::string& path) {
+        cpu_.cpubus_.SetSaves(type, path);
+    }
+
+    void N64::SetControllerState(int port, const Devices::ControllerState& state) {
+        cpu_.cpubus_.SetControllerState(port, state);
+    }
+
+    Devices::Input& N64::GetInput() {
+        return cpu_.cpubus_.GetInput();
+    }
+
+    void N64::PlayMovie(const std::string& path) {
+        cpu_.cpubus_.PlayMovie(path);
+    }
+
+    void N64::RecordMovie(const std::string& path) {
+        cpu_.cpubus_.RecordMovie(path);
+    }
+
+    void N64::SetInterpreter(Devices::InterpreterMode mode) {
+        cpu_.interpreter_ = mode;
+    }
+
     void N64::Update() {
-        cpu_.update_pipeline();
+        if (cpu_.direct_) [[likely]] {
+            cpu_.step();
+        } else {
+            cpu_.update_pipeline();
+        }
     }
     
     void N64::Reset() {
@@ -20,7 +20,40 @@ namespace TKPEmu::N64 {
         N64();
         bool LoadCartridge(std::string path);
         bool LoadIPL(std::string path);
+        void SetFastmem(bool enabled);
+        void SetExpansionPak(bool enabled);
+        void SetHLEBoot(bool enabled);
+        void SetRDPThreads(int count);
+        void SetRDPAsync(bool enabled);
+        void SetHLEAudio(bool enabled);
+        // Fast forward through loops waiting for an event, see Devices::CPU::check_idle_loop
+        void SetIdleLoopSkip(bool enabled);
+        // CPU cycles fast forwarded through idle loops since power on
+        uint64_t IdleCyclesSkipped() const { return cpu_.idle_skipped_cycles_; }
+        // Copy and fill guest memory natively in loops that do only that, see Devices::CPU::check_memory_loop
+        void SetMemoryLoopHLE(bool enabled);
+        // Bytes memory loops have copied or filled natively since power on
+        uint64_t MemoryLoopBytes() const { return cpu_.memory_loop_bytes_; }
+        // Direct execution or the latch pipeline, which is slower and only there to check
+        // accuracy against. Takes effect on the next Reset
+        void SetInterpreter(Devices::InterpreterMode mode);
+        // Where audio is streamed to, see Devices::MakeAudioSink
+        void SetAudioOutput(const std::string& spec);
+        // See Devices::CPUBus::SetSaves
+        void SetSaves(Devices::SaveType type, const std::string& path);
+        void SetControllerState(int port, const Devices::ControllerState& state);
+        // Scripted input for bots, see Devices::Input
+        Devices::Input& GetInput();
+        void PlayMovie(const std::string& path);
+        void RecordMovie(const std::string& path);
         void Update();
+        // Whether the VI finished a field since the last call
+        bool TakeField() {
+            if (!rcp_.vi_.field_done_) [[likely]]
+                return false;
+            rcp_.vi_.field_done_ = false;
+            return true;
+        }
         void Reset();
         void* GetColorData() {
             return rcp_.framebuffer_ptr_;
@@ -31,6 +64,7 @@ namespace TKPEmu::N64 {
         Devices::CPU cpu_;
 		friend class TKPEmu::N64::N64_TKPWrapper;
         friend class TKPEmu::Applications::N64_RomDisassembly;
+        friend class TKPEmu::N64::QA;
     };
 }
 #endif
\ No newline at end of file
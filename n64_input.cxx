@@ -0,0 +1,169 @@
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include "n64_input.hxx"
+#include "../include/error_factory.hxx"
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        constexpr char M64_SIGNATURE[4] = { 'M', '6', '4', 0x1A };
+        constexpr uint32_t M64_VERSION = 3;
+        constexpr uint16_t M64_START_POWER_ON = 2;
+        // Older versions had a shorter header
+        constexpr size_t M64_HEADER_SIZE = 0x400;
+        constexpr size_t M64_OLD_HEADER_SIZE = 0x200;
+        constexpr size_t M64_UID = 0x008;
+        constexpr size_t M64_VI_FRAMES = 0x00C;
+        constexpr size_t M64_FPS = 0x014;
+        constexpr size_t M64_CONTROLLERS = 0x015;
+        constexpr size_t M64_SAMPLES = 0x018;
+        constexpr size_t M64_START_TYPE = 0x01C;
+        constexpr size_t M64_CONTROLLER_FLAGS = 0x020;
+    }
+
+    Input::~Input() {
+        StopRecording();
+    }
+
+    uint32_t Input::pack(const ControllerState& state) {
+        // The bytes of a status reply, in the order a movie sample has them on a little endian host
+        return (state.buttons >> 8) | ((state.buttons & 0xFF) << 8) |
+            (static_cast<uint8_t>(state.x) << 16) | (static_cast<uint32_t>(static_cast<uint8_t>(state.y)) << 24);
+    }
+
+    ControllerState Input::unpack(uint32_t sample) {
+        ControllerState state;
+        state.buttons = ((sample & 0xFF) << 8) | ((sample >> 8) & 0xFF);
+        state.x = static_cast<int8_t>(sample >> 16);
+        state.y = static_cast<int8_t>(sample >> 24);
+        return state;
+    }
+
+    void Input::SetLive(int port, const ControllerState& state) {
+        live_[port].store(pack(state), std::memory_order_release);
+    }
+
+    bool Input::Push(const InputFrame& frame) {
+        InputFrame copy = frame;
+        if (!queue_.TryPush(std::move(copy)))
+            return false;
+        pushed_.fetch_add(1, std::memory_order_release);
+        pushed_.notify_one();
+        return true;
+    }
+
+    void Input::EndQueue() {
+        queue_ended_.store(true, std::memory_order_release);
+        pushed_.fetch_add(1, std::memory_order_release);
+        pushed_.notify_one();
+    }
+
+    uint8_t Input::PlayMovie(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open input movie: " + path);
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.size() < M64_OLD_HEADER_SIZE || std::memcmp(data.data(), M64_SIGNATURE, 4) != 0) {
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Not an .m64 movie: " + path);
+        }
+        uint32_t version;
+        uint16_t start_type;
+        uint32_t flags;
+        std::memcpy(&version, &data[4], 4);
+        std::memcpy(&start_type, &data[M64_START_TYPE], 2);
+        std::memcpy(&flags, &data[M64_CONTROLLER_FLAGS], 4);
+        if (start_type != M64_START_POWER_ON) {
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Input movie doesn't start from power on: " + path);
+        }
+        size_t header_size = version >= M64_VERSION ? M64_HEADER_SIZE : M64_OLD_HEADER_SIZE;
+        uint8_t ports = flags & 0xF;
+        int port_count = __builtin_popcount(ports);
+        if (port_count == 0 || data.size() < header_size) {
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Input movie has no controllers: " + path);
+        }
+        // A movie cut short in the middle of a poll loses the incomplete one
+        size_t frames = (data.size() - header_size) / (4 * port_count);
+        movie_.resize(frames * port_count);
+        std::memcpy(movie_.data(), &data[header_size], movie_.size() * 4);
+        movie_position_ = 0;
+        movie_ports_ = ports;
+        return ports;
+    }
+
+    void Input::Record(const std::string& path, uint8_t ports) {
+        StopRecording();
+        recording_ = std::fopen(path.c_str(), "wb");
+        if (!recording_) {
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not open input movie for recording: " + path);
+        }
+        recording_ports_ = ports & 0xF;
+        recorded_frames_ = 0;
+        write_movie_header();
+    }
+
+    void Input::StopRecording() {
+        if (!recording_)
+            return;
+        // The counts are only known now
+        std::fseek(recording_, 0, SEEK_SET);
+        write_movie_header();
+        std::fclose(recording_);
+        recording_ = nullptr;
+    }
+
+    void Input::write_movie_header() {
+        std::array<uint8_t, M64_HEADER_SIZE> header {};
+        auto put = [&header](size_t offset, uint32_t value, size_t size) {
+            std::memcpy(&header[offset], &value, size);
+        };
+        int port_count = __builtin_popcount(recording_ports_);
+        std::memcpy(header.data(), M64_SIGNATURE, 4);
+        put(4, M64_VERSION, 4);
+        put(M64_UID, std::time(nullptr), 4);
+        // Polls stand in for VIs, games poll once per frame
+        put(M64_VI_FRAMES, recorded_frames_, 4);
+        put(M64_FPS, 60, 1);
+        put(M64_CONTROLLERS, port_count, 1);
+        put(M64_SAMPLES, recorded_frames_ * port_count, 4);
+        put(M64_START_TYPE, M64_START_POWER_ON, 2);
+        put(M64_CONTROLLER_FLAGS, recording_ports_, 4);
+        std::fwrite(header.data(), header.size(), 1, recording_);
+    }
+
+    void Input::Poll(InputFrame& states) {
+        ++polls_;
+        for (int port = 0; port < CONTROLLER_PORTS; port++) {
+            states[port] = unpack(live_[port].load(std::memory_order_acquire));
+        }
+        if (PlayingMovie()) {
+            for (int port = 0; port < CONTROLLER_PORTS; port++) {
+                if (movie_ports_ & (1 << port))
+                    states[port] = unpack(movie_[movie_position_++]);
+            }
+        } else {
+            InputFrame frame;
+            bool popped = queue_.TryPop(frame);
+            while (!popped && lockstep_.load(std::memory_order_acquire)) {
+                // Read before trying again so a push in between wakes the wait right away
+                uint64_t pushed = pushed_.load(std::memory_order_acquire);
+                popped = queue_.TryPop(frame);
+                if (popped || queue_ended_.load(std::memory_order_acquire))
+                    break;
+                pushed_.wait(pushed, std::memory_order_acquire);
+            }
+            if (popped)
+                states = frame;
+        }
+        if (recording_) {
+            for (int port = 0; port < CONTROLLER_PORTS; port++) {
+                if (recording_ports_ & (1 << port)) {
+                    uint32_t sample = pack(states[port]);
+                    std::fwrite(&sample, 4, 1, recording_);
+                }
+            }
+            ++recorded_frames_;
+        }
+    }
+}
\ No newline at end of file
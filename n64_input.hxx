@@ -0,0 +1,104 @@
+#pragma once
+#ifndef TKP_N64_INPUT_H
+#define TKP_N64_INPUT_H
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "n64_spsc.hxx"
+
+namespace TKPEmu::N64::Devices {
+    // Controller buttons, as the bits of the first two bytes of a status read
+    enum ControllerButton : uint16_t {
+        BUTTON_A       = 1 << 15,
+        BUTTON_B       = 1 << 14,
+        BUTTON_Z       = 1 << 13,
+        BUTTON_START   = 1 << 12,
+        BUTTON_D_UP    = 1 << 11,
+        BUTTON_D_DOWN  = 1 << 10,
+        BUTTON_D_LEFT  = 1 << 9,
+        BUTTON_D_RIGHT = 1 << 8,
+        BUTTON_L       = 1 << 5,
+        BUTTON_R       = 1 << 4,
+        BUTTON_C_UP    = 1 << 3,
+        BUTTON_C_DOWN  = 1 << 2,
+        BUTTON_C_LEFT  = 1 << 1,
+        BUTTON_C_RIGHT = 1 << 0,
+    };
+    struct ControllerState {
+        uint16_t buttons = 0;
+        int8_t x = 0;
+        int8_t y = 0;
+    };
+    constexpr int CONTROLLER_PORTS = 4;
+    // What every port reads in one poll
+    using InputFrame = std::array<ControllerState, CONTROLLER_PORTS>;
+    /**
+        Where the controller states the game reads come from
+
+        A frame of input is consumed each time the game polls the controllers, that is
+        each PIF command block that reads at least one of them, never on a wall clock.
+        A run fed the same frames polls the same way, so it plays out the same every time.
+        For each poll, in order of priority:
+        - a movie being played supplies the ports it has samples for
+        - a frame pushed from another thread, for bots driving the emulator in process.
+          In lockstep the poll waits for one, so how fast the producer runs doesn't matter
+        - the live state, set from keys or directly
+        Whatever the game ended up reading can be recorded to a movie and played back.
+
+        Movies use the .m64 format of Mupen64, whose samples are the bytes of a
+        controller's status reply. Only movies starting from power on are supported.
+
+        @see https://tasvideos.org/EmulatorResources/Mupen/M64
+    */
+    class Input {
+    public:
+        Input() = default;
+        ~Input();
+        Input(const Input&) = delete;
+        Input& operator=(const Input&) = delete;
+        // Safe to call from any thread, it's picked up by the next poll
+        void SetLive(int port, const ControllerState& state);
+        /**
+            Queues the frame for the next poll without one, returns false if the queue is full.
+            Only a single thread may push.
+        */
+        bool Push(const InputFrame& frame);
+        // Makes polls wait for a pushed frame when there's none, until EndQueue is called
+        void SetLockstep(bool enabled) { lockstep_.store(enabled, std::memory_order_release); }
+        // Lets polls waiting in lockstep go on with the live state, the producer is done
+        void EndQueue();
+        // Loads a movie to play from the next poll on, returns a mask of the ports it has samples for
+        uint8_t PlayMovie(const std::string& path);
+        bool PlayingMovie() const { return movie_position_ < movie_.size(); }
+        // Records every poll of the ports in the mask to path, until StopRecording or destruction
+        void Record(const std::string& path, uint8_t ports);
+        void StopRecording();
+        // Called by the PIF when the game polls, fills states with this poll's input
+        void Poll(InputFrame& states);
+        uint64_t Polls() const { return polls_; }
+        constexpr static size_t QUEUE_SIZE = 1024;
+    private:
+        static uint32_t pack(const ControllerState& state);
+        static ControllerState unpack(uint32_t sample);
+        void write_movie_header();
+
+        std::array<std::atomic<uint32_t>, CONTROLLER_PORTS> live_ {};
+        SPSCQueue<InputFrame, QUEUE_SIZE> queue_;
+        // Bumped on every push and by EndQueue, polls waiting in lockstep sleep on it
+        std::atomic<uint64_t> pushed_ = 0;
+        std::atomic<bool> lockstep_ = false;
+        std::atomic<bool> queue_ended_ = false;
+        // Samples of the movie in play, one per movie port and poll
+        std::vector<uint32_t> movie_;
+        size_t movie_position_ = 0;
+        uint8_t movie_ports_ = 0;
+        std::FILE* recording_ = nullptr;
+        uint8_t recording_ports_ = 0;
+        uint32_t recorded_frames_ = 0;
+        uint64_t polls_ = 0;
+    };
+}
+#endif
\ No newline at end of file
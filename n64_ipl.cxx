@@ -0,0 +1,74 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include "n64_ipl.hxx"
+#include "n64_hash.hxx"
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        struct PathEntry {
+            // Reloaded if the file changed on disk
+            struct timespec mtime;
+            off_t size;
+            std::shared_ptr<const IPLImage> image;
+        };
+        std::mutex registry_mutex;
+        std::unordered_map<std::string, PathEntry> images_by_path;
+        // Weak so an image replaced under its path goes away with its last instance
+        std::unordered_map<uint64_t, std::weak_ptr<const IPLImage>> images_by_hash;
+    }
+
+    IPLImage::IPLImage(std::vector<uint8_t> data, uint64_t hash) :
+        data_(std::move(data)),
+        hash_(hash)
+    {
+    }
+
+    std::shared_ptr<const IPLImage> IPLRegistry::Load(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lguard(registry_mutex);
+        auto it = images_by_path.find(path);
+        if (it != images_by_path.end() && it->second.size == st.st_size &&
+                it->second.mtime.tv_sec == st.st_mtim.tv_sec && it->second.mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            close(fd);
+            return it->second.image;
+        }
+        // Copied instead of mapped: a mapping would fault with SIGBUS once the file is
+        // truncated, and show new bytes under the old hash if it's rewritten in place
+        std::vector<uint8_t> data(st.st_size);
+        size_t read = 0;
+        while (read < data.size()) {
+            ssize_t ret = pread(fd, data.data() + read, data.size() - read, read);
+            if (ret <= 0) {
+                close(fd);
+                return nullptr;
+            }
+            read += ret;
+        }
+        close(fd);
+        uint64_t hash = Hash::Hash64(data.data(), data.size());
+        auto image = images_by_hash[hash].lock();
+        if (!image || image->Data().size() != data.size() ||
+                std::memcmp(image->Data().data(), data.data(), data.size()) != 0) {
+            image = std::make_shared<const IPLImage>(std::move(data), hash);
+            images_by_hash[hash] = image;
+        }
+        images_by_path[path] = { st.st_mtim, st.st_size, image };
+        // Drops the hashes of images nothing holds anymore, like the one this path had before
+        std::erase_if(images_by_hash, [](const auto& entry) {
+            return entry.second.expired();
+        });
+        return image;
+    }
+}
\ No newline at end of file
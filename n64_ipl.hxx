@@ -0,0 +1,39 @@
+#pragma once
+#ifndef TKP_N64_IPL_H
+#define TKP_N64_IPL_H
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace TKPEmu::N64::Devices {
+    /**
+        Read-only boot ROM image, read from its file once
+    */
+    class IPLImage {
+    public:
+        IPLImage(std::vector<uint8_t> data, uint64_t hash);
+        IPLImage(const IPLImage&) = delete;
+        IPLImage& operator=(const IPLImage&) = delete;
+        std::span<const uint8_t> Data() const { return data_; }
+        uint64_t Hash() const { return hash_; }
+    private:
+        std::vector<uint8_t> data_;
+        uint64_t hash_;
+    };
+    /**
+        Process-wide boot ROM registry
+
+        Each distinct IPL is loaded once and shared between every instance that asks
+        for it. Images are looked up by path first and by content hash second, so the
+        same IPL under two names is still only kept once, while instances asking for
+        different IPLs (NTSC and PAL) each get their own.
+    */
+    class IPLRegistry {
+    public:
+        // Returns nullptr if the file can't be opened or is empty
+        static std::shared_ptr<const IPLImage> Load(const std::string& path);
+    };
+}
+#endif
\ No newline at end of file
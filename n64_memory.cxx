@@ -0,0 +1,140 @@
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <utility>
+#include "n64_memory.hxx"
+#include "../include/error_factory.hxx"
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        constexpr size_t align_up(size_t value, size_t alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    GuestMemory::GuestMemory(bool shareable) {
+        // Lay the regions out on huge page boundaries, leaving at least one guard page
+        // after each one. The gaps are only reserved, never committed.
+        size_t offset = 0;
+        size_t file_offset = 0;
+        for (size_t i = 0; i < offsets_.size(); i++) {
+            offsets_[i] = offset;
+            offset = align_up(offset + align_up(GuestRegionSizes[i], HUGE_PAGE_SIZE) + GUARD_SIZE, HUGE_PAGE_SIZE);
+            file_offsets_[i] = file_offset;
+            file_offset += align_up(GuestRegionSizes[i], PAGE_SIZE);
+        }
+        if (shareable) {
+            fd_ = memfd_create("n64_guest_memory", MFD_CLOEXEC);
+            if (fd_ == -1 || ftruncate(fd_, file_offset) == -1) {
+                release();
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not create shareable guest memory");
+            }
+        }
+        // Over-reserve by one huge page so the base itself can be aligned
+        reserved_ = offset + HUGE_PAGE_SIZE;
+        void* reservation = mmap(nullptr, reserved_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reservation == MAP_FAILED) {
+            reserved_ = 0;
+            release();
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not reserve guest memory");
+        }
+        base_ = static_cast<uint8_t*>(reservation);
+        uint8_t* aligned = reinterpret_cast<uint8_t*>(align_up(reinterpret_cast<uintptr_t>(base_), HUGE_PAGE_SIZE));
+        for (size_t i = 0; i < offsets_.size(); i++) {
+            offsets_[i] += aligned - base_;
+        }
+        try {
+            for (size_t i = 0; i < offsets_.size(); i++) {
+                map_region(static_cast<GuestRegion>(i));
+            }
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    GuestMemory::~GuestMemory() {
+        release();
+    }
+
+    GuestMemory::GuestMemory(GuestMemory&& other) noexcept :
+        base_(std::exchange(other.base_, nullptr)),
+        reserved_(std::exchange(other.reserved_, 0)),
+        fd_(std::exchange(other.fd_, -1)),
+        offsets_(other.offsets_),
+        file_offsets_(other.file_offsets_)
+    {
+    }
+
+    GuestMemory& GuestMemory::operator=(GuestMemory&& other) noexcept {
+        if (this != &other) {
+            release();
+            base_ = std::exchange(other.base_, nullptr);
+            reserved_ = std::exchange(other.reserved_, 0);
+            fd_ = std::exchange(other.fd_, -1);
+            offsets_ = other.offsets_;
+            file_offsets_ = other.file_offsets_;
+        }
+        return *this;
+    }
+
+    void GuestMemory::map_region(GuestRegion region) {
+        auto i = static_cast<size_t>(region);
+        uint8_t* start = base_ + offsets_[i];
+        size_t size = align_up(GuestRegionSizes[i], PAGE_SIZE);
+        if (fd_ != -1) {
+            // Shared file pages can only use transparent huge pages, and only if
+            // the administrator enabled them for shmem
+            if (mmap(start, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd_, file_offsets_[i]) == MAP_FAILED) {
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not map guest memory region");
+            }
+        } else {
+            constexpr int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+            if (size >= HUGE_PAGE_SIZE) {
+                // Explicit huge pages only work if the administrator reserved some,
+                // so failing here is expected and not an error. The mapping must not be
+                // MAP_NORESERVE, otherwise an empty pool shows up as SIGBUS on first touch.
+                size_t huge_size = align_up(size, HUGE_PAGE_SIZE);
+                if (mmap(start, huge_size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0) != MAP_FAILED) {
+                    return;
+                }
+            }
+            if (mmap(start, size, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, -1, 0) == MAP_FAILED) {
+                throw ErrorFactory::generate_exception(__func__, __LINE__, "Could not map guest memory region");
+            }
+        }
+        if (size >= HUGE_PAGE_SIZE) {
+            madvise(start, size, MADV_HUGEPAGE);
+        }
+    }
+
+    void GuestMemory::Discard(GuestRegion region) {
+        auto i = static_cast<size_t>(region);
+        if (fd_ != -1) {
+            // Punching a hole frees the file pages, every mapping of them (including
+            // the fastmem window) reads zeroes afterwards
+            size_t size = align_up(GuestRegionSizes[i], PAGE_SIZE);
+            if (fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, file_offsets_[i], size) == 0) {
+                return;
+            }
+            auto memory = Get(region);
+            std::fill(memory.begin(), memory.end(), 0);
+        } else {
+            // Fresh anonymous pages mapped over the region, the old ones are freed with them
+            map_region(region);
+        }
+    }
+
+    void GuestMemory::release() {
+        if (base_) {
+            munmap(base_, reserved_);
+            base_ = nullptr;
+            reserved_ = 0;
+        }
+        if (fd_ != -1) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef TKP_N64_MEMORY_H
+#define TKP_N64_MEMORY_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace TKPEmu::N64::Devices {
+    enum class GuestRegion {
+        CartRom,
+        Rdram,
+        RdpCmem,
+        SpMem,
+        Pif,
+        PageTable,
+        Count
+    };
+    constexpr std::array<size_t, static_cast<size_t>(GuestRegion::Count)> GuestRegionSizes = {
+        0xFC00000,                // CartRom
+        0x800000,                 // Rdram (expansion pak sized)
+        0x100000,                 // RdpCmem
+        0x2000,                   // SpMem (DMEM followed by IMEM)
+        0x800,                    // Pif (IPL followed by PIF RAM)
+        0x1000 * sizeof(uint8_t*) // PageTable
+    };
+    /**
+        Guest memory arena
+
+        Every guest region lives in one virtual reservation. Each region starts on a
+        2 MB boundary so it can be backed by huge pages, and regions are separated by
+        inaccessible guard pages so an access that runs off the end of one faults
+        instead of corrupting its neighbour. Regions that cover whole huge pages try
+        explicit (hugetlbfs) pages first and fall back to transparent huge pages.
+
+        The arena owns the memory, so whatever holds it stays small and movable.
+        A shareable arena is backed by a memfd instead of anonymous memory, so the
+        same pages can also be mapped elsewhere (see Fastmem).
+    */
+    class GuestMemory {
+    public:
+        explicit GuestMemory(bool shareable = false);
+        ~GuestMemory();
+        GuestMemory(GuestMemory&& other) noexcept;
+        GuestMemory& operator=(GuestMemory&& other) noexcept;
+        GuestMemory(const GuestMemory&) = delete;
+        GuestMemory& operator=(const GuestMemory&) = delete;
+        std::span<uint8_t> Get(GuestRegion region) const {
+            auto i = static_cast<size_t>(region);
+            return { base_ + offsets_[i], GuestRegionSizes[i] };
+        }
+        // File descriptor of the backing memfd, or -1 if the arena isn't shareable
+        int Fd() const { return fd_; }
+        size_t FileOffset(GuestRegion region) const {
+            return file_offsets_[static_cast<size_t>(region)];
+        }
+        // Drops every page of a region, it reads as zero again and is only committed on first touch
+        void Discard(GuestRegion region);
+        constexpr static size_t HUGE_PAGE_SIZE = 0x200000;
+        constexpr static size_t PAGE_SIZE = 0x1000;
+        constexpr static size_t GUARD_SIZE = PAGE_SIZE;
+    private:
+        void map_region(GuestRegion region);
+        void release();
+
+        uint8_t* base_ = nullptr;
+        size_t reserved_ = 0;
+        int fd_ = -1;
+        std::array<size_t, static_cast<size_t>(GuestRegion::Count)> offsets_ {};
+        std::array<size_t, static_cast<size_t>(GuestRegion::Count)> file_offsets_ {};
+    };
+}
+#endif
\ No newline at end of file
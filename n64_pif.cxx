@@ -0,0 +1,226 @@
+#include <cstring>
+#include <vector>
+#include "n64_pif.hxx"
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        constexpr uint32_t EEPROM4K_SIZE = 0x200;
+        constexpr uint32_t EEPROM16K_SIZE = 0x800;
+
+        // CRC the controller sends after pak data, polynomial 0x85 run over one extra zero byte
+        uint8_t pak_crc(const uint8_t* data) {
+            uint8_t crc = 0;
+            for (int i = 0; i <= 32; i++) {
+                for (int bit = 7; bit >= 0; bit--) {
+                    uint8_t tap = (crc & 0x80) ? 0x85 : 0;
+                    crc <<= 1;
+                    if (i != 32 && (data[i] >> bit) & 1)
+                        crc |= 1;
+                    crc ^= tap;
+                }
+            }
+            return crc;
+        }
+
+        // A memory pak as formatted by libultra, with every page free
+        std::vector<uint8_t> blank_mempak() {
+            std::vector<uint8_t> pak(PIF::MEMPAK_SIZE, 0);
+            std::array<uint8_t, 32> id {
+                0xFF, 0xFF, 0xFF, 0xFF, 0x05, 0x1A, 0x5F, 0x13,
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                // Device id, bank count and version
+                0x00, 0x01, 0x01, 0x00,
+            };
+            // The id checksum and its inverse cover the first 14 big endian halfwords
+            uint16_t sum = 0;
+            for (int i = 0; i < 28; i += 2) {
+                sum += (id[i] << 8) | id[i + 1];
+            }
+            uint16_t inverse = 0xFFF2 - sum;
+            id[28] = sum >> 8;
+            id[29] = sum;
+            id[30] = inverse >> 8;
+            id[31] = inverse;
+            for (uint32_t offset : { 0x20, 0x60, 0x80, 0xC0 }) {
+                std::memcpy(&pak[offset], id.data(), id.size());
+            }
+            // The inode table and its backup, 0x0003 marks a free page. The first entry
+            // holds the sum of the bytes of the entries past the five system pages.
+            for (uint32_t table : { 0x100, 0x200 }) {
+                uint8_t checksum = 0;
+                for (int entry = 1; entry < 128; entry++) {
+                    pak[table + entry * 2 + 1] = 0x03;
+                    if (entry >= 5)
+                        checksum += 0x03;
+                }
+                pak[table + 1] = checksum;
+            }
+            return pak;
+        }
+    }
+
+    void PIF::Open(SaveType type, SaveWriter* writer, const std::string& path) {
+        eeprom_type_ = SaveType::None;
+        if (type == SaveType::EEPROM4K || type == SaveType::EEPROM16K) {
+            eeprom_type_ = type;
+            uint32_t size = type == SaveType::EEPROM4K ? EEPROM4K_SIZE : EEPROM16K_SIZE;
+            eeprom_.Open(writer, path.empty() ? path : path + ".eep", std::vector<uint8_t>(size, 0xFF));
+        } else {
+            eeprom_.Close();
+        }
+        for (int port = 0; port < CONTROLLER_COUNT; port++) {
+            std::string pak_path = path.empty() ? path : path + ".mpk" + std::to_string(port + 1);
+            mempaks_[port].Open(writer, pak_path, blank_mempak());
+        }
+    }
+
+    uint8_t PIF::Command(uint8_t command, std::span<uint8_t> ram) {
+        if (command & 0x01) {
+            run_joybus(ram);
+            command &= ~0x01;
+        }
+        // The CIC challenge is answered as done right away
+        if (command & 0x20) {
+            command |= 0x80;
+        }
+        if (command & 0x40) {
+            std::memset(ram.data(), 0, ram.size());
+            command = 0;
+        }
+        return command;
+    }
+
+    void PIF::run_joybus(std::span<uint8_t> ram) {
+        int channel = 0;
+        size_t i = 0;
+        polled_ = false;
+        while (i < 0x3F && channel < 6) {
+            uint8_t tx = ram[i];
+            if (tx == 0xFE)
+                break;
+            if (tx == 0x00) {
+                // Skips the channel
+                channel++;
+                i++;
+                continue;
+            }
+            if (tx & 0x80) {
+                // Padding
+                i++;
+                continue;
+            }
+            if (i + 1 >= 0x3F || ram[i + 1] == 0xFE)
+                break;
+            uint8_t& rx = ram[i + 1];
+            int send_length = tx & 0x3F;
+            int recv_length = rx & 0x3F;
+            if (i + 2 + send_length + recv_length > 0x3F)
+                break;
+            const uint8_t* send = &ram[i + 2];
+            uint8_t* recv = &ram[i + 2 + send_length];
+            bool answered = false;
+            if (channel < CONTROLLER_COUNT) {
+                answered = controller_command(channel, send, send_length, recv, recv_length);
+            } else if (channel == 4) {
+                answered = eeprom_command(send, send_length, recv, recv_length);
+            }
+            if (!answered) {
+                rx |= 0x80;
+            }
+            i += 2 + send_length + recv_length;
+            channel++;
+        }
+    }
+
+    bool PIF::controller_command(int port, const uint8_t* send, int tx, uint8_t* recv, int rx) {
+        if (!connected_[port] || tx < 1)
+            return false;
+        SaveData& pak = mempaks_[port];
+        switch (send[0]) {
+            case 0x00:
+            case 0xFF: {
+                // Standard controller, the last byte tells whether a pak is plugged in
+                if (rx >= 3) {
+                    recv[0] = 0x05;
+                    recv[1] = 0x00;
+                    recv[2] = pak.Empty() ? 0x02 : 0x01;
+                }
+                break;
+            }
+            case 0x01: {
+                if (rx >= 4) {
+                    if (!polled_) {
+                        input_.Poll(controllers_);
+                        polled_ = true;
+                    }
+                    const ControllerState& state = controllers_[port];
+                    recv[0] = state.buttons >> 8;
+                    recv[1] = state.buttons;
+                    recv[2] = state.x;
+                    recv[3] = state.y;
+                }
+                break;
+            }
+            case 0x02: {
+                if (tx < 3 || rx < 33)
+                    break;
+                // The low 5 bits of the address are its CRC
+                uint32_t address = ((send[1] << 8) | send[2]) & 0xFFE0;
+                if (!pak.Empty() && address < pak.Size()) {
+                    std::memcpy(recv, pak.Data() + address, 32);
+                } else {
+                    std::memset(recv, 0, 32);
+                }
+                recv[32] = pak_crc(recv);
+                break;
+            }
+            case 0x03: {
+                if (tx < 35 || rx < 1)
+                    break;
+                uint32_t address = ((send[1] << 8) | send[2]) & 0xFFE0;
+                if (!pak.Empty() && address < pak.Size()) {
+                    std::memcpy(pak.Data() + address, send + 3, 32);
+                    pak.Commit(address, 32);
+                }
+                recv[0] = pak_crc(send + 3);
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool PIF::eeprom_command(const uint8_t* send, int tx, uint8_t* recv, int rx) {
+        if (eeprom_type_ == SaveType::None || tx < 1)
+            return false;
+        switch (send[0]) {
+            case 0x00:
+            case 0xFF: {
+                if (rx >= 3) {
+                    recv[0] = 0x00;
+                    recv[1] = eeprom_type_ == SaveType::EEPROM4K ? 0x80 : 0xC0;
+                    recv[2] = 0x00;
+                }
+                break;
+            }
+            case 0x04: {
+                if (tx < 2 || rx < 8)
+                    break;
+                uint32_t offset = (send[1] * 8) & (eeprom_.Size() - 1);
+                std::memcpy(recv, eeprom_.Data() + offset, 8);
+                break;
+            }
+            case 0x05: {
+                if (tx < 10)
+                    break;
+                uint32_t offset = (send[1] * 8) & (eeprom_.Size() - 1);
+                std::memcpy(eeprom_.Data() + offset, send + 2, 8);
+                eeprom_.Commit(offset, 8);
+                if (rx >= 1)
+                    recv[0] = 0x00;
+                break;
+            }
+        }
+        return true;
+    }
+}
\ No newline at end of file
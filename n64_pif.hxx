@@ -0,0 +1,58 @@
+#pragma once
+#ifndef TKP_N64_PIF_H
+#define TKP_N64_PIF_H
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include "n64_input.hxx"
+#include "n64_save.hxx"
+
+namespace TKPEmu::N64::Devices {
+    /**
+        The PIF side of the joybus
+
+        The game fills PIF RAM with a command block and the PIF runs it: every entry holds
+        how many bytes to send and to receive followed by the bytes themselves, and goes to
+        the next channel. Channels 0 to 3 are the controller ports, each controller has a
+        memory pak plugged in. Channel 4 is the cartridge EEPROM when there is one.
+        A device that doesn't answer sets the top bit of the receive length.
+        What the controllers report is taken from input_ once per block that reads them.
+
+        @see https://n64brew.dev/wiki/PIF-NUS
+        @see https://n64brew.dev/wiki/Joybus_Protocol
+    */
+    class PIF {
+    public:
+        constexpr static int CONTROLLER_COUNT = CONTROLLER_PORTS;
+        constexpr static uint32_t MEMPAK_SIZE = 0x8000;
+        // Opens the EEPROM if type is one, and the memory paks, from files starting with path
+        void Open(SaveType type, SaveWriter* writer, const std::string& path);
+        void SetControllerConnected(int port, bool connected) { connected_[port] = connected; }
+        bool IsControllerConnected(int port) const { return connected_[port]; }
+        // What the port reported the last time it was read
+        const ControllerState& GetControllerState(int port) const { return controllers_[port]; }
+        Input& GetInput() { return input_; }
+        /**
+            Acts on a write of command to the last byte of PIF RAM and returns what it becomes.
+            Bit 0 runs the command block, bit 5 asks for the CIC challenge and bit 6 clears RAM.
+        */
+        uint8_t Command(uint8_t command, std::span<uint8_t> ram);
+    private:
+        void run_joybus(std::span<uint8_t> ram);
+        // Runs one command of tx bytes with room for rx bytes of reply, returns false if
+        // nothing answers on the channel
+        bool controller_command(int port, const uint8_t* send, int tx, uint8_t* recv, int rx);
+        bool eeprom_command(const uint8_t* send, int tx, uint8_t* recv, int rx);
+
+        Input input_;
+        InputFrame controllers_ {};
+        // Whether the command block being run already took a frame from input_
+        bool polled_ = false;
+        std::array<bool, CONTROLLER_COUNT> connected_ = { true, false, false, false };
+        std::array<SaveData, CONTROLLER_COUNT> mempaks_;
+        SaveType eeprom_type_ = SaveType::None;
+        SaveData eeprom_;
+    };
+}
+#endif
\ No newline at end of file
@@ -2,8 +2,10 @@
 
 namespace TKPEmu::N64::Devices {
     void RCP::Reset() {
-        // These default values are in little endian
-        rsp_status_ = 0x01000000;
-        rsp_dma_busy_ = 0;
+        rsp_.Reset();
+        rdp_.Reset();
+        ai_.Reset();
+        si_.Reset();
+        vi_.Reset();
     }
 }
\ No newline at end of file
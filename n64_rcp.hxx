@@ -3,12 +3,22 @@
 #define TKP_N64_RCP_H
 #include <array>
 #include <cstdint>
+#include "n64_rsp.hxx"
+#include "n64_rdp.hxx"
+#include "n64_ai.hxx"
+#include "n64_si.hxx"
+#include "n64_vi.hxx"
 
 namespace TKPEmu::N64 {
     class N64;
     namespace Devices {
         class CPUBus;
         class CPU;
+        class RSP;
+        class AudioHLE;
+        class AudioInterface;
+        class SerialInterface;
+        class VideoInterface;
     }
 }
 
@@ -18,31 +28,20 @@ namespace TKPEmu::N64::Devices {
         void Reset();
     private:
 		uint8_t* framebuffer_ptr_ = nullptr;
-        // RSP internal registers
-        uint32_t rsp_status_ = 0;
-        uint32_t rsp_dma_busy_ = 0;
-        uint32_t rsp_pc_ = 0;
-        // Video Interface
-        uint32_t vi_ctrl_ = 0;
-        uint32_t vi_origin_ = 0;
-        uint32_t vi_width_ = 0;
-        uint32_t vi_v_intr_ = 0;
-        uint32_t vi_v_current_ = 0;
-        uint32_t vi_burst_ = 0;
-        uint32_t vi_v_sync_ = 0;
-        uint32_t vi_h_sync_ = 0;
-        uint32_t vi_h_sync_leap_ = 0;
-        uint32_t vi_h_video_ = 0;
-        uint32_t vi_v_video_ = 0;
-        uint32_t vi_v_burst_ = 0;
-        uint32_t vi_x_scale_ = 0;
-        uint32_t vi_y_scale_ = 0;
-        uint32_t vi_test_addr_ = 0;
-        uint32_t vi_staged_data_ = 0;
+        RSP rsp_;
+        RDP rdp_;
+        AudioInterface ai_;
+        SerialInterface si_;
+        VideoInterface vi_;
         // Called from cpubus when a relevant register is changed
         friend class TKPEmu::N64::N64;
         friend class TKPEmu::N64::Devices::CPUBus;
         friend class TKPEmu::N64::Devices::CPU;
+        friend class TKPEmu::N64::Devices::RSP;
+        friend class TKPEmu::N64::Devices::AudioHLE;
+        friend class TKPEmu::N64::Devices::AudioInterface;
+        friend class TKPEmu::N64::Devices::SerialInterface;
+        friend class TKPEmu::N64::Devices::VideoInterface;
     };
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <cstring>
+#include "n64_rdp.hxx"
+#include "n64_cpu.hxx"
+
+namespace TKPEmu::N64::Devices {
+    RDP::RDP() {
+        SetWorkerCount(1);
+    }
+
+    RDP::~RDP() {
+        stop_render_thread();
+        SetWorkerCount(0);
+    }
+
+    void RDP::SetWorkerCount(int count) {
+        // The pool may be busy on the render thread
+        wait_for_job(submitted_);
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            quit_ = true;
+        }
+        pool_cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+        threads_.clear();
+        workers_.clear();
+        quit_ = false;
+        for (int i = 0; i < count; i++) {
+            workers_.push_back(std::make_unique<RDPWorker>(i, count));
+        }
+        // Worker 0 runs on whichever thread renders the batch
+        for (int i = 1; i < count; i++) {
+            threads_.emplace_back(&RDP::worker_loop, this, i, generation_);
+        }
+    }
+
+    void RDP::SetAsync(bool enabled) {
+        stop_render_thread();
+        async_ = enabled;
+        if (async_) {
+            render_quit_ = false;
+            render_thread_ = std::thread(&RDP::render_loop, this);
+        }
+    }
+
+    void RDP::stop_render_thread() {
+        if (!render_thread_.joinable())
+            return;
+        render_quit_.store(true, std::memory_order_release);
+        render_wake_.fetch_add(1, std::memory_order_release);
+        render_wake_.notify_one();
+        render_thread_.join();
+    }
+
+    void RDP::Reset() {
+        Sync();
+        batch_writes_.clear();
+        color_image_ = {};
+        z_image_ = 0;
+        scissor_yl_ = 0;
+        other_modes_ = 0;
+        start_ = end_ = current_ = 0;
+        status_ = __builtin_bswap32(DPC_STATUS_CBUF_READY);
+        clock_ = buf_busy_ = pipe_busy_ = tmem_busy_ = 0;
+        start_pending_ = false;
+        partial_.clear();
+        batch_.clear();
+        int count = workers_.size();
+        for (int i = 0; i < count; i++) {
+            workers_[i] = std::make_unique<RDPWorker>(i, count);
+        }
+    }
+
+    uint32_t RDP::WriteRegister(int reg, uint32_t data) {
+        switch (reg & 7) {
+            case 0: {
+                start_ = __builtin_bswap32(data & 0xFF'FFF8);
+                start_pending_ = true;
+                status_ |= __builtin_bswap32(DPC_STATUS_START_VALID);
+                return data & 0xFF'FFF8;
+            }
+            case 1: {
+                end_ = __builtin_bswap32(data & 0xFF'FFF8);
+                if (start_pending_) {
+                    // A new buffer, anything left over from the old one is dropped
+                    current_ = start_;
+                    start_pending_ = false;
+                    partial_.clear();
+                    status_ &= ~__builtin_bswap32(DPC_STATUS_START_VALID);
+                }
+                process_commands();
+                return data & 0xFF'FFF8;
+            }
+            case 3: {
+                uint32_t status = __builtin_bswap32(status_);
+                auto apply = [&status, data](int clear_bit, int set_bit, uint32_t flag) {
+                    if (data & (1 << clear_bit))
+                        status &= ~flag;
+                    if (data & (1 << set_bit))
+                        status |= flag;
+                };
+                apply(0, 1, DPC_STATUS_XBUS_DMEM_DMA);
+                apply(2, 3, DPC_STATUS_FREEZE);
+                apply(4, 5, DPC_STATUS_FLUSH);
+                if (data & (1 << 9))
+                    clock_ = 0;
+                bool was_frozen = __builtin_bswap32(status_) & DPC_STATUS_FREEZE;
+                status_ = __builtin_bswap32(status);
+                if (was_frozen && !(status & DPC_STATUS_FREEZE)) {
+                    process_commands();
+                }
+                return status;
+            }
+        }
+        // The rest are read only
+        return ReadRegister(reg);
+    }
+
+    uint32_t RDP::ReadRegister(int reg) const {
+        switch (reg & 7) {
+            case 0: return __builtin_bswap32(start_);
+            case 1: return __builtin_bswap32(end_);
+            case 2: return __builtin_bswap32(current_);
+            case 3: return __builtin_bswap32(status_);
+            case 4: return __builtin_bswap32(clock_);
+            case 5: return __builtin_bswap32(buf_busy_);
+            case 6: return __builtin_bswap32(pipe_busy_);
+        }
+        return __builtin_bswap32(tmem_busy_);
+    }
+
+    uint64_t RDP::read_command_word(uint32_t addr) const {
+        uint64_t word = 0;
+        if (__builtin_bswap32(status_) & DPC_STATUS_XBUS_DMEM_DMA) {
+            std::memcpy(&word, &bus_->rsp_dmem_[addr & 0xFF8], 8);
+        } else if (addr + 8 <= bus_->rdram_.size()) {
+            std::memcpy(&word, &bus_->rdram_[addr], 8);
+        }
+        return __builtin_bswap64(word);
+    }
+
+    void RDP::process_commands() {
+        if (__builtin_bswap32(status_) & DPC_STATUS_FREEZE)
+            return;
+        uint32_t current = __builtin_bswap32(current_);
+        uint32_t end = __builtin_bswap32(end_);
+        bool full_sync = false;
+        while (current < end) {
+            partial_.push_back(read_command_word(current));
+            current += 8;
+            uint64_t command = partial_[0] >> 56;
+            if (partial_.size() < static_cast<size_t>(rdp_command_length(command)))
+                continue;
+            track_command(partial_);
+            batch_.insert(batch_.end(), partial_.begin(), partial_.end());
+            partial_.clear();
+            switch (command & 0x3F) {
+                case 0x29:
+                    full_sync = true;
+                    [[fallthrough]];
+                case 0x3E:
+                case 0x3F:
+                    // Later commands may read what was rendered so far
+                    flush();
+                    break;
+            }
+        }
+        current_ = __builtin_bswap32(current);
+        flush();
+        if (full_sync) {
+            // Everything before a full sync has to be in memory before the interrupt
+            wait_for_job(submitted_);
+            pending_writes_.clear();
+            bus_->raise_interrupt(MIInterrupt::DP);
+        }
+    }
+
+    void RDP::track_command(const std::vector<uint64_t>& command) {
+        uint64_t word = command[0];
+        switch ((word >> 56) & 0x3F) {
+            case 0x08: case 0x09: case 0x0A: case 0x0B:
+            case 0x0C: case 0x0D: case 0x0E: case 0x0F:
+            case 0x24: case 0x25: case 0x36: {
+                for (const auto& range : rdp_draw_ranges(color_image_, z_image_, scissor_yl_, other_modes_)) {
+                    if (range.end > range.begin)
+                        note_write(range.begin, range.end);
+                }
+                break;
+            }
+            case 0x2D:
+                scissor_yl_ = word & 0xFFF;
+                break;
+            case 0x2F:
+                other_modes_ = word;
+                break;
+            case 0x3E:
+                z_image_ = word & 0x3FF'FFFF;
+                break;
+            case 0x3F:
+                color_image_.size = (word >> 51) & 3;
+                color_image_.width = ((word >> 32) & 0x3FF) + 1;
+                color_image_.address = word & 0x3FF'FFFF;
+                break;
+        }
+    }
+
+    void RDP::note_write(uint32_t begin, uint32_t end) {
+        if (!async_)
+            return;
+        for (auto& write : batch_writes_) {
+            if (write.begin == begin) {
+                write.end = std::max(write.end, end);
+                return;
+            }
+        }
+        batch_writes_.push_back({ begin, end, 0 });
+    }
+
+    void RDP::flush() {
+        if (batch_.empty())
+            return;
+        if (!async_) {
+            render(batch_);
+            batch_.clear();
+            return;
+        }
+        uint64_t job = ++submitted_;
+        for (auto& write : batch_writes_) {
+            write.job = job;
+            pending_writes_.push_back(write);
+        }
+        batch_writes_.clear();
+        while (!queue_.TryPush(std::move(batch_))) {
+            // Full, wait for the render thread to free a slot
+            wait_for_job(completed_.load(std::memory_order_acquire) + 1);
+        }
+        render_wake_.fetch_add(1, std::memory_order_release);
+        render_wake_.notify_one();
+        batch_ = {};
+    }
+
+    void RDP::SyncRange(uint32_t addr, uint32_t length) {
+        uint64_t completed = completed_.load(std::memory_order_acquire);
+        uint64_t wait = 0;
+        std::erase_if(pending_writes_, [&](const PendingWrite& write) {
+            if (write.job <= completed)
+                return true;
+            if (addr < write.end && addr + length > write.begin)
+                wait = std::max(wait, write.job);
+            return false;
+        });
+        if (wait) {
+            wait_for_job(wait);
+            std::erase_if(pending_writes_, [wait](const PendingWrite& write) { return write.job <= wait; });
+        }
+    }
+
+    void RDP::Sync() {
+        wait_for_job(submitted_);
+        pending_writes_.clear();
+    }
+
+    void RDP::wait_for_job(uint64_t job) {
+        uint64_t completed;
+        while ((completed = completed_.load(std::memory_order_acquire)) < job) {
+            completed_.wait(completed, std::memory_order_acquire);
+        }
+    }
+
+    void RDP::render_loop() {
+        std::vector<uint64_t> commands;
+        while (true) {
+            uint64_t wake = render_wake_.load(std::memory_order_acquire);
+            if (queue_.TryPop(commands)) {
+                render(commands);
+                completed_.fetch_add(1, std::memory_order_release);
+                completed_.notify_all();
+                continue;
+            }
+            if (render_quit_.load(std::memory_order_acquire))
+                return;
+            render_wake_.wait(wake, std::memory_order_acquire);
+        }
+    }
+
+    void RDP::render(std::span<const uint64_t> commands) {
+        if (threads_.empty()) {
+            workers_[0]->Execute(commands, bus_->rdram_, bus_->rdram_versions_);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            job_ = commands;
+            ++generation_;
+            running_ = threads_.size();
+        }
+        pool_cv_.notify_all();
+        workers_[0]->Execute(commands, bus_->rdram_, bus_->rdram_versions_);
+        std::unique_lock<std::mutex> lock(pool_mutex_);
+        done_cv_.wait(lock, [this] { return running_ == 0; });
+    }
+
+    void RDP::worker_loop(int index, uint64_t generation) {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(pool_mutex_);
+                pool_cv_.wait(lock, [this, generation] { return quit_ || generation_ != generation; });
+                if (quit_)
+                    return;
+                generation = generation_;
+            }
+            workers_[index]->Execute(job_, bus_->rdram_, bus_->rdram_versions_);
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex_);
+                if (--running_ == 0)
+                    done_cv_.notify_one();
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,330 @@
+#pragma once
+#ifndef TKP_N64_RDP_H
+#define TKP_N64_RDP_H
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "n64_spsc.hxx"
+
+namespace TKPEmu::N64::Devices {
+    class CPUBus;
+    // DPC_STATUS bits as read
+    constexpr uint32_t DPC_STATUS_XBUS_DMEM_DMA = 1 << 0;
+    constexpr uint32_t DPC_STATUS_FREEZE        = 1 << 1;
+    constexpr uint32_t DPC_STATUS_FLUSH         = 1 << 2;
+    constexpr uint32_t DPC_STATUS_CBUF_READY    = 1 << 7;
+    constexpr uint32_t DPC_STATUS_START_VALID   = 1 << 10;
+    // Length of a command in 64-bit words, triangles carry optional shade, texture and z coefficients
+    constexpr int rdp_command_length(uint64_t command) {
+        command &= 0x3F;
+        if (command >= 0x08 && command <= 0x0F)
+            return 4 + ((command & 4) ? 8 : 0) + ((command & 2) ? 8 : 0) + ((command & 1) ? 2 : 0);
+        if (command == 0x24 || command == 0x25)
+            return 2;
+        return 1;
+    }
+    struct RDPTile {
+        uint8_t format = 0;
+        uint8_t size = 0;
+        // Row stride and start in TMEM, in 64-bit words
+        uint16_t line = 0;
+        uint16_t tmem = 0;
+        uint8_t palette = 0;
+        bool clamp_t = false, mirror_t = false, clamp_s = false, mirror_s = false;
+        uint8_t mask_t = 0, shift_t = 0, mask_s = 0, shift_s = 0;
+        // 10.2 fixed point
+        uint16_t sl = 0, tl = 0, sh = 0, th = 0;
+    };
+    struct RDPImage {
+        uint8_t format = 0;
+        uint8_t size = 0;
+        uint16_t width = 0;
+        uint32_t address = 0;
+    };
+    struct RDRAMRange {
+        uint32_t begin = 0;
+        uint32_t end = 0;
+    };
+    // Where drawing can write: the color image down to the bottom of the scissor box and,
+    // when Z is updated, as many rows of the Z image. The second range is empty otherwise.
+    inline std::array<RDRAMRange, 2> rdp_draw_ranges(const RDPImage& color_image, uint32_t z_image, uint16_t scissor_yl, uint64_t other_modes) {
+        uint32_t rows = (scissor_yl + 3) >> 2;
+        uint32_t address = color_image.address & 0xFF'FFFF;
+        std::array<RDRAMRange, 2> ranges {};
+        ranges[0] = { address, address + ((rows * color_image.width << color_image.size) >> 1) };
+        bool z_update = (other_modes >> 5) & 1;
+        int cycle_type = (other_modes >> 52) & 3;
+        if (z_update && cycle_type < 2) {
+            uint32_t z_address = z_image & 0xFF'FFFF;
+            ranges[1] = { z_address, z_address + rows * color_image.width * 2 };
+        }
+        return ranges;
+    }
+    // Everything set by RDP commands, each worker replays the command list into its own copy
+    struct RDPState {
+        uint64_t other_modes = 0;
+        uint64_t combine = 0;
+        uint32_t fill_color = 0;
+        uint32_t fog_color = 0;
+        uint32_t blend_color = 0;
+        uint32_t prim_color = 0;
+        uint32_t env_color = 0;
+        uint8_t prim_lod_frac = 0;
+        uint16_t prim_z = 0;
+        uint16_t prim_dz = 0;
+        // 10.2 fixed point, the bottom right edge is exclusive
+        uint16_t scissor_xh = 0, scissor_yh = 0, scissor_xl = 0, scissor_yl = 0;
+        RDPImage color_image;
+        RDPImage texture_image;
+        uint32_t z_image = 0;
+        std::array<RDPTile, 8> tiles {};
+        alignas(16) std::array<uint8_t, 0x1000> tmem {};
+    };
+    /**
+        One rasterizer thread's view of the RDP
+
+        Owns the rows of the screen whose 8 scanline band number modulo worker_count equals
+        index, and skips every other row. State commands (including TMEM loads) are replayed
+        in full by every worker, so workers never share anything but RDRAM and never touch
+        the same pixels.
+
+        Sampled tiles are decoded once to RGBA8888 and kept in a texture cache, keyed by the
+        RDRAM texture and TMEM layout they were loaded from (plus a hash of the palette for
+        color indexed ones). An entry is reused for as long as the RDRAM pages it came from
+        haven't been written, either by the CPU side (the page versions passed to Execute)
+        or by this worker's own drawing, which every worker replays in full. Tiles whose TMEM
+        can't be traced back to a single load are sampled straight from TMEM.
+    */
+    class RDPWorker {
+    public:
+        RDPWorker(int index, int worker_count) : index_(index), worker_count_(worker_count) {}
+        void Execute(std::span<const uint64_t> commands, std::span<uint8_t> rdram, std::span<const uint32_t> rdram_versions);
+        constexpr static int BAND_SHIFT = 3;
+        // RDRAM writes are tracked per 4 KB page
+        constexpr static int VERSION_PAGE_SHIFT = 12;
+        constexpr static size_t TEXTURE_CACHE_SIZE = 512;
+        // Bigger tiles (only possible with large masks) are sampled from TMEM
+        constexpr static size_t MAX_DECODED_TEXELS = 0x4000;
+    private:
+        struct Color {
+            int32_t r, g, b, a;
+        };
+        // Per pixel inputs of the color combiner and blender
+        struct Pixel {
+            Color shade;
+            Color texel0;
+            Color texel1;
+            uint32_t z;
+            int32_t lod_frac;
+        };
+        // Everything that decides what a decoded tile looks like, other than RDRAM contents
+        struct TextureKey {
+            // The load command, which selects the texels copied
+            uint64_t load;
+            // Hash of the palette entries the tile uses, 0 without a TLUT
+            uint64_t tlut;
+            // Texture image the load read from, and its width, size and format
+            uint32_t address;
+            uint32_t image;
+            // TMEM address and line of the load and of the sampled tile, tile format, size and palette
+            uint32_t load_tmem;
+            uint32_t tile;
+            // Sampled width and height
+            uint32_t extent;
+            // TLUT enable and type
+            uint32_t modes;
+            bool operator==(const TextureKey&) const = default;
+        };
+        // TMEM bytes written by one LOAD_TILE or LOAD_BLOCK, rows apart by line bytes.
+        // 32-bit loads also fill the same range of the high half.
+        struct TMEMLoad {
+            uint64_t command;
+            uint32_t address;
+            uint32_t image;
+            uint32_t load_tmem;
+            RDRAMRange rdram;
+            // Version of the rdram range before the texels were read
+            uint64_t version;
+            uint16_t tmem;
+            uint16_t line;
+            uint16_t row_bytes;
+            uint16_t rows;
+            bool split;
+        };
+        // A tile's texels as RGBA8888 (red in the top byte), stored in 4x4 blocks so the
+        // texels a bilinear fetch needs are usually on the same cache line
+        struct DecodedTexture {
+            TextureKey key;
+            RDRAMRange rdram;
+            uint64_t version;
+            int width;
+            int height;
+            int blocks_per_row;
+            std::vector<uint32_t> texels;
+            __always_inline uint32_t Fetch(int s, int t) const {
+                return texels[(((t >> 2) * blocks_per_row + (s >> 2)) << 4) | ((t & 3) << 2) | (s & 3)];
+            }
+        };
+        __always_inline bool owns_row(int y) const {
+            return ((y >> BAND_SHIFT) % worker_count_) == index_;
+        }
+        void execute_command(const uint64_t* words);
+        void set_tile(uint64_t word);
+        void set_tile_size(uint64_t word);
+        void load_tile(uint64_t word);
+        void load_block(uint64_t word);
+        void load_tlut(uint64_t word);
+        void fill_rectangle(uint64_t word);
+        void texture_rectangle(const uint64_t* words, bool flip);
+        void triangle(const uint64_t* words);
+        void fill_span(int y, int x0, int x1);
+        Color sample_texture(int tile, int32_t s, int32_t t);
+        Color fetch_texel(const RDPTile& tile, int s, int t);
+        const DecodedTexture* bound_texture(int tile);
+        const DecodedTexture* bind_texture(int tile);
+        void record_tmem_load(const TMEMLoad& load);
+        void forget_tmem_range(uint32_t begin, uint32_t end, bool split);
+        void unbind_textures() { bound_mask_ = 0; }
+        uint64_t rdram_version(RDRAMRange range) const;
+        void mark_drawn();
+        int wrap_coordinate(int coord, uint16_t low, uint16_t high, bool clamp, bool mirror, uint8_t mask);
+        Color combine_cycle(int cycle, const Pixel& pixel, const Color& combined);
+        void shade_pixel(int x, int y, Pixel& pixel);
+        uint8_t read_rdram8(uint32_t addr) const;
+        uint16_t read_rdram16(uint32_t addr) const;
+        uint32_t read_rdram32(uint32_t addr) const;
+        void write_rdram16(uint32_t addr, uint16_t data);
+        void write_rdram32(uint32_t addr, uint32_t data);
+        void write_rdram8(uint32_t addr, uint8_t data);
+        Color read_framebuffer(int x, int y) const;
+        void write_framebuffer(int x, int y, const Color& color);
+        __always_inline int cycle_type() const { return (state_.other_modes >> 52) & 3; }
+
+        RDPState state_;
+        std::span<uint8_t> rdram_;
+        std::span<const uint32_t> rdram_versions_;
+        // Per page count of draws that may have written it
+        std::vector<uint32_t> drawn_versions_;
+        std::vector<TMEMLoad> tmem_loads_;
+        std::unordered_map<uint64_t, std::unique_ptr<DecodedTexture>> texture_cache_;
+        // Texture each tile samples from (nullptr when it isn't cached), valid while its bit in bound_mask_ is set
+        std::array<const DecodedTexture*, 8> bound_textures_ {};
+        uint8_t bound_mask_ = 0;
+        uint32_t noise_ = 0x1234'5678;
+        int index_;
+        int worker_count_;
+    };
+    /**
+        Reality Display Processor
+
+        Commands are fetched from RDRAM (or DMEM) between DPC_CURRENT and DPC_END as they are
+        submitted and collected into a batch. The batch is rasterized when it reaches a point
+        later commands may depend on: a full sync, a new color or Z image (so rendering to a
+        texture finishes before it is sampled) or the end of a submission. Rendering is split
+        into horizontal bands run on a pool of RDPWorker threads.
+
+        In async mode batches are handed to a render thread through an SPSCQueue instead, so
+        the CPU keeps running while they are rasterized. The emulation thread remembers which
+        color and Z image ranges each batch in flight writes, and only waits for the render
+        thread at a full sync (before raising the DP interrupt) or when something on its side
+        touches one of those ranges, see SyncRange.
+
+        Coverage and dithering aren't emulated, every pixel is treated as fully covered.
+
+        @see https://n64brew.dev/wiki/Reality_Display_Processor
+    */
+    class RDP {
+    public:
+        RDP();
+        ~RDP();
+        RDP(const RDP&) = delete;
+        RDP& operator=(const RDP&) = delete;
+        void Reset();
+        void SetBus(CPUBus* bus) { bus_ = bus; }
+        // Number of rasterizer threads including the emulation thread, must be set before Reset
+        void SetWorkerCount(int count);
+        // Applies a write to DPC register reg (0 is DPC_START), returns the value it reads back as
+        uint32_t WriteRegister(int reg, uint32_t data);
+        uint32_t ReadRegister(int reg) const;
+        // Rasterizes on a separate render thread, see above
+        void SetAsync(bool enabled);
+        // True while a batch in flight may still write to RDRAM
+        __always_inline bool HasPendingWrites() const { return !pending_writes_.empty(); }
+        // Waits for every batch in flight that writes to [addr, addr + length)
+        void SyncRange(uint32_t addr, uint32_t length);
+        // Waits for every batch in flight
+        void Sync();
+    private:
+        // An RDRAM range a submitted batch renders to, job is the batch's sequence number
+        struct PendingWrite {
+            uint32_t begin;
+            uint32_t end;
+            uint64_t job;
+        };
+        void process_commands();
+        void track_command(const std::vector<uint64_t>& command);
+        void note_write(uint32_t begin, uint32_t end);
+        void flush();
+        void render(std::span<const uint64_t> commands);
+        void render_loop();
+        void stop_render_thread();
+        void wait_for_job(uint64_t job);
+        void worker_loop(int index, uint64_t generation);
+        uint64_t read_command_word(uint32_t addr) const;
+
+        CPUBus* bus_ = nullptr;
+        // Memory mapped registers, kept in guest byte order like the rest of the bus
+        uint32_t start_ = 0;
+        uint32_t end_ = 0;
+        uint32_t current_ = 0;
+        uint32_t status_ = 0;
+        uint32_t clock_ = 0;
+        uint32_t buf_busy_ = 0;
+        uint32_t pipe_busy_ = 0;
+        uint32_t tmem_busy_ = 0;
+        bool start_pending_ = false;
+        // Words of a command that hasn't been completely submitted yet
+        std::vector<uint64_t> partial_;
+        // Complete commands waiting to be rasterized
+        std::vector<uint64_t> batch_;
+        // The little state the emulation thread follows to know where batches draw to
+        RDPImage color_image_;
+        uint32_t z_image_ = 0;
+        uint16_t scissor_yl_ = 0;
+        uint64_t other_modes_ = 0;
+        std::vector<PendingWrite> batch_writes_;
+        std::vector<PendingWrite> pending_writes_;
+
+        bool async_ = false;
+        SPSCQueue<std::vector<uint64_t>, 64> queue_;
+        std::thread render_thread_;
+        // Number of batches pushed, only touched by the emulation thread
+        uint64_t submitted_ = 0;
+        // Number of batches rendered, the render thread notifies every increment
+        std::atomic<uint64_t> completed_ = 0;
+        // Bumped to wake the render thread up after a push or to make it quit
+        std::atomic<uint64_t> render_wake_ = 0;
+        std::atomic<bool> render_quit_ = false;
+
+        std::vector<std::unique_ptr<RDPWorker>> workers_;
+        std::vector<std::thread> threads_;
+        std::mutex pool_mutex_;
+        std::condition_variable pool_cv_;
+        std::condition_variable done_cv_;
+        // The batch the pool is working on
+        std::span<const uint64_t> job_;
+        uint64_t generation_ = 0;
+        int running_ = 0;
+        bool quit_ = false;
+        friend class CPUBus;
+        friend class CPU;
+    };
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,821 @@
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+#include "n64_rdp.hxx"
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        enum CycleType {
+            ONE_CYCLE = 0,
+            TWO_CYCLE = 1,
+            COPY = 2,
+            FILL = 3,
+        };
+
+        __always_inline int32_t sext(uint32_t value, int bits) {
+            return static_cast<int32_t>(value << (32 - bits)) >> (32 - bits);
+        }
+
+        __always_inline uint8_t clamp8(int32_t value) {
+            return std::clamp(value, 0, 255);
+        }
+
+        // Z buffer entries are a 14-bit float (3-bit exponent, 11-bit mantissa) and 2 bits of dz
+        uint16_t z_compress(uint32_t z) {
+            z &= 0x3FFFF;
+            int exponent = 0;
+            while (exponent < 7 && (z & (0x20000 >> exponent)))
+                exponent++;
+            int shift = exponent < 6 ? 6 - exponent : 0;
+            uint32_t mantissa = (z >> shift) & 0x7FF;
+            return (exponent << 13) | (mantissa << 2);
+        }
+
+        uint32_t z_decompress(uint16_t value) {
+            constexpr struct {
+                int shift;
+                uint32_t add;
+            } Exponents[8] = {
+                { 6, 0x00000 }, { 5, 0x20000 }, { 4, 0x30000 }, { 3, 0x38000 },
+                { 2, 0x3C000 }, { 1, 0x3E000 }, { 0, 0x3F000 }, { 0, 0x3F800 },
+            };
+            auto& exponent = Exponents[value >> 13];
+            return (((value >> 2) & 0x7FF) << exponent.shift) + exponent.add;
+        }
+
+        __always_inline uint8_t expand5(uint32_t value) {
+            return (value << 3) | (value >> 2);
+        }
+
+        uint32_t image_descriptor(const RDPImage& image) {
+            return image.width | (image.size << 16) | (image.format << 20);
+        }
+
+        uint32_t tmem_descriptor(const RDPTile& tile) {
+            return tile.tmem | (tile.line << 16);
+        }
+    }
+
+    void RDPWorker::Execute(std::span<const uint64_t> commands, std::span<uint8_t> rdram, std::span<const uint32_t> rdram_versions) {
+        rdram_ = rdram;
+        rdram_versions_ = rdram_versions;
+        drawn_versions_.resize(rdram_versions.size());
+        // RDRAM may have changed since the last batch
+        unbind_textures();
+        size_t i = 0;
+        while (i < commands.size()) {
+            execute_command(&commands[i]);
+            i += rdp_command_length(commands[i] >> 56);
+        }
+    }
+
+    void RDPWorker::execute_command(const uint64_t* words) {
+        uint64_t word = words[0];
+        switch ((word >> 56) & 0x3F) {
+            case 0x08: case 0x09: case 0x0A: case 0x0B:
+            case 0x0C: case 0x0D: case 0x0E: case 0x0F:
+                mark_drawn();
+                triangle(words);
+                break;
+            case 0x24:
+                mark_drawn();
+                texture_rectangle(words, false);
+                break;
+            case 0x25:
+                mark_drawn();
+                texture_rectangle(words, true);
+                break;
+            case 0x2D:
+                state_.scissor_xh = (word >> 44) & 0xFFF;
+                state_.scissor_yh = (word >> 32) & 0xFFF;
+                state_.scissor_xl = (word >> 12) & 0xFFF;
+                state_.scissor_yl = word & 0xFFF;
+                break;
+            case 0x2E:
+                state_.prim_z = (word >> 16) & 0x7FFF;
+                state_.prim_dz = word & 0xFFFF;
+                break;
+            case 0x2F:
+                // The TLUT settings change what color indexed tiles decode to
+                if ((state_.other_modes ^ word) & (3ull << 46))
+                    unbind_textures();
+                state_.other_modes = word & 0x00FF'FFFF'FFFF'FFFF;
+                break;
+            case 0x30:
+                load_tlut(word);
+                break;
+            case 0x32:
+                set_tile_size(word);
+                break;
+            case 0x33:
+                load_block(word);
+                break;
+            case 0x34:
+                load_tile(word);
+                break;
+            case 0x35:
+                set_tile(word);
+                break;
+            case 0x36:
+                mark_drawn();
+                fill_rectangle(word);
+                break;
+            case 0x37:
+                state_.fill_color = word;
+                break;
+            case 0x38:
+                state_.fog_color = word;
+                break;
+            case 0x39:
+                state_.blend_color = word;
+                break;
+            case 0x3A:
+                state_.prim_lod_frac = word >> 32;
+                state_.prim_color = word;
+                break;
+            case 0x3B:
+                state_.env_color = word;
+                break;
+            case 0x3C:
+                state_.combine = word & 0x00FF'FFFF'FFFF'FFFF;
+                break;
+            case 0x3D:
+            case 0x3F: {
+                bool texture = ((word >> 56) & 0x3F) == 0x3D;
+                if (!texture) {
+                    // Whatever is drawn next may be sampled later as a texture
+                    unbind_textures();
+                }
+                RDPImage& image = texture ? state_.texture_image : state_.color_image;
+                image.format = (word >> 53) & 7;
+                image.size = (word >> 51) & 3;
+                image.width = ((word >> 32) & 0x3FF) + 1;
+                image.address = word & 0x3FF'FFFF;
+                break;
+            }
+            case 0x3E:
+                unbind_textures();
+                state_.z_image = word & 0x3FF'FFFF;
+                break;
+        }
+    }
+
+    void RDPWorker::set_tile(uint64_t word) {
+        bound_mask_ &= ~(1 << ((word >> 24) & 7));
+        RDPTile& tile = state_.tiles[(word >> 24) & 7];
+        tile.format = (word >> 53) & 7;
+        tile.size = (word >> 51) & 3;
+        tile.line = (word >> 41) & 0x1FF;
+        tile.tmem = (word >> 32) & 0x1FF;
+        tile.palette = (word >> 20) & 0xF;
+        tile.clamp_t = (word >> 19) & 1;
+        tile.mirror_t = (word >> 18) & 1;
+        tile.mask_t = (word >> 14) & 0xF;
+        tile.shift_t = (word >> 10) & 0xF;
+        tile.clamp_s = (word >> 9) & 1;
+        tile.mirror_s = (word >> 8) & 1;
+        tile.mask_s = (word >> 4) & 0xF;
+        tile.shift_s = word & 0xF;
+    }
+
+    void RDPWorker::set_tile_size(uint64_t word) {
+        bound_mask_ &= ~(1 << ((word >> 24) & 7));
+        RDPTile& tile = state_.tiles[(word >> 24) & 7];
+        tile.sl = (word >> 44) & 0xFFF;
+        tile.tl = (word >> 32) & 0xFFF;
+        tile.sh = (word >> 12) & 0xFFF;
+        tile.th = word & 0xFFF;
+    }
+
+    void RDPWorker::load_tile(uint64_t word) {
+        set_tile_size(word);
+        const RDPTile& tile = state_.tiles[(word >> 24) & 7];
+        const RDPImage& image = state_.texture_image;
+        int s0 = tile.sl >> 2, t0 = tile.tl >> 2;
+        int s1 = tile.sh >> 2, t1 = tile.th >> 2;
+        uint32_t first = image.address + (((t0 * image.width + s0) << image.size) >> 1);
+        uint32_t last = image.address + ((((t1 * image.width + s1 + 1) << image.size) + 1) >> 1);
+        // Taken before the copy, a write during it makes the decoded texture stale instead of missed
+        uint64_t version = rdram_version({ first, last });
+        auto& tmem = state_.tmem;
+        for (int t = t0; t <= t1; t++) {
+            uint32_t row = tile.tmem * 8 + (t - t0) * tile.line * 8;
+            // Odd rows have their 32-bit words swapped so both rows can be read in one cycle
+            uint32_t swizzle = ((t - t0) & 1) ? 4 : 0;
+            if (image.size == 3) {
+                // 32-bit texels keep red and green in the low half of TMEM, blue and alpha in the high half
+                for (int s = s0; s <= s1; s++) {
+                    uint32_t texel = read_rdram32(image.address + (t * image.width + s) * 4);
+                    uint32_t offset = ((row + (s - s0) * 2) ^ swizzle) & 0x7FF;
+                    tmem[offset] = texel >> 24;
+                    tmem[offset + 1] = texel >> 16;
+                    tmem[offset | 0x800] = texel >> 8;
+                    tmem[(offset | 0x800) + 1] = texel;
+                }
+            } else {
+                uint32_t source = image.address + (((t * image.width + s0) << image.size) >> 1);
+                uint32_t bytes = ((s1 - s0 + 1) << image.size) >> 1;
+                for (uint32_t i = 0; i < bytes; i++) {
+                    tmem[((row + i) ^ swizzle) & 0xFFF] = read_rdram8(source + i);
+                }
+            }
+        }
+        uint32_t texels = std::max(s1 - s0 + 1, 0);
+        uint32_t row_bytes = image.size == 3 ? texels * 2 : (texels << image.size) >> 1;
+        record_tmem_load({
+            word, image.address, image_descriptor(image), tmem_descriptor(tile), { first, last }, version,
+            static_cast<uint16_t>(tile.tmem * 8), static_cast<uint16_t>(tile.line * 8),
+            static_cast<uint16_t>(row_bytes), static_cast<uint16_t>(std::max(t1 - t0 + 1, 0)), image.size == 3,
+        });
+    }
+
+    void RDPWorker::load_block(uint64_t word) {
+        const RDPTile& tile = state_.tiles[(word >> 24) & 7];
+        const RDPImage& image = state_.texture_image;
+        uint32_t sl = (word >> 44) & 0xFFF;
+        uint32_t tl = (word >> 32) & 0xFFF;
+        uint32_t texels = ((word >> 12) & 0xFFF) - sl + 1;
+        uint32_t dxt = word & 0xFFF;
+        uint32_t source = image.address + (((tl * image.width + sl) << image.size) >> 1);
+        uint32_t words = ((texels << image.size) + 15) >> 4;
+        uint64_t version = rdram_version({ source, source + words * 8 });
+        auto& tmem = state_.tmem;
+        // dxt is added once per 64-bit word, the row is odd (and swizzled) while bit 11 is set
+        uint32_t t = 0;
+        for (uint32_t i = 0; i < words; i++) {
+            uint32_t swizzle = (t & 0x800) ? 4 : 0;
+            if (image.size == 3) {
+                for (uint32_t k = 0; k < 2; k++) {
+                    uint32_t texel = read_rdram32(source + i * 8 + k * 4);
+                    uint32_t offset = ((tile.tmem * 8 + (i * 2 + k) * 2) ^ swizzle) & 0x7FF;
+                    tmem[offset] = texel >> 24;
+                    tmem[offset + 1] = texel >> 16;
+                    tmem[offset | 0x800] = texel >> 8;
+                    tmem[(offset | 0x800) + 1] = texel;
+                }
+            } else {
+                for (uint32_t j = 0; j < 8; j++) {
+                    tmem[((tile.tmem * 8 + i * 8 + j) ^ swizzle) & 0xFFF] = read_rdram8(source + i * 8 + j);
+                }
+            }
+            t += dxt;
+        }
+        // A block is a single row, 32-bit texels take half as many bytes in each half of TMEM
+        uint32_t bytes = image.size == 3 ? words * 4 : words * 8;
+        record_tmem_load({
+            word, image.address, image_descriptor(image), tmem_descriptor(tile), { source, source + words * 8 }, version,
+            static_cast<uint16_t>(tile.tmem * 8), 0, static_cast<uint16_t>(std::min<uint32_t>(bytes, 0x1000)), 1, image.size == 3,
+        });
+    }
+
+    void RDPWorker::load_tlut(uint64_t word) {
+        const RDPTile& tile = state_.tiles[(word >> 24) & 7];
+        const RDPImage& image = state_.texture_image;
+        uint32_t sl = ((word >> 44) & 0xFFF) >> 2;
+        uint32_t tl = ((word >> 32) & 0xFFF) >> 2;
+        uint32_t sh = ((word >> 12) & 0xFFF) >> 2;
+        uint32_t source = image.address + (tl * image.width + sl) * 2;
+        unbind_textures();
+        forget_tmem_range(tile.tmem * 8, tile.tmem * 8 + (std::min(sh - sl, 255u) + 1) * 8, false);
+        // Each 16-bit entry is written four times over a 64-bit word in the high half of TMEM
+        for (uint32_t i = 0; i <= sh - sl && i < 256; i++) {
+            uint16_t entry = read_rdram16(source + i * 2);
+            uint32_t offset = (tile.tmem * 8 + i * 8) & 0xFFF;
+            for (int copy = 0; copy < 4; copy++) {
+                state_.tmem[(offset + copy * 2) & 0xFFF] = entry >> 8;
+                state_.tmem[(offset + copy * 2 + 1) & 0xFFF] = entry;
+            }
+        }
+    }
+
+    void RDPWorker::fill_rectangle(uint64_t word) {
+        int xl = (word >> 44) & 0xFFF, yl = (word >> 32) & 0xFFF;
+        int xh = (word >> 12) & 0xFFF, yh = word & 0xFFF;
+        bool inclusive = cycle_type() >= COPY;
+        int x0 = std::max(xh, static_cast<int>(state_.scissor_xh)) >> 2;
+        int y0 = std::max(yh, static_cast<int>(state_.scissor_yh)) >> 2;
+        int x1 = std::min(inclusive ? (xl >> 2) + 1 : (xl + 3) >> 2, state_.scissor_xl >> 2);
+        int y1 = std::min(inclusive ? (yl >> 2) + 1 : (yl + 3) >> 2, state_.scissor_yl >> 2);
+        for (int y = y0; y < y1; y++) {
+            if (!owns_row(y))
+                continue;
+            if (cycle_type() == FILL) {
+                fill_span(y, x0, x1);
+                continue;
+            }
+            for (int x = x0; x < x1; x++) {
+                Pixel pixel {};
+                pixel.z = state_.prim_z << 3;
+                shade_pixel(x, y, pixel);
+            }
+        }
+    }
+
+    void RDPWorker::fill_span(int y, int x0, int x1) {
+        if (x0 >= x1)
+            return;
+        const RDPImage& image = state_.color_image;
+        uint32_t bytes_per_pixel = (1 << image.size) >> 1;
+        uint32_t start = (image.address + (y * image.width + x0) * bytes_per_pixel) & 0xFF'FFFF;
+        uint32_t end = start + (x1 - x0) * bytes_per_pixel;
+        end = std::min<uint32_t>(end, rdram_.size());
+        if (start >= end)
+            return;
+        // Every byte comes from the fill color by its address, for any pixel size
+        uint32_t fill = state_.fill_color;
+        auto byte_at = [fill](uint32_t addr) -> uint8_t {
+            return fill >> (8 * (3 - (addr & 3)));
+        };
+        uint32_t addr = start;
+        while (addr < end && (addr & 15)) {
+            rdram_[addr] = byte_at(addr);
+            addr++;
+        }
+        const __m128i pattern = _mm_set1_epi32(__builtin_bswap32(fill));
+        while (addr + 16 <= end) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&rdram_[addr]), pattern);
+            addr += 16;
+        }
+        while (addr < end) {
+            rdram_[addr] = byte_at(addr);
+            addr++;
+        }
+    }
+
+    void RDPWorker::texture_rectangle(const uint64_t* words, bool flip) {
+        uint64_t word = words[0];
+        int xl = (word >> 44) & 0xFFF, yl = (word >> 32) & 0xFFF;
+        int tile = (word >> 24) & 7;
+        int xh = (word >> 12) & 0xFFF, yh = word & 0xFFF;
+        int32_t s = static_cast<int16_t>(words[1] >> 48);
+        int32_t t = static_cast<int16_t>(words[1] >> 32);
+        int32_t dsdx = static_cast<int16_t>(words[1] >> 16);
+        int32_t dtdy = static_cast<int16_t>(words[1]);
+        bool copy = cycle_type() == COPY;
+        if (copy) {
+            // Copy mode moves 4 texels per cycle, dsdx is given as 4.0 for one texel per pixel
+            dsdx >>= 2;
+        }
+        bool inclusive = cycle_type() >= COPY;
+        int start_x = xh >> 2, start_y = yh >> 2;
+        int x0 = std::max(xh, static_cast<int>(state_.scissor_xh)) >> 2;
+        int y0 = std::max(yh, static_cast<int>(state_.scissor_yh)) >> 2;
+        int x1 = std::min(inclusive ? (xl >> 2) + 1 : (xl + 3) >> 2, state_.scissor_xl >> 2);
+        int y1 = std::min(inclusive ? (yl >> 2) + 1 : (yl + 3) >> 2, state_.scissor_yl >> 2);
+        bool alpha_compare = state_.other_modes & 1;
+        for (int y = y0; y < y1; y++) {
+            if (!owns_row(y))
+                continue;
+            for (int x = x0; x < x1; x++) {
+                // s10.5 coordinates, the steps are s5.10
+                int32_t dx = x - start_x, dy = y - start_y;
+                int32_t ss = s + ((flip ? dsdx * dy : dsdx * dx) >> 5);
+                int32_t tt = t + ((flip ? dtdy * dx : dtdy * dy) >> 5);
+                if (copy) {
+                    Color texel = sample_texture(tile, ss, tt);
+                    if (alpha_compare && texel.a == 0)
+                        continue;
+                    write_framebuffer(x, y, texel);
+                    continue;
+                }
+                Pixel pixel {};
+                pixel.texel0 = sample_texture(tile, ss, tt);
+                if (cycle_type() == TWO_CYCLE)
+                    pixel.texel1 = sample_texture((tile + 1) & 7, ss, tt);
+                pixel.z = state_.prim_z << 3;
+                shade_pixel(x, y, pixel);
+            }
+        }
+    }
+
+    void RDPWorker::triangle(const uint64_t* words) {
+        struct Attribute {
+            int64_t value, dx, de;
+        };
+        uint64_t w0 = words[0];
+        int command = (w0 >> 56) & 0x3F;
+        bool has_shade = command & 4, has_texture = command & 2, has_z = command & 1;
+        bool left_major = (w0 >> 55) & 1;
+        int tile = (w0 >> 48) & 7;
+        int32_t yl = sext((w0 >> 32) & 0x3FFF, 14);
+        int32_t ym = sext((w0 >> 16) & 0x3FFF, 14);
+        int32_t yh = sext(w0 & 0x3FFF, 14);
+        int64_t xl = static_cast<int32_t>(words[1] >> 32), dxldy = static_cast<int32_t>(words[1]);
+        int64_t xh = static_cast<int32_t>(words[2] >> 32), dxhdy = static_cast<int32_t>(words[2]);
+        int64_t xm = static_cast<int32_t>(words[3] >> 32), dxmdy = static_cast<int32_t>(words[3]);
+        const uint64_t* coefficients = words + 4;
+        // Shade and texture coefficients are split into integer and fraction words
+        auto attribute = [](const uint64_t* block, int i) {
+            int shift = 48 - 16 * i;
+            auto fixed = [shift](uint64_t integer, uint64_t fraction) -> int64_t {
+                return static_cast<int32_t>((static_cast<uint32_t>(integer >> shift) << 16) | ((fraction >> shift) & 0xFFFF));
+            };
+            return Attribute { fixed(block[0], block[2]), fixed(block[1], block[3]), fixed(block[4], block[6]) };
+        };
+        std::array<Attribute, 4> shade {};
+        std::array<Attribute, 3> texture {};
+        Attribute z {};
+        if (has_shade) {
+            for (int i = 0; i < 4; i++)
+                shade[i] = attribute(coefficients, i);
+            coefficients += 8;
+        }
+        if (has_texture) {
+            for (int i = 0; i < 3; i++)
+                texture[i] = attribute(coefficients, i);
+            coefficients += 8;
+        }
+        if (has_z) {
+            z = { static_cast<int32_t>(coefficients[0] >> 32), static_cast<int32_t>(coefficients[0]), static_cast<int32_t>(coefficients[1] >> 32) };
+        }
+        bool z_from_primitive = (state_.other_modes >> 2) & 1;
+        bool persp = (state_.other_modes >> 51) & 1;
+        int top = yh >> 2;
+        int y0 = std::max((yh + 3) >> 2, state_.scissor_yh >> 2);
+        int y1 = std::min((yl + 3) >> 2, state_.scissor_yl >> 2);
+        int scissor_x0 = state_.scissor_xh >> 2, scissor_x1 = state_.scissor_xl >> 2;
+        for (int y = y0; y < y1; y++) {
+            if (!owns_row(y))
+                continue;
+            int64_t dy = y - top;
+            int64_t major = xh + dxhdy * dy;
+            int64_t minor = (y * 4 < ym) ? xm + dxmdy * dy : xl + dxldy * (y * 4 - ym) / 4;
+            int64_t left = left_major ? major : minor;
+            int64_t right = left_major ? minor : major;
+            // Pixels whose left edge is inside [left, right)
+            int x0 = std::max(static_cast<int>((left + 0xFFFF) >> 16), scissor_x0);
+            int x1 = std::min(static_cast<int>((right + 0xFFFF) >> 16), scissor_x1);
+            if (x0 >= x1)
+                continue;
+            // Attributes start on the major edge and step by de per scanline, dx per pixel
+            int64_t offset = (static_cast<int64_t>(x0) << 16) - major;
+            auto at_span_start = [dy, offset](const Attribute& attribute) {
+                return attribute.value + attribute.de * dy + ((attribute.dx * offset) >> 16);
+            };
+            std::array<int64_t, 4> shade_values;
+            std::array<int64_t, 3> texture_values;
+            for (int i = 0; i < 4; i++)
+                shade_values[i] = at_span_start(shade[i]);
+            for (int i = 0; i < 3; i++)
+                texture_values[i] = at_span_start(texture[i]);
+            int64_t z_value = at_span_start(z);
+            for (int x = x0; x < x1; x++) {
+                Pixel pixel {};
+                pixel.shade = {
+                    clamp8(shade_values[0] >> 16), clamp8(shade_values[1] >> 16),
+                    clamp8(shade_values[2] >> 16), clamp8(shade_values[3] >> 16),
+                };
+                if (has_texture) {
+                    int32_t s = texture_values[0] >> 16, t = texture_values[1] >> 16;
+                    if (persp) {
+                        int64_t w = texture_values[2];
+                        if (w <= 0)
+                            w = 1;
+                        s = std::clamp<int64_t>((texture_values[0] << 15) / w, INT16_MIN, INT16_MAX);
+                        t = std::clamp<int64_t>((texture_values[1] << 15) / w, INT16_MIN, INT16_MAX);
+                    }
+                    pixel.texel0 = sample_texture(tile, s, t);
+                    if (cycle_type() == TWO_CYCLE)
+                        pixel.texel1 = sample_texture((tile + 1) & 7, s, t);
+                }
+                pixel.z = z_from_primitive ? state_.prim_z << 3 : std::clamp<int64_t>(z_value >> 13, 0, 0x3FFFF);
+                shade_pixel(x, y, pixel);
+                for (int i = 0; i < 4; i++)
+                    shade_values[i] += shade[i].dx;
+                for (int i = 0; i < 3; i++)
+                    texture_values[i] += texture[i].dx;
+                z_value += z.dx;
+            }
+        }
+    }
+
+    int RDPWorker::wrap_coordinate(int coord, uint16_t low, uint16_t high, bool clamp, bool mirror, uint8_t mask) {
+        if (clamp || mask == 0) {
+            int max = (high >> 2) - (low >> 2);
+            coord = std::clamp(coord, 0, std::max(max, 0));
+        }
+        if (mask) {
+            if (mirror && ((coord >> mask) & 1))
+                coord = ~coord;
+            coord &= (1 << mask) - 1;
+        }
+        return coord;
+    }
+
+    RDPWorker::Color RDPWorker::sample_texture(int tile_index, int32_t s, int32_t t) {
+        const RDPTile& tile = state_.tiles[tile_index];
+        auto shift = [](int32_t coord, uint8_t amount) {
+            return amount < 11 ? coord >> amount : coord << (16 - amount);
+        };
+        // s10.5 relative to the top left of the tile
+        s = shift(s, tile.shift_s) - (tile.sl << 3);
+        t = shift(t, tile.shift_t) - (tile.tl << 3);
+        const DecodedTexture* decoded = bound_texture(tile_index);
+        auto texel = [this, &tile, decoded](int s, int t) -> Color {
+            s = wrap_coordinate(s, tile.sl, tile.sh, tile.clamp_s, tile.mirror_s, tile.mask_s);
+            t = wrap_coordinate(t, tile.tl, tile.th, tile.clamp_t, tile.mirror_t, tile.mask_t);
+            if (!decoded)
+                return fetch_texel(tile, s, t);
+            uint32_t rgba = decoded->Fetch(s, t);
+            return { static_cast<int32_t>(rgba >> 24), static_cast<int32_t>((rgba >> 16) & 0xFF), static_cast<int32_t>((rgba >> 8) & 0xFF), static_cast<int32_t>(rgba & 0xFF) };
+        };
+        bool bilinear = ((state_.other_modes >> 45) & 1) && cycle_type() != COPY;
+        if (!bilinear)
+            return texel(s >> 5, t >> 5);
+        int s0 = s >> 5, t0 = t >> 5;
+        int fs = s & 31, ft = t & 31;
+        Color c00 = texel(s0, t0), c10 = texel(s0 + 1, t0);
+        Color c01 = texel(s0, t0 + 1), c11 = texel(s0 + 1, t0 + 1);
+        auto lerp = [fs, ft](int32_t a, int32_t b, int32_t c, int32_t d) {
+            int32_t top = a * (32 - fs) + b * fs;
+            int32_t bottom = c * (32 - fs) + d * fs;
+            return (top * (32 - ft) + bottom * ft + 512) >> 10;
+        };
+        return {
+            lerp(c00.r, c10.r, c01.r, c11.r), lerp(c00.g, c10.g, c01.g, c11.g),
+            lerp(c00.b, c10.b, c01.b, c11.b), lerp(c00.a, c10.a, c01.a, c11.a),
+        };
+    }
+
+    RDPWorker::Color RDPWorker::fetch_texel(const RDPTile& tile, int s, int t) {
+        const auto& tmem = state_.tmem;
+        uint32_t row = tile.tmem * 8 + t * tile.line * 8;
+        uint32_t swizzle = (t & 1) ? 4 : 0;
+        auto read16 = [&tmem](uint32_t offset) -> uint16_t {
+            return (tmem[offset & 0xFFF] << 8) | tmem[(offset + 1) & 0xFFF];
+        };
+        auto rgba16 = [](uint16_t texel) -> Color {
+            return { expand5(texel >> 11), expand5((texel >> 6) & 31), expand5((texel >> 1) & 31), (texel & 1) ? 255 : 0 };
+        };
+        uint32_t index = 0;
+        switch (tile.size) {
+            case 0: {
+                uint8_t byte = tmem[((row + (s >> 1)) ^ swizzle) & 0xFFF];
+                index = (s & 1) ? byte & 0xF : byte >> 4;
+                break;
+            }
+            case 1:
+                index = tmem[((row + s) ^ swizzle) & 0xFFF];
+                break;
+            case 2:
+                index = read16((row + s * 2) ^ swizzle);
+                break;
+            case 3: {
+                uint32_t offset = ((row + s * 2) ^ swizzle) & 0x7FF;
+                uint16_t rg = read16(offset), ba = read16(offset | 0x800);
+                return { rg >> 8, rg & 0xFF, ba >> 8, ba & 0xFF };
+            }
+        }
+        bool tlut = (state_.other_modes >> 47) & 1;
+        if (tlut && tile.size < 2) {
+            // Color indexed, the palette lives in the high half of TMEM
+            if (tile.size == 0)
+                index |= tile.palette << 4;
+            uint16_t entry = read16(0x800 + index * 8);
+            bool ia = (state_.other_modes >> 46) & 1;
+            if (ia)
+                return { entry >> 8, entry >> 8, entry >> 8, entry & 0xFF };
+            return rgba16(entry);
+        }
+        switch (tile.format) {
+            case 0:
+                if (tile.size == 2)
+                    return rgba16(index);
+                break;
+            case 3:
+                if (tile.size == 0) {
+                    int32_t i = ((index >> 1) << 5) | ((index >> 1) << 2) | ((index >> 1) >> 1);
+                    return { i, i, i, (index & 1) ? 255 : 0 };
+                } else if (tile.size == 1) {
+                    int32_t i = (index >> 4) * 17;
+                    return { i, i, i, static_cast<int32_t>(index & 0xF) * 17 };
+                } else {
+                    int32_t i = index >> 8;
+                    return { i, i, i, static_cast<int32_t>(index & 0xFF) };
+                }
+        }
+        // Intensity, also what color indexed textures read as without a TLUT
+        int32_t i = tile.size == 0 ? index * 17 : index & 0xFF;
+        return { i, i, i, i };
+    }
+
+    RDPWorker::Color RDPWorker::combine_cycle(int cycle, const Pixel& pixel, const Color& combined) {
+        uint64_t c = state_.combine;
+        int sub_a_rgb, sub_b_rgb, mul_rgb, add_rgb, sub_a_a, sub_b_a, mul_a, add_a;
+        if (cycle == 0) {
+            sub_a_rgb = (c >> 52) & 15; mul_rgb = (c >> 47) & 31; sub_a_a = (c >> 44) & 7; mul_a = (c >> 41) & 7;
+            sub_b_rgb = (c >> 28) & 15; add_rgb = (c >> 15) & 7; sub_b_a = (c >> 12) & 7; add_a = (c >> 9) & 7;
+        } else {
+            sub_a_rgb = (c >> 37) & 15; mul_rgb = (c >> 32) & 31; sub_a_a = (c >> 21) & 7; mul_a = (c >> 18) & 7;
+            sub_b_rgb = (c >> 24) & 15; add_rgb = (c >> 6) & 7; sub_b_a = (c >> 3) & 7; add_a = c & 7;
+        }
+        auto unpack = [](uint32_t color) -> Color {
+            return { static_cast<int32_t>(color >> 24), static_cast<int32_t>((color >> 16) & 0xFF), static_cast<int32_t>((color >> 8) & 0xFF), static_cast<int32_t>(color & 0xFF) };
+        };
+        Color prim = unpack(state_.prim_color), env = unpack(state_.env_color);
+        const Color zero {}, one { 255, 255, 255, 255 };
+        // Inputs shared by every slot of the color equation
+        auto common = [&](int input) -> const Color* {
+            switch (input) {
+                case 0: return &combined;
+                case 1: return &pixel.texel0;
+                case 2: return &pixel.texel1;
+                case 3: return &prim;
+                case 4: return &pixel.shade;
+                case 5: return &env;
+            }
+            return nullptr;
+        };
+        auto scalar = [](int32_t value) -> Color {
+            return { value, value, value, value };
+        };
+        Color a, b, m, d;
+        if (auto* input = common(sub_a_rgb)) a = *input;
+        else if (sub_a_rgb == 6) a = one;
+        else if (sub_a_rgb == 7) {
+            noise_ = noise_ * 1103515245 + 12345;
+            a = scalar((noise_ >> 16) & 0xFF);
+        } else a = zero;
+        if (auto* input = common(sub_b_rgb)) b = *input;
+        else b = zero;
+        if (auto* input = common(mul_rgb)) m = *input;
+        else switch (mul_rgb) {
+            case 7: m = scalar(combined.a); break;
+            case 8: m = scalar(pixel.texel0.a); break;
+            case 9: m = scalar(pixel.texel1.a); break;
+            case 10: m = scalar(prim.a); break;
+            case 11: m = scalar(pixel.shade.a); break;
+            case 12: m = scalar(env.a); break;
+            case 13: m = scalar(pixel.lod_frac); break;
+            case 14: m = scalar(state_.prim_lod_frac); break;
+            default: m = zero; break;
+        }
+        if (auto* input = common(add_rgb)) d = *input;
+        else if (add_rgb == 6) d = one;
+        else d = zero;
+        auto alpha_input = [&](int input) -> int32_t {
+            if (input == 6)
+                return 255;
+            const Color* color = common(input);
+            return color ? color->a : 0;
+        };
+        int32_t alpha_mul = mul_a == 0 ? pixel.lod_frac : mul_a == 6 ? state_.prim_lod_frac : alpha_input(mul_a);
+        auto equation = [](int32_t a, int32_t b, int32_t c, int32_t d) {
+            return clamp8(((a - b) * c + (d << 8) + 0x80) >> 8);
+        };
+        return {
+            equation(a.r, b.r, m.r, d.r),
+            equation(a.g, b.g, m.g, d.g),
+            equation(a.b, b.b, m.b, d.b),
+            equation(alpha_input(sub_a_a), alpha_input(sub_b_a), alpha_mul, alpha_input(add_a)),
+        };
+    }
+
+    void RDPWorker::shade_pixel(int x, int y, Pixel& pixel) {
+        uint64_t modes = state_.other_modes;
+        bool two_cycle = cycle_type() == TWO_CYCLE;
+        Color combined {};
+        if (two_cycle)
+            combined = combine_cycle(0, pixel, combined);
+        combined = combine_cycle(1, pixel, combined);
+        if (modes & 1) {
+            // Alpha compare against the blend color alpha, or noise when dithering alpha
+            int32_t threshold = ((modes >> 1) & 1) ? (noise_ >> 24) : (state_.blend_color & 0xFF);
+            if (combined.a < threshold)
+                return;
+        }
+        bool z_compare = (modes >> 4) & 1, z_update = (modes >> 5) & 1;
+        uint32_t z_addr = (state_.z_image + (y * state_.color_image.width + x) * 2) & 0xFF'FFFF;
+        if (z_compare) {
+            uint32_t old_z = z_decompress(read_rdram16(z_addr));
+            int z_mode = (modes >> 10) & 3;
+            bool pass;
+            if (z_mode == 3) {
+                // Decal, pass when coplanar with what's already there
+                uint32_t tolerance = std::max<uint32_t>(state_.prim_dz, 16);
+                pass = (pixel.z > old_z ? pixel.z - old_z : old_z - pixel.z) <= tolerance;
+            } else {
+                pass = pixel.z < old_z;
+            }
+            if (!pass)
+                return;
+        }
+        Color memory = read_framebuffer(x, y);
+        auto unpack_rgb = [](uint32_t color) -> Color {
+            return { static_cast<int32_t>(color >> 24), static_cast<int32_t>((color >> 16) & 0xFF), static_cast<int32_t>((color >> 8) & 0xFF), static_cast<int32_t>(color & 0xFF) };
+        };
+        Color blend_color = unpack_rgb(state_.blend_color), fog_color = unpack_rgb(state_.fog_color);
+        bool force_blend = (modes >> 14) & 1;
+        auto blend = [&](int cycle, const Color& input, bool always) -> Color {
+            int p_select = (modes >> (cycle ? 28 : 30)) & 3;
+            int a_select = (modes >> (cycle ? 24 : 26)) & 3;
+            int m_select = (modes >> (cycle ? 20 : 22)) & 3;
+            int b_select = (modes >> (cycle ? 16 : 18)) & 3;
+            auto color = [&](int select) -> const Color& {
+                switch (select) {
+                    case 0: return input;
+                    case 1: return memory;
+                    case 2: return blend_color;
+                }
+                return fog_color;
+            };
+            const Color& p = color(p_select);
+            if (!always && !force_blend) {
+                // Fully covered pixels that aren't force blended pass the first input through
+                return { p.r, p.g, p.b, input.a };
+            }
+            const Color& m = color(m_select);
+            int32_t a = a_select == 0 ? combined.a : a_select == 1 ? fog_color.a : a_select == 2 ? pixel.shade.a : 0;
+            int32_t b = b_select == 0 ? 255 - a : b_select == 1 ? memory.a : b_select == 2 ? 255 : 0;
+            auto mix = [a, b](int32_t p, int32_t m) {
+                return clamp8((p * a + m * b + 127) / 255);
+            };
+            return { mix(p.r, m.r), mix(p.g, m.g), mix(p.b, m.b), input.a };
+        };
+        Color output = blend(0, combined, two_cycle);
+        if (two_cycle)
+            output = blend(1, output, false);
+        write_framebuffer(x, y, output);
+        if (z_update) {
+            write_rdram16(z_addr, z_compress(pixel.z));
+        }
+    }
+
+    RDPWorker::Color RDPWorker::read_framebuffer(int x, int y) const {
+        const RDPImage& image = state_.color_image;
+        uint32_t index = y * image.width + x;
+        switch (image.size) {
+            case 2: {
+                uint16_t pixel = read_rdram16(image.address + index * 2);
+                return { expand5(pixel >> 11), expand5((pixel >> 6) & 31), expand5((pixel >> 1) & 31), (pixel & 1) ? 255 : 0 };
+            }
+            case 3: {
+                uint32_t pixel = read_rdram32(image.address + index * 4);
+                return { static_cast<int32_t>(pixel >> 24), static_cast<int32_t>((pixel >> 16) & 0xFF), static_cast<int32_t>((pixel >> 8) & 0xFF), static_cast<int32_t>(pixel & 0xFF) };
+            }
+        }
+        int32_t i = read_rdram8(image.address + index);
+        return { i, i, i, 255 };
+    }
+
+    void RDPWorker::write_framebuffer(int x, int y, const Color& color) {
+        const RDPImage& image = state_.color_image;
+        uint32_t index = y * image.width + x;
+        switch (image.size) {
+            case 2:
+                write_rdram16(image.address + index * 2, ((color.r >> 3) << 11) | ((color.g >> 3) << 6) | ((color.b >> 3) << 1) | 1);
+                break;
+            case 3:
+                write_rdram32(image.address + index * 4, (color.r << 24) | (color.g << 16) | (color.b << 8) | 0xFF);
+                break;
+            default:
+                write_rdram8(image.address + index, color.r);
+                break;
+        }
+    }
+
+    uint8_t RDPWorker::read_rdram8(uint32_t addr) const {
+        addr &= 0xFF'FFFF;
+        return addr < rdram_.size() ? rdram_[addr] : 0;
+    }
+
+    uint16_t RDPWorker::read_rdram16(uint32_t addr) const {
+        addr &= 0xFF'FFFE;
+        if (addr + 2 > rdram_.size())
+            return 0;
+        uint16_t data;
+        std::memcpy(&data, &rdram_[addr], 2);
+        return __builtin_bswap16(data);
+    }
+
+    uint32_t RDPWorker::read_rdram32(uint32_t addr) const {
+        addr &= 0xFF'FFFC;
+        if (addr + 4 > rdram_.size())
+            return 0;
+        uint32_t data;
+        std::memcpy(&data, &rdram_[addr], 4);
+        return __builtin_bswap32(data);
+    }
+
+    void RDPWorker::write_rdram8(uint32_t addr, uint8_t data) {
+        addr &= 0xFF'FFFF;
+        if (addr < rdram_.size())
+            rdram_[addr] = data;
+    }
+
+    void RDPWorker::write_rdram16(uint32_t addr, uint16_t data) {
+        addr &= 0xFF'FFFE;
+        if (addr + 2 > rdram_.size())
+            return;
+        data = __builtin_bswap16(data);
+        std::memcpy(&rdram_[addr], &data, 2);
+    }
+
+    void RDPWorker::write_rdram32(uint32_t addr, uint32_t data) {
+        addr &= 0xFF'FFFC;
+        if (addr + 4 > rdram_.size())
+            return;
+        data = __builtin_bswap32(data);
+        std::memcpy(&rdram_[addr], &data, 4);
+    }
+}
\ No newline at end of file
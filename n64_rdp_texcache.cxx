@@ -0,0 +1,165 @@
+#include <algorithm>
+#include "n64_rdp.hxx"
+#include "n64_hash.hxx"
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        __always_inline bool overlaps(uint32_t begin, uint32_t end, uint32_t other_begin, uint32_t other_end) {
+            return begin < other_end && other_begin < end;
+        }
+    }
+
+    void RDPWorker::record_tmem_load(const TMEMLoad& load) {
+        unbind_textures();
+        uint32_t extent = load.rows ? (load.rows - 1) * load.line + load.row_bytes : 0;
+        forget_tmem_range(load.tmem, load.tmem + extent, load.split);
+        // Loads that wrap around TMEM aren't traced
+        uint32_t limit = load.split ? 0x800 : 0x1000;
+        if (load.rows == 0 || load.tmem + extent > limit)
+            return;
+        TMEMLoad traced = load;
+        // A partial 64-bit word lands out of order on odd rows, only whole words count
+        traced.row_bytes &= ~7;
+        if (traced.rows > 1 && traced.line == traced.row_bytes) {
+            // Rows back to back are the same as one long row
+            traced.row_bytes *= traced.rows;
+            traced.rows = 1;
+        }
+        if (traced.row_bytes)
+            tmem_loads_.push_back(traced);
+    }
+
+    void RDPWorker::forget_tmem_range(uint32_t begin, uint32_t end, bool split) {
+        if (end > (split ? 0x800u : 0x1000u)) {
+            tmem_loads_.clear();
+            return;
+        }
+        std::erase_if(tmem_loads_, [=](const TMEMLoad& load) {
+            uint32_t load_end = load.tmem + (load.rows - 1) * load.line + load.row_bytes;
+            for (uint32_t i = 0; i <= load.split; i++) {
+                for (uint32_t j = 0; j <= split; j++) {
+                    if (overlaps(load.tmem + i * 0x800, load_end + i * 0x800, begin + j * 0x800, end + j * 0x800))
+                        return true;
+                }
+            }
+            return false;
+        });
+    }
+
+    const RDPWorker::DecodedTexture* RDPWorker::bound_texture(int tile) {
+        if (!(bound_mask_ & (1 << tile))) {
+            bound_textures_[tile] = bind_texture(tile);
+            bound_mask_ |= 1 << tile;
+        }
+        return bound_textures_[tile];
+    }
+
+    const RDPWorker::DecodedTexture* RDPWorker::bind_texture(int tile_index) {
+        const RDPTile& tile = state_.tiles[tile_index];
+        // Every coordinate wrap_coordinate can return
+        int width = tile.mask_s ? 1 << tile.mask_s : std::max((tile.sh >> 2) - (tile.sl >> 2), 0) + 1;
+        int height = tile.mask_t ? 1 << tile.mask_t : std::max((tile.th >> 2) - (tile.tl >> 2), 0) + 1;
+        if (static_cast<size_t>(width) * height > MAX_DECODED_TEXELS)
+            return nullptr;
+        uint32_t row_bytes = tile.size == 3 ? width * 2 : ((width << tile.size) + 1) >> 1;
+        row_bytes = (row_bytes + 7) & ~7;
+        uint32_t begin = tile.tmem * 8;
+        uint32_t line = tile.line * 8;
+        uint32_t end = begin + (height - 1) * line + row_bytes;
+        // Find the load all of the tile's TMEM came from
+        const TMEMLoad* source = nullptr;
+        for (const auto& load : tmem_loads_) {
+            if (tile.size == 3 && !load.split)
+                continue;
+            if (load.rows == 1) {
+                if (begin >= load.tmem && end <= load.tmem + load.row_bytes)
+                    source = &load;
+            } else if (line && line == load.line && begin >= load.tmem) {
+                uint32_t row = (begin - load.tmem) / line;
+                uint32_t offset = (begin - load.tmem) % line;
+                if (offset + row_bytes <= load.row_bytes && row + height <= load.rows)
+                    source = &load;
+            }
+            if (source)
+                break;
+        }
+        if (!source)
+            return nullptr;
+        TextureKey key {};
+        key.load = source->command & ~(7ull << 24);
+        key.address = source->address;
+        key.image = source->image;
+        key.load_tmem = source->load_tmem;
+        key.tile = tile.tmem | (tile.line << 9) | (tile.format << 18) | (tile.size << 21) | (tile.palette << 23);
+        key.extent = width | (height << 16);
+        bool tlut = (state_.other_modes >> 47) & 1;
+        if (tlut && tile.size < 2) {
+            key.modes = (state_.other_modes >> 46) & 3;
+            uint32_t palette = tile.size == 0 ? 0x800 + tile.palette * 16 * 8 : 0x800;
+            uint32_t entries = tile.size == 0 ? 16 : 256;
+            key.tlut = Hash::Hash64(&state_.tmem[palette], entries * 8) | 1;
+        }
+        uint64_t hash = Hash::Hash64(&key, sizeof(key));
+        // The version when TMEM was loaded, RDRAM may have changed since without a reload
+        uint64_t version = source->version;
+        DecodedTexture* texture = nullptr;
+        auto it = texture_cache_.find(hash);
+        if (it != texture_cache_.end() && it->second->key == key) {
+            texture = it->second.get();
+            if (texture->version == version)
+                return texture;
+        } else {
+            if (texture_cache_.size() >= TEXTURE_CACHE_SIZE) {
+                // Other tiles may point into the cache
+                texture_cache_.clear();
+                unbind_textures();
+            }
+            auto& entry = texture_cache_[hash];
+            entry = std::make_unique<DecodedTexture>();
+            texture = entry.get();
+            texture->key = key;
+        }
+        // Missing or its RDRAM was written since, decode it from TMEM again
+        texture->rdram = source->rdram;
+        texture->version = version;
+        texture->width = width;
+        texture->height = height;
+        texture->blocks_per_row = (width + 3) >> 2;
+        texture->texels.assign(texture->blocks_per_row * ((height + 3) >> 2) * 16, 0);
+        for (int t = 0; t < height; t++) {
+            for (int s = 0; s < width; s++) {
+                Color color = fetch_texel(tile, s, t);
+                uint32_t rgba = (static_cast<uint32_t>(color.r) << 24) | (color.g << 16) | (color.b << 8) | color.a;
+                texture->texels[(((t >> 2) * texture->blocks_per_row + (s >> 2)) << 4) | ((t & 3) << 2) | (s & 3)] = rgba;
+            }
+        }
+        return texture;
+    }
+
+    uint64_t RDPWorker::rdram_version(RDRAMRange range) const {
+        if (range.end <= range.begin || rdram_versions_.empty())
+            return 0;
+        uint32_t begin = range.begin & 0xFF'FFFF;
+        uint32_t first = begin >> VERSION_PAGE_SHIFT;
+        uint32_t last = std::min<uint32_t>((begin + (range.end - range.begin) - 1) >> VERSION_PAGE_SHIFT, rdram_versions_.size() - 1);
+        // Versions only go up, so the sum changes whenever any of them does
+        uint64_t version = 0;
+        for (uint32_t page = first; page <= last; page++) {
+            version += __atomic_load_n(&rdram_versions_[page], __ATOMIC_RELAXED) + drawn_versions_[page];
+        }
+        return version;
+    }
+
+    void RDPWorker::mark_drawn() {
+        if (drawn_versions_.empty())
+            return;
+        for (const auto& range : rdp_draw_ranges(state_.color_image, state_.z_image, state_.scissor_yl, state_.other_modes)) {
+            if (range.end <= range.begin)
+                continue;
+            uint32_t last = std::min<uint32_t>((range.end - 1) >> VERSION_PAGE_SHIFT, drawn_versions_.size() - 1);
+            for (uint32_t page = range.begin >> VERSION_PAGE_SHIFT; page <= last; page++) {
+                drawn_versions_[page]++;
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,536 @@
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include "n64_rsp.hxx"
+#include "n64_cpu.hxx"
+#include "n64_hash.hxx"
+#include "../include/error_factory.hxx"
+#define TKP_INSTR_FUNC void
+
+namespace TKPEmu::N64::Devices {
+    void RSP::Reset() {
+        gpr_.fill(0);
+        std::fill(std::begin(vpr_), std::end(vpr_), _mm_setzero_si128());
+        acc_lo_ = acc_md_ = acc_hi_ = _mm_setzero_si128();
+        vco_lo_ = vco_hi_ = vcc_lo_ = vcc_hi_ = vce_ = _mm_setzero_si128();
+        div_in_ = div_out_ = 0;
+        div_dp_ = false;
+        pc_ = 0;
+        next_pc_ = 4;
+        halted_ = true;
+        status_ = __builtin_bswap32(SP_STATUS_HALT);
+        dma_spaddr_ = dma_ramaddr_ = 0;
+        dma_rdlen_ = dma_wrlen_ = 0;
+        dma_full_ = dma_busy_ = 0;
+        dma_count_ = 0;
+        pc_reg_ = 0;
+        semaphore_ = 0;
+        audio_.Reset();
+    }
+
+    void RSP::Run(int cycles) {
+        if (!microcode_) [[unlikely]] {
+            microcode_ = load_microcode();
+        }
+        auto& code = microcode_->code;
+        while (!halted_ && cycles-- > 0) {
+            cur_pc_ = pc_;
+            const auto& decoded = code[pc_ >> 2];
+            instr_ = decoded.instr;
+            pc_ = next_pc_;
+            next_pc_ = (next_pc_ + 4) & 0xFFC;
+            (decoded.handler)(this);
+        }
+        pc_reg_ = __builtin_bswap32(pc_);
+    }
+
+    RSP::func_ptr RSP::decode(Instruction instr) {
+        // Resolve the second level tables now so executing is a single indirect call
+        switch (instr.IType.op) {
+            case 0x00:
+                return SpecialTable[instr.RType.func];
+            case 0x12:
+                if (instr.RType.rs & 0x10)
+                    return VectorTable[instr.RType.func];
+                break;
+            case 0x32:
+                return LoadTable[instr.RType.rd & 15];
+            case 0x3A:
+                return StoreTable[instr.RType.rd & 15];
+        }
+        return InstructionTable[instr.IType.op];
+    }
+
+    const RSP::Microcode* RSP::load_microcode() {
+        uint64_t hash = Hash::Hash64(imem_, 0x1000);
+        auto it = microcode_cache_.find(hash);
+        if (it != microcode_cache_.end() && std::memcmp(it->second->imem.data(), imem_, 0x1000) == 0) {
+            return it->second.get();
+        }
+        if (microcode_cache_.size() >= MICROCODE_CACHE_SIZE) {
+            microcode_cache_.clear();
+        }
+        auto microcode = std::make_unique<Microcode>();
+        std::memcpy(microcode->imem.data(), imem_, 0x1000);
+        for (size_t i = 0; i < microcode->code.size(); i++) {
+            Instruction instr;
+            instr.Full = __builtin_bswap32(*reinterpret_cast<uint32_t*>(&imem_[i * 4]));
+            microcode->code[i] = { decode(instr), instr };
+        }
+        auto& entry = microcode_cache_[hash];
+        entry = std::move(microcode);
+        return entry.get();
+    }
+
+    uint32_t RSP::WriteStatus(uint32_t data) {
+        uint32_t status = this->status();
+        auto apply = [&status, data](int clear_bit, int set_bit, uint32_t flag) {
+            if ((data & (1 << clear_bit)) && !(data & (1 << set_bit)))
+                status &= ~flag;
+            else if ((data & (1 << set_bit)) && !(data & (1 << clear_bit)))
+                status |= flag;
+        };
+        apply(0, 1, SP_STATUS_HALT);
+        if (data & (1 << 2))
+            status &= ~SP_STATUS_BROKE;
+        if ((data & (1 << 3)) && !(data & (1 << 4)))
+            bus_->clear_interrupt(MIInterrupt::SP);
+        else if ((data & (1 << 4)) && !(data & (1 << 3)))
+            bus_->raise_interrupt(MIInterrupt::SP);
+        apply(5, 6, SP_STATUS_SSTEP);
+        apply(7, 8, SP_STATUS_INTR_ON_BREAK);
+        for (int i = 0; i < 8; i++) {
+            apply(9 + i * 2, 10 + i * 2, SP_STATUS_SIG0 << i);
+        }
+        status_ = __builtin_bswap32(status);
+        bool was_halted = halted_;
+        halted_ = status & SP_STATUS_HALT;
+        if (was_halted && !halted_) {
+            // A task started from the top of IMEM, by osSpTaskStart
+            if (hle_audio_ && pc_ == 0 && audio_.Run(dmem_)) {
+                // Done already, finish the way the microcode would
+                status |= SP_STATUS_HALT | SP_STATUS_BROKE | SP_STATUS_TASKDONE;
+                status_ = __builtin_bswap32(status);
+                halted_ = true;
+                if (status & SP_STATUS_INTR_ON_BREAK) {
+                    bus_->raise_interrupt(MIInterrupt::SP);
+                }
+                return status;
+            }
+            bus_->scheduler_.Schedule(SchedulerEvent::RSP, 0);
+        }
+        return status;
+    }
+
+    void RSP::WritePC(uint32_t data) {
+        pc_ = data & 0xFFC;
+        next_pc_ = (pc_ + 4) & 0xFFC;
+        pc_reg_ = __builtin_bswap32(pc_);
+    }
+
+    uint32_t RSP::ReadSemaphore() {
+        return __builtin_bswap32(std::exchange(semaphore_, __builtin_bswap32(1)));
+    }
+
+    uint32_t RSP::WriteDMALength(uint32_t data, bool to_rdram) {
+        if (dma_count_ == 2) {
+            return data;
+        }
+        dma_queue_[dma_count_++] = {
+            __builtin_bswap32(dma_spaddr_),
+            __builtin_bswap32(dma_ramaddr_),
+            data,
+            to_rdram,
+        };
+        if (dma_count_ == 1) {
+            start_dma();
+        }
+        update_dma_status();
+        return data;
+    }
+
+    void RSP::start_dma() {
+        const auto& dma = dma_queue_[0];
+        uint32_t length = ((dma.length & 0xFFF) | 7) + 1;
+        uint32_t count = ((dma.length >> 12) & 0xFF) + 1;
+        // 8 bytes per RCP cycle, which runs at 2/3 of the CPU clock
+        bus_->scheduler_.Schedule(SchedulerEvent::SPDMA, length * count * 3 / 16);
+    }
+
+    void RSP::FinishDMA() {
+        const auto dma = dma_queue_[0];
+        uint32_t length = ((dma.length & 0xFFF) | 7) + 1;
+        uint32_t count = ((dma.length >> 12) & 0xFF) + 1;
+        uint32_t skip = (dma.length >> 20) & 0xFF8;
+        if (skip == 0) {
+            // Back to back rows are one contiguous copy
+            length *= count;
+            count = 1;
+        }
+        bool imem = dma.sp_addr & 0x1000;
+        uint8_t* sp_mem = imem ? imem_ : dmem_;
+        uint32_t sp_addr = dma.sp_addr & 0xFF8;
+        uint32_t ram_addr = dma.ram_addr & 0xFF'FFF8;
+        auto& rdram = bus_->rdram_;
+        if (bus_->rcp_.rdp_.HasPendingWrites()) {
+            bus_->rcp_.rdp_.SyncRange(ram_addr, (length + skip) * count);
+        }
+        for (uint32_t row = 0; row < count; row++) {
+            uint32_t done = 0;
+            while (done < length) {
+                // Copy in runs that don't cross the end of SP memory or of installed RDRAM
+                uint32_t chunk = std::min(length - done, 0x1000 - sp_addr);
+                if (ram_addr < rdram.size()) {
+                    chunk = std::min<uint32_t>(chunk, rdram.size() - ram_addr);
+                    if (dma.to_rdram) {
+                        std::memcpy(&rdram[ram_addr], sp_mem + sp_addr, chunk);
+                        bus_->mark_rdram_dirty(ram_addr, chunk);
+                    } else {
+                        std::memcpy(sp_mem + sp_addr, &rdram[ram_addr], chunk);
+                    }
+                } else if (!dma.to_rdram) {
+                    std::memset(sp_mem + sp_addr, 0, chunk);
+                }
+                sp_addr = (sp_addr + chunk) & 0xFFF;
+                ram_addr += chunk;
+                done += chunk;
+            }
+            ram_addr += skip;
+        }
+        if (imem && !dma.to_rdram) {
+            InvalidateIMEM();
+        }
+        // The registers are left pointing past the transfer, the length counts down to -8
+        dma_spaddr_ = __builtin_bswap32((dma.sp_addr & 0x1000) | sp_addr);
+        dma_ramaddr_ = __builtin_bswap32(ram_addr & 0xFF'FFF8);
+        dma_rdlen_ = dma_wrlen_ = __builtin_bswap32((dma.length & 0xFF80'0000) | 0xFF8);
+        if (--dma_count_) {
+            dma_queue_[0] = dma_queue_[1];
+            start_dma();
+        }
+        update_dma_status();
+    }
+
+    void RSP::update_dma_status() {
+        uint32_t status = this->status() & ~(SP_STATUS_DMA_BUSY | SP_STATUS_DMA_FULL);
+        if (dma_count_ > 0)
+            status |= SP_STATUS_DMA_BUSY;
+        if (dma_count_ > 1)
+            status |= SP_STATUS_DMA_FULL;
+        status_ = __builtin_bswap32(status);
+        dma_busy_ = __builtin_bswap32(dma_count_ > 0 ? 1 : 0);
+        dma_full_ = __builtin_bswap32(dma_count_ > 1 ? 1 : 0);
+    }
+
+    uint32_t RSP::read_dmem(uint32_t addr, int size) {
+        uint32_t data = 0;
+        for (int i = 0; i < size; i++) {
+            data = (data << 8) | dmem_byte(addr + i);
+        }
+        return data;
+    }
+
+    void RSP::write_dmem(uint32_t addr, uint32_t data, int size) {
+        for (int i = size - 1; i >= 0; i--) {
+            set_dmem_byte(addr + i, data);
+            data >>= 8;
+        }
+    }
+
+    uint32_t RSP::read_cop0(int reg) {
+        if (reg & 8) {
+            return bus_->rcp_.rdp_.ReadRegister(reg & 7);
+        }
+        switch (reg & 15) {
+            case 0:
+                return __builtin_bswap32(dma_spaddr_);
+            case 1:
+                return __builtin_bswap32(dma_ramaddr_);
+            case 2:
+                return __builtin_bswap32(dma_rdlen_);
+            case 3:
+                return __builtin_bswap32(dma_wrlen_);
+            case 4:
+                return status();
+            case 5:
+                return __builtin_bswap32(dma_full_);
+            case 6:
+                return __builtin_bswap32(dma_busy_);
+            case 7:
+                return ReadSemaphore();
+        }
+        return 0;
+    }
+
+    void RSP::write_cop0(int reg, uint32_t data) {
+        if (reg & 8) {
+            bus_->rcp_.rdp_.WriteRegister(reg & 7, data);
+            return;
+        }
+        switch (reg & 15) {
+            case 0:
+                dma_spaddr_ = __builtin_bswap32(data & 0x1FF8);
+                break;
+            case 1:
+                dma_ramaddr_ = __builtin_bswap32(data & 0xFF'FFF8);
+                break;
+            case 2:
+                dma_rdlen_ = __builtin_bswap32(WriteDMALength(data, false));
+                break;
+            case 3:
+                dma_wrlen_ = __builtin_bswap32(WriteDMALength(data, true));
+                break;
+            case 4:
+                WriteStatus(data);
+                break;
+            case 7:
+                semaphore_ = 0;
+                break;
+        }
+    }
+
+    void RSP::branch(bool condition) {
+        if (condition) {
+            int32_t offset = static_cast<int16_t>(instr_.IType.immediate) << 2;
+            next_pc_ = (cur_pc_ + 4 + offset) & 0xFFC;
+        }
+    }
+
+    void RSP::link(int reg) {
+        set_gpr(reg, (cur_pc_ + 8) & 0xFFC);
+    }
+
+    TKP_INSTR_FUNC RSP::ERROR() {
+        throw ErrorFactory::generate_exception(__func__, __LINE__, "RSP ERROR opcode reached");
+    }
+
+    TKP_INSTR_FUNC RSP::NOP() {
+        // Unused encodings do nothing on the RSP
+    }
+
+    TKP_INSTR_FUNC RSP::SPECIAL() {
+        (SpecialTable[instr_.RType.func])(this);
+    }
+
+    TKP_INSTR_FUNC RSP::REGIMM() {
+        switch (instr_.RType.rt) {
+            case 0x00: r_BLTZ(); break;
+            case 0x01: r_BGEZ(); break;
+            case 0x10: r_BLTZAL(); break;
+            case 0x11: r_BGEZAL(); break;
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::J() {
+        next_pc_ = (instr_.JType.target << 2) & 0xFFC;
+    }
+
+    TKP_INSTR_FUNC RSP::JAL() {
+        link(31);
+        J();
+    }
+
+    TKP_INSTR_FUNC RSP::BEQ() {
+        branch(rs() == rt());
+    }
+
+    TKP_INSTR_FUNC RSP::BNE() {
+        branch(rs() != rt());
+    }
+
+    TKP_INSTR_FUNC RSP::BLEZ() {
+        branch(static_cast<int32_t>(rs()) <= 0);
+    }
+
+    TKP_INSTR_FUNC RSP::BGTZ() {
+        branch(static_cast<int32_t>(rs()) > 0);
+    }
+
+    TKP_INSTR_FUNC RSP::ADDI() {
+        // No overflow exceptions on the RSP, ADDI and ADDIU are the same
+        set_gpr(instr_.IType.rt, rs() + static_cast<int16_t>(instr_.IType.immediate));
+    }
+
+    TKP_INSTR_FUNC RSP::SLTI() {
+        set_gpr(instr_.IType.rt, static_cast<int32_t>(rs()) < static_cast<int16_t>(instr_.IType.immediate));
+    }
+
+    TKP_INSTR_FUNC RSP::SLTIU() {
+        set_gpr(instr_.IType.rt, rs() < static_cast<uint32_t>(static_cast<int16_t>(instr_.IType.immediate)));
+    }
+
+    TKP_INSTR_FUNC RSP::ANDI() {
+        set_gpr(instr_.IType.rt, rs() & instr_.IType.immediate);
+    }
+
+    TKP_INSTR_FUNC RSP::ORI() {
+        set_gpr(instr_.IType.rt, rs() | instr_.IType.immediate);
+    }
+
+    TKP_INSTR_FUNC RSP::XORI() {
+        set_gpr(instr_.IType.rt, rs() ^ instr_.IType.immediate);
+    }
+
+    TKP_INSTR_FUNC RSP::LUI() {
+        set_gpr(instr_.IType.rt, instr_.IType.immediate << 16);
+    }
+
+    TKP_INSTR_FUNC RSP::COP0() {
+        switch (instr_.RType.rs) {
+            case 0x00:
+                set_gpr(instr_.RType.rt, read_cop0(instr_.RType.rd));
+                break;
+            case 0x04:
+                write_cop0(instr_.RType.rd, rt());
+                break;
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::COP2() {
+        if (instr_.RType.rs & 0x10) {
+            (VectorTable[instr_.RType.func])(this);
+            return;
+        }
+        switch (instr_.RType.rs) {
+            case 0x00: MFC2(); break;
+            case 0x02: CFC2(); break;
+            case 0x04: MTC2(); break;
+            case 0x06: CTC2(); break;
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::LB() {
+        set_gpr(instr_.IType.rt, static_cast<int8_t>(read_dmem(rs() + static_cast<int16_t>(instr_.IType.immediate), 1)));
+    }
+
+    TKP_INSTR_FUNC RSP::LH() {
+        set_gpr(instr_.IType.rt, static_cast<int16_t>(read_dmem(rs() + static_cast<int16_t>(instr_.IType.immediate), 2)));
+    }
+
+    TKP_INSTR_FUNC RSP::LW() {
+        set_gpr(instr_.IType.rt, read_dmem(rs() + static_cast<int16_t>(instr_.IType.immediate), 4));
+    }
+
+    TKP_INSTR_FUNC RSP::LBU() {
+        set_gpr(instr_.IType.rt, read_dmem(rs() + static_cast<int16_t>(instr_.IType.immediate), 1));
+    }
+
+    TKP_INSTR_FUNC RSP::LHU() {
+        set_gpr(instr_.IType.rt, read_dmem(rs() + static_cast<int16_t>(instr_.IType.immediate), 2));
+    }
+
+    TKP_INSTR_FUNC RSP::SB() {
+        write_dmem(rs() + static_cast<int16_t>(instr_.IType.immediate), rt(), 1);
+    }
+
+    TKP_INSTR_FUNC RSP::SH() {
+        write_dmem(rs() + static_cast<int16_t>(instr_.IType.immediate), rt(), 2);
+    }
+
+    TKP_INSTR_FUNC RSP::SW() {
+        write_dmem(rs() + static_cast<int16_t>(instr_.IType.immediate), rt(), 4);
+    }
+
+    TKP_INSTR_FUNC RSP::LWC2() {
+        (LoadTable[instr_.RType.rd & 15])(this);
+    }
+
+    TKP_INSTR_FUNC RSP::SWC2() {
+        (StoreTable[instr_.RType.rd & 15])(this);
+    }
+
+    TKP_INSTR_FUNC RSP::s_SLL() {
+        set_gpr(instr_.RType.rd, rt() << instr_.RType.sa);
+    }
+
+    TKP_INSTR_FUNC RSP::s_SRL() {
+        set_gpr(instr_.RType.rd, rt() >> instr_.RType.sa);
+    }
+
+    TKP_INSTR_FUNC RSP::s_SRA() {
+        set_gpr(instr_.RType.rd, static_cast<int32_t>(rt()) >> instr_.RType.sa);
+    }
+
+    TKP_INSTR_FUNC RSP::s_SLLV() {
+        set_gpr(instr_.RType.rd, rt() << (rs() & 31));
+    }
+
+    TKP_INSTR_FUNC RSP::s_SRLV() {
+        set_gpr(instr_.RType.rd, rt() >> (rs() & 31));
+    }
+
+    TKP_INSTR_FUNC RSP::s_SRAV() {
+        set_gpr(instr_.RType.rd, static_cast<int32_t>(rt()) >> (rs() & 31));
+    }
+
+    TKP_INSTR_FUNC RSP::s_JR() {
+        next_pc_ = rs() & 0xFFC;
+    }
+
+    TKP_INSTR_FUNC RSP::s_JALR() {
+        uint32_t target = rs() & 0xFFC;
+        link(instr_.RType.rd);
+        next_pc_ = target;
+    }
+
+    TKP_INSTR_FUNC RSP::s_BREAK() {
+        uint32_t status = this->status() | SP_STATUS_HALT | SP_STATUS_BROKE;
+        status_ = __builtin_bswap32(status);
+        halted_ = true;
+        if (status & SP_STATUS_INTR_ON_BREAK) {
+            bus_->raise_interrupt(MIInterrupt::SP);
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::s_ADD() {
+        set_gpr(instr_.RType.rd, rs() + rt());
+    }
+
+    TKP_INSTR_FUNC RSP::s_SUB() {
+        set_gpr(instr_.RType.rd, rs() - rt());
+    }
+
+    TKP_INSTR_FUNC RSP::s_AND() {
+        set_gpr(instr_.RType.rd, rs() & rt());
+    }
+
+    TKP_INSTR_FUNC RSP::s_OR() {
+        set_gpr(instr_.RType.rd, rs() | rt());
+    }
+
+    TKP_INSTR_FUNC RSP::s_XOR() {
+        set_gpr(instr_.RType.rd, rs() ^ rt());
+    }
+
+    TKP_INSTR_FUNC RSP::s_NOR() {
+        set_gpr(instr_.RType.rd, ~(rs() | rt()));
+    }
+
+    TKP_INSTR_FUNC RSP::s_SLT() {
+        set_gpr(instr_.RType.rd, static_cast<int32_t>(rs()) < static_cast<int32_t>(rt()));
+    }
+
+    TKP_INSTR_FUNC RSP::s_SLTU() {
+        set_gpr(instr_.RType.rd, rs() < rt());
+    }
+
+    TKP_INSTR_FUNC RSP::r_BLTZ() {
+        branch(static_cast<int32_t>(rs()) < 0);
+    }
+
+    TKP_INSTR_FUNC RSP::r_BGEZ() {
+        branch(static_cast<int32_t>(rs()) >= 0);
+    }
+
+    TKP_INSTR_FUNC RSP::r_BLTZAL() {
+        bool condition = static_cast<int32_t>(rs()) < 0;
+        link(31);
+        branch(condition);
+    }
+
+    TKP_INSTR_FUNC RSP::r_BGEZAL() {
+        bool condition = static_cast<int32_t>(rs()) >= 0;
+        link(31);
+        branch(condition);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,350 @@
+#pragma once
+#ifndef TKP_N64_RSP_H
+#define TKP_N64_RSP_H
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <immintrin.h>
+#include "n64_types.hxx"
+#include "n64_rsp_audio.hxx"
+
+namespace TKPEmu::N64::Devices {
+    class CPUBus;
+    class RSP;
+    template<auto MemberFunc>
+    static void rsp_lut_wrapper(RSP* rsp) {
+        (rsp->*MemberFunc)();
+    }
+    // SP_STATUS bits as read
+    constexpr uint32_t SP_STATUS_HALT          = 1 << 0;
+    constexpr uint32_t SP_STATUS_BROKE         = 1 << 1;
+    constexpr uint32_t SP_STATUS_DMA_BUSY      = 1 << 2;
+    constexpr uint32_t SP_STATUS_DMA_FULL      = 1 << 3;
+    constexpr uint32_t SP_STATUS_IO_FULL       = 1 << 4;
+    constexpr uint32_t SP_STATUS_SSTEP         = 1 << 5;
+    constexpr uint32_t SP_STATUS_INTR_ON_BREAK = 1 << 6;
+    constexpr uint32_t SP_STATUS_SIG0          = 1 << 7;
+    // Signal 2, set by microcode when its task is done
+    constexpr uint32_t SP_STATUS_TASKDONE      = SP_STATUS_SIG0 << 2;
+    /**
+        Reality Signal Processor
+
+        A MIPS-like scalar core that runs microcode from IMEM against DMEM, plus a vector
+        unit with 32 registers of 8 16-bit lanes and a 48-bit accumulator per lane.
+        Each vector register is held in an SSE register with element 0 in the lowest
+        lane, so most vector instructions map to a handful of 16-bit SIMD operations.
+        The accumulator is kept as three 16-bit slices (high, mid, low), the way
+        the hardware exposes it through VSAR.
+
+        The core runs in batches scheduled alongside the CPU, see SchedulerEvent::RSP.
+        Instructions aren't decoded as they're fetched, instead the whole of IMEM is decoded
+        to final handlers once per distinct microcode and cached by content hash, so the
+        graphics and audio microcodes that are uploaded over and over are decoded once.
+
+        @see https://n64brew.dev/wiki/Reality_Signal_Processor
+    */
+    class RSP {
+    public:
+        void Reset();
+        void SetBus(CPUBus* bus) {
+            bus_ = bus;
+            audio_.SetBus(bus);
+        }
+        // Audio tasks with a known microcode run natively instead of on the interpreter
+        void SetHLEAudio(bool enabled) { hle_audio_ = enabled; }
+        void SetMemory(uint8_t* dmem, uint8_t* imem) {
+            dmem_ = dmem;
+            imem_ = imem;
+            InvalidateIMEM();
+        }
+        // Must be called whenever IMEM is written, the next batch re-resolves the microcode
+        void InvalidateIMEM() { microcode_ = nullptr; }
+        // Runs up to cycles instructions, stops early if the RSP halts
+        void Run(int cycles);
+        // Applies a write to SP_STATUS (set/clear command bits), returns the new status
+        uint32_t WriteStatus(uint32_t data);
+        void WritePC(uint32_t data);
+        // Reads SP_SEMAPHORE, which sets it, so only one of the CPU and RSP sees it clear
+        uint32_t ReadSemaphore();
+        /**
+            Queues a DMA from the current SP_MEM_ADDR and SP_DRAM_ADDR, data is the value written
+            to SP_RD_LEN (RDRAM to SP memory) or SP_WR_LEN (SP memory to RDRAM).
+            One DMA can be pending behind the one in flight, further requests are dropped.
+            Returns the value the length register reads back as.
+        */
+        uint32_t WriteDMALength(uint32_t data, bool to_rdram);
+        // Performs the DMA in flight and starts the pending one, see SchedulerEvent::SPDMA
+        void FinishDMA();
+        bool IsHalted() const { return halted_; }
+        constexpr static int BATCH_CYCLES = 256;
+        // The RSP is clocked at 2/3 of the CPU
+        constexpr static int BATCH_CPU_CYCLES = BATCH_CYCLES * 3 / 2;
+    private:
+        using func_ptr = void (*)(RSP*);
+        struct DecodedInstruction {
+            func_ptr handler;
+            Instruction instr;
+        };
+        // IMEM decoded to one handler per word, along with the image it was decoded from
+        struct Microcode {
+            std::array<uint8_t, 0x1000> imem;
+            std::array<DecodedInstruction, 0x400> code;
+        };
+        static func_ptr decode(Instruction instr);
+        struct DMARequest {
+            uint32_t sp_addr;
+            uint32_t ram_addr;
+            uint32_t length;
+            bool to_rdram;
+        };
+        void start_dma();
+        void update_dma_status();
+        const Microcode* load_microcode();
+        void ERROR();
+        void NOP();
+        // Scalar unit
+        void SPECIAL();
+        void REGIMM();
+        void J();
+        void JAL();
+        void BEQ();
+        void BNE();
+        void BLEZ();
+        void BGTZ();
+        void ADDI();
+        void SLTI();
+        void SLTIU();
+        void ANDI();
+        void ORI();
+        void XORI();
+        void LUI();
+        void COP0();
+        void COP2();
+        void LB();
+        void LH();
+        void LW();
+        void LBU();
+        void LHU();
+        void SB();
+        void SH();
+        void SW();
+        void LWC2();
+        void SWC2();
+        void s_SLL();
+        void s_SRL();
+        void s_SRA();
+        void s_SLLV();
+        void s_SRLV();
+        void s_SRAV();
+        void s_JR();
+        void s_JALR();
+        void s_BREAK();
+        void s_ADD();
+        void s_SUB();
+        void s_AND();
+        void s_OR();
+        void s_XOR();
+        void s_NOR();
+        void s_SLT();
+        void s_SLTU();
+        void r_BLTZ();
+        void r_BGEZ();
+        void r_BLTZAL();
+        void r_BGEZAL();
+        // Vector unit moves
+        void MFC2();
+        void MTC2();
+        void CFC2();
+        void CTC2();
+        // Vector loads and stores, indexed by the rd field of LWC2/SWC2
+        void LBV();
+        void LSV();
+        void LLV();
+        void LDV();
+        void LQV();
+        void LRV();
+        void LPV();
+        void LUV();
+        void LHV();
+        void LFV();
+        void LTV();
+        void SBV();
+        void SSV();
+        void SLV();
+        void SDV();
+        void SQV();
+        void SRV();
+        void SPV();
+        void SUV();
+        void SHV();
+        void SFV();
+        void SWV();
+        void STV();
+        // Vector computational instructions
+        void VMULF();
+        void VMULU();
+        void VRNDP();
+        void VMULQ();
+        void VMUDL();
+        void VMUDM();
+        void VMUDN();
+        void VMUDH();
+        void VMACF();
+        void VMACU();
+        void VRNDN();
+        void VMACQ();
+        void VMADL();
+        void VMADM();
+        void VMADN();
+        void VMADH();
+        void VADD();
+        void VSUB();
+        void VABS();
+        void VADDC();
+        void VSUBC();
+        void VSAR();
+        void VLT();
+        void VEQ();
+        void VNE();
+        void VGE();
+        void VCL();
+        void VCH();
+        void VCR();
+        void VMRG();
+        void VAND();
+        void VNAND();
+        void VOR();
+        void VNOR();
+        void VXOR();
+        void VNXOR();
+        void VRCP();
+        void VRCPL();
+        void VRCPH();
+        void VMOV();
+        void VRSQ();
+        void VRSQL();
+        void VRSQH();
+
+        constexpr static std::array<func_ptr, 64> InstructionTable = {
+            &rsp_lut_wrapper<&RSP::SPECIAL>, &rsp_lut_wrapper<&RSP::REGIMM>, &rsp_lut_wrapper<&RSP::J>, &rsp_lut_wrapper<&RSP::JAL>, &rsp_lut_wrapper<&RSP::BEQ>, &rsp_lut_wrapper<&RSP::BNE>, &rsp_lut_wrapper<&RSP::BLEZ>, &rsp_lut_wrapper<&RSP::BGTZ>,
+            &rsp_lut_wrapper<&RSP::ADDI>, &rsp_lut_wrapper<&RSP::ADDI>, &rsp_lut_wrapper<&RSP::SLTI>, &rsp_lut_wrapper<&RSP::SLTIU>, &rsp_lut_wrapper<&RSP::ANDI>, &rsp_lut_wrapper<&RSP::ORI>, &rsp_lut_wrapper<&RSP::XORI>, &rsp_lut_wrapper<&RSP::LUI>,
+            &rsp_lut_wrapper<&RSP::COP0>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::COP2>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::LB>, &rsp_lut_wrapper<&RSP::LH>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::LW>, &rsp_lut_wrapper<&RSP::LBU>, &rsp_lut_wrapper<&RSP::LHU>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::LW>,
+            &rsp_lut_wrapper<&RSP::SB>, &rsp_lut_wrapper<&RSP::SH>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::SW>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::LWC2>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::SWC2>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+        };
+        constexpr static std::array<func_ptr, 64> SpecialTable = {
+            &rsp_lut_wrapper<&RSP::s_SLL>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::s_SRL>, &rsp_lut_wrapper<&RSP::s_SRA>, &rsp_lut_wrapper<&RSP::s_SLLV>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::s_SRLV>, &rsp_lut_wrapper<&RSP::s_SRAV>,
+            &rsp_lut_wrapper<&RSP::s_JR>, &rsp_lut_wrapper<&RSP::s_JALR>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::s_BREAK>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::s_ADD>, &rsp_lut_wrapper<&RSP::s_ADD>, &rsp_lut_wrapper<&RSP::s_SUB>, &rsp_lut_wrapper<&RSP::s_SUB>, &rsp_lut_wrapper<&RSP::s_AND>, &rsp_lut_wrapper<&RSP::s_OR>, &rsp_lut_wrapper<&RSP::s_XOR>, &rsp_lut_wrapper<&RSP::s_NOR>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::s_SLT>, &rsp_lut_wrapper<&RSP::s_SLTU>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+        };
+        constexpr static std::array<func_ptr, 16> LoadTable = {
+            &rsp_lut_wrapper<&RSP::LBV>, &rsp_lut_wrapper<&RSP::LSV>, &rsp_lut_wrapper<&RSP::LLV>, &rsp_lut_wrapper<&RSP::LDV>, &rsp_lut_wrapper<&RSP::LQV>, &rsp_lut_wrapper<&RSP::LRV>, &rsp_lut_wrapper<&RSP::LPV>, &rsp_lut_wrapper<&RSP::LUV>,
+            &rsp_lut_wrapper<&RSP::LHV>, &rsp_lut_wrapper<&RSP::LFV>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::LTV>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+        };
+        constexpr static std::array<func_ptr, 16> StoreTable = {
+            &rsp_lut_wrapper<&RSP::SBV>, &rsp_lut_wrapper<&RSP::SSV>, &rsp_lut_wrapper<&RSP::SLV>, &rsp_lut_wrapper<&RSP::SDV>, &rsp_lut_wrapper<&RSP::SQV>, &rsp_lut_wrapper<&RSP::SRV>, &rsp_lut_wrapper<&RSP::SPV>, &rsp_lut_wrapper<&RSP::SUV>,
+            &rsp_lut_wrapper<&RSP::SHV>, &rsp_lut_wrapper<&RSP::SFV>, &rsp_lut_wrapper<&RSP::SWV>, &rsp_lut_wrapper<&RSP::STV>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+        };
+        constexpr static std::array<func_ptr, 64> VectorTable = {
+            &rsp_lut_wrapper<&RSP::VMULF>, &rsp_lut_wrapper<&RSP::VMULU>, &rsp_lut_wrapper<&RSP::VRNDP>, &rsp_lut_wrapper<&RSP::VMULQ>, &rsp_lut_wrapper<&RSP::VMUDL>, &rsp_lut_wrapper<&RSP::VMUDM>, &rsp_lut_wrapper<&RSP::VMUDN>, &rsp_lut_wrapper<&RSP::VMUDH>,
+            &rsp_lut_wrapper<&RSP::VMACF>, &rsp_lut_wrapper<&RSP::VMACU>, &rsp_lut_wrapper<&RSP::VRNDN>, &rsp_lut_wrapper<&RSP::VMACQ>, &rsp_lut_wrapper<&RSP::VMADL>, &rsp_lut_wrapper<&RSP::VMADM>, &rsp_lut_wrapper<&RSP::VMADN>, &rsp_lut_wrapper<&RSP::VMADH>,
+            &rsp_lut_wrapper<&RSP::VADD>, &rsp_lut_wrapper<&RSP::VSUB>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::VABS>, &rsp_lut_wrapper<&RSP::VADDC>, &rsp_lut_wrapper<&RSP::VSUBC>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::VSAR>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::VLT>, &rsp_lut_wrapper<&RSP::VEQ>, &rsp_lut_wrapper<&RSP::VNE>, &rsp_lut_wrapper<&RSP::VGE>, &rsp_lut_wrapper<&RSP::VCL>, &rsp_lut_wrapper<&RSP::VCH>, &rsp_lut_wrapper<&RSP::VCR>, &rsp_lut_wrapper<&RSP::VMRG>,
+            &rsp_lut_wrapper<&RSP::VAND>, &rsp_lut_wrapper<&RSP::VNAND>, &rsp_lut_wrapper<&RSP::VOR>, &rsp_lut_wrapper<&RSP::VNOR>, &rsp_lut_wrapper<&RSP::VXOR>, &rsp_lut_wrapper<&RSP::VNXOR>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::VRCP>, &rsp_lut_wrapper<&RSP::VRCPL>, &rsp_lut_wrapper<&RSP::VRCPH>, &rsp_lut_wrapper<&RSP::VMOV>, &rsp_lut_wrapper<&RSP::VRSQ>, &rsp_lut_wrapper<&RSP::VRSQL>, &rsp_lut_wrapper<&RSP::VRSQH>, &rsp_lut_wrapper<&RSP::NOP>,
+            &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>, &rsp_lut_wrapper<&RSP::NOP>,
+        };
+
+        // Scalar helpers
+        __always_inline void branch(bool condition);
+        __always_inline void link(int reg);
+        __always_inline uint32_t rs() const { return gpr_[instr_.RType.rs]; }
+        __always_inline uint32_t rt() const { return gpr_[instr_.RType.rt]; }
+        __always_inline void set_gpr(int reg, uint32_t value) {
+            gpr_[reg] = value;
+            gpr_[0] = 0;
+        }
+        uint32_t read_dmem(uint32_t addr, int size);
+        void write_dmem(uint32_t addr, uint32_t data, int size);
+        uint32_t read_cop0(int reg);
+        void write_cop0(int reg, uint32_t data);
+        uint32_t status() const { return __builtin_bswap32(status_); }
+        // Vector helpers
+        __always_inline uint8_t& vbyte(int reg, int byte) {
+            // Registers are big endian, lanes are little endian
+            return reinterpret_cast<uint8_t*>(&vpr_[reg])[(byte & 15) ^ 1];
+        }
+        __always_inline uint16_t& velement(int reg, int element) {
+            return reinterpret_cast<uint16_t*>(&vpr_[reg])[element & 7];
+        }
+        __always_inline int vd() const { return (instr_.Full >> 6) & 31; }
+        __always_inline int vs() const { return (instr_.Full >> 11) & 31; }
+        __always_inline int vt() const { return (instr_.Full >> 16) & 31; }
+        __always_inline int velement_field() const { return (instr_.Full >> 21) & 15; }
+        // vt with the element specifier applied
+        __always_inline __m128i vte() const;
+        // Vector loads and stores: element and effective address
+        __always_inline int ls_element() const { return (instr_.Full >> 7) & 15; }
+        __always_inline uint32_t ls_address(int size) const {
+            int32_t offset = static_cast<int32_t>(instr_.Full << 25) >> 25;
+            return rs() + offset * size;
+        }
+        __always_inline uint8_t dmem_byte(uint32_t addr) const { return dmem_[addr & 0xFFF]; }
+        __always_inline void set_dmem_byte(uint32_t addr, uint8_t data) { dmem_[addr & 0xFFF] = data; }
+        __always_inline void acc_add(__m128i lo, __m128i md, __m128i hi);
+        __always_inline void vrcp_common(bool low, bool sqrt);
+        __always_inline void vrcph_common();
+
+        // Scalar unit
+        std::array<uint32_t, 32> gpr_ {};
+        Instruction instr_ {};
+        // Address of the instruction being executed
+        uint32_t cur_pc_ = 0;
+        uint32_t pc_ = 0;
+        uint32_t next_pc_ = 4;
+        bool halted_ = true;
+        // Vector unit
+        __m128i vpr_[32] {};
+        __m128i acc_lo_ {}, acc_md_ {}, acc_hi_ {};
+        __m128i vco_lo_ {}, vco_hi_ {}, vcc_lo_ {}, vcc_hi_ {}, vce_ {};
+        int16_t div_in_ = 0;
+        int16_t div_out_ = 0;
+        bool div_dp_ = false;
+
+        uint8_t* dmem_ = nullptr;
+        uint8_t* imem_ = nullptr;
+        // Microcode currently in IMEM, nullptr if IMEM changed since it was looked up
+        const Microcode* microcode_ = nullptr;
+        std::unordered_map<uint64_t, std::unique_ptr<Microcode>> microcode_cache_;
+        constexpr static size_t MICROCODE_CACHE_SIZE = 32;
+        CPUBus* bus_ = nullptr;
+        AudioHLE audio_;
+        bool hle_audio_ = false;
+        // Memory mapped registers, kept in guest byte order like the rest of the bus
+        uint32_t status_ = __builtin_bswap32(SP_STATUS_HALT);
+        uint32_t dma_spaddr_ = 0;
+        uint32_t dma_ramaddr_ = 0;
+        uint32_t dma_rdlen_ = 0;
+        uint32_t dma_wrlen_ = 0;
+        uint32_t dma_full_ = 0;
+        uint32_t dma_busy_ = 0;
+        uint32_t pc_reg_ = 0;
+        uint32_t semaphore_ = 0;
+        // The DMA in flight first, then the pending one
+        std::array<DMARequest, 2> dma_queue_ {};
+        int dma_count_ = 0;
+        friend class CPUBus;
+        friend class CPU;
+    };
+}
+#endif
\ No newline at end of file
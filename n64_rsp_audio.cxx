@@ -0,0 +1,613 @@
+#include <algorithm>
+#include <cstring>
+#include "n64_rsp_audio.hxx"
+#include "n64_cpu.hxx"
+#include "n64_hash.hxx"
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        // Command flags
+        constexpr uint8_t A_INIT = 0x01;
+        constexpr uint8_t A_LOOP = 0x02;
+        constexpr uint8_t A_LEFT = 0x02;
+        constexpr uint8_t A_VOL  = 0x04;
+        constexpr uint8_t A_AUX  = 0x08;
+        // Buffer addresses in ABI1 commands are relative to the start of the microcode's work area
+        constexpr uint16_t DMEM_BASE = 0x5C0;
+
+        struct AudioUcodeInfo {
+            // Word 0x28 of the data segment
+            uint32_t signature;
+            AudioABI abi;
+        };
+        constexpr std::array<AudioUcodeInfo, 3> AudioUcodeTable = {{
+            { 0x1E24'138C, AudioABI::ABI1 },
+            // GoldenEye
+            { 0x1DC8'138C, AudioABI::ABI1 },
+            // Blast Corps, Diddy Kong Racing
+            { 0x1E3C'1390, AudioABI::ABI1 },
+        }};
+
+        // Coefficients of the 4 tap interpolation filter for each of 64 phases, the second
+        // half mirrors the first
+        constexpr auto ResampleTable = [] {
+            constexpr uint16_t half[32][4] = {
+                { 0x0C39, 0x66AD, 0x0D46, 0xFFDF }, { 0x0B39, 0x6696, 0x0E5F, 0xFFD8 },
+                { 0x0A44, 0x6669, 0x0F83, 0xFFD0 }, { 0x095A, 0x6626, 0x10B4, 0xFFC8 },
+                { 0x087D, 0x65CD, 0x11F0, 0xFFBF }, { 0x07AB, 0x655E, 0x1338, 0xFFB6 },
+                { 0x06E4, 0x64D9, 0x148C, 0xFFAC }, { 0x0628, 0x643F, 0x15EB, 0xFFA1 },
+                { 0x0577, 0x638F, 0x1756, 0xFF96 }, { 0x04D1, 0x62CB, 0x18CB, 0xFF8A },
+                { 0x0435, 0x61F3, 0x1A4C, 0xFF7E }, { 0x03A4, 0x6106, 0x1BD7, 0xFF71 },
+                { 0x031C, 0x6007, 0x1D6C, 0xFF64 }, { 0x029F, 0x5EF5, 0x1F0B, 0xFF56 },
+                { 0x022A, 0x5DD0, 0x20B3, 0xFF48 }, { 0x01BE, 0x5C9A, 0x2264, 0xFF3A },
+                { 0x015B, 0x5B53, 0x241E, 0xFF2C }, { 0x0101, 0x59FC, 0x25E0, 0xFF1E },
+                { 0x00AE, 0x5896, 0x27A9, 0xFF10 }, { 0x0063, 0x5720, 0x297A, 0xFF02 },
+                { 0x001F, 0x559D, 0x2B50, 0xFEF4 }, { 0xFFE2, 0x540D, 0x2D2C, 0xFEE8 },
+                { 0xFFAC, 0x5270, 0x2F0D, 0xFEDB }, { 0xFF7C, 0x50C7, 0x30F3, 0xFED0 },
+                { 0xFF53, 0x4F14, 0x32DC, 0xFEC6 }, { 0xFF2E, 0x4D57, 0x34C8, 0xFEBD },
+                { 0xFF0F, 0x4B91, 0x36B6, 0xFEB6 }, { 0xFEF5, 0x49C2, 0x38A5, 0xFEB0 },
+                { 0xFEDF, 0x47ED, 0x3A95, 0xFEAC }, { 0xFECE, 0x4611, 0x3C85, 0xFEAB },
+                { 0xFEC0, 0x4430, 0x3E74, 0xFEAC }, { 0xFEB6, 0x424A, 0x4060, 0xFEAF },
+            };
+            std::array<int16_t, 64 * 4> table {};
+            for (int phase = 0; phase < 32; phase++) {
+                for (int tap = 0; tap < 4; tap++) {
+                    table[phase * 4 + tap] = static_cast<int16_t>(half[phase][tap]);
+                    table[(63 - phase) * 4 + 3 - tap] = static_cast<int16_t>(half[phase][tap]);
+                }
+            }
+            return table;
+        }();
+
+        struct Ramp {
+            int32_t value;
+            int32_t target;
+            int32_t step;
+        };
+
+        __always_inline int16_t clamp16(int64_t value) {
+            return std::clamp<int64_t>(value, INT16_MIN, INT16_MAX);
+        }
+
+        __always_inline uint32_t align(uint32_t value, uint32_t alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+        __always_inline int32_t read32(const uint8_t* ptr) {
+            uint32_t value;
+            std::memcpy(&value, ptr, 4);
+            return __builtin_bswap32(value);
+        }
+
+        __always_inline void write32(uint8_t* ptr, int32_t value) {
+            uint32_t swapped = __builtin_bswap32(value);
+            std::memcpy(ptr, &swapped, 4);
+        }
+
+        // Steps towards the target, returns the new volume
+        __always_inline int16_t ramp_step(Ramp& ramp) {
+            ramp.value = static_cast<uint32_t>(ramp.value) + ramp.step;
+            bool reached = ramp.step <= 0 ? ramp.value <= ramp.target : ramp.value >= ramp.target;
+            if (reached) {
+                ramp.value = ramp.target;
+                ramp.step = 0;
+            }
+            return ramp.value >> 16;
+        }
+
+        // Samples are big endian in the buffer
+        __always_inline __m128i swap_samples(__m128i samples) {
+            return _mm_shuffle_epi8(samples, _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+        }
+
+        __always_inline __m128i load_samples(const uint8_t* ptr) {
+            return swap_samples(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)));
+        }
+
+        __always_inline void store_samples(uint8_t* ptr, __m128i samples) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), swap_samples(samples));
+        }
+
+        // Full 32-bit products of each lane, lanes 0-3 in lo and 4-7 in hi
+        __always_inline void multiply(__m128i a, __m128i b, __m128i& lo, __m128i& hi) {
+            __m128i low = _mm_mullo_epi16(a, b);
+            __m128i high = _mm_mulhi_epi16(a, b);
+            lo = _mm_unpacklo_epi16(low, high);
+            hi = _mm_unpackhi_epi16(low, high);
+        }
+
+        // (a * b + 0x4000) >> 15, saturated
+        __always_inline __m128i multiply_q15(__m128i a, __m128i b) {
+            __m128i lo, hi;
+            multiply(a, b, lo, hi);
+            __m128i round = _mm_set1_epi32(0x4000);
+            lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 15);
+            hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 15);
+            return _mm_packs_epi32(lo, hi);
+        }
+
+        // dst + ((src * gain) >> 15), saturated
+        __always_inline __m128i mix_samples(__m128i dst, __m128i src, __m128i gain) {
+            __m128i lo, hi;
+            multiply(src, gain, lo, hi);
+            lo = _mm_add_epi32(_mm_cvtepi16_epi32(dst), _mm_srai_epi32(lo, 15));
+            hi = _mm_add_epi32(_mm_cvtepi16_epi32(_mm_srli_si128(dst, 8)), _mm_srai_epi32(hi, 15));
+            return _mm_packs_epi32(lo, hi);
+        }
+    }
+
+    void AudioHLE::Reset() {
+        segments_.fill(0);
+        in_ = out_ = count_ = 0;
+        dry_right_ = wet_left_ = wet_right_ = 0;
+        dry_ = wet_ = 0;
+        volume_.fill(0);
+        target_.fill(0);
+        rate_.fill(0);
+        loop_ = 0;
+        table_.fill(0);
+        predictors_dirty_ = true;
+        buffer_.fill(0);
+    }
+
+    bool AudioHLE::Run(const uint8_t* dmem) {
+        auto word = [dmem](uint32_t addr) {
+            return static_cast<uint32_t>(read32(dmem + addr));
+        };
+        if (word(TASK_TYPE) != M_AUDTASK)
+            return false;
+        switch (identify(word(TASK_UCODE), word(TASK_UCODE_SIZE), word(TASK_UCODE_DATA))) {
+            case AudioABI::ABI1:
+                run_abi1(word(TASK_DATA_PTR), word(TASK_DATA_SIZE));
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    AudioABI AudioHLE::identify(uint32_t ucode, uint32_t ucode_size, uint32_t ucode_data) {
+        std::array<uint8_t, 0x1000> text;
+        uint32_t size = ucode_size ? std::min<uint32_t>(ucode_size, text.size()) : text.size();
+        load(text.data(), ucode, size);
+        uint64_t hash = Hash::Hash64(text.data(), size);
+        auto it = abi_cache_.find(hash);
+        if (it != abi_cache_.end())
+            return it->second;
+        AudioABI abi = AudioABI::None;
+        if (load32(ucode_data) == 1 && load32(ucode_data + 0x30) == 0xF000'0F00) {
+            uint32_t signature = load32(ucode_data + 0x28);
+            for (const auto& info : AudioUcodeTable) {
+                if (info.signature == signature)
+                    abi = info.abi;
+            }
+        }
+        if (abi_cache_.size() >= ABI_CACHE_SIZE) {
+            abi_cache_.clear();
+        }
+        abi_cache_[hash] = abi;
+        return abi;
+    }
+
+    void AudioHLE::run_abi1(uint32_t alist, uint32_t size) {
+        segments_.fill(0);
+        alist_.resize(std::min<size_t>(size, bus_->rdram_.size()) & ~7);
+        load(alist_.data(), alist, alist_.size());
+        for (size_t i = 0; i < alist_.size(); i += 8) {
+            uint32_t w1 = read32(&alist_[i]);
+            uint32_t w2 = read32(&alist_[i + 4]);
+            switch ((w1 >> 24) & 0x7F) {
+                case 0x00: break;
+                case 0x01: adpcm(w1, w2); break;
+                case 0x02: clear_buffer(w1, w2); break;
+                case 0x03: envelope_mixer(w1, w2); break;
+                case 0x04: load_buffer(w1, w2); break;
+                case 0x05: resample(w1, w2); break;
+                case 0x06: save_buffer(w1, w2); break;
+                case 0x07: {
+                    uint32_t segment = w2 >> 24;
+                    segments_[segment < segments_.size() ? segment : 0] = w2 & 0xFF'FFFF;
+                    break;
+                }
+                case 0x08: set_buffer(w1, w2); break;
+                case 0x09: set_volume(w1, w2); break;
+                case 0x0A: dmem_move(w1, w2); break;
+                case 0x0B: load_adpcm(w1, w2); break;
+                case 0x0C: mixer(w1, w2); break;
+                case 0x0D: interleave(w1, w2); break;
+                case 0x0E: pole_filter(w1, w2); break;
+                case 0x0F: loop_ = segment_address(w2); break;
+                // Not in this ABI, the microcode ignores them too
+                default: break;
+            }
+        }
+    }
+
+    void AudioHLE::load(void* dst, uint32_t addr, uint32_t size) {
+        auto& rdram = bus_->rdram_;
+        addr &= 0xFF'FFFF;
+        if (bus_->rcp_.rdp_.HasPendingWrites()) {
+            bus_->rcp_.rdp_.SyncRange(addr, size);
+        }
+        uint32_t valid = addr < rdram.size() ? std::min<uint32_t>(size, rdram.size() - addr) : 0;
+        if (valid)
+            std::memcpy(dst, &rdram[addr], valid);
+        std::memset(static_cast<uint8_t*>(dst) + valid, 0, size - valid);
+    }
+
+    void AudioHLE::store(uint32_t addr, const void* src, uint32_t size) {
+        auto& rdram = bus_->rdram_;
+        addr &= 0xFF'FFFF;
+        if (bus_->rcp_.rdp_.HasPendingWrites()) {
+            bus_->rcp_.rdp_.SyncRange(addr, size);
+        }
+        uint32_t valid = addr < rdram.size() ? std::min<uint32_t>(size, rdram.size() - addr) : 0;
+        if (valid) {
+            std::memcpy(&rdram[addr], src, valid);
+            bus_->mark_rdram_dirty(addr, valid);
+        }
+    }
+
+    uint32_t AudioHLE::load32(uint32_t addr) {
+        uint8_t data[4];
+        load(data, addr, 4);
+        return read32(data);
+    }
+
+    uint32_t AudioHLE::segment_address(uint32_t address) const {
+        uint32_t segment = address >> 24;
+        return segments_[segment < segments_.size() ? segment : 0] + (address & 0xFF'FFFF);
+    }
+
+    void AudioHLE::clear_buffer(uint32_t w1, uint32_t w2) {
+        uint16_t dmem = w1 + DMEM_BASE;
+        uint32_t count = align(w2 & 0xFFFF, 16);
+        for (uint32_t i = 0; i < count; i += 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&buffer_[(dmem + i) & 0xFFF]), _mm_setzero_si128());
+        }
+    }
+
+    void AudioHLE::envelope_mixer(uint32_t w1, uint32_t w2) {
+        uint8_t flags = w1 >> 16;
+        uint32_t address = segment_address(w2);
+        // Envelope state carried between tasks, in a layout only this function reads
+        std::array<uint8_t, 40> state;
+        load(state.data(), address, state.size());
+        std::array<Ramp, 2> ramps;
+        std::array<int32_t, 2> sequence, rates;
+        int16_t dry = dry_, wet = wet_;
+        if (flags & A_INIT) {
+            for (int i = 0; i < 2; i++) {
+                ramps[i].value = volume_[i] << 16;
+                ramps[i].target = target_[i] << 16;
+                rates[i] = rate_[i];
+                sequence[i] = static_cast<int64_t>(volume_[i]) * rate_[i];
+            }
+        } else {
+            wet = read32(&state[0]) >> 16;
+            dry = read32(&state[4]) >> 16;
+            for (int i = 0; i < 2; i++) {
+                ramps[i].target = read32(&state[8 + i * 4]);
+                rates[i] = read32(&state[16 + i * 4]);
+                sequence[i] = read32(&state[24 + i * 4]);
+                ramps[i].value = read32(&state[32 + i * 4]);
+            }
+        }
+        for (auto& ramp : ramps) {
+            ramp.step = static_cast<uint32_t>(ramp.target) - ramp.value;
+        }
+        // Without the aux flag only the dry pair is mixed into
+        std::array<uint16_t, 4> outputs = { out_, dry_right_, wet_left_, wet_right_ };
+        int buffers = (flags & A_AUX) ? 4 : 2;
+        __m128i dry_gain = _mm_set1_epi16(dry);
+        __m128i wet_gain = _mm_set1_epi16(wet);
+        for (uint32_t offset = 0; offset < count_; offset += 16) {
+            // The ramps aim for an exponential curve, re-aimed every 8 samples
+            for (int i = 0; i < 2; i++) {
+                if (ramps[i].step != 0) {
+                    sequence[i] = (static_cast<int64_t>(sequence[i]) * rates[i]) >> 16;
+                    ramps[i].step = static_cast<int32_t>(static_cast<uint32_t>(sequence[i]) - ramps[i].value) >> 3;
+                }
+            }
+            alignas(16) std::array<int16_t, 8> left, right;
+            for (int x = 0; x < 8; x++) {
+                left[x] = ramp_step(ramps[0]);
+                right[x] = ramp_step(ramps[1]);
+            }
+            __m128i left_volume = _mm_load_si128(reinterpret_cast<const __m128i*>(left.data()));
+            __m128i right_volume = _mm_load_si128(reinterpret_cast<const __m128i*>(right.data()));
+            __m128i gains[4] = {
+                multiply_q15(left_volume, dry_gain),
+                multiply_q15(right_volume, dry_gain),
+                multiply_q15(left_volume, wet_gain),
+                multiply_q15(right_volume, wet_gain),
+            };
+            __m128i input = load_samples(&buffer_[(in_ + offset) & 0xFFF]);
+            for (int i = 0; i < buffers; i++) {
+                uint8_t* ptr = &buffer_[(outputs[i] + offset) & 0xFFF];
+                store_samples(ptr, mix_samples(load_samples(ptr), input, gains[i]));
+            }
+        }
+        write32(&state[0], static_cast<int32_t>(wet) << 16);
+        write32(&state[4], static_cast<int32_t>(dry) << 16);
+        for (int i = 0; i < 2; i++) {
+            write32(&state[8 + i * 4], ramps[i].target);
+            write32(&state[16 + i * 4], rates[i]);
+            write32(&state[24 + i * 4], sequence[i]);
+            write32(&state[32 + i * 4], ramps[i].value);
+        }
+        store(address, state.data(), state.size());
+    }
+
+    void AudioHLE::load_buffer(uint32_t, uint32_t w2) {
+        if (count_ == 0)
+            return;
+        uint32_t dmem = in_ & 0xFFC;
+        uint32_t count = std::min<uint32_t>(align(count_, 8), 0x1000 - dmem);
+        load(&buffer_[dmem], segment_address(w2) & ~7, count);
+    }
+
+    void AudioHLE::save_buffer(uint32_t, uint32_t w2) {
+        if (count_ == 0)
+            return;
+        uint32_t dmem = out_ & 0xFFC;
+        uint32_t count = std::min<uint32_t>(align(count_, 8), 0x1000 - dmem);
+        store(segment_address(w2) & ~7, &buffer_[dmem], count);
+    }
+
+    void AudioHLE::adpcm(uint32_t w1, uint32_t w2) {
+        uint8_t flags = w1 >> 16;
+        uint32_t address = segment_address(w2);
+        uint32_t count = align(count_, 32);
+        uint32_t dmemi = in_;
+        uint32_t dmemo = out_;
+        if (predictors_dirty_) {
+            build_predictors();
+        }
+        // The last frame decoded goes first, it's the history the resampler needs
+        alignas(16) std::array<int16_t, 16> last {};
+        if (!(flags & A_INIT)) {
+            std::array<uint8_t, 32> data;
+            load(data.data(), (flags & A_LOOP) ? loop_ : address, data.size());
+            for (int i = 0; i < 16; i++) {
+                last[i] = (data[i * 2] << 8) | data[i * 2 + 1];
+            }
+        }
+        __m128i first = _mm_load_si128(reinterpret_cast<const __m128i*>(&last[0]));
+        __m128i second = _mm_load_si128(reinterpret_cast<const __m128i*>(&last[8]));
+        store_samples(&buffer_[dmemo & 0xFFF], first);
+        store_samples(&buffer_[(dmemo + 16) & 0xFFF], second);
+        dmemo += 32;
+        // Each frame is a header byte and 16 4-bit residuals
+        auto predict = [this](int entry, __m128i residuals, __m128i history) {
+            const __m128i* rows = predictors_[entry];
+            // [prev1, prev2, s0..s5] and [s6, s7, 0...]
+            __m128i lo = _mm_blend_epi16(_mm_slli_si128(residuals, 4), _mm_srli_si128(history, 12), 0x03);
+            __m128i hi = _mm_srli_si128(residuals, 12);
+            __m128i sums[8];
+            for (int i = 0; i < 8; i++) {
+                sums[i] = _mm_add_epi32(_mm_madd_epi16(lo, rows[i * 2]), _mm_madd_epi16(hi, rows[i * 2 + 1]));
+            }
+            __m128i low = _mm_hadd_epi32(_mm_hadd_epi32(sums[0], sums[1]), _mm_hadd_epi32(sums[2], sums[3]));
+            __m128i high = _mm_hadd_epi32(_mm_hadd_epi32(sums[4], sums[5]), _mm_hadd_epi32(sums[6], sums[7]));
+            return _mm_packs_epi32(_mm_srai_epi32(low, 11), _mm_srai_epi32(high, 11));
+        };
+        while (count != 0) {
+            uint8_t header = buffer_[dmemi++ & 0xFFF];
+            int scale = header >> 4;
+            __m128i shift = _mm_cvtsi32_si128(scale < 12 ? 12 - scale : 0);
+            int entry = header & 0xF;
+            uint64_t packed = 0;
+            for (int i = 0; i < 8; i++) {
+                packed |= static_cast<uint64_t>(buffer_[(dmemi + i) & 0xFFF]) << (i * 8);
+            }
+            dmemi += 8;
+            // Every byte twice per lane, then the high nibble of one and the low nibble of the other into the top bits
+            __m128i bytes = _mm_cvtsi64_si128(packed);
+            bytes = _mm_unpacklo_epi8(bytes, bytes);
+            __m128i mask = _mm_set1_epi16(static_cast<int16_t>(0xF000));
+            __m128i high_nibbles = _mm_and_si128(bytes, mask);
+            __m128i low_nibbles = _mm_and_si128(_mm_slli_epi16(bytes, 4), mask);
+            __m128i residuals0 = _mm_sra_epi16(_mm_unpacklo_epi16(high_nibbles, low_nibbles), shift);
+            __m128i residuals1 = _mm_sra_epi16(_mm_unpackhi_epi16(high_nibbles, low_nibbles), shift);
+            first = predict(entry, residuals0, second);
+            second = predict(entry, residuals1, first);
+            store_samples(&buffer_[dmemo & 0xFFF], first);
+            store_samples(&buffer_[(dmemo + 16) & 0xFFF], second);
+            dmemo += 32;
+            count -= 32;
+        }
+        alignas(16) std::array<uint8_t, 32> data;
+        _mm_store_si128(reinterpret_cast<__m128i*>(&data[0]), swap_samples(first));
+        _mm_store_si128(reinterpret_cast<__m128i*>(&data[16]), swap_samples(second));
+        store(address, data.data(), data.size());
+    }
+
+    void AudioHLE::build_predictors() {
+        for (int entry = 0; entry < 16; entry++) {
+            const int16_t* book1 = &table_[entry * 16];
+            const int16_t* book2 = &table_[entry * 16 + 8];
+            for (int i = 0; i < 8; i++) {
+                alignas(16) std::array<int16_t, 16> row {};
+                row[0] = book1[i];
+                row[1] = book2[i];
+                for (int j = 0; j < i; j++) {
+                    row[2 + j] = book2[i - 1 - j];
+                }
+                // The residual itself, scaled by the 11 fraction bits of the coefficients
+                row[2 + i] = 1 << 11;
+                predictors_[entry][i * 2] = _mm_load_si128(reinterpret_cast<const __m128i*>(&row[0]));
+                predictors_[entry][i * 2 + 1] = _mm_load_si128(reinterpret_cast<const __m128i*>(&row[8]));
+            }
+        }
+        predictors_dirty_ = false;
+    }
+
+    void AudioHLE::resample(uint32_t w1, uint32_t w2) {
+        uint8_t flags = w1 >> 16;
+        uint32_t pitch = (w1 & 0xFFFF) << 1;
+        uint32_t address = segment_address(w2);
+        uint16_t ipos = (in_ >> 1) - 4;
+        uint16_t opos = out_ >> 1;
+        uint32_t count = align(count_, 16) >> 1;
+        // The 4 samples before the input are the tail of the previous task's input
+        uint32_t accumulator = 0;
+        std::array<uint8_t, 10> state {};
+        if (!(flags & A_INIT)) {
+            load(state.data(), address, state.size());
+            accumulator = (state[8] << 8) | state[9];
+        }
+        for (int i = 0; i < 4; i++) {
+            set_sample(ipos + i, (state[i * 2] << 8) | state[i * 2 + 1]);
+        }
+        // Two outputs per multiply-add, 4 per iteration
+        for (uint32_t i = 0; i < count; i += 4) {
+            __m128i taps[4], coefficients[4];
+            for (int j = 0; j < 4; j++) {
+                taps[j] = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&buffer_[(ipos * 2) & 0xFFE]));
+                coefficients[j] = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&ResampleTable[(accumulator >> 10) * 4]));
+                accumulator += pitch;
+                ipos += accumulator >> 16;
+                accumulator &= 0xFFFF;
+            }
+            __m128i sums01 = _mm_madd_epi16(swap_samples(_mm_unpacklo_epi64(taps[0], taps[1])), _mm_unpacklo_epi64(coefficients[0], coefficients[1]));
+            __m128i sums23 = _mm_madd_epi16(swap_samples(_mm_unpacklo_epi64(taps[2], taps[3])), _mm_unpacklo_epi64(coefficients[2], coefficients[3]));
+            __m128i output = _mm_srai_epi32(_mm_hadd_epi32(sums01, sums23), 15);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(&buffer_[(opos * 2) & 0xFFE]), swap_samples(_mm_packs_epi32(output, output)));
+            opos += 4;
+        }
+        for (int i = 0; i < 4; i++) {
+            int16_t value = sample(ipos + i);
+            state[i * 2] = static_cast<uint16_t>(value) >> 8;
+            state[i * 2 + 1] = value;
+        }
+        state[8] = accumulator >> 8;
+        state[9] = accumulator;
+        store(address, state.data(), state.size());
+    }
+
+    void AudioHLE::set_buffer(uint32_t w1, uint32_t w2) {
+        uint8_t flags = w1 >> 16;
+        if (flags & A_AUX) {
+            dry_right_ = w1 + DMEM_BASE;
+            wet_left_ = (w2 >> 16) + DMEM_BASE;
+            wet_right_ = w2 + DMEM_BASE;
+        } else {
+            in_ = w1 + DMEM_BASE;
+            out_ = (w2 >> 16) + DMEM_BASE;
+            count_ = w2;
+        }
+    }
+
+    void AudioHLE::set_volume(uint32_t w1, uint32_t w2) {
+        uint8_t flags = w1 >> 16;
+        if (flags & A_AUX) {
+            dry_ = w1;
+            wet_ = w2;
+            return;
+        }
+        int channel = (flags & A_LEFT) ? 0 : 1;
+        if (flags & A_VOL) {
+            volume_[channel] = w1;
+        } else {
+            target_[channel] = w1;
+            rate_[channel] = w2;
+        }
+    }
+
+    void AudioHLE::dmem_move(uint32_t w1, uint32_t w2) {
+        uint16_t dmemi = w1 + DMEM_BASE;
+        uint16_t dmemo = (w2 >> 16) + DMEM_BASE;
+        uint32_t count = align(w2 & 0xFFFF, 16);
+        // Byte by byte in increasing order, an overlapping move repeats the start
+        for (uint32_t i = 0; i < count; i++) {
+            buffer_[(dmemo + i) & 0xFFF] = buffer_[(dmemi + i) & 0xFFF];
+        }
+    }
+
+    void AudioHLE::load_adpcm(uint32_t w1, uint32_t w2) {
+        std::array<uint8_t, sizeof(table_)> data;
+        uint32_t count = std::min<uint32_t>(align(w1 & 0xFFFF, 8), data.size());
+        load(data.data(), segment_address(w2), count);
+        for (uint32_t i = 0; i < count / 2; i++) {
+            table_[i] = (data[i * 2] << 8) | data[i * 2 + 1];
+        }
+        predictors_dirty_ = true;
+    }
+
+    void AudioHLE::mixer(uint32_t w1, uint32_t w2) {
+        if (count_ == 0)
+            return;
+        __m128i gain = _mm_set1_epi16(static_cast<int16_t>(w1));
+        uint16_t dmemi = (w2 >> 16) + DMEM_BASE;
+        uint16_t dmemo = w2 + DMEM_BASE;
+        uint32_t count = align(count_, 32);
+        for (uint32_t offset = 0; offset < count; offset += 16) {
+            uint8_t* dst = &buffer_[(dmemo + offset) & 0xFFE];
+            __m128i src = load_samples(&buffer_[(dmemi + offset) & 0xFFE]);
+            store_samples(dst, mix_samples(load_samples(dst), src, gain));
+        }
+    }
+
+    void AudioHLE::interleave(uint32_t, uint32_t w2) {
+        if (count_ == 0)
+            return;
+        uint16_t left = (w2 >> 16) + DMEM_BASE;
+        uint16_t right = w2 + DMEM_BASE;
+        uint32_t count = align(count_, 16);
+        // Samples move as they are, no need to swap them
+        for (uint32_t offset = 0; offset < count; offset += 16) {
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&buffer_[(left + offset) & 0xFFF]));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&buffer_[(right + offset) & 0xFFF]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&buffer_[(out_ + offset * 2) & 0xFFF]), _mm_unpacklo_epi16(l, r));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&buffer_[(out_ + offset * 2 + 16) & 0xFFF]), _mm_unpackhi_epi16(l, r));
+        }
+    }
+
+    void AudioHLE::pole_filter(uint32_t w1, uint32_t w2) {
+        if (count_ == 0)
+            return;
+        uint8_t flags = w1 >> 16;
+        uint16_t gain = w1;
+        uint32_t address = segment_address(w2);
+        uint32_t count = align(count_, 16);
+        std::array<uint8_t, 8> state {};
+        if (!(flags & A_INIT)) {
+            load(state.data(), address, state.size());
+        }
+        int16_t l1 = (state[4] << 8) | state[5];
+        int16_t l2 = (state[6] << 8) | state[7];
+        const int16_t* h1 = &table_[0];
+        int16_t* h2 = &table_[8];
+        std::array<int16_t, 8> h2_before;
+        for (int i = 0; i < 8; i++) {
+            h2_before[i] = h2[i];
+            // The microcode scales the codebook in place, later commands see it scaled
+            h2[i] = (static_cast<int32_t>(h2[i]) * gain) >> 14;
+        }
+        predictors_dirty_ = true;
+        uint32_t ipos = in_ >> 1;
+        uint32_t opos = out_ >> 1;
+        std::array<int16_t, 8> output {};
+        for (; count != 0; count -= 16) {
+            std::array<int16_t, 8> frame;
+            for (int i = 0; i < 8; i++) {
+                frame[i] = sample(ipos++);
+            }
+            for (int i = 0; i < 8; i++) {
+                int64_t accumulator = static_cast<int64_t>(frame[i]) * gain + h1[i] * l1 + h2_before[i] * l2;
+                for (int j = 0; j < i; j++) {
+                    accumulator += h2[j] * frame[i - 1 - j];
+                }
+                output[i] = clamp16(accumulator >> 14);
+                set_sample(opos++, output[i]);
+            }
+            l1 = output[6];
+            l2 = output[7];
+        }
+        for (int i = 0; i < 4; i++) {
+            state[i * 2] = static_cast<uint16_t>(output[4 + i]) >> 8;
+            state[i * 2 + 1] = output[4 + i];
+        }
+        store(address, state.data(), state.size());
+    }
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+#ifndef TKP_N64_RSP_AUDIO_H
+#define TKP_N64_RSP_AUDIO_H
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <immintrin.h>
+
+namespace TKPEmu::N64::Devices {
+    class CPUBus;
+    // The OSTask libultra places at the end of DMEM before starting the RSP
+    constexpr uint32_t TASK_TYPE       = 0xFC0;
+    constexpr uint32_t TASK_UCODE      = 0xFD0;
+    constexpr uint32_t TASK_UCODE_SIZE = 0xFD4;
+    constexpr uint32_t TASK_UCODE_DATA = 0xFD8;
+    constexpr uint32_t TASK_DATA_PTR   = 0xFF0;
+    constexpr uint32_t TASK_DATA_SIZE  = 0xFF4;
+    constexpr uint32_t M_AUDTASK = 2;
+    enum class AudioABI {
+        None,
+        // The original libultra audio microcode and its GoldenEye and Blast Corps builds
+        ABI1,
+    };
+    /**
+        High level emulation of the audio microcode
+
+        Audio tasks are command lists (alists) of 64-bit commands that decode ADPCM,
+        resample, apply volume envelopes and mix into buffers in DMEM, which get saved
+        to RDRAM for the AI to play. Instead of interpreting the microcode, the commands
+        are run natively here with the per sample loops done 8 samples at a time in SSE.
+
+        A ucode is identified once, from the signature in its data segment, and the
+        result is cached by the hash of its text so later tasks only pay for the hash.
+        Unknown microcode is left to the RSP interpreter.
+
+        The working buffer stands in for DMEM and holds samples big endian, like DMEM would.
+    */
+    class AudioHLE {
+    public:
+        void Reset();
+        void SetBus(CPUBus* bus) { bus_ = bus; }
+        // Runs the task described by the OSTask in dmem, returns false if it's not a known audio task
+        bool Run(const uint8_t* dmem);
+    private:
+        AudioABI identify(uint32_t ucode, uint32_t ucode_size, uint32_t ucode_data);
+        void run_abi1(uint32_t alist, uint32_t size);
+        // RDRAM accessors, out of range reads return zeroes and writes are dropped
+        void load(void* dst, uint32_t addr, uint32_t size);
+        void store(uint32_t addr, const void* src, uint32_t size);
+        uint32_t load32(uint32_t addr);
+        uint32_t segment_address(uint32_t address) const;
+        __always_inline int16_t sample(uint32_t pos) const {
+            uint32_t addr = (pos * 2) & 0xFFE;
+            return static_cast<int16_t>((buffer_[addr] << 8) | buffer_[addr + 1]);
+        }
+        __always_inline void set_sample(uint32_t pos, int16_t value) {
+            uint32_t addr = (pos * 2) & 0xFFE;
+            buffer_[addr] = static_cast<uint16_t>(value) >> 8;
+            buffer_[addr + 1] = value;
+        }
+        // Audio commands, w1 is the upper word
+        void clear_buffer(uint32_t w1, uint32_t w2);
+        void envelope_mixer(uint32_t w1, uint32_t w2);
+        void load_buffer(uint32_t w1, uint32_t w2);
+        void save_buffer(uint32_t w1, uint32_t w2);
+        void adpcm(uint32_t w1, uint32_t w2);
+        void resample(uint32_t w1, uint32_t w2);
+        void set_buffer(uint32_t w1, uint32_t w2);
+        void set_volume(uint32_t w1, uint32_t w2);
+        void dmem_move(uint32_t w1, uint32_t w2);
+        void load_adpcm(uint32_t w1, uint32_t w2);
+        void mixer(uint32_t w1, uint32_t w2);
+        void interleave(uint32_t w1, uint32_t w2);
+        void pole_filter(uint32_t w1, uint32_t w2);
+        // Rebuilds the per codebook entry predictor matrices, see adpcm
+        void build_predictors();
+
+        CPUBus* bus_ = nullptr;
+        std::unordered_map<uint64_t, AudioABI> abi_cache_;
+        constexpr static size_t ABI_CACHE_SIZE = 32;
+        std::vector<uint8_t> alist_;
+        // Stands in for DMEM, the padding lets 8 sample loads run off the end
+        alignas(16) std::array<uint8_t, 0x1000 + 16> buffer_ {};
+        std::array<uint32_t, 16> segments_ {};
+        // Buffers picked by SETBUFF, as addresses into buffer_
+        uint16_t in_ = 0;
+        uint16_t out_ = 0;
+        uint16_t count_ = 0;
+        uint16_t dry_right_ = 0;
+        uint16_t wet_left_ = 0;
+        uint16_t wet_right_ = 0;
+        // Envelope parameters picked by SETVOL, index 0 is the left channel
+        int16_t dry_ = 0;
+        int16_t wet_ = 0;
+        std::array<int16_t, 2> volume_ {};
+        std::array<int16_t, 2> target_ {};
+        std::array<int32_t, 2> rate_ {};
+        uint32_t loop_ = 0;
+        // ADPCM codebook, up to 16 entries of two 8 tap predictors
+        std::array<int16_t, 16 * 16> table_ {};
+        /**
+            The codebook rearranged so that decoding a frame half is a matrix multiplication:
+            row i holds the coefficients of output i for the input vector
+            [prev1, prev2, s0, s1, s2, s3, s4, s5 | s6, s7, 0...], in two registers.
+        */
+        __m128i predictors_[16][16] {};
+        bool predictors_dirty_ = true;
+    };
+}
+#endif
\ No newline at end of file
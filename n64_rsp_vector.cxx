@@ -0,0 +1,868 @@
+#include <algorithm>
+#include "n64_rsp.hxx"
+#define TKP_INSTR_FUNC void
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        // pshufb masks for the element specifier of vector instructions
+        constexpr auto ElementMasks = [] {
+            std::array<std::array<uint8_t, 16>, 16> masks {};
+            for (int e = 0; e < 16; e++) {
+                for (int i = 0; i < 8; i++) {
+                    int source = i;
+                    if (e >= 8)
+                        source = e & 7;
+                    else if (e >= 4)
+                        source = (i & ~3) | (e & 3);
+                    else if (e >= 2)
+                        source = (i & ~1) | (e & 1);
+                    masks[e][i * 2] = source * 2;
+                    masks[e][i * 2 + 1] = source * 2 + 1;
+                }
+            }
+            return masks;
+        }();
+
+        struct DivideTables {
+            std::array<uint16_t, 512> reciprocals;
+            std::array<uint16_t, 512> inverse_square_roots;
+        };
+        const DivideTables& divide_tables() {
+            static const DivideTables tables = [] {
+                DivideTables tables {};
+                for (uint64_t i = 0; i < 512; i++) {
+                    uint64_t b = (uint64_t(1) << 34) / (i + 512);
+                    tables.reciprocals[i] = (b + 1) >> 8;
+                }
+                for (uint64_t i = 0; i < 512; i++) {
+                    // Largest b (at least 1 << 17) with a * b * b < 1 << 44
+                    uint64_t a = (i + 512) >> (i & 1);
+                    constexpr uint64_t limit = uint64_t(1) << 44;
+                    uint64_t b = static_cast<uint64_t>(__builtin_sqrt(static_cast<double>(limit) / a));
+                    while (b > 0 && a * b * b >= limit)
+                        b--;
+                    while (a * (b + 1) * (b + 1) < limit)
+                        b++;
+                    b = std::max<uint64_t>(b, uint64_t(1) << 17);
+                    tables.inverse_square_roots[i] = b >> 1;
+                }
+                return tables;
+            }();
+            return tables;
+        }
+
+        int32_t rcp(int32_t input) {
+            int32_t mask = input >> 31;
+            int32_t data = input ^ mask;
+            if (input > -32768)
+                data -= mask;
+            if (data == 0)
+                return 0x7FFF'FFFF;
+            if (input == -32768)
+                return 0xFFFF'0000;
+            uint32_t shift = __builtin_clz(data);
+            uint32_t index = ((uint64_t(data) << shift) & 0x7FC0'0000) >> 22;
+            int32_t result = divide_tables().reciprocals[index];
+            result = (0x10000 | result) << 14;
+            return (result >> (31 - shift)) ^ mask;
+        }
+
+        int32_t rsq(int32_t input) {
+            int32_t mask = input >> 31;
+            int32_t data = input ^ mask;
+            if (input > -32768)
+                data -= mask;
+            if (data == 0)
+                return 0x7FFF'FFFF;
+            if (input == -32768)
+                return 0xFFFF'0000;
+            uint32_t shift = __builtin_clz(data);
+            uint32_t index = ((uint64_t(data) << shift) & 0x7FC0'0000) >> 22;
+            index = (index & 0x1FE) | (shift & 1);
+            int32_t result = divide_tables().inverse_square_roots[index];
+            result = (0x10000 | result) << 14;
+            return (result >> ((31 - shift) >> 1)) ^ mask;
+        }
+
+        __always_inline __m128i ones() {
+            return _mm_set1_epi32(-1);
+        }
+
+        // Unsigned carry out of a + b, as a lane mask
+        __always_inline __m128i carry_mask(__m128i sum, __m128i b) {
+            const __m128i bias = _mm_set1_epi16(-0x8000);
+            return _mm_cmpgt_epi16(_mm_xor_si128(b, bias), _mm_xor_si128(sum, bias));
+        }
+
+        // Accumulator bits 16-47 clamped to a signed 16-bit value
+        __always_inline __m128i sclamp_acc(__m128i md, __m128i hi) {
+            return _mm_packs_epi32(_mm_unpacklo_epi16(md, hi), _mm_unpackhi_epi16(md, hi));
+        }
+
+        // Low slice if the accumulator fits in 32 signed bits, otherwise 0 or 0xFFFF by sign
+        __always_inline __m128i uclamp_acc(__m128i lo, __m128i md, __m128i hi) {
+            __m128i hi_negative = _mm_srai_epi16(hi, 15);
+            __m128i md_negative = _mm_srai_epi16(md, 15);
+            __m128i fits = _mm_and_si128(_mm_cmpeq_epi16(hi_negative, hi), _mm_cmpeq_epi16(hi_negative, md_negative));
+            __m128i clamped = _mm_cmpeq_epi16(hi_negative, _mm_setzero_si128());
+            return _mm_blendv_epi8(clamped, lo, fits);
+        }
+
+        // Middle slice, 0 if the accumulator is negative, 0xFFFF if it doesn't fit in 16 unsigned bits
+        __always_inline __m128i uclamp_md(__m128i md, __m128i hi) {
+            __m128i over = _mm_or_si128(_mm_xor_si128(_mm_cmpeq_epi16(hi, _mm_setzero_si128()), ones()), _mm_srai_epi16(md, 15));
+            return _mm_andnot_si128(_mm_srai_epi16(hi, 15), _mm_or_si128(md, over));
+        }
+
+        __always_inline uint16_t flags_to_bits(__m128i lo, __m128i hi) {
+            return _mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+        }
+
+        __always_inline __m128i bits_to_flags(uint8_t bits) {
+            const __m128i lanes = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+            return _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16(bits), lanes), lanes);
+        }
+
+        // The lanes of a vector stored to memory, as they can't be accessed through a pointer to it
+        struct alignas(16) Lanes {
+            Lanes() = default;
+            explicit Lanes(__m128i vector) { _mm_store_si128(reinterpret_cast<__m128i*>(elements), vector); }
+            __m128i vector() const { return _mm_load_si128(reinterpret_cast<const __m128i*>(elements)); }
+            uint16_t& operator[](int n) { return elements[n]; }
+            uint16_t operator[](int n) const { return elements[n]; }
+            uint16_t elements[8] {};
+        };
+
+        __always_inline int64_t get_acc(const Lanes& lo, const Lanes& md, const Lanes& hi, int n) {
+            int64_t acc = static_cast<int64_t>(static_cast<int16_t>(hi[n])) << 32;
+            acc |= static_cast<uint64_t>(md[n]) << 16;
+            acc |= lo[n];
+            return acc;
+        }
+
+        __always_inline void set_acc(Lanes& lo, Lanes& md, Lanes& hi, int n, int64_t acc) {
+            hi[n] = acc >> 32;
+            md[n] = acc >> 16;
+            lo[n] = acc;
+        }
+
+        __always_inline int16_t sclamp16(int64_t value) {
+            return std::clamp<int64_t>(value, -32768, 32767);
+        }
+    }
+
+    __m128i RSP::vte() const {
+        return _mm_shuffle_epi8(vpr_[vt()], _mm_loadu_si128(reinterpret_cast<const __m128i*>(ElementMasks[velement_field()].data())));
+    }
+
+    void RSP::acc_add(__m128i lo, __m128i md, __m128i hi) {
+        __m128i sum_lo = _mm_add_epi16(acc_lo_, lo);
+        __m128i carry_lo = carry_mask(sum_lo, lo);
+        __m128i sum_md = _mm_add_epi16(acc_md_, md);
+        __m128i carry_md = carry_mask(sum_md, md);
+        sum_md = _mm_sub_epi16(sum_md, carry_lo);
+        carry_md = _mm_or_si128(carry_md, _mm_and_si128(carry_lo, _mm_cmpeq_epi16(sum_md, _mm_setzero_si128())));
+        acc_hi_ = _mm_sub_epi16(_mm_add_epi16(acc_hi_, hi), carry_md);
+        acc_md_ = sum_md;
+        acc_lo_ = sum_lo;
+    }
+
+    TKP_INSTR_FUNC RSP::MFC2() {
+        int e = (instr_.Full >> 7) & 15;
+        int reg = instr_.RType.rd;
+        set_gpr(instr_.RType.rt, static_cast<int16_t>((vbyte(reg, e) << 8) | vbyte(reg, e + 1)));
+    }
+
+    TKP_INSTR_FUNC RSP::MTC2() {
+        int e = (instr_.Full >> 7) & 15;
+        int reg = instr_.RType.rd;
+        vbyte(reg, e) = rt() >> 8;
+        if (e != 15)
+            vbyte(reg, e + 1) = rt();
+    }
+
+    TKP_INSTR_FUNC RSP::CFC2() {
+        uint16_t flags;
+        switch (instr_.RType.rd & 3) {
+            case 0: flags = flags_to_bits(vco_lo_, vco_hi_); break;
+            case 1: flags = flags_to_bits(vcc_lo_, vcc_hi_); break;
+            default: flags = flags_to_bits(vce_, _mm_setzero_si128()); break;
+        }
+        set_gpr(instr_.RType.rt, static_cast<int16_t>(flags));
+    }
+
+    TKP_INSTR_FUNC RSP::CTC2() {
+        uint16_t flags = rt();
+        switch (instr_.RType.rd & 3) {
+            case 0:
+                vco_lo_ = bits_to_flags(flags);
+                vco_hi_ = bits_to_flags(flags >> 8);
+                break;
+            case 1:
+                vcc_lo_ = bits_to_flags(flags);
+                vcc_hi_ = bits_to_flags(flags >> 8);
+                break;
+            default:
+                vce_ = bits_to_flags(flags);
+                break;
+        }
+    }
+
+    // Loads and stores follow the byte-exact behaviour documented by ares, including
+    // the wrapping of unaligned accesses within a 16 byte row. vt is the register field.
+    TKP_INSTR_FUNC RSP::LBV() {
+        vbyte(vt(), ls_element()) = dmem_byte(ls_address(1));
+    }
+
+    TKP_INSTR_FUNC RSP::LSV() {
+        uint32_t addr = ls_address(2);
+        for (int i = ls_element(), end = std::min(i + 2, 16); i < end; i++)
+            vbyte(vt(), i) = dmem_byte(addr++);
+    }
+
+    TKP_INSTR_FUNC RSP::LLV() {
+        uint32_t addr = ls_address(4);
+        for (int i = ls_element(), end = std::min(i + 4, 16); i < end; i++)
+            vbyte(vt(), i) = dmem_byte(addr++);
+    }
+
+    TKP_INSTR_FUNC RSP::LDV() {
+        uint32_t addr = ls_address(8);
+        for (int i = ls_element(), end = std::min(i + 8, 16); i < end; i++)
+            vbyte(vt(), i) = dmem_byte(addr++);
+    }
+
+    TKP_INSTR_FUNC RSP::LQV() {
+        uint32_t addr = ls_address(16);
+        int e = ls_element();
+        if (e == 0 && (addr & 15) == 0) {
+            // The common case, one aligned row
+            __m128i row = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dmem_[addr & 0xFF0]));
+            vpr_[vt()] = _mm_shuffle_epi8(row, _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+            return;
+        }
+        int end = std::min<int>(e + 16 - (addr & 15), 16);
+        for (int i = e; i < end; i++)
+            vbyte(vt(), i) = dmem_byte(addr++);
+    }
+
+    TKP_INSTR_FUNC RSP::LRV() {
+        uint32_t addr = ls_address(16);
+        int start = 16 - ((addr & 15) - ls_element());
+        addr &= ~15;
+        for (int i = start; i < 16; i++)
+            vbyte(vt(), i) = dmem_byte(addr++);
+    }
+
+    TKP_INSTR_FUNC RSP::LPV() {
+        uint32_t addr = ls_address(8);
+        int index = (addr & 7) - ls_element();
+        addr &= ~7;
+        for (int i = 0; i < 8; i++)
+            velement(vt(), i) = dmem_byte(addr + ((index + i) & 15)) << 8;
+    }
+
+    TKP_INSTR_FUNC RSP::LUV() {
+        uint32_t addr = ls_address(8);
+        int index = (addr & 7) - ls_element();
+        addr &= ~7;
+        for (int i = 0; i < 8; i++)
+            velement(vt(), i) = dmem_byte(addr + ((index + i) & 15)) << 7;
+    }
+
+    TKP_INSTR_FUNC RSP::LHV() {
+        uint32_t addr = ls_address(16);
+        int index = (addr & 7) - ls_element();
+        addr &= ~7;
+        for (int i = 0; i < 8; i++)
+            velement(vt(), i) = dmem_byte(addr + ((index + i * 2) & 15)) << 7;
+    }
+
+    TKP_INSTR_FUNC RSP::LFV() {
+        uint32_t addr = ls_address(16);
+        int e = ls_element();
+        int index = (addr & 7) - e;
+        addr &= ~7;
+        Lanes temp;
+        for (int i = 0; i < 4; i++) {
+            temp[i] = dmem_byte(addr + ((index + i * 4) & 15)) << 7;
+            temp[i + 4] = dmem_byte(addr + ((index + i * 4 + 8) & 15)) << 7;
+        }
+        for (int i = e, end = std::min(e + 8, 16); i < end; i++)
+            vbyte(vt(), i) = temp[(i ^ 1) >> 1] >> ((i ^ 1) & 1) * 8;
+    }
+
+    TKP_INSTR_FUNC RSP::LTV() {
+        uint32_t addr = ls_address(16);
+        int e = ls_element();
+        uint32_t begin = addr & ~7;
+        addr = begin + ((e + (addr & 8)) & 15);
+        int base = vt() & ~7;
+        int offset = e >> 1;
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 2; j++) {
+                vbyte(base + offset, i * 2 + j) = dmem_byte(addr++);
+                if (addr == begin + 16)
+                    addr = begin;
+            }
+            offset = (offset + 1) & 7;
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::SBV() {
+        set_dmem_byte(ls_address(1), vbyte(vt(), ls_element()));
+    }
+
+    TKP_INSTR_FUNC RSP::SSV() {
+        uint32_t addr = ls_address(2);
+        for (int i = ls_element(), end = i + 2; i < end; i++)
+            set_dmem_byte(addr++, vbyte(vt(), i));
+    }
+
+    TKP_INSTR_FUNC RSP::SLV() {
+        uint32_t addr = ls_address(4);
+        for (int i = ls_element(), end = i + 4; i < end; i++)
+            set_dmem_byte(addr++, vbyte(vt(), i));
+    }
+
+    TKP_INSTR_FUNC RSP::SDV() {
+        uint32_t addr = ls_address(8);
+        for (int i = ls_element(), end = i + 8; i < end; i++)
+            set_dmem_byte(addr++, vbyte(vt(), i));
+    }
+
+    TKP_INSTR_FUNC RSP::SQV() {
+        uint32_t addr = ls_address(16);
+        int e = ls_element();
+        if (e == 0 && (addr & 15) == 0) {
+            __m128i row = _mm_shuffle_epi8(vpr_[vt()], _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&dmem_[addr & 0xFF0]), row);
+            return;
+        }
+        for (int i = e, end = e + (16 - (addr & 15)); i < end; i++)
+            set_dmem_byte(addr++, vbyte(vt(), i));
+    }
+
+    TKP_INSTR_FUNC RSP::SRV() {
+        uint32_t addr = ls_address(16);
+        int e = ls_element();
+        int end = e + (addr & 15);
+        int base = 16 - (addr & 15);
+        addr &= ~15;
+        for (int i = e; i < end; i++)
+            set_dmem_byte(addr++, vbyte(vt(), i + base));
+    }
+
+    TKP_INSTR_FUNC RSP::SPV() {
+        uint32_t addr = ls_address(8);
+        for (int i = ls_element(), end = i + 8; i < end; i++) {
+            if ((i & 15) < 8)
+                set_dmem_byte(addr++, vbyte(vt(), (i & 7) << 1));
+            else
+                set_dmem_byte(addr++, velement(vt(), i) >> 7);
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::SUV() {
+        uint32_t addr = ls_address(8);
+        for (int i = ls_element(), end = i + 8; i < end; i++) {
+            if ((i & 15) < 8)
+                set_dmem_byte(addr++, velement(vt(), i) >> 7);
+            else
+                set_dmem_byte(addr++, vbyte(vt(), (i & 7) << 1));
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::SHV() {
+        uint32_t addr = ls_address(16);
+        int e = ls_element();
+        int index = addr & 7;
+        addr &= ~7;
+        for (int i = 0; i < 8; i++) {
+            int position = e + (i << 1);
+            uint8_t value = (vbyte(vt(), position) << 1) | (vbyte(vt(), position + 1) >> 7);
+            set_dmem_byte(addr + ((index + i * 2) & 15), value);
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::SFV() {
+        uint32_t addr = ls_address(16);
+        int index = addr & 7;
+        addr &= ~7;
+        int elements[4];
+        switch (ls_element()) {
+            case 0: case 15: elements[0] = 0; elements[1] = 1; elements[2] = 2; elements[3] = 3; break;
+            case 1: elements[0] = 6; elements[1] = 7; elements[2] = 4; elements[3] = 5; break;
+            case 4: elements[0] = 1; elements[1] = 2; elements[2] = 3; elements[3] = 0; break;
+            case 5: elements[0] = 7; elements[1] = 4; elements[2] = 5; elements[3] = 6; break;
+            case 8: elements[0] = 4; elements[1] = 5; elements[2] = 6; elements[3] = 7; break;
+            case 11: elements[0] = 3; elements[1] = 0; elements[2] = 1; elements[3] = 2; break;
+            case 12: elements[0] = 5; elements[1] = 6; elements[2] = 7; elements[3] = 4; break;
+            default:
+                for (int i = 0; i < 4; i++)
+                    set_dmem_byte(addr + ((index + i * 4) & 15), 0);
+                return;
+        }
+        for (int i = 0; i < 4; i++)
+            set_dmem_byte(addr + ((index + i * 4) & 15), velement(vt(), elements[i]) >> 7);
+    }
+
+    TKP_INSTR_FUNC RSP::SWV() {
+        uint32_t addr = ls_address(16);
+        int e = ls_element();
+        int base = addr & 7;
+        addr &= ~7;
+        for (int i = e; i < e + 16; i++)
+            set_dmem_byte(addr + (base++ & 15), vbyte(vt(), i));
+    }
+
+    TKP_INSTR_FUNC RSP::STV() {
+        uint32_t addr = ls_address(16);
+        int e = ls_element();
+        int start = vt() & ~7;
+        int element = 16 - (e & ~1);
+        int base = (addr & 7) - (e & ~1);
+        addr &= ~7;
+        for (int reg = start; reg < start + 8; reg++) {
+            set_dmem_byte(addr + (base++ & 15), vbyte(reg, element++));
+            set_dmem_byte(addr + (base++ & 15), vbyte(reg, element++));
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::VMULF() {
+        __m128i vt = vte();
+        __m128i lo = _mm_mullo_epi16(vpr_[vs()], vt);
+        __m128i hi = _mm_mulhi_epi16(vpr_[vs()], vt);
+        // Doubled product plus rounding (0x8000)
+        __m128i product_lo = _mm_slli_epi16(lo, 1);
+        __m128i product_md = _mm_or_si128(_mm_slli_epi16(hi, 1), _mm_srli_epi16(lo, 15));
+        __m128i round_carry = _mm_srli_epi16(product_lo, 15);
+        acc_lo_ = _mm_xor_si128(product_lo, _mm_set1_epi16(-0x8000));
+        acc_md_ = _mm_add_epi16(product_md, round_carry);
+        __m128i md_carry = _mm_and_si128(_mm_cmpeq_epi16(acc_md_, _mm_setzero_si128()), _mm_cmpeq_epi16(round_carry, _mm_set1_epi16(1)));
+        acc_hi_ = _mm_sub_epi16(_mm_srai_epi16(hi, 15), md_carry);
+        vpr_[vd()] = sclamp_acc(acc_md_, acc_hi_);
+    }
+
+    TKP_INSTR_FUNC RSP::VMULU() {
+        __m128i vt = vte();
+        __m128i lo = _mm_mullo_epi16(vpr_[vs()], vt);
+        __m128i hi = _mm_mulhi_epi16(vpr_[vs()], vt);
+        __m128i product_lo = _mm_slli_epi16(lo, 1);
+        __m128i product_md = _mm_or_si128(_mm_slli_epi16(hi, 1), _mm_srli_epi16(lo, 15));
+        __m128i round_carry = _mm_srli_epi16(product_lo, 15);
+        acc_lo_ = _mm_xor_si128(product_lo, _mm_set1_epi16(-0x8000));
+        acc_md_ = _mm_add_epi16(product_md, round_carry);
+        __m128i md_carry = _mm_and_si128(_mm_cmpeq_epi16(acc_md_, _mm_setzero_si128()), _mm_cmpeq_epi16(round_carry, _mm_set1_epi16(1)));
+        acc_hi_ = _mm_sub_epi16(_mm_srai_epi16(hi, 15), md_carry);
+        vpr_[vd()] = uclamp_md(acc_md_, acc_hi_);
+    }
+
+    TKP_INSTR_FUNC RSP::VMUDL() {
+        acc_lo_ = _mm_mulhi_epu16(vpr_[vs()], vte());
+        acc_md_ = _mm_setzero_si128();
+        acc_hi_ = _mm_setzero_si128();
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VMUDM() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        // Signed vs times unsigned vt
+        __m128i hi = _mm_sub_epi16(_mm_mulhi_epu16(vs, vt), _mm_and_si128(_mm_srai_epi16(vs, 15), vt));
+        acc_lo_ = _mm_mullo_epi16(vs, vt);
+        acc_md_ = hi;
+        acc_hi_ = _mm_srai_epi16(hi, 15);
+        vpr_[vd()] = acc_md_;
+    }
+
+    TKP_INSTR_FUNC RSP::VMUDN() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        // Unsigned vs times signed vt
+        __m128i hi = _mm_sub_epi16(_mm_mulhi_epu16(vs, vt), _mm_and_si128(_mm_srai_epi16(vt, 15), vs));
+        acc_lo_ = _mm_mullo_epi16(vs, vt);
+        acc_md_ = hi;
+        acc_hi_ = _mm_srai_epi16(hi, 15);
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VMUDH() {
+        __m128i vt = vte();
+        acc_lo_ = _mm_setzero_si128();
+        acc_md_ = _mm_mullo_epi16(vpr_[vs()], vt);
+        acc_hi_ = _mm_mulhi_epi16(vpr_[vs()], vt);
+        vpr_[vd()] = sclamp_acc(acc_md_, acc_hi_);
+    }
+
+    TKP_INSTR_FUNC RSP::VMACF() {
+        __m128i vt = vte();
+        __m128i lo = _mm_mullo_epi16(vpr_[vs()], vt);
+        __m128i hi = _mm_mulhi_epi16(vpr_[vs()], vt);
+        acc_add(_mm_slli_epi16(lo, 1), _mm_or_si128(_mm_slli_epi16(hi, 1), _mm_srli_epi16(lo, 15)), _mm_srai_epi16(hi, 15));
+        vpr_[vd()] = sclamp_acc(acc_md_, acc_hi_);
+    }
+
+    TKP_INSTR_FUNC RSP::VMACU() {
+        __m128i vt = vte();
+        __m128i lo = _mm_mullo_epi16(vpr_[vs()], vt);
+        __m128i hi = _mm_mulhi_epi16(vpr_[vs()], vt);
+        acc_add(_mm_slli_epi16(lo, 1), _mm_or_si128(_mm_slli_epi16(hi, 1), _mm_srli_epi16(lo, 15)), _mm_srai_epi16(hi, 15));
+        vpr_[vd()] = uclamp_md(acc_md_, acc_hi_);
+    }
+
+    TKP_INSTR_FUNC RSP::VMADL() {
+        acc_add(_mm_mulhi_epu16(vpr_[vs()], vte()), _mm_setzero_si128(), _mm_setzero_si128());
+        vpr_[vd()] = uclamp_acc(acc_lo_, acc_md_, acc_hi_);
+    }
+
+    TKP_INSTR_FUNC RSP::VMADM() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        __m128i hi = _mm_sub_epi16(_mm_mulhi_epu16(vs, vt), _mm_and_si128(_mm_srai_epi16(vs, 15), vt));
+        acc_add(_mm_mullo_epi16(vs, vt), hi, _mm_srai_epi16(hi, 15));
+        vpr_[vd()] = sclamp_acc(acc_md_, acc_hi_);
+    }
+
+    TKP_INSTR_FUNC RSP::VMADN() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        __m128i hi = _mm_sub_epi16(_mm_mulhi_epu16(vs, vt), _mm_and_si128(_mm_srai_epi16(vt, 15), vs));
+        acc_add(_mm_mullo_epi16(vs, vt), hi, _mm_srai_epi16(hi, 15));
+        vpr_[vd()] = uclamp_acc(acc_lo_, acc_md_, acc_hi_);
+    }
+
+    TKP_INSTR_FUNC RSP::VMADH() {
+        __m128i vt = vte();
+        acc_add(_mm_setzero_si128(), _mm_mullo_epi16(vpr_[vs()], vt), _mm_mulhi_epi16(vpr_[vs()], vt));
+        vpr_[vd()] = sclamp_acc(acc_md_, acc_hi_);
+    }
+
+    // The rarely used rounding and MPEG instructions are done lane by lane
+    TKP_INSTR_FUNC RSP::VMULQ() {
+        Lanes vs(vpr_[this->vs()]), vt(vte());
+        Lanes lo, md, hi, result;
+        for (int n = 0; n < 8; n++) {
+            int32_t product = static_cast<int16_t>(vs[n]) * static_cast<int16_t>(vt[n]);
+            if (product < 0)
+                product += 31;
+            set_acc(lo, md, hi, n, static_cast<int64_t>(product) << 16);
+            result[n] = sclamp16(product >> 1) & ~15;
+        }
+        acc_lo_ = lo.vector();
+        acc_md_ = md.vector();
+        acc_hi_ = hi.vector();
+        vpr_[vd()] = result.vector();
+    }
+
+    TKP_INSTR_FUNC RSP::VMACQ() {
+        Lanes lo(acc_lo_), md(acc_md_), hi(acc_hi_);
+        Lanes result;
+        for (int n = 0; n < 8; n++) {
+            int64_t acc = get_acc(lo, md, hi, n);
+            int32_t product = acc >> 16;
+            if (product < 0 && !(product & (1 << 5)))
+                product += 32;
+            else if (product >= 32 && !(product & (1 << 5)))
+                product -= 32;
+            hi[n] = product >> 16;
+            md[n] = product;
+            result[n] = sclamp16(product >> 1) & ~15;
+        }
+        acc_md_ = md.vector();
+        acc_hi_ = hi.vector();
+        vpr_[vd()] = result.vector();
+    }
+
+    TKP_INSTR_FUNC RSP::VRNDP() {
+        Lanes vt(vte()), lo(acc_lo_), md(acc_md_), hi(acc_hi_);
+        Lanes result;
+        for (int n = 0; n < 8; n++) {
+            int64_t product = static_cast<int16_t>(vt[n]);
+            if (vs() & 1)
+                product <<= 16;
+            int64_t acc = get_acc(lo, md, hi, n);
+            if (acc >= 0)
+                acc = (acc + product) << 16 >> 16;
+            set_acc(lo, md, hi, n, acc);
+            result[n] = sclamp16(acc >> 16);
+        }
+        acc_lo_ = lo.vector();
+        acc_md_ = md.vector();
+        acc_hi_ = hi.vector();
+        vpr_[vd()] = result.vector();
+    }
+
+    TKP_INSTR_FUNC RSP::VRNDN() {
+        Lanes vt(vte()), lo(acc_lo_), md(acc_md_), hi(acc_hi_);
+        Lanes result;
+        for (int n = 0; n < 8; n++) {
+            int64_t product = static_cast<int16_t>(vt[n]);
+            if (vs() & 1)
+                product <<= 16;
+            int64_t acc = get_acc(lo, md, hi, n);
+            if (acc < 0)
+                acc = (acc + product) << 16 >> 16;
+            set_acc(lo, md, hi, n, acc);
+            result[n] = sclamp16(acc >> 16);
+        }
+        acc_lo_ = lo.vector();
+        acc_md_ = md.vector();
+        acc_hi_ = hi.vector();
+        vpr_[vd()] = result.vector();
+    }
+
+    TKP_INSTR_FUNC RSP::VADD() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        // Adding the carry to the smaller operand first keeps the saturation exact
+        __m128i min = _mm_subs_epi16(_mm_min_epi16(vs, vt), vco_lo_);
+        __m128i max = _mm_max_epi16(vs, vt);
+        acc_lo_ = _mm_sub_epi16(_mm_add_epi16(vs, vt), vco_lo_);
+        vpr_[vd()] = _mm_adds_epi16(min, max);
+        vco_lo_ = vco_hi_ = _mm_setzero_si128();
+    }
+
+    TKP_INSTR_FUNC RSP::VSUB() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        __m128i unsat_diff = _mm_sub_epi16(vt, vco_lo_);
+        __m128i sat_diff = _mm_subs_epi16(vt, vco_lo_);
+        acc_lo_ = _mm_sub_epi16(vs, unsat_diff);
+        __m128i result = _mm_subs_epi16(vs, sat_diff);
+        // vt + carry overflowed, take the lost one off the result
+        __m128i overflow = _mm_cmpgt_epi16(sat_diff, unsat_diff);
+        vpr_[vd()] = _mm_adds_epi16(result, overflow);
+        vco_lo_ = vco_hi_ = _mm_setzero_si128();
+    }
+
+    TKP_INSTR_FUNC RSP::VABS() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        acc_lo_ = _mm_sign_epi16(vt, vs);
+        // -(-32768) saturates in vd but not in the accumulator
+        __m128i overflow = _mm_and_si128(_mm_cmpeq_epi16(acc_lo_, _mm_set1_epi16(-0x8000)), _mm_srai_epi16(vs, 15));
+        vpr_[vd()] = _mm_xor_si128(acc_lo_, overflow);
+    }
+
+    TKP_INSTR_FUNC RSP::VADDC() {
+        __m128i vt = vte();
+        __m128i sum = _mm_add_epi16(vpr_[vs()], vt);
+        vco_lo_ = carry_mask(sum, vt);
+        vco_hi_ = _mm_setzero_si128();
+        acc_lo_ = sum;
+        vpr_[vd()] = sum;
+    }
+
+    TKP_INSTR_FUNC RSP::VSUBC() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        __m128i diff = _mm_sub_epi16(vs, vt);
+        const __m128i bias = _mm_set1_epi16(-0x8000);
+        vco_lo_ = _mm_cmpgt_epi16(_mm_xor_si128(vt, bias), _mm_xor_si128(vs, bias));
+        vco_hi_ = _mm_xor_si128(_mm_cmpeq_epi16(vs, vt), ones());
+        acc_lo_ = diff;
+        vpr_[vd()] = diff;
+    }
+
+    TKP_INSTR_FUNC RSP::VSAR() {
+        switch (velement_field()) {
+            case 8: vpr_[vd()] = acc_hi_; break;
+            case 9: vpr_[vd()] = acc_md_; break;
+            case 10: vpr_[vd()] = acc_lo_; break;
+            default: vpr_[vd()] = _mm_setzero_si128(); break;
+        }
+    }
+
+    TKP_INSTR_FUNC RSP::VLT() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi16(vs, vt), _mm_and_si128(vco_lo_, vco_hi_));
+        vcc_lo_ = _mm_or_si128(_mm_cmplt_epi16(vs, vt), eq);
+        vcc_hi_ = vco_lo_ = vco_hi_ = _mm_setzero_si128();
+        acc_lo_ = _mm_blendv_epi8(vt, vs, vcc_lo_);
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VEQ() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        vcc_lo_ = _mm_andnot_si128(vco_hi_, _mm_cmpeq_epi16(vs, vt));
+        vcc_hi_ = vco_lo_ = vco_hi_ = _mm_setzero_si128();
+        acc_lo_ = _mm_blendv_epi8(vt, vs, vcc_lo_);
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VNE() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        vcc_lo_ = _mm_or_si128(_mm_xor_si128(_mm_cmpeq_epi16(vs, vt), ones()), vco_hi_);
+        vcc_hi_ = vco_lo_ = vco_hi_ = _mm_setzero_si128();
+        acc_lo_ = _mm_blendv_epi8(vt, vs, vcc_lo_);
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VGE() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        __m128i eq = _mm_andnot_si128(_mm_and_si128(vco_lo_, vco_hi_), _mm_cmpeq_epi16(vs, vt));
+        vcc_lo_ = _mm_or_si128(_mm_cmpgt_epi16(vs, vt), eq);
+        vcc_hi_ = vco_lo_ = vco_hi_ = _mm_setzero_si128();
+        acc_lo_ = _mm_blendv_epi8(vt, vs, vcc_lo_);
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VCL() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        __m128i sum = _mm_add_epi16(vs, vt);
+        __m128i carry = carry_mask(sum, vt);
+        __m128i sum_zero = _mm_cmpeq_epi16(sum, _mm_setzero_si128());
+        // Signs differed and the values weren't equal before: vcc_lo is recomputed from the sum
+        __m128i lo_cond = _mm_blendv_epi8(
+            _mm_andnot_si128(carry, sum_zero),
+            _mm_or_si128(sum_zero, _mm_xor_si128(carry, ones())),
+            vce_);
+        __m128i update_lo = _mm_andnot_si128(vco_hi_, vco_lo_);
+        vcc_lo_ = _mm_blendv_epi8(vcc_lo_, lo_cond, update_lo);
+        // Signs matched and the values weren't equal before: vcc_hi is recomputed from vs >= vt
+        const __m128i bias = _mm_set1_epi16(-0x8000);
+        __m128i ge = _mm_xor_si128(_mm_cmpgt_epi16(_mm_xor_si128(vt, bias), _mm_xor_si128(vs, bias)), ones());
+        __m128i update_hi = _mm_andnot_si128(_mm_or_si128(vco_lo_, vco_hi_), ones());
+        vcc_hi_ = _mm_blendv_epi8(vcc_hi_, ge, update_hi);
+        __m128i neg_vt = _mm_sub_epi16(_mm_setzero_si128(), vt);
+        __m128i when_lo = _mm_blendv_epi8(vs, neg_vt, vcc_lo_);
+        __m128i when_hi = _mm_blendv_epi8(vs, vt, vcc_hi_);
+        acc_lo_ = _mm_blendv_epi8(when_hi, when_lo, vco_lo_);
+        vco_lo_ = vco_hi_ = vce_ = _mm_setzero_si128();
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VCH() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        __m128i sign = _mm_srai_epi16(_mm_xor_si128(vs, vt), 15);
+        // vt negated where the signs differ, so result is vs + vt or vs - vt
+        __m128i target = _mm_sub_epi16(_mm_xor_si128(vt, sign), sign);
+        __m128i result = _mm_sub_epi16(vs, target);
+        __m128i le = _mm_cmplt_epi16(result, _mm_set1_epi16(1));
+        __m128i ge = _mm_cmpgt_epi16(result, _mm_set1_epi16(-1));
+        __m128i vt_negative = _mm_srai_epi16(vt, 15);
+        vcc_lo_ = _mm_blendv_epi8(vt_negative, le, sign);
+        vcc_hi_ = _mm_blendv_epi8(ge, vt_negative, sign);
+        vce_ = _mm_and_si128(sign, _mm_cmpeq_epi16(result, ones()));
+        __m128i not_zero = _mm_xor_si128(_mm_cmpeq_epi16(result, _mm_setzero_si128()), ones());
+        __m128i not_complement = _mm_xor_si128(_mm_cmpeq_epi16(vs, _mm_xor_si128(vt, ones())), ones());
+        vco_lo_ = sign;
+        vco_hi_ = _mm_and_si128(not_zero, not_complement);
+        acc_lo_ = _mm_blendv_epi8(vs, target, _mm_blendv_epi8(ge, le, sign));
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VCR() {
+        __m128i vt = vte();
+        __m128i vs = vpr_[this->vs()];
+        __m128i sign = _mm_srai_epi16(_mm_xor_si128(vs, vt), 15);
+        // One's complement of vt where the signs differ, so result is vs + vt + 1 or vs - vt
+        __m128i target = _mm_xor_si128(vt, sign);
+        __m128i result = _mm_sub_epi16(vs, target);
+        __m128i le = _mm_cmplt_epi16(result, _mm_set1_epi16(1));
+        __m128i ge = _mm_cmpgt_epi16(result, _mm_set1_epi16(-1));
+        __m128i vt_negative = _mm_srai_epi16(vt, 15);
+        vcc_lo_ = _mm_blendv_epi8(vt_negative, le, sign);
+        vcc_hi_ = _mm_blendv_epi8(ge, vt_negative, sign);
+        vco_lo_ = vco_hi_ = vce_ = _mm_setzero_si128();
+        acc_lo_ = _mm_blendv_epi8(vs, target, _mm_blendv_epi8(ge, le, sign));
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VMRG() {
+        acc_lo_ = _mm_blendv_epi8(vte(), vpr_[vs()], vcc_lo_);
+        vco_lo_ = vco_hi_ = _mm_setzero_si128();
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VAND() {
+        acc_lo_ = _mm_and_si128(vpr_[vs()], vte());
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VNAND() {
+        acc_lo_ = _mm_xor_si128(_mm_and_si128(vpr_[vs()], vte()), ones());
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VOR() {
+        acc_lo_ = _mm_or_si128(vpr_[vs()], vte());
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VNOR() {
+        acc_lo_ = _mm_xor_si128(_mm_or_si128(vpr_[vs()], vte()), ones());
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VXOR() {
+        acc_lo_ = _mm_xor_si128(vpr_[vs()], vte());
+        vpr_[vd()] = acc_lo_;
+    }
+
+    TKP_INSTR_FUNC RSP::VNXOR() {
+        acc_lo_ = _mm_xor_si128(_mm_xor_si128(vpr_[vs()], vte()), ones());
+        vpr_[vd()] = acc_lo_;
+    }
+
+    void RSP::vrcp_common(bool low, bool sqrt) {
+        __m128i vt = vte();
+        int e = velement_field() & 7;
+        int32_t input;
+        if (low && div_dp_)
+            input = (static_cast<int32_t>(div_in_) << 16) | velement(this->vt(), e);
+        else
+            input = static_cast<int16_t>(velement(this->vt(), e));
+        int32_t result = sqrt ? rsq(input) : rcp(input);
+        div_dp_ = false;
+        div_out_ = result >> 16;
+        acc_lo_ = vt;
+        velement(vd(), vs()) = result;
+    }
+
+    void RSP::vrcph_common() {
+        __m128i vt = vte();
+        int e = velement_field() & 7;
+        div_dp_ = true;
+        div_in_ = velement(this->vt(), e);
+        acc_lo_ = vt;
+        velement(vd(), vs()) = div_out_;
+    }
+
+    TKP_INSTR_FUNC RSP::VRCP() {
+        vrcp_common(false, false);
+    }
+
+    TKP_INSTR_FUNC RSP::VRCPL() {
+        vrcp_common(true, false);
+    }
+
+    TKP_INSTR_FUNC RSP::VRCPH() {
+        vrcph_common();
+    }
+
+    TKP_INSTR_FUNC RSP::VRSQ() {
+        vrcp_common(false, true);
+    }
+
+    TKP_INSTR_FUNC RSP::VRSQL() {
+        vrcp_common(true, true);
+    }
+
+    TKP_INSTR_FUNC RSP::VRSQH() {
+        vrcph_common();
+    }
+
+    TKP_INSTR_FUNC RSP::VMOV() {
+        __m128i vt = vte();
+        acc_lo_ = vt;
+        velement(vd(), vs()) = Lanes(vt)[vs() & 7];
+    }
+}
\ No newline at end of file
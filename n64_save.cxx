@@ -0,0 +1,295 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "n64_save.hxx"
+
+namespace TKPEmu::N64::Devices {
+    namespace {
+        // Macronix MX29L1100, the high word identifies the chip as FlashRAM
+        constexpr uint64_t FLASHRAM_ID = 0x1111'8001'00C2'001E;
+        constexpr uint32_t FLASHRAM_ERASE_OK = 0x1111'8008;
+        constexpr uint32_t FLASHRAM_WRITE_OK = 0x1111'8004;
+        constexpr uint32_t FLASHRAM_SECTOR_SIZE = 0x4000;
+    }
+
+    SaveWriter::~SaveWriter() {
+        if (!thread_.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        wake_cv_.notify_one();
+        thread_.join();
+    }
+
+    int SaveWriter::Open(const std::string& path, const std::vector<uint8_t>& data) {
+        std::lock_guard<std::mutex> lock(files_mutex_);
+        files_.push_back({ path, data, false });
+        return files_.size() - 1;
+    }
+
+    void SaveWriter::CloseAll() {
+        Flush();
+        std::lock_guard<std::mutex> lock(files_mutex_);
+        files_.clear();
+    }
+
+    void SaveWriter::Write(int id, uint32_t offset, const uint8_t* data, uint32_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back({ id, offset, size, pending_data_.size() });
+            pending_data_.insert(pending_data_.end(), data, data + size);
+            ++queued_;
+        }
+        // Most instances never save, so the thread starts with the first write and not
+        // with the first file, which every instance with a save path opens
+        if (!thread_.joinable()) {
+            thread_ = std::thread(&SaveWriter::writer_loop, this);
+        }
+        wake_cv_.notify_one();
+    }
+
+    void SaveWriter::Flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        uint64_t target = queued_;
+        if (written_ >= target)
+            return;
+        flush_requested_ = true;
+        wake_cv_.notify_one();
+        done_cv_.wait(lock, [this, target] { return written_ >= target; });
+    }
+
+    void SaveWriter::writer_loop() {
+        std::vector<PendingWrite> writes;
+        std::vector<uint8_t> data;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_cv_.wait(lock, [this] { return quit_ || flush_requested_ || !pending_.empty(); });
+            if (!quit_ && !flush_requested_) {
+                // Games save a block at a time, let the rest of the save arrive
+                wake_cv_.wait_for(lock, COALESCE_DELAY, [this] { return quit_ || flush_requested_; });
+            }
+            writes.swap(pending_);
+            data.swap(pending_data_);
+            uint64_t batch = queued_;
+            flush_requested_ = false;
+            bool quit = quit_;
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> files_lock(files_mutex_);
+                for (const auto& write : writes) {
+                    File& file = files_[write.id];
+                    std::memcpy(file.contents.data() + write.offset, data.data() + write.data, write.size);
+                    file.dirty = true;
+                }
+                for (auto& file : files_) {
+                    if (!file.dirty)
+                        continue;
+                    if (persist(file)) {
+                        file.dirty = false;
+                    } else {
+                        failures_.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+            writes.clear();
+            data.clear();
+            lock.lock();
+            written_ = batch;
+            done_cv_.notify_all();
+            if (quit && pending_.empty())
+                return;
+        }
+    }
+
+    bool SaveWriter::persist(const File& file) {
+        // Written next to the save and renamed over it, so the old save survives a crash
+        std::string temp = file.path + ".tmp";
+        int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1)
+            return false;
+        size_t written = 0;
+        while (written < file.contents.size()) {
+            ssize_t ret = write(fd, file.contents.data() + written, file.contents.size() - written);
+            if (ret <= 0) {
+                close(fd);
+                unlink(temp.c_str());
+                return false;
+            }
+            written += ret;
+        }
+        bool synced = fsync(fd) == 0;
+        close(fd);
+        if (!synced || std::rename(temp.c_str(), file.path.c_str()) != 0) {
+            unlink(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void SaveData::Open(SaveWriter* writer, const std::string& path, std::vector<uint8_t> blank) {
+        data_ = std::move(blank);
+        writer_ = nullptr;
+        id_ = -1;
+        if (path.empty())
+            return;
+        std::ifstream file(path, std::ios::binary);
+        if (file) {
+            file.read(reinterpret_cast<char*>(data_.data()), data_.size());
+        }
+        writer_ = writer;
+        id_ = writer_->Open(path, data_);
+    }
+
+    void SaveData::Close() {
+        data_.clear();
+        writer_ = nullptr;
+        id_ = -1;
+    }
+
+    void SaveData::Commit(uint32_t offset, uint32_t size) {
+        if (writer_) {
+            writer_->Write(id_, offset, data_.data() + offset, size);
+        }
+    }
+
+    void CartSave::Open(SaveType type, SaveWriter* writer, const std::string& path) {
+        type_ = type;
+        switch (type) {
+            case SaveType::SRAM: {
+                data_.Open(writer, path.empty() ? path : path + ".sra", std::vector<uint8_t>(SRAM_SIZE, 0));
+                break;
+            }
+            case SaveType::FlashRAM: {
+                // Erased
+                data_.Open(writer, path.empty() ? path : path + ".fla", std::vector<uint8_t>(FLASHRAM_SIZE, 0xFF));
+                break;
+            }
+            default: {
+                type_ = SaveType::None;
+                data_.Close();
+                break;
+            }
+        }
+        Reset();
+    }
+
+    void CartSave::Reset() {
+        mode_ = FlashMode::Read;
+        status_ = FLASHRAM_ID;
+        offset_ = 0;
+        page_.fill(0);
+    }
+
+    void CartSave::Read(uint32_t offset, uint8_t* dst, uint32_t length) {
+        std::memset(dst, 0, length);
+        if (type_ == SaveType::SRAM) {
+            offset &= SRAM_SIZE - 1;
+            std::memcpy(dst, data_.Data() + offset, std::min(length, SRAM_SIZE - offset));
+        } else if (type_ == SaveType::FlashRAM) {
+            if (mode_ == FlashMode::Read) {
+                // The array is addressed in 16-bit units
+                offset = (offset * 2) & (FLASHRAM_SIZE - 1);
+                std::memcpy(dst, data_.Data() + offset, std::min(length, FLASHRAM_SIZE - offset));
+            } else {
+                uint64_t status = __builtin_bswap64(status_);
+                std::memcpy(dst, &status, std::min<uint32_t>(length, sizeof(status)));
+            }
+        }
+    }
+
+    void CartSave::Write(uint32_t offset, const uint8_t* src, uint32_t length) {
+        if (type_ == SaveType::SRAM) {
+            offset &= SRAM_SIZE - 1;
+            length = std::min(length, SRAM_SIZE - offset);
+            std::memcpy(data_.Data() + offset, src, length);
+            data_.Commit(offset, length);
+        } else if (type_ == SaveType::FlashRAM && mode_ == FlashMode::Write) {
+            std::memcpy(page_.data(), src, std::min<size_t>(length, page_.size()));
+        }
+    }
+
+    uint32_t CartSave::ReadWord(uint32_t offset) {
+        if (type_ == SaveType::FlashRAM)
+            return status_ >> 32;
+        if (type_ == SaveType::SRAM) {
+            uint32_t data;
+            std::memcpy(&data, data_.Data() + (offset & (SRAM_SIZE - 4)), 4);
+            return __builtin_bswap32(data);
+        }
+        return 0;
+    }
+
+    void CartSave::WriteWord(uint32_t offset, uint32_t data) {
+        if (type_ == SaveType::FlashRAM) {
+            if (offset == FLASHRAM_COMMAND)
+                flash_command(data);
+        } else if (type_ == SaveType::SRAM) {
+            offset &= SRAM_SIZE - 4;
+            data = __builtin_bswap32(data);
+            std::memcpy(data_.Data() + offset, &data, 4);
+            data_.Commit(offset, 4);
+        }
+    }
+
+    void CartSave::flash_command(uint32_t command) {
+        auto set_status = [this](uint32_t status) {
+            status_ = (static_cast<uint64_t>(status) << 32) | static_cast<uint32_t>(status_);
+        };
+        switch (command >> 24) {
+            case 0x4B: {
+                mode_ = FlashMode::SectorErase;
+                offset_ = ((command & 0x3FF) * page_.size()) & ~(FLASHRAM_SECTOR_SIZE - 1);
+                break;
+            }
+            case 0x3C: {
+                mode_ = FlashMode::ChipErase;
+                break;
+            }
+            case 0x78: {
+                // Erases are instant, the game sees them done the first time it polls
+                if (mode_ == FlashMode::SectorErase) {
+                    std::memset(data_.Data() + offset_, 0xFF, FLASHRAM_SECTOR_SIZE);
+                    data_.Commit(offset_, FLASHRAM_SECTOR_SIZE);
+                } else if (mode_ == FlashMode::ChipErase) {
+                    std::memset(data_.Data(), 0xFF, FLASHRAM_SIZE);
+                    data_.Commit(0, FLASHRAM_SIZE);
+                } else {
+                    break;
+                }
+                set_status(FLASHRAM_ERASE_OK);
+                mode_ = FlashMode::Status;
+                break;
+            }
+            case 0xB4: {
+                mode_ = FlashMode::Write;
+                break;
+            }
+            case 0xA5: {
+                offset_ = (command & 0x3FF) * page_.size();
+                std::memcpy(data_.Data() + offset_, page_.data(), page_.size());
+                data_.Commit(offset_, page_.size());
+                set_status(FLASHRAM_WRITE_OK);
+                mode_ = FlashMode::Status;
+                break;
+            }
+            case 0xD2: {
+                mode_ = FlashMode::Status;
+                break;
+            }
+            case 0xE1: {
+                mode_ = FlashMode::Status;
+                status_ = FLASHRAM_ID;
+                break;
+            }
+            case 0xF0: {
+                mode_ = FlashMode::Read;
+                break;
+            }
+        }
+    }
+}
\ No newline at end of file
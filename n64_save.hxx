@@ -0,0 +1,153 @@
+#pragma once
+#ifndef TKP_N64_SAVE_H
+#define TKP_N64_SAVE_H
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace TKPEmu::N64::Devices {
+    // Save chip on the cartridge, there's no header field for it so it has to be configured
+    enum class SaveType {
+        None,
+        // On the joybus, see PIF
+        EEPROM4K,
+        EEPROM16K,
+        // On PI domain 2, see CartSave
+        SRAM,
+        FlashRAM,
+    };
+    /**
+        Persists save files on a background thread
+
+        The emulation thread only records which bytes changed, under a lock that is never
+        held across I/O. The writer waits a little for more writes to pile up, so a game
+        saving a block at a time rewrites each file once, then replaces every changed file
+        with a fully written and fsynced copy. A crash mid save leaves the old file intact.
+    */
+    class SaveWriter {
+    public:
+        SaveWriter() = default;
+        ~SaveWriter();
+        SaveWriter(const SaveWriter&) = delete;
+        SaveWriter& operator=(const SaveWriter&) = delete;
+        // Starts tracking a file whose current contents are data, returns the id writes refer to
+        int Open(const std::string& path, const std::vector<uint8_t>& data);
+        // Writes whatever is pending and forgets every file
+        void CloseAll();
+        // Queues size bytes at offset of file id
+        void Write(int id, uint32_t offset, const uint8_t* data, uint32_t size);
+        // Blocks until everything queued so far is on disk
+        void Flush();
+        // Files that couldn't be written, they're retried with the next write
+        uint64_t Failures() const { return failures_.load(std::memory_order_relaxed); }
+        // How long writes are gathered before the files are rewritten
+        constexpr static auto COALESCE_DELAY = std::chrono::milliseconds(500);
+    private:
+        struct File {
+            std::string path;
+            std::vector<uint8_t> contents;
+            bool dirty = false;
+        };
+        struct PendingWrite {
+            int id;
+            uint32_t offset;
+            uint32_t size;
+            // Where the bytes start in pending_data_
+            size_t data;
+        };
+        void writer_loop();
+        bool persist(const File& file);
+
+        std::mutex mutex_;
+        std::condition_variable wake_cv_;
+        std::condition_variable done_cv_;
+        // Guarded by mutex_, filled by the emulation thread
+        std::vector<PendingWrite> pending_;
+        std::vector<uint8_t> pending_data_;
+        uint64_t queued_ = 0;
+        uint64_t written_ = 0;
+        bool flush_requested_ = false;
+        bool quit_ = false;
+        // Held by the writer thread while it updates and writes files, never by the emulation
+        // thread except to open and close them
+        std::mutex files_mutex_;
+        std::vector<File> files_;
+        std::atomic<uint64_t> failures_ = 0;
+        std::thread thread_;
+    };
+    /**
+        The contents of one save chip, loaded from its file if there is one
+
+        Every change has to be committed so the writer picks it up.
+    */
+    class SaveData {
+    public:
+        // Loads path, or starts out as blank if it doesn't exist. An empty path keeps the save in memory
+        void Open(SaveWriter* writer, const std::string& path, std::vector<uint8_t> blank);
+        void Close();
+        uint8_t* Data() { return data_.data(); }
+        size_t Size() const { return data_.size(); }
+        bool Empty() const { return data_.empty(); }
+        void Commit(uint32_t offset, uint32_t size);
+    private:
+        std::vector<uint8_t> data_;
+        SaveWriter* writer_ = nullptr;
+        int id_ = -1;
+    };
+    /**
+        SRAM or FlashRAM, mapped at the start of PI domain 2 (0x0800'0000)
+
+        SRAM is plain memory accessed through PI DMA. FlashRAM is programmed through
+        commands written to 0x0801'0000: pages are written by filling a 128 byte buffer
+        with DMA and then executing a write, and have to be erased (set to 0xFF) first.
+        Its status and silicon id are read from 0x0800'0000. The model is that of the
+        Macronix part most games shipped with.
+
+        @see https://n64brew.dev/wiki/Flash_RAM
+    */
+    class CartSave {
+    public:
+        constexpr static uint32_t SRAM_SIZE = 0x8000;
+        constexpr static uint32_t FLASHRAM_SIZE = 0x20000;
+        constexpr static uint32_t FLASHRAM_COMMAND = 0x1'0000;
+        // Loads the save from path with the extension of its type appended, if type is one of these
+        void Open(SaveType type, SaveWriter* writer, const std::string& path);
+        void Reset();
+        bool Present() const { return type_ == SaveType::SRAM || type_ == SaveType::FlashRAM; }
+        // PI DMA from the cartridge, offset is relative to the start of domain 2
+        void Read(uint32_t offset, uint8_t* dst, uint32_t length);
+        // PI DMA to the cartridge
+        void Write(uint32_t offset, const uint8_t* src, uint32_t length);
+        // 32-bit CPU accesses, in host byte order
+        uint32_t ReadWord(uint32_t offset);
+        void WriteWord(uint32_t offset, uint32_t data);
+    private:
+        enum class FlashMode {
+            Idle,
+            Read,
+            Status,
+            SectorErase,
+            ChipErase,
+            Write,
+        };
+        void flash_command(uint32_t command);
+
+        SaveType type_ = SaveType::None;
+        SaveData data_;
+        FlashMode mode_ = FlashMode::Idle;
+        // Silicon id in the low word, the high word reports the last operation
+        uint64_t status_ = 0;
+        uint32_t offset_ = 0;
+        std::array<uint8_t, 128> page_ {};
+        // What CPU reads return, in guest byte order
+        uint32_t register_ = 0;
+        friend class CPUBus;
+    };
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef TKP_N64_SCHEDULER_H
+#define TKP_N64_SCHEDULER_H
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace TKPEmu::N64::Devices {
+    enum class SchedulerEvent {
+        RSP,
+        SPDMA,
+        AI,
+        SI,
+        VI,
+        VIField,
+        Count
+    };
+    /**
+        Event scheduler
+
+        Time is counted in CPU cycles. Every event has at most one pending deadline, and the
+        earliest one is cached so the per-cycle check is a single compare. Devices that
+        run alongside the CPU (the RSP, DMA engines) do their work in batches when
+        their event comes due instead of being stepped every cycle.
+    */
+    class Scheduler {
+    public:
+        constexpr static uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+        // Advances time, returns true if an event is due
+        __always_inline bool Tick(uint64_t cycles = 1) {
+            now_ += cycles;
+            return now_ >= next_;
+        }
+        // Sets (or moves) the deadline of an event to delay cycles from now
+        void Schedule(SchedulerEvent event, uint64_t delay) {
+            deadlines_[static_cast<size_t>(event)] = now_ + delay;
+            update_next();
+        }
+        void Cancel(SchedulerEvent event) {
+            deadlines_[static_cast<size_t>(event)] = NEVER;
+            update_next();
+        }
+        bool IsScheduled(SchedulerEvent event) const {
+            return deadlines_[static_cast<size_t>(event)] != NEVER;
+        }
+        // Unschedules and returns the earliest due event, or SchedulerEvent::Count if none is due
+        SchedulerEvent PopDue() {
+            if (now_ < next_)
+                return SchedulerEvent::Count;
+            size_t earliest = 0;
+            for (size_t i = 1; i < deadlines_.size(); i++) {
+                if (deadlines_[i] < deadlines_[earliest])
+                    earliest = i;
+            }
+            deadlines_[earliest] = NEVER;
+            update_next();
+            return static_cast<SchedulerEvent>(earliest);
+        }
+        uint64_t Now() const { return now_; }
+        uint64_t NextDeadline() const { return next_; }
+        void Reset() {
+            now_ = 0;
+            deadlines_.fill(NEVER);
+            next_ = NEVER;
+        }
+    private:
+        void update_next() {
+            next_ = NEVER;
+            for (auto deadline : deadlines_) {
+                if (deadline < next_)
+                    next_ = deadline;
+            }
+        }
+
+        uint64_t now_ = 0;
+        uint64_t next_ = NEVER;
+        std::array<uint64_t, static_cast<size_t>(SchedulerEvent::Count)> deadlines_ = [] {
+            std::array<uint64_t, static_cast<size_t>(SchedulerEvent::Count)> deadlines {};
+            deadlines.fill(NEVER);
+            return deadlines;
+        }();
+    };
+}
+#endif
\ No newline at end of file
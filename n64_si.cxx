@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <cstring>
+#include "n64_si.hxx"
+#include "n64_cpu.hxx"
+
+namespace TKPEmu::N64::Devices {
+    void SerialInterface::Reset() {
+        dram_addr_ = pif_addr_ = status_ = 0;
+        if (bus_)
+            bus_->scheduler_.Cancel(SchedulerEvent::SI);
+    }
+
+    uint32_t SerialInterface::WriteRegister(int reg, uint32_t data) {
+        switch (reg & 7) {
+            case 0: {
+                data &= 0xFF'FFF8;
+                dram_addr_ = __builtin_bswap32(data);
+                return data;
+            }
+            case 1: {
+                pif_addr_ = __builtin_bswap32(data);
+                start_dma(false);
+                return data;
+            }
+            case 4: {
+                pif_addr_ = __builtin_bswap32(data);
+                start_dma(true);
+                return data;
+            }
+            case 6: {
+                // Any write acknowledges the interrupt
+                status_ &= ~__builtin_bswap32(SI_STATUS_INTERRUPT);
+                bus_->clear_interrupt(MIInterrupt::SI);
+                return __builtin_bswap32(status_);
+            }
+        }
+        // The 4 byte transfers aren't used by libultra
+        pif_addr_ = __builtin_bswap32(data);
+        return data;
+    }
+
+    void SerialInterface::start_dma(bool to_pif) {
+        if (__builtin_bswap32(status_) & SI_STATUS_DMA_BUSY)
+            return;
+        auto pif_ram = bus_->pif_ram_;
+        uint32_t dram_addr = __builtin_bswap32(dram_addr_);
+        if (dram_addr + pif_ram.size() <= bus_->rdram_.size()) {
+            uint8_t* rdram = &bus_->rdram_[dram_addr];
+            bus_->rcp_.rdp_.SyncRange(dram_addr, pif_ram.size());
+            if (to_pif) {
+                std::memcpy(pif_ram.data(), rdram, pif_ram.size());
+                pif_ram[0x3F] = bus_->pif_.Command(pif_ram[0x3F], pif_ram);
+            } else {
+                std::memcpy(rdram, pif_ram.data(), pif_ram.size());
+                bus_->mark_rdram_dirty(dram_addr, pif_ram.size());
+            }
+        }
+        status_ |= __builtin_bswap32(SI_STATUS_DMA_BUSY);
+        bus_->scheduler_.Schedule(SchedulerEvent::SI, DMA_CYCLES);
+    }
+
+    void SerialInterface::FinishDMA() {
+        uint32_t status = __builtin_bswap32(status_);
+        status &= ~SI_STATUS_DMA_BUSY;
+        status |= SI_STATUS_INTERRUPT;
+        status_ = __builtin_bswap32(status);
+        bus_->raise_interrupt(MIInterrupt::SI);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+#ifndef TKP_N64_SI_H
+#define TKP_N64_SI_H
+#include <cstdint>
+
+namespace TKPEmu::N64::Devices {
+    class CPUBus;
+    // SI_STATUS bits as read
+    constexpr uint32_t SI_STATUS_DMA_BUSY  = 1 << 0;
+    constexpr uint32_t SI_STATUS_IO_BUSY   = 1 << 1;
+    constexpr uint32_t SI_STATUS_INTERRUPT = 1 << 12;
+    /**
+        Serial Interface
+
+        Moves the 64 bytes of PIF RAM to and from RDRAM. Writing a PIF address to
+        SI_PIF_AD_WR64B copies RDRAM at SI_DRAM_ADDR into PIF RAM and lets the PIF act
+        on it, SI_PIF_AD_RD64B copies PIF RAM back. The copy itself happens right away,
+        the SI stays busy and interrupts once the transfer would have been over.
+    */
+    class SerialInterface {
+    public:
+        // About how long the PIF takes to run a command block and send it back
+        constexpr static uint64_t DMA_CYCLES = 0x1200;
+        void Reset();
+        void SetBus(CPUBus* bus) { bus_ = bus; }
+        // Applies a write to SI register reg (0 is SI_DRAM_ADDR), returns the value it reads back as
+        uint32_t WriteRegister(int reg, uint32_t data);
+        // Called when the DMA in flight is over
+        void FinishDMA();
+    private:
+        void start_dma(bool to_pif);
+
+        CPUBus* bus_ = nullptr;
+        // Memory mapped registers, kept in guest byte order like the rest of the bus
+        uint32_t dram_addr_ = 0;
+        uint32_t pif_addr_ = 0;
+        uint32_t status_ = 0;
+        friend class CPUBus;
+    };
+}
+#endif
\ No newline at end of file
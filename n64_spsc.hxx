@@ -0,0 +1,58 @@
+#pragma once
+#ifndef TKP_N64_SPSC_H
+#define TKP_N64_SPSC_H
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <utility>
+
+namespace TKPEmu::N64::Devices {
+    /**
+        Lock-free single producer, single consumer ring buffer
+
+        Exactly one thread may push and exactly one other thread may pop. The indices only
+        ever grow and are wrapped when a slot is picked, so full and empty are told apart
+        without wasting a slot. Each side keeps a cached copy of the other side's index and
+        only reloads it when the queue looks full (or empty), so the shared cache lines move
+        between cores once per batch of pushes instead of once per push.
+    */
+    template <typename T, size_t Capacity>
+    class SPSCQueue {
+        static_assert(std::has_single_bit(Capacity), "Capacity must be a power of two");
+    public:
+        // Moves value in and returns true, or leaves it untouched if the queue is full
+        bool TryPush(T&& value) {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_cache_ == Capacity) {
+                head_cache_ = head_.load(std::memory_order_acquire);
+                if (tail - head_cache_ == Capacity)
+                    return false;
+            }
+            slots_[tail & (Capacity - 1)] = std::move(value);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        bool TryPop(T& value) {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_cache_) {
+                tail_cache_ = tail_.load(std::memory_order_acquire);
+                if (head == tail_cache_)
+                    return false;
+            }
+            value = std::move(slots_[head & (Capacity - 1)]);
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+    private:
+        constexpr static size_t CACHE_LINE_SIZE = 64;
+        // Written by the consumer
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_ = 0;
+        size_t tail_cache_ = 0;
+        // Written by the producer
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_ = 0;
+        size_t head_cache_ = 0;
+        alignas(CACHE_LINE_SIZE) std::array<T, Capacity> slots_ {};
+    };
+}
+#endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "n64_tkpwrapper.hxx"
 #include "n64_tkpargs.hxx"
 #include <iostream>
+#include <filesystem>
 // #include <valgrind/callgrind.h>
 
 #ifndef CALLGRIND_START_INSTRUMENTATION
@@ -12,7 +13,6 @@
 #endif
 
 namespace TKPEmu::N64 {
-	bool N64_TKPWrapper::ipl_loaded_ = false;
 	N64_TKPWrapper::N64_TKPWrapper() : n64_impl_() {}
 
 	// N64_TKPWrapper::N64_TKPWrapper(std::unique_ptr<OptionsBase> args) : N64_TKPWrapper() {
@@ -27,11 +27,23 @@ namespace TKPEmu::N64 {
 	}
 	
 	bool N64_TKPWrapper::load_file(std::string path) {
-		bool ipl_loaded = ipl_loaded_;
-		if (!ipl_loaded) {
-			bool ipl_status = n64_impl_.LoadIPL(IPLPath);
-			ipl_loaded = ipl_status;
-		}
+		n64_impl_.SetExpansionPak(ExpansionPak);
+		n64_impl_.SetFastmem(UseFastmem);
+		n64_impl_.SetHLEBoot(HLEBoot);
+		n64_impl_.SetRDPThreads(RDPThreads);
+		n64_impl_.SetRDPAsync(RDPAsync);
+		n64_impl_.SetHLEAudio(HLEAudio);
+		n64_impl_.SetIdleLoopSkip(SkipIdleLoops);
+		n64_impl_.SetMemoryLoopHLE(HLEMemoryLoops);
+		n64_impl_.SetInterpreter(PipelineInterpreter ? Devices::InterpreterMode::Pipeline : Devices::InterpreterMode::Direct);
+		n64_impl_.SetAudioOutput(AudioOutput);
+		n64_impl_.SetSaves(SaveType, SavePath.empty() ? std::filesystem::path(path).replace_extension().string() : SavePath);
+		if (!InputMovie.empty())
+			n64_impl_.PlayMovie(InputMovie);
+		if (!InputRecording.empty())
+			n64_impl_.RecordMovie(InputRecording);
+		// Cheap after the first instance, the image is shared through Devices::IPLRegistry
+		bool ipl_loaded = HLEBoot || n64_impl_.LoadIPL(IPLPath);
 		bool opened = n64_impl_.LoadCartridge(path);
 		Loaded = opened && ipl_loaded;
 		return Loaded;
@@ -54,7 +66,7 @@ namespace TKPEmu::N64 {
 			update();
 			++cur_frame_instrs_;
 			#ifdef NO_PROFILING
-			if (cur_frame_instrs_ >= INSTRS_PER_FRAME) [[unlikely]] {
+			if (n64_impl_.TakeField() || cur_frame_instrs_ >= INSTRS_PER_FRAME) [[unlikely]] {
 			#else
 			if (cur_frame_instrs_ == 5000) [[unlikely]] {
 				stopped_break = true;
@@ -104,11 +116,29 @@ namespace TKPEmu::N64 {
 	}
 
 	void N64_TKPWrapper::HandleKeyDown(uint32_t key) {
-
+		update_keys(key, true);
 	}
 
 	void N64_TKPWrapper::HandleKeyUp(uint32_t key) {
+		update_keys(key, false);
+	}
 
+	void N64_TKPWrapper::update_keys(uint32_t key, bool down) {
+		// About as far as a real stick goes
+		constexpr int STICK_RANGE = 80;
+		if (auto it = KeyBindings.find(key); it != KeyBindings.end()) {
+			if (down)
+				key_state_.buttons |= it->second;
+			else
+				key_state_.buttons &= ~it->second;
+		}
+		for (size_t i = 0; i < StickKeys.size(); i++) {
+			if (StickKeys[i] == key)
+				stick_held_[i] = down;
+		}
+		key_state_.x = (stick_held_[3] - stick_held_[2]) * STICK_RANGE;
+		key_state_.y = (stick_held_[0] - stick_held_[1]) * STICK_RANGE;
+		n64_impl_.SetControllerState(0, key_state_);
 	}
 
 	void N64_TKPWrapper::v_extra_close()  {
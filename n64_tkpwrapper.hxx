@@ -3,9 +3,12 @@
 #define TKP_N64_TKPWRAPPER_H
 #include "../include/emulator.h"
 #include "n64_impl.hxx"
+#include <array>
 #include <chrono>
+#include <unordered_map>
 
 namespace TKPEmu::N64 {
+	// Frames end with VI fields, or after this many instructions (closing and errors skip close to it)
 	constexpr auto INSTRS_PER_FRAME = (93'750'000);
 	namespace Applications {
 		class N64_RomDisassembly;
@@ -14,16 +17,61 @@ namespace TKPEmu::N64 {
 		TKP_EMULATOR(N64_TKPWrapper);
 	public:
 		uint64_t LastFrameTime = 0;
+		uint64_t IdleCyclesSkipped() const { return n64_impl_.IdleCyclesSkipped(); }
+		uint64_t MemoryLoopBytes() const { return n64_impl_.MemoryLoopBytes(); }
+		// Boot ROM of this instance, instances may use different ones (NTSC and PAL)
 		std::string IPLPath;
+		// Use virtual memory fastmem instead of the page table, see Devices::Fastmem
+		bool UseFastmem = false;
+		// Install the 4 MB expansion pak (8 MB of RDRAM in total)
+		bool ExpansionPak = false;
+		// Start at the game's entry point without running the IPL, IPLPath isn't needed
+		bool HLEBoot = false;
+		// Threads the software RDP splits the screen between, including the emulation thread
+		int RDPThreads = 1;
+		// Rasterize on a render thread of its own, overlapping with CPU emulation
+		bool RDPAsync = true;
+		// Run audio microcode tasks natively instead of on the RSP interpreter
+		bool HLEAudio = true;
+		// Skip ahead to the next event when the game spins in a loop waiting for one
+		bool SkipIdleLoops = true;
+		// Copy and clear memory natively when the game loops over it a load or store at a time
+		bool HLEMemoryLoops = true;
+		// Run the CPU through the five stage latch pipeline instead of an instruction at a time, much slower
+		bool PipelineInterpreter = false;
+		// Audio output: empty for none, "null", a WAV file path or "|command" to pipe raw samples
+		std::string AudioOutput;
+		// Save chip of the cartridge, nothing in the ROM tells which one it has
+		Devices::SaveType SaveType = Devices::SaveType::EEPROM4K;
+		// Saves go to files named this plus an extension, the ROM path without its extension if empty
+		std::string SavePath;
+		// .m64 movie played from power on, the controllers it was recorded with are the ones connected
+		std::string InputMovie;
+		// Records what the game reads from the controllers on every poll to this .m64 file
+		std::string InputRecording;
+		// Keys (SDL keycodes) to the buttons of controller 1 they press
+		std::unordered_map<uint32_t, uint16_t> KeyBindings = {
+			{ 'x', Devices::BUTTON_A }, { 'c', Devices::BUTTON_B }, { 'z', Devices::BUTTON_Z },
+			{ '\r', Devices::BUTTON_START }, { 'q', Devices::BUTTON_L }, { 'e', Devices::BUTTON_R },
+			{ 'i', Devices::BUTTON_C_UP }, { 'k', Devices::BUTTON_C_DOWN },
+			{ 'j', Devices::BUTTON_C_LEFT }, { 'l', Devices::BUTTON_C_RIGHT },
+			{ 't', Devices::BUTTON_D_UP }, { 'g', Devices::BUTTON_D_DOWN },
+			{ 'f', Devices::BUTTON_D_LEFT }, { 'h', Devices::BUTTON_D_RIGHT },
+		};
+		// Keys that push the analog stick of controller 1 up, down, left and right
+		std::array<uint32_t, 4> StickKeys = { 'w', 's', 'a', 'd' };
     private:
         N64 n64_impl_;
 		bool should_draw_ = false;
-		static bool ipl_loaded_;
 		void update();
 		void v_extra_close() override;
 		bool& IsResized() override { return n64_impl_.cpu_.should_resize_; }
 		std::chrono::system_clock::time_point frame_start = std::chrono::system_clock::now();
 		uint64_t cur_frame_instrs_ = 0;
+		// Controller 1 as the keys held make it, only touched by the thread handling keys
+		Devices::ControllerState key_state_;
+		std::array<bool, 4> stick_held_ {};
+		void update_keys(uint32_t key, bool down);
 		friend class TKPEmu::Applications::N64_RomDisassembly;
     };
 }
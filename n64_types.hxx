@@ -5,6 +5,8 @@
 #include <limits>
 #include <immintrin.h>
 #include <array>
+#include <bit>
+#include <string>
 
 namespace TKPEmu::N64 {
     constexpr uint32_t EMPTY_INSTRUCTION = 0xFFFFFFFF;
@@ -186,7 +188,6 @@ namespace TKPEmu::N64 {
         WORD        = 4,
         UDOUBLEWORD = 8,
         DOUBLEWORD  = 8,
-        UDOUBLEWORD_DIRECT = 8,
         NONE
     };
     enum class WriteType {
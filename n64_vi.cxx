@@ -0,0 +1,111 @@
+#include <algorithm>
+#include "n64_vi.hxx"
+#include "n64_cpu.hxx"
+
+namespace TKPEmu::N64::Devices {
+    void VideoInterface::Reset() {
+        ctrl_ = origin_ = width_ = v_current_ = burst_ = v_sync_ = h_sync_ = 0;
+        h_sync_leap_ = h_video_ = v_video_ = v_burst_ = x_scale_ = y_scale_ = 0;
+        test_addr_ = staged_data_ = 0;
+        // Past the end of any field, so there's no interrupt until one is asked for
+        v_intr_ = __builtin_bswap32(0x3FF);
+        field_ = 0;
+        fields_ = 0;
+        field_done_ = false;
+        if (bus_) {
+            field_start_ = bus_->scheduler_.Now();
+            update_timing();
+        }
+    }
+
+    uint32_t VideoInterface::WriteRegister(int reg, uint32_t data) {
+        switch (reg & 0xF) {
+            case 3: {
+                data &= 0x3FF;
+                v_intr_ = __builtin_bswap32(data);
+                schedule_interrupt();
+                return data;
+            }
+            case 4: {
+                // Any write acknowledges the interrupt, the line itself can't be changed
+                bus_->clear_interrupt(MIInterrupt::VI);
+                update_current();
+                return __builtin_bswap32(v_current_);
+            }
+            case 6: {
+                data &= 0x3FF;
+                v_sync_ = __builtin_bswap32(data);
+                update_timing();
+                return data;
+            }
+            case 7: {
+                data &= 0x1F'0FFF;
+                h_sync_ = __builtin_bswap32(data);
+                update_timing();
+                return data;
+            }
+        }
+        return data;
+    }
+
+    uint64_t VideoInterface::half_line_cycles(uint64_t half_line) const {
+        // Rounded up, so the half-line has started by the cycle this returns
+        return (half_line * line_clocks_ * CPU_CLOCK + 2 * CLOCK - 1) / (2 * CLOCK);
+    }
+
+    uint32_t VideoInterface::half_line_now() const {
+        uint64_t elapsed = bus_->scheduler_.Now() - field_start_;
+        uint64_t half_line = elapsed * 2 * CLOCK / (line_clocks_ * CPU_CLOCK);
+        return std::min<uint64_t>(half_line, half_lines_ - 1);
+    }
+
+    void VideoInterface::update_current() {
+        uint32_t current = half_line_now() & ~1u;
+        if (__builtin_bswap32(ctrl_) & VI_CTRL_SERRATE)
+            current |= field_;
+        v_current_ = __builtin_bswap32(current);
+    }
+
+    void VideoInterface::update_timing() {
+        uint64_t now = bus_->scheduler_.Now();
+        uint32_t half_line = half_line_now();
+        uint32_t v_sync = __builtin_bswap32(v_sync_) & 0x3FF;
+        uint32_t h_sync = __builtin_bswap32(h_sync_) & 0xFFF;
+        half_lines_ = (v_sync ? v_sync : NTSC_V_SYNC) + 1;
+        line_clocks_ = (h_sync ? h_sync : NTSC_H_SYNC) + 1;
+        // The scan goes on from the same half-line with the new line length
+        if (half_line >= half_lines_ || half_line_cycles(half_line) > now)
+            half_line = 0;
+        field_start_ = now - half_line_cycles(half_line);
+        bus_->scheduler_.Schedule(SchedulerEvent::VIField, field_start_ + field_cycles() - now);
+        schedule_interrupt();
+    }
+
+    void VideoInterface::schedule_interrupt() {
+        uint32_t target = __builtin_bswap32(v_intr_) & 0x3FE;
+        if (target >= half_lines_) {
+            bus_->scheduler_.Cancel(SchedulerEvent::VI);
+            return;
+        }
+        uint64_t now = bus_->scheduler_.Now();
+        uint64_t time = field_start_ + half_line_cycles(target);
+        while (time <= now)
+            time += field_cycles();
+        bus_->scheduler_.Schedule(SchedulerEvent::VI, time - now);
+    }
+
+    void VideoInterface::Interrupt() {
+        bus_->raise_interrupt(MIInterrupt::VI);
+        schedule_interrupt();
+    }
+
+    void VideoInterface::FinishField() {
+        field_start_ += field_cycles();
+        field_ = (__builtin_bswap32(ctrl_) & VI_CTRL_SERRATE) ? field_ ^ 1 : 0;
+        ++fields_;
+        field_done_ = true;
+        uint64_t now = bus_->scheduler_.Now();
+        uint64_t end = field_start_ + field_cycles();
+        bus_->scheduler_.Schedule(SchedulerEvent::VIField, end > now ? end - now : 1);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef TKP_N64_VI_H
+#define TKP_N64_VI_H
+#include <cstdint>
+
+namespace TKPEmu::N64 {
+    class N64;
+}
+
+namespace TKPEmu::N64::Devices {
+    class CPUBus;
+    // VI_CTRL bit that turns on interlacing
+    constexpr uint32_t VI_CTRL_SERRATE = 1 << 6;
+    /**
+        Video Interface timing
+
+        The VI scans fields of VI_V_SYNC + 1 half-lines, each line taking VI_H_SYNC + 1
+        VI clocks. Nothing happens per line: the field start is remembered and
+        VI_V_CURRENT is worked out from the cycle count when it's read. The field end
+        and the line VI_V_INTR asks for are scheduler events, the latter raising the VI
+        interrupt in MI. Until a game programs the sync registers NTSC timing is used.
+        The registers that only affect the picture are left to the bus.
+
+        @see https://n64brew.dev/wiki/Video_Interface
+    */
+    class VideoInterface {
+    public:
+        constexpr static uint64_t CLOCK = 48'681'812;
+        constexpr static uint64_t CPU_CLOCK = 93'750'000;
+        constexpr static uint32_t NTSC_V_SYNC = 0x20D;
+        constexpr static uint32_t NTSC_H_SYNC = 0xC15;
+        // Starts a new field from the current cycle
+        void Reset();
+        void SetBus(CPUBus* bus) { bus_ = bus; }
+        // Applies a write to VI register reg (0 is VI_CTRL), returns the value it reads back as
+        uint32_t WriteRegister(int reg, uint32_t data);
+        // Called when the line VI_V_INTR names is reached
+        void Interrupt();
+        // Called when the last half-line of a field is over
+        void FinishField();
+        uint64_t Fields() const { return fields_; }
+    private:
+        void update_current();
+        void update_timing();
+        void schedule_interrupt();
+        // Cycles from the field start to the start of half-line
+        uint64_t half_line_cycles(uint64_t half_line) const;
+        uint32_t half_line_now() const;
+        uint64_t field_cycles() const { return half_line_cycles(half_lines_); }
+
+        CPUBus* bus_ = nullptr;
+        // Memory mapped registers, kept in guest byte order like the rest of the bus
+        uint32_t ctrl_ = 0;
+        uint32_t origin_ = 0;
+        uint32_t width_ = 0;
+        uint32_t v_intr_ = 0;
+        uint32_t v_current_ = 0;
+        uint32_t burst_ = 0;
+        uint32_t v_sync_ = 0;
+        uint32_t h_sync_ = 0;
+        uint32_t h_sync_leap_ = 0;
+        uint32_t h_video_ = 0;
+        uint32_t v_video_ = 0;
+        uint32_t v_burst_ = 0;
+        uint32_t x_scale_ = 0;
+        uint32_t y_scale_ = 0;
+        uint32_t test_addr_ = 0;
+        uint32_t staged_data_ = 0;
+        uint64_t field_start_ = 0;
+        uint32_t half_lines_ = NTSC_V_SYNC + 1;
+        uint32_t line_clocks_ = NTSC_H_SYNC + 1;
+        // Odd or even field, only alternates when interlaced
+        uint32_t field_ = 0;
+        uint64_t fields_ = 0;
+        // Set when a field ends, taken by the frontend to present a frame
+        bool field_done_ = false;
+        friend class CPUBus;
+        friend class TKPEmu::N64::N64;
+    };
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,18 @@
+#include <iostream>
+#include <string>
+#include "n64_test_functions.hxx"
+
+// Checks that both interpreters agree, --bench also times them
+int main(int argc, char** argv) {
+    using TKPEmu::N64::QA;
+    using TKPEmu::N64::Devices::InterpreterMode;
+    if (!QA::TestInterpreterEquivalence()) {
+        std::cerr << "Interpreter equivalence failed: " << QA::TestError << std::endl;
+        return 1;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        std::cout << "direct " << QA::BenchmarkInterpreter(InterpreterMode::Direct) << " ms" << std::endl;
+        std::cout << "pipeline " << QA::BenchmarkInterpreter(InterpreterMode::Pipeline) << " ms" << std::endl;
+    }
+    return 0;
+}
\ No newline at end of file
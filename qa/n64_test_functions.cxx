@@ -1,5 +1,119 @@
+#include <chrono>
+#include <cstring>
 #include "n64_test_functions.hxx"
 
+namespace {
+    using Code = std::vector<uint32_t>;
+    constexpr uint32_t CODE = 0x10'0000;
+    constexpr uint32_t CODE_VADDR = 0x8000'0000 | CODE;
+    constexpr uint64_t MAX_STEPS = 50'000'000;
+
+    constexpr uint32_t r_type(int rs, int rt, int rd, int sa, int func) {
+        return (rs << 21) | (rt << 16) | (rd << 11) | (sa << 6) | func;
+    }
+
+    constexpr uint32_t i_type(int op, int rs, int rt, int imm) {
+        return (op << 26) | (rs << 21) | (rt << 16) | (imm & 0xFFFF);
+    }
+
+    constexpr uint32_t j_type(int op, uint32_t addr) {
+        return (op << 26) | ((addr >> 2) & 0x3FF'FFFF);
+    }
+
+    constexpr uint32_t B_SELF = i_type(0x04, 0, 0, -1);
+
+    // Loads, stores, mult, jal/jr and branch likely over a table at 0x200000
+    Code alu_program(int iters) {
+        return {
+            i_type(0x0F, 0, 4, 0x8020), i_type(0x09, 0, 8, iters), r_type(0, 0, 9, 0, 0x21),
+            i_type(0x23, 4, 10, 0), r_type(9, 10, 9, 0, 0x21), r_type(10, 8, 0, 0, 0x18), r_type(0, 0, 11, 0, 0x12),
+            j_type(0x03, CODE_VADDR + 20 * 4), i_type(0x2B, 4, 11, 0x800),
+            i_type(0x14, 9, 0, 2), i_type(0x09, 9, 9, 1000),
+            i_type(0x09, 4, 4, 4), i_type(0x09, 8, 8, -1), i_type(0x05, 8, 0, -11), i_type(0x28, 4, 9, 0x1000),
+            i_type(0x0F, 0, 12, 0x8030), i_type(0x2B, 12, 9, 0), i_type(0x21, 12, 13, 2), B_SELF, 0,
+            r_type(14, 11, 14, 0, 0x26), r_type(31, 0, 0, 0, 0x08), r_type(0, 14, 15, 3, 0x03),
+        };
+    }
+
+    // Every pair the decoder fuses, with branches that land between the halves of a pair
+    Code fusion_program(int iters) {
+        return {
+            i_type(0x09, 0, 8, iters),
+            i_type(0x0F, 0, 4, 0x8020), i_type(0x0D, 4, 4, 0x0010),
+            i_type(0x0F, 0, 5, 0x8020), i_type(0x09, 5, 6, -0x10),
+            i_type(0x0F, 0, 7, 0x8020), i_type(0x23, 7, 9, 0x0020),
+            r_type(9, 8, 9, 0, 0x21),
+            i_type(0x0F, 0, 7, 0x8020), i_type(0x2B, 7, 9, 0x0020),
+            r_type(9, 8, 10, 0, 0x2A), i_type(0x05, 10, 0, 1),
+            i_type(0x09, 11, 11, 1),
+            i_type(0x0A, 8, 12, 100), i_type(0x14, 12, 0, 1),
+            i_type(0x09, 13, 13, 1),
+            i_type(0x0B, 8, 14, 3), i_type(0x04, 14, 0, 2),
+            i_type(0x0F, 0, 15, 0x1234),
+            i_type(0x0D, 15, 15, 0x5678),
+            r_type(15, 16, 16, 0, 0x26),
+            i_type(0x09, 8, 8, -1), i_type(0x05, 8, 0, -22), 0,
+            B_SELF, 0,
+        };
+    }
+
+    // Starts at 0x100FFC so the first pair is split by the page boundary. The loop runs twice
+    // and the first pass stores r20 and r22 over the ori of each pair
+    Code rewrite_program() {
+        return {
+            i_type(0x0F, 0, 17, 0x4444), i_type(0x0D, 17, 17, 0x1111),
+            i_type(0x0F, 0, 18, 0x2222), i_type(0x0D, 18, 18, 0x3333),
+            i_type(0x0F, 0, 19, 0x8010), i_type(0x2B, 19, 20, 0x1008), i_type(0x2B, 19, 22, 0x1000),
+            i_type(0x05, 21, 0, -8), i_type(0x09, 0, 21, 0),
+            B_SELF, 0,
+        };
+    }
+
+    // Fills, copies, byte and halfword stores, a kseg1 doubleword copy and an overlapping
+    // copy that isn't a memory loop
+    Code memory_program() {
+        enum { LUI = 0x0F, ADDIU = 0x09, DADDIU = 0x19, ORI = 0x0D, BNE = 0x05, BNEL = 0x15,
+            LW = 0x23, SW = 0x2B, SB = 0x28, LD = 0x37, SD = 0x3F, SH = 0x29 };
+        return {
+            i_type(LUI, 0, 4, 0x8030), i_type(LUI, 0, 7, 0x8031),
+            i_type(ADDIU, 4, 4, 4), i_type(BNE, 4, 7, -2), i_type(SW, 4, 0, -4),
+            i_type(LUI, 0, 4, 0x8032), i_type(LUI, 0, 7, 0x8033), i_type(LUI, 0, 8, 0x1234), i_type(ORI, 8, 8, 0x5678),
+            i_type(SW, 4, 8, 0), i_type(ADDIU, 4, 4, 4), i_type(BNE, 4, 7, -3), 0,
+            i_type(LUI, 0, 4, 0x8034), i_type(ADDIU, 4, 7, 0x1001), i_type(ORI, 0, 9, 0xAB),
+            i_type(ADDIU, 4, 4, 1), i_type(BNE, 4, 7, -2), i_type(SB, 4, 9, -1),
+            i_type(LUI, 0, 5, 0x8035), i_type(LUI, 0, 4, 0x8036), i_type(LUI, 0, 7, 0x8037),
+            i_type(LW, 5, 10, 0), i_type(ADDIU, 5, 5, 4), i_type(SW, 4, 10, 0), i_type(ADDIU, 4, 4, 4), i_type(BNE, 4, 7, -5), 0,
+            i_type(LUI, 0, 5, 0x8035), i_type(LUI, 0, 4, 0x8038), i_type(LUI, 0, 7, 0x8039),
+            i_type(LW, 5, 8, 0), i_type(LW, 5, 9, 4), i_type(LW, 5, 10, 8), i_type(LW, 5, 11, 12),
+            i_type(SW, 4, 8, 0), i_type(SW, 4, 9, 4), i_type(SW, 4, 10, 8), i_type(SW, 4, 11, 12),
+            i_type(ADDIU, 5, 5, 16), i_type(ADDIU, 4, 4, 16), i_type(BNE, 4, 7, -11), 0,
+            i_type(LUI, 0, 5, 0xA035), i_type(LUI, 0, 4, 0xA03A), i_type(LUI, 0, 7, 0xA03A), i_type(ORI, 7, 7, 0x8000),
+            i_type(LD, 5, 12, 0), i_type(DADDIU, 5, 5, 8), i_type(DADDIU, 4, 4, 8), i_type(BNEL, 4, 7, -4), i_type(SD, 4, 12, -8),
+            i_type(LUI, 0, 4, 0x803B), i_type(ORI, 0, 6, 0), i_type(ORI, 0, 7, 0x400), i_type(ORI, 0, 9, 0xBEEF),
+            i_type(SH, 4, 9, 0), i_type(ADDIU, 6, 6, 1), i_type(BNE, 6, 7, -3), i_type(ADDIU, 4, 4, 2),
+            i_type(LUI, 0, 4, 0x803C), i_type(ADDIU, 4, 5, -4), i_type(LUI, 0, 7, 0x803C), i_type(ORI, 7, 7, 0x1000),
+            i_type(LW, 5, 10, 0), i_type(ADDIU, 5, 5, 4), i_type(SW, 4, 10, 0), i_type(ADDIU, 4, 4, 4), i_type(BNE, 4, 7, -5), 0,
+            B_SELF, 0,
+        };
+    }
+
+    void place(std::vector<std::pair<uint32_t, uint32_t>>& words, uint32_t paddr, const Code& code) {
+        for (size_t i = 0; i < code.size(); i++) {
+            words.emplace_back(paddr + i * 4, code[i]);
+        }
+    }
+
+    // Address of the b . the code ends in, the only one in these programs
+    uint32_t end_of(uint32_t paddr, const Code& code) {
+        for (size_t i = 0; i < code.size(); i++) {
+            if (code[i] == B_SELF) {
+                return 0x8000'0000 | (paddr + i * 4);
+            }
+        }
+        return 0;
+    }
+}
+
 namespace TKPEmu::N64 {
     std::string QA::TestError = "";
     bool QA::TestDillonB(std::filesystem::path path) {
@@ -29,4 +143,168 @@ namespace TKPEmu::N64 {
         // return false;
         return true;
     }
+
+    bool QA::TestInterpreterEquivalence() {
+        std::vector<std::pair<std::string, Program>> programs(4);
+        {
+            auto& [name, program] = programs[0];
+            name = "alu";
+            auto code = alu_program(256);
+            for (uint32_t i = 0; i < 0x400; i++) {
+                program.words.emplace_back(0x20'0000 + i * 4, i * 7 + 1);
+            }
+            place(program.words, CODE, code);
+            program.entry = CODE_VADDR;
+            program.end = end_of(CODE, code);
+        }
+        {
+            auto& [name, program] = programs[1];
+            name = "fusion";
+            auto code = fusion_program(200);
+            for (uint32_t i = 0; i < 0x40; i++) {
+                program.words.emplace_back(0x20'0000 + i * 4, i * 7 + 1);
+            }
+            place(program.words, CODE, code);
+            program.entry = CODE_VADDR;
+            program.end = end_of(CODE, code);
+        }
+        {
+            auto& [name, program] = programs[2];
+            name = "rewrite";
+            auto code = rewrite_program();
+            place(program.words, CODE + 0xFFC, code);
+            program.registers = { { 20, i_type(0x0D, 18, 18, 0x7777) }, { 21, 1 }, { 22, i_type(0x0D, 17, 17, 0x5555) } };
+            program.entry = CODE_VADDR + 0xFFC;
+            program.end = end_of(CODE + 0xFFC, code);
+        }
+        {
+            auto& [name, program] = programs[3];
+            name = "memory";
+            auto code = memory_program();
+            uint32_t seed = 12345;
+            for (uint32_t paddr = 0x35'0000; paddr < 0x36'0000; paddr += 4) {
+                seed = seed * 1103515245 + 12345;
+                program.words.emplace_back(paddr, seed);
+            }
+            place(program.words, CODE, code);
+            program.entry = CODE_VADDR;
+            program.end = end_of(CODE, code);
+        }
+        for (const auto& [name, program] : programs) {
+            auto direct = start_program(program, Devices::InterpreterMode::Direct, true);
+            auto direct_no_hle = start_program(program, Devices::InterpreterMode::Direct, false);
+            auto pipeline = start_program(program, Devices::InterpreterMode::Pipeline, true);
+            for (auto* n64 : { direct.get(), direct_no_hle.get(), pipeline.get() }) {
+                if (!run_program(*n64, program)) {
+                    TestError = name + ": " + TestError;
+                    return false;
+                }
+            }
+            if (!compare_machines(*direct, *direct_no_hle, true)) {
+                TestError = name + ": memory loop HLE: " + TestError;
+                return false;
+            }
+            if (!compare_machines(*direct, *pipeline, false)) {
+                TestError = name + ": pipeline: " + TestError;
+                return false;
+            }
+        }
+        const auto& rewrite = programs[2].second;
+        auto n64 = start_program(rewrite, Devices::InterpreterMode::Direct, true);
+        run_program(*n64, rewrite);
+        if (n64->cpu_.gpr_regs_[17].UD != 0x4444'5555 || n64->cpu_.gpr_regs_[18].UD != 0x2222'7777) {
+            TestError = "rewrite: the pairs didn't run as written";
+            return false;
+        }
+        return true;
+    }
+
+    double QA::BenchmarkInterpreter(Devices::InterpreterMode mode) {
+        Program program;
+        auto code = fusion_program(30000);
+        for (uint32_t i = 0; i < 0x40; i++) {
+            program.words.emplace_back(0x20'0000 + i * 4, i * 7 + 1);
+        }
+        place(program.words, CODE, code);
+        program.entry = CODE_VADDR;
+        program.end = end_of(CODE, code);
+        double best = 0;
+        for (int i = 0; i < 5; i++) {
+            auto n64 = start_program(program, mode, true);
+            auto start = std::chrono::steady_clock::now();
+            run_program(*n64, program);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (i == 0 || elapsed.count() < best) {
+                best = elapsed.count();
+            }
+        }
+        return best;
+    }
+
+    std::unique_ptr<N64> QA::start_program(const Program& program, Devices::InterpreterMode mode, bool memory_hle) {
+        auto n64 = std::make_unique<N64>();
+        n64->SetInterpreter(mode);
+        n64->SetIdleLoopSkip(false);
+        n64->SetMemoryLoopHLE(memory_hle);
+        n64->Reset();
+        auto& cpubus = n64->cpubus_;
+        for (auto [paddr, data] : program.words) {
+            *reinterpret_cast<uint32_t*>(&cpubus.rdram_[paddr]) = __builtin_bswap32(data);
+            cpubus.mark_rdram_dirty(paddr, 4);
+        }
+        auto& cpu = n64->cpu_;
+        for (auto [reg, value] : program.registers) {
+            cpu.gpr_regs_[reg].UD = value;
+        }
+        cpu.pc_ = static_cast<int32_t>(program.entry);
+        if (cpu.direct_) {
+            cpu.next_pc_ = cpu.pc_ + 4;
+        } else {
+            cpu.fill_pipeline();
+        }
+        return n64;
+    }
+
+    bool QA::run_program(N64& n64, const Program& program) {
+        // The pipeline fetches two instructions ahead of the one it retires
+        uint32_t end = program.end + (n64.cpu_.direct_ ? 0 : 8);
+        uint64_t steps = 0;
+        while (static_cast<uint32_t>(n64.cpu_.pc_) != end) {
+            if (++steps > MAX_STEPS) {
+                TestError = "didn't reach the end of the program";
+                return false;
+            }
+            n64.Update();
+        }
+        // Lets the pipeline retire what's still in flight, the b . and its delay slot do nothing
+        for (int i = 0; i < 8; i++) {
+            n64.Update();
+        }
+        return true;
+    }
+
+    bool QA::compare_machines(const N64& a, const N64& b, bool cycles) {
+        const auto& cpu_a = a.cpu_;
+        const auto& cpu_b = b.cpu_;
+        for (int i = 1; i < 32; i++) {
+            if (cpu_a.gpr_regs_[i].UD != cpu_b.gpr_regs_[i].UD) {
+                TestError = "r" + std::to_string(i) + " differs";
+                return false;
+            }
+        }
+        if (cpu_a.hi_ != cpu_b.hi_ || cpu_a.lo_ != cpu_b.lo_) {
+            TestError = "hi/lo differ";
+            return false;
+        }
+        if (std::memcmp(a.cpubus_.rdram_.data(), b.cpubus_.rdram_.data(), a.cpubus_.rdram_size_) != 0) {
+            TestError = "RDRAM differs";
+            return false;
+        }
+        if (cycles && (a.cpubus_.scheduler_.Now() != b.cpubus_.scheduler_.Now() ||
+                cpu_a.cp0_regs_[9].UD != cpu_b.cp0_regs_[9].UD)) {
+            TestError = "cycle count differs";
+            return false;
+        }
+        return true;
+    }
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 #define TKP_N64_TEST_FUNCS_H
 #include <string>
 #include <filesystem>
+#include <memory>
+#include <utility>
+#include <vector>
 #include "../n64_impl.hxx"
 
 namespace TKPEmu::N64 {
@@ -12,6 +15,26 @@ namespace TKPEmu::N64 {
         // test roms depending on what each test rom outputs
         // when it passes
         static bool TestDillonB(std::filesystem::path path);
+        // Runs small guest programs in direct mode and in the latch pipeline and checks that
+        // they leave the same registers and RDRAM behind. The programs go through the decoded
+        // handlers, fused pairs, a pair across a page boundary, a pair rewritten after it was
+        // decoded and the memory loop idioms. Direct mode without memory loop HLE has to match
+        // direct mode with it down to the cycle
+        static bool TestInterpreterEquivalence();
+        // Best of a few runs of the fused pair loop, in milliseconds
+        static double BenchmarkInterpreter(Devices::InterpreterMode mode);
+    private:
+        struct Program {
+            // Words written to RDRAM before the program starts, physical address first
+            std::vector<std::pair<uint32_t, uint32_t>> words;
+            std::vector<std::pair<int, uint64_t>> registers;
+            uint32_t entry;
+            // Address of the b . the program stops at
+            uint32_t end;
+        };
+        static std::unique_ptr<N64> start_program(const Program& program, Devices::InterpreterMode mode, bool memory_hle);
+        static bool run_program(N64& n64, const Program& program);
+        static bool compare_machines(const N64& a, const N64& b, bool cycles);
     };
 }
 #endif
\ No newline at end of file